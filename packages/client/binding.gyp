@@ -1,4 +1,20 @@
 {
+  "variables": {
+    # Opus encoding mode: node-gyp rebuild -- -Dwith_opus=1 -Dopus_dir=<libopus>
+    # (expects <opus_dir>/include/opus.h and <opus_dir>/lib/opus.lib)
+    "with_opus%": 0,
+    "opus_dir%": "",
+    # Native noise suppression: -Dwith_rnnoise=1 -Drnnoise_dir=<rnnoise>
+    # (expects <rnnoise_dir>/include/rnnoise.h and <rnnoise_dir>/lib/rnnoise.lib,
+    # built with its x86 SIMD kernels enabled)
+    "with_rnnoise%": 0,
+    "rnnoise_dir%": "",
+    # The POSIX addon, off until it builds on each platform's CI:
+    # -Dwith_sck=1 on macOS (SDK 13+), -Dwith_pipewire=1 on Linux (needs the
+    # libpipewire-0.3 and libX11 development packages)
+    "with_sck%": 0,
+    "with_pipewire%": 0
+  },
   "targets": [
     {
       "target_name": "audio_capture",
@@ -18,9 +34,96 @@
           ],
           "libraries": [
             "-lmmdevapi",
+            "-lavrt",
             "-lole32",
             "-luser32"
           ],
+          "msvs_settings": {
+            "VCCLCompilerTool": {
+              "AdditionalOptions": ["/std:c++17"]
+            }
+          },
+          "conditions": [
+            ["with_opus==1", {
+              "defines": ["MIGO_WITH_OPUS"],
+              "include_dirs": ["<(opus_dir)/include"],
+              "libraries": ["<(opus_dir)/lib/opus.lib"]
+            }],
+            ["with_rnnoise==1", {
+              "defines": ["MIGO_WITH_RNNOISE"],
+              "include_dirs": ["<(rnnoise_dir)/include"],
+              "libraries": ["<(rnnoise_dir)/lib/rnnoise.lib"]
+            }]
+          ]
+        }],
+        # The shared core with a per-OS backend (src/native/capture-backend.h)
+        ["OS=='mac' and with_sck==1", {
+          "sources": [
+            "src/native/audio-capture-posix.cpp",
+            "src/native/screencapturekit-backend.mm"
+          ],
+          "include_dirs": [
+            "<!@(node -p \"require('node-addon-api').include\")"
+          ],
+          "dependencies": [
+            "<!(node -p \"require('node-addon-api').gyp\")"
+          ],
+          "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS"],
+          "link_settings": {
+            "libraries": [
+              "$(SDKROOT)/System/Library/Frameworks/ScreenCaptureKit.framework",
+              "$(SDKROOT)/System/Library/Frameworks/CoreMedia.framework",
+              "$(SDKROOT)/System/Library/Frameworks/CoreGraphics.framework",
+              "$(SDKROOT)/System/Library/Frameworks/Foundation.framework"
+            ]
+          },
+          "xcode_settings": {
+            # SCStream audio capture arrived in macOS 13
+            "MACOSX_DEPLOYMENT_TARGET": "13.0",
+            "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+            "CLANG_ENABLE_OBJC_ARC": "YES"
+          }
+        }],
+        ["OS=='linux' and with_pipewire==1", {
+          "sources": [
+            "src/native/audio-capture-posix.cpp",
+            "src/native/pipewire-backend.cpp"
+          ],
+          "include_dirs": [
+            "<!@(node -p \"require('node-addon-api').include\")"
+          ],
+          "dependencies": [
+            "<!(node -p \"require('node-addon-api').gyp\")"
+          ],
+          "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS"],
+          "cflags_cc": [
+            "-std=c++17",
+            "<!@(pkg-config --cflags libpipewire-0.3)"
+          ],
+          "libraries": [
+            "<!@(pkg-config --libs libpipewire-0.3)",
+            "-lX11"
+          ]
+        }],
+        ["OS!='win' and not (OS=='mac' and with_sck==1) and not (OS=='linux' and with_pipewire==1)", {
+          "type": "none"
+        }]
+      ]
+    },
+    {
+      # Known tone source for the capture benchmark (src/native/bench-capture.cjs)
+      "target_name": "tone_generator",
+      "conditions": [
+        ["OS=='win'", {
+          "type": "executable",
+          "sources": ["src/native/tone-generator.cpp"],
+          "defines": [
+            "WINVER=0x0A00",
+            "_WIN32_WINNT=0x0A00"
+          ],
+          "libraries": [
+            "-lole32"
+          ],
           "msvs_settings": {
             "VCCLCompilerTool": {
               "AdditionalOptions": ["/std:c++17"]
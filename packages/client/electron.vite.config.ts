@@ -6,6 +6,15 @@ import tailwindcss from "@tailwindcss/vite";
 export default defineConfig({
   main: {
     plugins: [externalizeDepsPlugin()],
+    build: {
+      rollupOptions: {
+        input: {
+          index: resolve("src/main/index.ts"),
+          // Forked as a utilityProcess by ipc/audio-capture.ts
+          "audio-capture-host": resolve("src/main/audio-capture-host.ts"),
+        },
+      },
+    },
   },
   preload: {
     plugins: [externalizeDepsPlugin()],
@@ -0,0 +1,159 @@
+// Utility process that owns the native capture addon (WASAPI, or
+// ScreenCaptureKit/PipeWire through audio-capture-posix.cpp).
+//
+// Captured PCM never touches the Electron main process: the addon's TSFN
+// fires on this process's otherwise idle event loop, and every buffer is
+// posted straight into a MessagePort whose other end lives in the renderer's
+// AudioCaptureProcessor worklet. The main process only relays control calls
+// (start/stop/resolveWindows) over parentPort, which also carries the share's
+// recovery state changes back as { event: "state", data } messages.
+//
+// Spawned by ipc/audio-capture.ts with the addon path as argv[2].
+
+import type { MessagePortMain } from "electron";
+
+type HostRequest = { id: number; method: string; args: unknown[] };
+type HostResponse = { id: number; result?: unknown; error?: string };
+type HostEvent = { event: "state"; data: unknown };
+
+type AudioCaptureAddon = Record<string, any>;
+
+type MeterTarget = { key: string; pid: number; excludeMode: boolean };
+/** onData's second argument, see TimingToJS in audio-capture.cpp. */
+type CaptureTiming = {
+  captureTime: number | null;
+  devicePosition: number | null;
+  latencyMs: number | null;
+};
+
+// How often the worklet is told a buffer's capture timing; latency moves
+// slowly, and a message per buffer would double the port's traffic.
+const TIMING_INTERVAL_MS = 1000;
+type CaptureSession = {
+  start(pid: number, excludeMode: boolean, options?: object): Promise<unknown>;
+  stop(): void;
+  getLevels(): unknown;
+};
+
+let addon: AudioCaptureAddon | null = null;
+try {
+  const mod = { exports: {} as AudioCaptureAddon };
+  process.dlopen(mod, process.argv[2]);
+  addon = mod.exports;
+  addon.onStateChange((data: unknown) => {
+    const ev: HostEvent = { event: "state", data };
+    process.parentPort.postMessage(ev);
+  });
+} catch (err) {
+  console.error("audio-capture-host: failed to load addon:", err);
+}
+
+// Renderer end of the current capture's data channel
+let dataPort: MessagePortMain | null = null;
+
+function closeDataPort(): void {
+  if (dataPort) {
+    dataPort.close();
+    dataPort = null;
+  }
+}
+
+// Meter-only sessions previewing candidate sources, by caller-chosen key.
+// They never deliver PCM; the picker polls their levels.
+const meters = new Map<string, CaptureSession>();
+
+function stopMeter(key: string): void {
+  meters.get(key)?.stop();
+  meters.delete(key);
+}
+
+async function startMeters(targets: MeterTarget[]): Promise<number> {
+  const keep = new Set(targets.map((t) => t.key));
+  for (const key of meters.keys()) if (!keep.has(key)) stopMeter(key);
+  await Promise.all(
+    targets
+      .filter((t) => !meters.has(t.key))
+      .map(async (t) => {
+        const session: CaptureSession = new addon!.CaptureSession();
+        meters.set(t.key, session);
+        try {
+          // Previews shouldn't compete with a live share for MMCSS
+          // recover: false, a preview whose target went away just goes quiet
+          await session.start(t.pid, t.excludeMode, { meterOnly: true, mmcssTask: "", recover: false });
+        } catch {
+          if (meters.get(t.key) === session) meters.delete(t.key);
+        }
+      }),
+  );
+  return meters.size;
+}
+
+function handle(req: HostRequest, ports: MessagePortMain[]): unknown {
+  if (req.method === "isLoaded") return !!addon;
+  // The POSIX build exports a subset of the WASAPI one
+  if (req.method === "hasMethod") return !!addon && typeof addon[req.args[0] as string] === "function";
+  if (!addon) throw new Error("Audio capture addon not loaded");
+
+  switch (req.method) {
+    case "startCapture":
+    case "startMixCapture": {
+      // The port arrives with the start request; wire it up before the
+      // capture thread can produce its first packet. onData throws while a
+      // capture runs or starts, and then the running share keeps its port.
+      const port = ports[0];
+      if (port) {
+        // A number is a silence marker (that many frames of zeros), which
+        // the worklet synthesizes itself; Uint8Array is one Opus packet. A
+        // timing message describes the buffer posted right after it.
+        let lastTiming = -Infinity;
+        try {
+          addon.onData((data: Float32Array | Int16Array | Uint8Array | number, timing: CaptureTiming) => {
+            if (timing.captureTime !== null && timing.captureTime - lastTiming >= TIMING_INTERVAL_MS) {
+              lastTiming = timing.captureTime;
+              port.postMessage({ type: "timing", ...timing });
+            }
+            port.postMessage(data);
+          });
+        } catch (err) {
+          port.close();
+          throw err;
+        }
+        closeDataPort();
+        port.start();
+        dataPort = port;
+      }
+      return addon[req.method](...req.args);
+    }
+    case "startMeters":
+      return startMeters(req.args[0] as MeterTarget[]);
+    case "getMeterLevels": {
+      const levels: Record<string, unknown> = {};
+      for (const [key, session] of meters) levels[key] = session.getLevels();
+      return levels;
+    }
+    case "stopMeters":
+      for (const key of [...meters.keys()]) stopMeter(key);
+      return;
+    case "stopCapture": {
+      const result = addon.stopCapture();
+      closeDataPort();
+      return result;
+    }
+    default: {
+      const fn = addon[req.method];
+      if (typeof fn !== "function") throw new Error(`Unknown method ${req.method}`);
+      return fn(...req.args);
+    }
+  }
+}
+
+process.parentPort.on("message", async (event) => {
+  const req = event.data as HostRequest;
+  const res: HostResponse = { id: req.id };
+  try {
+    res.result = await handle(req, event.ports);
+  } catch (err) {
+    res.error = err instanceof Error ? err.message : String(err);
+  }
+  process.parentPort.postMessage(res);
+});
@@ -1,69 +1,482 @@
-import { app, BrowserWindow, ipcMain } from "electron";
+import { app, BrowserWindow, ipcMain, MessageChannelMain, utilityProcess } from "electron";
+import type { UtilityProcess } from "electron";
+import { existsSync, mkdirSync } from "fs";
 import { join } from "path";
 
-// WASAPI process audio capture (Windows only)
-type AudioCaptureAddon = {
-  startCapture: (pid: number, excludeMode: boolean) => void;
-  stopCapture: () => void;
-  onData: (callback: (buffer: Float32Array) => void) => void;
-  hwndToPid: (hwnd: number) => number;
+// WASAPI process audio capture (Windows only).
+//
+// The addon lives in a utility process (see audio-capture-host.ts) so that
+// PCM flows capture thread → host event loop → MessagePort → renderer
+// worklet, without ever queueing behind work on the main process event loop.
+type CaptureOptions = {
+  zeroCopy?: boolean;
+  /** Coalesce packets into chunks of this many ms (0 = deliver immediately). */
+  chunkMs?: number;
+  /** Coalesce packets into chunks of this many frames (0 = deliver immediately). */
+  chunkFrames?: number;
+  /** MMCSS task class for the capture thread ("" = normal scheduling). */
+  mmcssTask?: string;
+  mmcssPriority?: "verylow" | "low" | "normal" | "high" | "critical";
+  /** Delivered format; converted natively from WASAPI's 48 kHz stereo float32. */
+  sampleRate?: number;
+  channels?: 1 | 2;
+  sampleFormat?: "float32" | "int16";
+  /** Deliver silent runs as a frame count instead of buffers of zeros. */
+  suppressSilence?: boolean;
+  /** Peak magnitude at or below which a packet counts as silent (default 0). */
+  silenceThreshold?: number;
+  /** "opus" delivers encoded packets as Uint8Array (needs a with_opus build). */
+  codec?: "pcm" | "opus";
+  opusBitrate?: number;
+  /** 2.5, 5, 10, 20, 40 or 60 */
+  opusFrameMs?: number;
+  /** Keep native levels for getLevels(); meterOnly never delivers data. */
+  meter?: boolean;
+  meterOnly?: boolean;
+  /** RNNoise on the capture thread (needs a with_rnnoise build). Speech only;
+   * it mangles music and game audio. */
+  noiseSuppression?: boolean;
+  /** Run at the audio engine's minimum period (IAudioClient3) if the client allows. */
+  lowLatency?: boolean;
+  /** Re-activate a stream that fails while running (default true). */
+  recover?: boolean;
+  /** Packets a stalled event loop leaves waiting longer than maxQueueMs
+   * (default 200; 0 = only the pool bounds them) are dropped oldest-first,
+   * newest-first, or merged into one callback (default "drop-oldest"). */
+  queuePolicy?: "drop-oldest" | "drop-newest" | "merge";
+  maxQueueMs?: number;
+  /** Keep the last this many seconds (max 300) in memory for saveReplay(). */
+  replaySeconds?: number;
+  /** "native" captures the output device's own layout (5.1, 7.1) instead of
+   * engine-downmixed stereo; process captures only. */
+  captureLayout?: "stereo" | "native";
+  /** Native layout only: per-speaker [left, right] gains over the BS.775
+   * defaults, or "passthrough" to deliver every channel (48 kHz float32,
+   * no noiseSuppression or replay). See channel-downmix.h for the names. */
+  downmix?: "passthrough" | Partial<Record<CaptureSpeaker, [number, number]>>;
 };
-let audioCapture: AudioCaptureAddon | null = null;
-let addonLoadAttempted = false;
 
-function loadAudioCapture(): AudioCaptureAddon | null {
-  if (addonLoadAttempted) return audioCapture;
-  addonLoadAttempted = true;
-  if (process.platform !== "win32") return null;
+/** Speaker positions in channel-mask order. */
+type CaptureSpeaker =
+  | "FL" | "FR" | "FC" | "LFE" | "BL" | "BR" | "FLC" | "FRC" | "BC"
+  | "SL" | "SR" | "TC" | "TFL" | "TFC" | "TFR" | "TBL" | "TBC" | "TBR";
+
+/** The format WASAPI delivers: stereo unless captureLayout was "native" and
+ * the device has more channels, then downmixed natively or passed through. */
+type CaptureFormat = {
+  sampleRate: number;
+  channels: number;
+  channelMask: number;
+  /** Per channel, null for one the mask doesn't name. */
+  speakers: (CaptureSpeaker | null)[];
+  mode: "stereo" | "downmix" | "passthrough";
+};
+
+/** A recovery state change of the running share, see Stream recovery in audio-capture.cpp. */
+export type CaptureStateEvent = {
+  /** "running" only follows a successful recovery. */
+  state: "running" | "recovering" | "failed";
+  reason?: "device-invalidated" | "service-not-running" | "resources-invalidated" | "process-exited" | "stream-error";
+  /** HRESULT that failed the stream, as 0x%08X. */
+  error?: string;
+  attempt: number;
+  retryInMs?: number;
+  /** The target, which changes when a restarted process is followed. */
+  pid: number;
+};
+
+/** Shared-mode engine period in frames; 0 where the client didn't report it. */
+type CapturePeriod = {
+  /** The stream actually runs at the minimum period. */
+  lowLatency: boolean;
+  periodFrames: number;
+  defaultPeriodFrames: number;
+  fundamentalPeriodFrames: number;
+  minPeriodFrames: number;
+  maxPeriodFrames: number;
+};
+
+/** Options a share passes through from the renderer. */
+type ShareOptions = {
+  chunkMs?: number;
+  /** The worklet's ring must be built for the same format. */
+  sampleFormat?: "float32" | "int16";
+  lowLatency?: boolean;
+  noiseSuppression?: boolean;
+  replaySeconds?: number;
+  captureLayout?: "stereo" | "native";
+};
+
+/** Local recording formats; "ogg" (Opus in Ogg) needs a with_opus build. */
+type RecordOptions = { format?: "wav" | "ogg"; opusBitrate?: number };
+
+/** A finished recording or saved replay. */
+type RecordResult = { path: string; frames: number; seconds: number; bytes: number };
+
+/** What startCapture reports about the session it brought up. */
+type CaptureInfo = {
+  eventDriven: boolean;
+  /** Polling mode only: drain interval, and whether a high-resolution timer paces it. */
+  poll: { periodMs: number; highResTimer: boolean } | null;
+  zeroCopy: boolean;
+  /** Started from a client warmed by prepareCapture. */
+  prewarmed: boolean;
+  /** macOS/Linux builds only: "screencapturekit" or "pipewire". */
+  backend?: string;
+  /** Windows only. threadId: the capture thread, shared by sessions of the same MMCSS class. */
+  mmcss?: { task: string; priority: string; registered: boolean; taskIndex: number; threadId: number };
+  /** channels is the capture's in passthrough mode, else 1 or 2. */
+  format: { sampleRate: number; channels: number; sampleFormat: "float32" | "int16" };
+  captureFormat: CaptureFormat;
+  suppressSilence: boolean;
+  codec: "pcm" | "opus";
+  opus?: { bitrate: number; frameMs: number; dtx: boolean };
+  meter: boolean;
+  meterOnly: boolean;
+  noiseSuppression: boolean;
+  /** As requested; period.lowLatency says whether the stream got it. */
+  lowLatency: boolean;
+  /** Windows only. */
+  period?: CapturePeriod & { bufferFrames: number };
+  queue: { policy: NonNullable<CaptureOptions["queuePolicy"]>; maxQueueMs: number };
+  /** Seconds the replay ring holds, 0 for none. */
+  replaySeconds: number;
+  /** startMixCapture only: the sources being mixed, in order. */
+  mix?: (MixSource & { period: CapturePeriod })[];
+};
+
+/** One input of startMixCapture, see ParseMixSources in audio-capture.cpp. */
+type MixSource =
+  | { type: "process"; pid: number; excludeMode?: boolean; gain?: number }
+  | { type: "output" | "microphone"; deviceId?: string; gain?: number };
+
+/** A mixed share input as the renderer names it: a desktopCapturer source
+ * (resolved like a single share), or an audio endpoint (default if no id). */
+type MixRequest =
+  | { sourceId: string; sourceType: "window" | "screen"; gain?: number }
+  | { type: "output" | "microphone"; deviceId?: string; gain?: number };
+
+/** One process from probeProcesses(). */
+type ProbeResult = {
+  pid: number;
+  active: boolean;
+  peak: number;
+  momentaryLufs: number;
+  packets: number;
+  error?: string;
+};
+
+/** Latest 100 ms block metered natively, see level-meter.h. */
+export type CaptureLevels = {
+  peak: [number, number];
+  rms: [number, number];
+  momentaryLufs: number;
+  shortTermLufs: number;
+  active: boolean;
+  blocks: number;
+};
+
+/** Fixed-bucket histogram: counts[i] is values <= edgesUs[i], the last bucket the rest. */
+type CaptureHistogram = { edgesUs: number[]; counts: number[] };
+
+/** Native capture telemetry, see capture-stats.h. */
+export type CaptureStats = {
+  packets: number;
+  frames: number;
+  silentPackets: number;
+  discontinuities: number;
+  timestampErrors: number;
+  positionGaps: number;
+  gapFrames: number;
+  devicePosition: number;
+  qpcPosition: number;
+  droppedPackets: number;
+  drains: number;
+  suppressedPackets: number;
+  suppressedFrames: number;
+  silenceMarkers: number;
+  encodedPackets: number;
+  encodedBytes: number;
+  encodeErrors: number;
+  tsfnCalls: number;
+  tsfnCallFailures: number;
+  readyDepth: number;
+  maxReadyDepth: number;
+  lentSlots: number;
+  packetInterval: CaptureHistogram;
+  drainDuration: CaptureHistogram;
+  /** Capture time (QPC) to the JS callback, per delivered packet */
+  deliveryLatency: CaptureHistogram;
+  maxDeliveryLatencyUs: number;
+  /** Packets copied into fresh ArrayBuffers instead of lent */
+  copiedPackets: number;
+  copiedBytes: number;
+  /** Frames through RNNoise, and its voice probability (0..1) for the latest one */
+  denoisedFrames: number;
+  voiceProbability: number;
+  /** Ready packets the queue policy discarded, and merged callbacks */
+  queueDroppedPackets: number;
+  queueDroppedFrames: number;
+  queueMerges: number;
+  queueMergedPackets: number;
+  captureFormat: CaptureFormat;
+  /** Local recording: frames written so far, frames the writer fell too far
+   * behind to take, and frames held for saveReplay() */
+  recording: boolean;
+  recordedFrames: number;
+  recordDroppedFrames: number;
+  replayFrames: number;
+  /** Kernel + user time of the capture thread, which sessions of one MMCSS
+   * class share; -1 when not running */
+  captureThreadCpuMs: number;
+  timeToFirstPacketMs: number;
+  state: CaptureStateEvent["state"];
+  recoveryAttempts: number;
+  recoveries: number;
+  /** Hot swaps of the capture target, and ones that fell back to the old target */
+  retargets: number;
+  retargetFailures: number;
+  /** While capturing; for a mix, the source with the shortest period. */
+  period?: CapturePeriod & { bufferFrames: number };
+  /** startMixCapture only; the totals above then count mixed blocks. */
+  mix?: {
+    packets: number;
+    frames: number;
+    lateFrames: number;
+    gapFrames: number;
+    resyncs: number;
+    error?: string;
+  }[];
+};
+
+type HostResponse = { id: number; result?: unknown; error?: string };
+type HostEvent = { event: "state"; data: CaptureStateEvent };
+
+class CaptureHost {
+  /** Receives the share's recovery state changes. */
+  onState: ((ev: CaptureStateEvent) => void) | null = null;
+  private child: UtilityProcess | null = null;
+  private nextId = 1;
+  private pending = new Map<number, { resolve: (v: unknown) => void; reject: (e: Error) => void }>();
+
+  constructor(private addonPath: string) {}
+
+  private spawn(): UtilityProcess {
+    if (this.child) return this.child;
+    const child = utilityProcess.fork(join(__dirname, "audio-capture-host.js"), [this.addonPath], {
+      serviceName: "Migo Audio Capture",
+    });
+    child.on("message", (msg: HostResponse | HostEvent) => {
+      if ("event" in msg) {
+        this.onState?.(msg.data);
+        return;
+      }
+      const res = msg;
+      const entry = this.pending.get(res.id);
+      if (!entry) return;
+      this.pending.delete(res.id);
+      if (res.error !== undefined) entry.reject(new Error(res.error));
+      else entry.resolve(res.result);
+    });
+    child.on("exit", (code) => {
+      if (this.child === child) this.child = null;
+      for (const entry of this.pending.values()) {
+        entry.reject(new Error(`Audio capture host exited (code ${code})`));
+      }
+      this.pending.clear();
+    });
+    this.child = child;
+    return child;
+  }
+
+  call<T = unknown>(method: string, args: unknown[] = [], ports?: Electron.MessagePortMain[]): Promise<T> {
+    const id = this.nextId++;
+    return new Promise<T>((resolve, reject) => {
+      this.pending.set(id, { resolve: resolve as (v: unknown) => void, reject });
+      this.spawn().postMessage({ id, method, args }, ports);
+    });
+  }
+}
+
+let host: CaptureHost | null = null;
+let hostLoadAttempted = false;
+
+// Whether the loaded addon exports a method: prepare, probe and retarget are
+// WASAPI-only (see audio-capture-posix.cpp). Asked once per method.
+const hostMethods = new Map<string, boolean>();
+
+async function hostHas(h: CaptureHost, method: string): Promise<boolean> {
+  const known = hostMethods.get(method);
+  if (known !== undefined) return known;
   try {
-    // In production, extraResources places the .node file in resources/
-    // In dev, it's at the project root build/Release/
-    const addonPath = app.isPackaged
-      ? join(process.resourcesPath, "audio_capture.node")
-      : join(app.getAppPath(), "build", "Release", "audio_capture.node");
-    const mod = { exports: {} as AudioCaptureAddon };
-    process.dlopen(mod, addonPath);
-    audioCapture = mod.exports;
+    const has = await h.call<boolean>("hasMethod", [method]);
+    hostMethods.set(method, has);
+    return has;
   } catch {
-    // Not available (macOS, or addon not compiled)
+    return false;
   }
-  return audioCapture;
+}
+
+function loadAudioCapture(): CaptureHost | null {
+  if (hostLoadAttempted) return host;
+  hostLoadAttempted = true;
+  // WASAPI on Windows; ScreenCaptureKit or PipeWire behind the same API elsewhere
+  if (!["win32", "darwin", "linux"].includes(process.platform)) return null;
+  // In production, extraResources places the .node file in resources/
+  // In dev, it's at the project root build/Release/
+  const addonPath = app.isPackaged
+    ? join(process.resourcesPath, "audio_capture.node")
+    : join(app.getAppPath(), "build", "Release", "audio_capture.node");
+  // Not compiled for this machine
+  if (!existsSync(addonPath)) return null;
+  host = new CaptureHost(addonPath);
+  return host;
+}
+
+/** A window's process, as resolveWindows reports it; null once it's gone. */
+type WindowProcess = {
+  pid: number;
+  exe: string;
+  /** The processes that started it, nearest first. */
+  ancestors: { pid: number; exe: string }[];
+} | null;
+
+/** Resolve many "window:<hwnd>:<n>" desktopCapturer sources in one host
+ * round trip; a native cache keeps repeat lookups off the process list. */
+async function resolveWindows(h: CaptureHost, sourceIds: string[]): Promise<WindowProcess[]> {
+  const hwnds = sourceIds.map((id) => parseInt(id.split(":")[1], 10) || 0);
+  return h.call<WindowProcess[]>("resolveWindows", [hwnds]);
+}
+
+/** Map a desktopCapturer source to the loopback target: a window's process
+ * tree, or everything except Migo for a whole screen. */
+async function resolveTarget(
+  h: CaptureHost,
+  sourceId: string,
+  sourceType: "window" | "screen",
+): Promise<{ pid: number; excludeMode: boolean }> {
+  if (sourceType === "window") {
+    const [window] = await resolveWindows(h, [sourceId]);
+    if (!window) throw new Error(`Could not resolve PID for ${sourceId}`);
+    return { pid: window.pid, excludeMode: false }; // INCLUDE target process tree
+  }
+  return { pid: process.pid, excludeMode: true }; // EXCLUDE self
+}
+
+/** Native options for a share the renderer plays through its worklet. */
+function shareOptions(options?: ShareOptions): CaptureOptions {
+  // zeroCopy lends pooled native memory to JS; the addon falls back to
+  // copying when the V8 memory cage rejects external buffers.
+  return {
+    zeroCopy: true,
+    chunkMs: options?.chunkMs ?? 0,
+    sampleFormat: options?.sampleFormat ?? "float32",
+    // The worklet synthesizes silent runs, so idle shares only send
+    // a frame count every 100 ms.
+    suppressSilence: true,
+    meter: true,
+    lowLatency: options?.lowLatency ?? false,
+    noiseSuppression: options?.noiseSuppression ?? false,
+    replaySeconds: options?.replaySeconds ?? 0,
+    // The worklet plays stereo, so a native layout is always downmixed
+    captureLayout: options?.captureLayout ?? "stereo",
+  };
+}
+
+/** A fresh file under userData/recordings; the renderer never picks paths. */
+function recordingPath(kind: "recording" | "replay", format: RecordOptions["format"]): string {
+  const dir = join(app.getPath("userData"), "recordings");
+  mkdirSync(dir, { recursive: true });
+  const stamp = new Date().toISOString().replace(/[:.]/g, "-");
+  return join(dir, `${kind}-${stamp}.${format ?? "wav"}`);
 }
 
 export function registerAudioCaptureIPC(mainWindow: BrowserWindow): void {
-  ipcMain.handle("audio-capture:isAvailable", () => !!loadAudioCapture());
+  /** Start a share whose data flows over a fresh MessagePort. One end goes
+   * to the host with the start request, the other to the renderer, which
+   * hands it to the worklet. Set up before starting so no packet is produced
+   * without somewhere to go. */
+  async function startWithPort(h: CaptureHost, method: string, args: unknown[]): Promise<CaptureInfo> {
+    h.onState = (ev) => {
+      if (ev.state !== "running") console.warn("audio-capture: share", ev.state, ev);
+      if (!mainWindow.isDestroyed()) mainWindow.webContents.send("audio-capture:state", ev);
+    };
+    const { port1, port2 } = new MessageChannelMain();
+    mainWindow.webContents.postMessage("audio-capture:port", null, [port2]);
+    const info = await h.call<CaptureInfo>(method, args, [port1]);
+    if (info.mmcss && !info.mmcss.registered) {
+      const err = await h.call<string>("getLastError");
+      console.warn(`audio-capture: MMCSS "${info.mmcss.task}" not registered: ${err}`);
+    }
+    return info;
+  }
+
+  ipcMain.handle("audio-capture:isAvailable", async () => {
+    const h = loadAudioCapture();
+    if (!h) return false;
+    try {
+      return await h.call<boolean>("isLoaded");
+    } catch {
+      return false;
+    }
+  });
+
+  // Whether shares can ask for noiseSuppression
+  ipcMain.handle("audio-capture:isNoiseSuppressionAvailable", async () => {
+    const h = loadAudioCapture();
+    if (!h) return false;
+    try {
+      return await h.call<boolean>("isNoiseSuppressionAvailable");
+    } catch {
+      return false;
+    }
+  });
+
+  // Whether a running share can switch sources with retarget
+  ipcMain.handle("audio-capture:isRetargetAvailable", async () => {
+    const h = loadAudioCapture();
+    return !!h && (await hostHas(h, "retargetCapture"));
+  });
+
+  // Activate + Initialize ahead of time (e.g. while the picker is open) so a
+  // matching start only has to call IAudioClient::Start. Best effort, and a
+  // no-op where the addon has nothing to prewarm.
+  ipcMain.handle(
+    "audio-capture:prepare",
+    async (
+      _event,
+      sourceId: string,
+      sourceType: "window" | "screen",
+      options?: { lowLatency?: boolean },
+    ) => {
+      const h = loadAudioCapture();
+      if (!h || !(await hostHas(h, "prepareCapture"))) return false;
+      try {
+        const { pid, excludeMode } = await resolveTarget(h, sourceId, sourceType);
+        // Only a start with the same lowLatency setting uses the prewarm
+        await h.call("prepareCapture", [pid, excludeMode, { lowLatency: options?.lowLatency ?? false }]);
+        return true;
+      } catch (err) {
+        console.warn("audio-capture:prepare failed:", err);
+        return false;
+      }
+    },
+  );
 
   ipcMain.handle(
     "audio-capture:start",
-    async (_event, sourceId: string, sourceType: "window" | "screen") => {
-      const addon = loadAudioCapture();
-      if (!addon) return false;
+    async (
+      _event,
+      sourceId: string,
+      sourceType: "window" | "screen",
+      options?: ShareOptions,
+    ) => {
+      const h = loadAudioCapture();
+      if (!h) return false;
 
       try {
-        let pid: number;
-        let excludeMode: boolean;
-
-        if (sourceType === "window") {
-          const parts = sourceId.split(":");
-          const hwnd = parseInt(parts[1], 10);
-          pid = addon.hwndToPid(hwnd);
-          if (!pid) throw new Error(`Could not resolve PID for HWND ${hwnd}`);
-          excludeMode = false; // INCLUDE target process tree
-        } else {
-          pid = process.pid;
-          excludeMode = true; // EXCLUDE self
-        }
-
-        // Set up data callback BEFORE starting capture (worker thread needs it)
-        addon.onData((buffer: Float32Array) => {
-          if (!mainWindow.isDestroyed()) {
-            mainWindow.webContents.send("audio-capture:data", buffer.buffer);
-          }
-        });
-
-        // Start capture on a dedicated MTA thread (returns immediately)
-        addon.startCapture(pid, excludeMode);
-
+        const { pid, excludeMode } = await resolveTarget(h, sourceId, sourceType);
+        await startWithPort(h, "startCapture", [pid, excludeMode, shareOptions(options)]);
         return true;
       } catch (err) {
         console.error("audio-capture:start failed:", err);
@@ -72,10 +485,183 @@ export function registerAudioCaptureIPC(mainWindow: BrowserWindow): void {
     },
   );
 
-  ipcMain.handle("audio-capture:stop", () => {
-    if (!audioCapture) return;
+  // Switch the running share to another window or screen without restarting
+  // it: the port, worklet and published track stay as they are, and the
+  // native side crossfades from the old stream to the new one.
+  ipcMain.handle(
+    "audio-capture:retarget",
+    async (_event, sourceId: string, sourceType: "window" | "screen") => {
+      if (!host || !(await hostHas(host, "retargetCapture"))) return false;
+      try {
+        const { pid, excludeMode } = await resolveTarget(host, sourceId, sourceType);
+        await host.call("retargetCapture", [pid, excludeMode]);
+        return true;
+      } catch (err) {
+        console.warn("audio-capture:retarget failed:", err);
+        return false;
+      }
+    },
+  );
+
+  // Several sources (windows, the whole output device, a microphone) mixed
+  // natively into the one stream the worklet plays.
+  ipcMain.handle(
+    "audio-capture:startMix",
+    async (_event, requests: MixRequest[], options?: ShareOptions) => {
+      const h = loadAudioCapture();
+      if (!h) return false;
+
+      try {
+        const sources = await Promise.all(
+          requests.map(async (r): Promise<MixSource> => {
+            if (!("sourceId" in r)) return r;
+            const target = await resolveTarget(h, r.sourceId, r.sourceType);
+            return { type: "process", ...target, gain: r.gain };
+          }),
+        );
+        await startWithPort(h, "startMixCapture", [sources, shareOptions(options)]);
+        return true;
+      } catch (err) {
+        console.error("audio-capture:startMix failed:", err);
+        return false;
+      }
+    },
+  );
+
+  /** ms from the last start request to its first captured packet, -1 if none yet. */
+  ipcMain.handle("audio-capture:getTimeToFirstPacket", async () => {
+    if (!host) return -1;
+    try {
+      return await host.call<number>("getTimeToFirstPacket");
+    } catch {
+      return -1;
+    }
+  });
+
+  ipcMain.handle("audio-capture:getStats", async () => {
+    if (!host) return null;
+    try {
+      return await host.call<CaptureStats>("getStats");
+    } catch {
+      return null;
+    }
+  });
+
+  /** Levels of the running share, null when not capturing. */
+  ipcMain.handle("audio-capture:getLevels", async () => {
+    if (!host) return null;
+    try {
+      return await host.call<CaptureLevels | null>("getLevels");
+    } catch {
+      return null;
+    }
+  });
+
+  // One-shot parallel probe: which of these windows' processes are making
+  // sound right now. Windows sharing a process share a result. Nothing is
+  // reported audible where the addon can't probe.
+  ipcMain.handle(
+    "audio-capture:probe",
+    async (_event, sourceIds: string[], durationMs?: number) => {
+      const h = loadAudioCapture();
+      const audible: Record<string, boolean> = {};
+      if (!h || !(await hostHas(h, "probeProcesses"))) return audible;
+      try {
+        const pids = (await resolveWindows(h, sourceIds)).map((w) => w?.pid ?? 0);
+        const unique = [...new Set(pids.filter((pid) => pid > 0))];
+        const results = await h.call<ProbeResult[]>("probeProcesses", [unique, durationMs ?? 400]);
+        const active = new Set(results.filter((r) => r.active).map((r) => r.pid));
+        sourceIds.forEach((id, i) => (audible[id] = active.has(pids[i])));
+      } catch (err) {
+        console.warn("audio-capture:probe failed:", err);
+      }
+      return audible;
+    },
+  );
+
+  // Meter-only sessions for the picker: one per candidate window, replacing
+  // any previous set. Sources whose PID can't be resolved are skipped.
+  ipcMain.handle("audio-capture:startMeters", async (_event, sourceIds: string[]) => {
+    const h = loadAudioCapture();
+    if (!h) return false;
+    try {
+      const windows = await resolveWindows(h, sourceIds);
+      const targets = sourceIds.flatMap((key, i) => {
+        const w = windows[i];
+        return w ? [{ key, pid: w.pid, excludeMode: false }] : [];
+      });
+      await h.call("startMeters", [targets]);
+      return true;
+    } catch (err) {
+      console.warn("audio-capture:startMeters failed:", err);
+      return false;
+    }
+  });
+
+  ipcMain.handle("audio-capture:getMeterLevels", async () => {
+    if (!host) return {};
+    try {
+      return await host.call<Record<string, CaptureLevels | null>>("getMeterLevels");
+    } catch {
+      return {};
+    }
+  });
+
+  ipcMain.handle("audio-capture:stopMeters", async () => {
+    if (!host) return;
+    try {
+      await host.call("stopMeters");
+    } catch {}
+  });
+
+  // Tee the running share to disk; stopRecording resolves with the file.
+  let recordingFile: string | null = null;
+  ipcMain.handle("audio-capture:startRecording", async (_event, options?: RecordOptions) => {
+    if (!host) return false;
+    try {
+      const file = recordingPath("recording", options?.format);
+      await host.call("startRecording", [file, options ?? {}]);
+      recordingFile = file;
+      return true;
+    } catch (err) {
+      console.warn("audio-capture:startRecording failed:", err);
+      return false;
+    }
+  });
+
+  ipcMain.handle("audio-capture:stopRecording", async () => {
+    if (!host || !recordingFile) return null;
+    const path = recordingFile;
+    recordingFile = null;
+    try {
+      const result = await host.call<Omit<RecordResult, "path">>("stopRecording");
+      return { path, ...result };
+    } catch (err) {
+      console.warn("audio-capture:stopRecording failed:", err);
+      return null;
+    }
+  });
+
+  /** Write out the last seconds (default all) of a share started with replaySeconds. */
+  ipcMain.handle(
+    "audio-capture:saveReplay",
+    async (_event, options?: RecordOptions & { seconds?: number }) => {
+      if (!host) return null;
+      try {
+        const path = recordingPath("replay", options?.format);
+        const result = await host.call<Omit<RecordResult, "path">>("saveReplay", [path, options ?? {}]);
+        return { path, ...result };
+      } catch (err) {
+        console.warn("audio-capture:saveReplay failed:", err);
+        return null;
+      }
+    },
+  );
+
+  ipcMain.handle("audio-capture:stop", async () => {
+    if (!host) return;
     try {
-      audioCapture.stopCapture();
+      await host.call("stopCapture");
     } catch (err) {
       console.error("audio-capture:stop failed:", err);
     }
@@ -0,0 +1,835 @@
+// Per-application loopback capture on macOS and Linux.
+//
+// The audio_capture addon for platforms without WASAPI. A CaptureBackend
+// (capture-backend.h: ScreenCaptureKit or PipeWire) delivers 48 kHz stereo
+// float32 on its own realtime thread; everything after that is the core the
+// Windows build uses too: level metering, output conversion, silence
+// markers and chunking into PacketPool slots, then zero-copy delivery and
+// the queue policy of capture-delivery.h on the JS thread.
+//
+// The exports are the subset of audio-capture.cpp's the app relies on, with
+// the same shapes: start(pid, excludeMode, options?) → Promise<info>, stop,
+// onData(cb(samples | silentFrames, timing)), onStateChange, getStats,
+// getLevels, resolveWindows. Mixing, prewarm, retarget, recording, Opus and
+// RNNoise are Windows-only; options that would change what's delivered
+// without them are rejected; scheduling hints (mmcss*, lowLatency) are
+// accepted and ignored. A stream that ends on its own reports "failed": no
+// backend here re-activates a stream.
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <napi.h>
+
+#include "capture-backend.h"
+#include "capture-clock.h"
+#include "capture-delivery.h"
+#include "capture-output.h"
+#include "capture-stats.h"
+#include "format-converter.h"
+#include "level-meter.h"
+#include "packet-pool.h"
+#include "signal-scan.h"
+
+// ─── startCapture options ──────────────────────────────────────────────────────
+
+// Backend buffers are converted and chunked in blocks of at most this many
+// capture frames (20 ms), whatever quantum the backend runs at.
+static constexpr uint32_t kBlockFrames = CaptureBackend::kSampleRate / 50;
+
+// The delivery options (capture-output.h) are all this build has
+struct CaptureOptions : DeliveryOptions {};
+
+// ParseDeliveryOptions, plus a rejection of each Windows-only option that
+// would change what's delivered
+static bool ParseCaptureOptions(const Napi::Object &o, CaptureOptions &out,
+                                std::string &err) {
+  if (!ParseDeliveryOptions(o, out, err)) return false;
+
+  // Windows-only features, accepted only when they're off
+  if (o.Get("codec").IsString() &&
+      o.Get("codec").As<Napi::String>().Utf8Value() != "pcm") {
+    err = "Opus encoding is only available on Windows";
+    return false;
+  }
+  if (o.Has("noiseSuppression") &&
+      o.Get("noiseSuppression").ToBoolean().Value()) {
+    err = "noiseSuppression is only available on Windows";
+    return false;
+  }
+  if (o.Get("replaySeconds").IsNumber() &&
+      o.Get("replaySeconds").As<Napi::Number>().DoubleValue() > 0) {
+    err = "replaySeconds is only available on Windows";
+    return false;
+  }
+  if (o.Get("captureLayout").IsString() &&
+      o.Get("captureLayout").As<Napi::String>().Utf8Value() != "stereo") {
+    err = "captureLayout: \"native\" is only available on Windows";
+    return false;
+  }
+  return true;
+}
+
+// ─── Capture session ───────────────────────────────────────────────────────────
+
+// One failure of a running stream, allocated by the backend thread and
+// freed by StateToJS.
+struct StateEvent {
+  std::string reason;
+  std::string error;
+  uint32_t pid = 0;
+};
+
+class CaptureSession;
+static void DrainToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *session, void *data);
+using DrainTsfn = Napi::TypedThreadSafeFunction<CaptureSession, void, DrainToJS>;
+static void StateToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *session, StateEvent *e);
+using StateTsfn =
+    Napi::TypedThreadSafeFunction<CaptureSession, StateEvent, StateToJS>;
+
+class CaptureSession : public CaptureBackend::Sink {
+public:
+  CaptureSession() = default;
+  CaptureSession(const CaptureSession &) = delete;
+  CaptureSession &operator=(const CaptureSession &) = delete;
+  ~CaptureSession() {
+    Stop();
+    if (m_stateTsfn) {
+      m_stateTsfn->Release();
+      delete m_stateTsfn;
+    }
+  }
+
+  // Open the backend stream and start delivering. Blocks until the stream
+  // runs, so it runs on a worker thread (see StartWorker).
+  bool Start(uint32_t pid, bool excludeMode, const CaptureOptions &opts,
+             std::string &err);
+  void Stop();
+
+  // JS thread: bracket an asynchronous Start(); see audio-capture.cpp.
+  // CancelStart() also interrupts it.
+  bool BeginStart();
+  bool EndStart();
+  bool CancelStart();
+  // Any thread: make a pending Start() give up ("Capture stopped")
+  void Interrupt() { m_interrupted.store(true); }
+  // False (and unchanged) while a start is pending or the capture runs
+  bool SetCallback(Napi::Env env, Napi::Function cb);
+  void SetStateCallback(Napi::Env env, Napi::Function cb);
+  Napi::Object Info(Napi::Env env) const;
+  Napi::Object Stats(Napi::Env env) const;
+  Napi::Value Levels(Napi::Env env) const;
+
+  bool IsRunning() const { return m_running.load(); }
+  bool IsZeroCopy() const { return m_delivery.ZeroCopy(); }
+  std::string LastError() const {
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+  }
+  int DataCount() const { return m_dataCount.load(); }
+  int DroppedCount() const { return m_droppedCount.load(); }
+  double TimeToFirstPacketMs() const {
+    const uint64_t first = m_firstPacketTime.load(std::memory_order_acquire);
+    if (first == 0) return -1;
+    return (first - m_startTime.load()) / 10000.0;
+  }
+
+  // CaptureBackend::Sink, on the backend thread
+  void OnAudio(const float *frames, uint32_t numFrames, uint64_t captureTime,
+               uint64_t position) override;
+  void OnFailed(const char *reason, const std::string &message) override;
+
+private:
+  friend void DrainToJS(Napi::Env, Napi::Function, CaptureSession *, void *);
+
+  bool Fail(std::string msg, std::string &err);
+  void SetLastError(std::string msg);
+  void AppendBlock(const float *src, uint32_t numFrames);
+  void AppendOutput(const uint8_t *src, uint32_t frames);
+  void SuppressSilence(uint32_t numFrames);
+
+  std::unique_ptr<CaptureBackend> m_backend;
+  std::atomic<bool> m_running{false};
+  // The stream ended on its own; the backend is torn down by Start/Stop
+  std::atomic<bool> m_failed{false};
+  std::mutex m_mutex;    // held for the whole of Start() and Stop()
+  mutable std::mutex m_errorMutex;
+  std::string m_lastError;
+  bool m_starting = false;    // JS thread only
+  bool m_cancelStart = false; // JS thread only
+  // Set by Interrupt(), cleared by BeginStart(); the backend's Start() polls it
+  std::atomic<bool> m_interrupted{false};
+  DrainTsfn *m_tsfn = nullptr;
+  StateTsfn *m_stateTsfn = nullptr;
+  uint32_t m_targetPid = 0;
+  bool m_targetExclude = false;
+
+  std::atomic<int> m_dataCount{0};
+  std::atomic<int> m_droppedCount{0}; // packets lost to pool exhaustion
+  CaptureStats m_stats;
+  PacketPool m_pool;
+  PacketDelivery m_delivery{m_pool, m_stats};
+
+  // Output format; m_convert is false when it's the capture format itself
+  OutputFormat m_format;
+  bool m_convert = false;
+  FormatConverter m_converter;       // backend thread only while running
+  std::vector<uint8_t> m_convertBuf; // one converted block
+
+  bool m_meter = false;
+  bool m_meterOnly = false;
+  LevelMeter m_levels;
+
+  // Time to first packet, on the capture clock
+  std::atomic<uint64_t> m_startTime{0};
+  std::atomic<uint64_t> m_firstPacketTime{0};
+
+  // Chunking and silence markers (capture-output.h). Backend thread only
+  // while running.
+  PacketChunker m_chunker{m_pool, m_stats, m_droppedCount};
+  uint64_t m_packetTime = 0;     // capture time of the block being appended
+  uint64_t m_packetPosition = 0; // its position, in capture frames
+  bool m_suppressSilence = false;
+  float m_silenceThreshold = 0.0f;
+};
+
+// ─── Deliver pooled packets to JS via ThreadSafeFunction ─────────────────────
+
+// Runs on the JS thread; see PacketDelivery::Drain. A null env means the
+// TSFN was aborted by Stop(); the session may already be gone.
+static void DrainToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *s, void *) {
+  if (env == nullptr) return;
+  s->m_delivery.Drain(env, jsCallback);
+}
+
+// Runs on the JS thread with the stream's failure, in the shape of the
+// Windows module's state events: { state: "failed", reason, error?,
+// attempt, pid }.
+static void StateToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *, StateEvent *e) {
+  std::unique_ptr<StateEvent> event(e);
+  if (env == nullptr) return;
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("state", "failed");
+  o.Set("reason", e->reason);
+  if (!e->error.empty()) o.Set("error", e->error);
+  o.Set("attempt", 0.0);
+  o.Set("pid", static_cast<double>(e->pid));
+  jsCallback.Call({o});
+}
+
+// ─── Backend thread ────────────────────────────────────────────────────────────
+
+void CaptureSession::OnAudio(const float *frames, uint32_t numFrames,
+                             uint64_t captureTime, uint64_t position) {
+  if (!m_running.load(std::memory_order_relaxed)) return;
+  if (captureTime == 0) captureTime = CaptureClockNow();
+  uint64_t expected = 0;
+  m_firstPacketTime.compare_exchange_strong(expected, CaptureClockNow(),
+                                            std::memory_order_release);
+  m_stats.RecordPacket(numFrames, position, captureTime, frames == nullptr,
+                       false, false);
+  m_dataCount.fetch_add(1, std::memory_order_relaxed);
+
+  if (m_meter) m_levels.Process(frames, numFrames);
+  if (m_meterOnly) return;
+
+  // Blocks keep their own capture time and position
+  uint32_t done = 0;
+  while (done < numFrames) {
+    const uint32_t n =
+        numFrames - done < kBlockFrames ? numFrames - done : kBlockFrames;
+    m_packetTime = captureTime + uint64_t(done) * 10000000 /
+                                     CaptureBackend::kSampleRate;
+    m_packetPosition = position + done;
+    AppendBlock(frames ? frames + size_t(done) * CaptureBackend::kChannels
+                       : nullptr,
+                n);
+    done += n;
+  }
+  // Backends keep delivering (silent) buffers while the target is quiet, so
+  // checking once per buffer is enough to not strand a partial chunk.
+  m_chunker.FlushStale(CaptureClockNow());
+  m_delivery.Schedule(m_tsfn);
+}
+
+// The stream is gone. Tearing the backend down has to wait for Start or
+// Stop: this runs on the thread the backend's Stop() joins.
+void CaptureSession::OnFailed(const char *reason, const std::string &message) {
+  if (!m_running.load()) return;
+  m_failed.store(true);
+  m_chunker.FlushSilence();
+  m_chunker.FlushChunk();
+  m_delivery.Schedule(m_tsfn);
+  SetLastError(std::string(reason) + ": " + message);
+  // The last use of m_tsfn: SetCallback() may replace it from here on. A
+  // Stop() racing this waits for it in the backend's Stop().
+  m_running.store(false);
+  if (m_stateTsfn) {
+    auto *e = new StateEvent{reason, message, m_targetPid};
+    if (m_stateTsfn->NonBlockingCall(e) != napi_ok) delete e;
+  }
+}
+
+// One block of capture-format frames (nullptr = silence) into the output.
+void CaptureSession::AppendBlock(const float *src, uint32_t numFrames) {
+  if (m_suppressSilence) {
+    if (!src || IsSilent(src, size_t(numFrames) * CaptureBackend::kChannels,
+                         m_silenceThreshold)) {
+      SuppressSilence(numFrames);
+      return;
+    }
+    m_chunker.FlushSilence(); // the run ends before this block's audio
+  }
+  if (!m_convert) {
+    AppendOutput(reinterpret_cast<const uint8_t *>(src), numFrames);
+    return;
+  }
+  const uint32_t outFrames = m_converter.Process(src, numFrames, m_convertBuf.data());
+  AppendOutput(m_convertBuf.data(), outFrames);
+}
+
+void CaptureSession::AppendOutput(const uint8_t *src, uint32_t frames) {
+  m_chunker.Append(src, static_cast<size_t>(frames) * m_format.channels,
+                   src == nullptr, m_packetTime, m_packetPosition);
+}
+
+// The converter still runs on a silent block, so the resampler phase and
+// output frame count stay exact; its output is discarded.
+void CaptureSession::SuppressSilence(uint32_t numFrames) {
+  const uint32_t outFrames =
+      m_convert ? m_converter.Process(nullptr, numFrames, m_convertBuf.data())
+                : numFrames;
+  m_chunker.Silence(outFrames, m_packetTime, m_packetPosition);
+}
+
+// ─── Session lifecycle (JS thread) ─────────────────────────────────────────────
+
+bool CaptureSession::Fail(std::string msg, std::string &err) {
+  SetLastError(msg);
+  err = std::move(msg);
+  if (m_backend) m_backend->Stop();
+  m_backend.reset();
+  return false;
+}
+
+void CaptureSession::SetLastError(std::string msg) {
+  std::lock_guard<std::mutex> lock(m_errorMutex);
+  m_lastError = std::move(msg);
+}
+
+bool CaptureSession::BeginStart() {
+  if (m_starting) return false;
+  m_starting = true;
+  m_cancelStart = false;
+  m_interrupted.store(false);
+  m_startTime.store(CaptureClockNow());
+  return true;
+}
+
+bool CaptureSession::EndStart() {
+  m_starting = false;
+  bool cancelled = m_cancelStart;
+  m_cancelStart = false;
+  return cancelled;
+}
+
+bool CaptureSession::CancelStart() {
+  if (!m_starting) return false;
+  m_cancelStart = true;
+  Interrupt();
+  return true;
+}
+
+bool CaptureSession::Start(uint32_t pid, bool excludeMode,
+                           const CaptureOptions &opts, std::string &err) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_interrupted.load()) {
+    err = "Capture stopped";
+    return false;
+  }
+  if (m_running.load()) {
+    err = "Capture already running";
+    return false;
+  }
+  // A stream that failed on its own is only torn down here or in Stop()
+  if (m_backend) m_backend->Stop();
+  m_backend.reset();
+  m_failed.store(false);
+
+  m_stats.Reset();
+  m_levels.Reset();
+  m_dataCount.store(0);
+  m_droppedCount.store(0);
+  m_firstPacketTime.store(0);
+  SetLastError("");
+  m_targetPid = pid;
+  m_targetExclude = excludeMode;
+  m_meter = opts.meter;
+  m_meterOnly = opts.meterOnly;
+
+  m_backend = CreateCaptureBackend();
+  if (!m_backend) return Fail("No capture backend on this platform", err);
+
+  // ── Output format conversion, in blocks of kBlockFrames ──
+  m_format = opts.format;
+  m_convert = m_format != OutputFormat();
+  uint32_t blockOutFrames = kBlockFrames;
+  if (m_convert) {
+    if (!m_converter.Configure(m_format, kBlockFrames)) {
+      return Fail("Unsupported output format: " +
+                      std::to_string(m_format.sampleRate) + " Hz",
+                  err);
+    }
+    m_converter.Reset();
+    blockOutFrames = m_converter.MaxOutFrames(kBlockFrames);
+    m_convertBuf.assign(
+        static_cast<size_t>(blockOutFrames) * m_format.BytesPerFrame(), 0);
+  }
+
+  // ── Packet pool: a chunk plus one block per slot ──
+  const uint32_t slots =
+      opts.zeroCopy ? PacketPool::kMaxSlots : PacketPool::kDefaultSlots;
+  const bool poolOk =
+      m_meterOnly ? m_pool.Init(1, 1)
+                  : m_pool.Init(slots,
+                                (opts.chunkFrames + blockOutFrames) *
+                                    m_format.channels,
+                                m_format.BytesPerSample());
+  if (!poolOk) return Fail("Failed to allocate packet pool", err);
+  m_delivery.Configure(opts.zeroCopy, opts.queuePolicy, opts.maxQueueMs,
+                       m_format.sampleRate, m_format.channels, 0);
+  m_chunker.Configure(opts.chunkFrames, m_format.channels, m_format.sampleRate);
+  m_suppressSilence = opts.suppressSilence;
+  m_silenceThreshold = opts.silenceThreshold;
+
+  // ── Open the stream; the sink runs from its first buffer on ──
+  m_running.store(true);
+  CaptureTarget target;
+  target.pid = pid;
+  target.excludeMode = excludeMode;
+  std::string backendErr;
+  if (!m_backend->Start(target, this, m_interrupted, backendErr)) {
+    m_running.store(false);
+    return Fail(backendErr, err);
+  }
+  return true;
+}
+
+void CaptureSession::Stop() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_running.store(false);
+  // No sink call runs once the backend has stopped
+  if (m_backend) m_backend->Stop();
+  m_backend.reset();
+  m_chunker.Discard(); // an unflushed partial chunk goes with the pool
+
+  // Abort rather than release: a drain still queued must not run against a
+  // session that may be destroyed right after this.
+  if (m_tsfn) {
+    m_tsfn->Abort();
+    delete m_tsfn;
+    m_tsfn = nullptr;
+  }
+}
+
+void CaptureSession::SetStateCallback(Napi::Env env, Napi::Function cb) {
+  if (m_stateTsfn) {
+    m_stateTsfn->Release();
+    delete m_stateTsfn;
+  }
+  m_stateTsfn =
+      new StateTsfn(StateTsfn::New(env, cb, "AudioCaptureState", 0, 1, this));
+  m_stateTsfn->Unref(env);
+}
+
+// JS thread. OnFailed() clears m_running after its last drain.
+bool CaptureSession::SetCallback(Napi::Env env, Napi::Function cb) {
+  if (m_starting || m_running.load()) return false;
+  if (m_tsfn) {
+    m_tsfn->Release();
+    delete m_tsfn;
+  }
+  // maxQueueSize 1: PacketDelivery::Schedule never queues more than one call
+  m_tsfn = new DrainTsfn(DrainTsfn::New(env, cb, "AudioCaptureData", 1, 1, this));
+  return true;
+}
+
+// The Windows info object's shape, minus what only WASAPI has (MMCSS, the
+// engine period, the polling fallback).
+Napi::Object CaptureSession::Info(Napi::Env env) const {
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("backend", m_backend ? m_backend->Name() : "");
+  result.Set("eventDriven", true);
+  result.Set("poll", env.Null());
+  result.Set("zeroCopy", m_delivery.ZeroCopy());
+  result.Set("prewarmed", false);
+
+  Napi::Object format = Napi::Object::New(env);
+  format.Set("sampleRate", static_cast<double>(m_format.sampleRate));
+  format.Set("channels", static_cast<double>(m_format.channels));
+  format.Set("sampleFormat", m_format.int16 ? "int16" : "float32");
+  result.Set("format", format);
+  Napi::Object captureFormat = Napi::Object::New(env);
+  captureFormat.Set("sampleRate", static_cast<double>(CaptureBackend::kSampleRate));
+  captureFormat.Set("channels", static_cast<double>(CaptureBackend::kChannels));
+  captureFormat.Set("mode", "stereo");
+  result.Set("captureFormat", captureFormat);
+  result.Set("suppressSilence", m_suppressSilence);
+  result.Set("codec", "pcm");
+  result.Set("meter", m_meter);
+  result.Set("meterOnly", m_meterOnly);
+  Napi::Object queue = Napi::Object::New(env);
+  queue.Set("policy", QueuePolicyName(m_delivery.Policy()));
+  queue.Set("maxQueueMs", static_cast<double>(m_delivery.MaxQueueMs()));
+  result.Set("queue", queue);
+  return result;
+}
+
+// Snapshot of the lock-free counters; safe to call while capturing.
+Napi::Object CaptureSession::Stats(Napi::Env env) const {
+  auto num = [](const auto &a) { return static_cast<double>(a.load()); };
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("backend", m_backend ? m_backend->Name() : "");
+  o.Set("packets", num(m_stats.packets));
+  o.Set("frames", num(m_stats.frames));
+  o.Set("silentPackets", num(m_stats.silentPackets));
+  o.Set("discontinuities", num(m_stats.discontinuities));
+  o.Set("positionGaps", num(m_stats.positionGaps));
+  o.Set("gapFrames", num(m_stats.gapFrames));
+  o.Set("devicePosition", num(m_stats.devicePosition));
+  o.Set("qpcPosition", num(m_stats.qpcPosition));
+  o.Set("droppedPackets", num(m_droppedCount));
+  o.Set("suppressedPackets", num(m_stats.suppressedPackets));
+  o.Set("suppressedFrames", num(m_stats.suppressedFrames));
+  o.Set("silenceMarkers", num(m_stats.silenceMarkers));
+  m_delivery.StatsToJS(o);
+  o.Set("packetInterval", HistogramToJS(env, m_stats.packetInterval));
+  o.Set("timeToFirstPacketMs", TimeToFirstPacketMs());
+  // The backend's thread (a dispatch queue on macOS) isn't ours to time
+  o.Set("captureThreadCpuMs", -1.0);
+  o.Set("state", m_failed.load() ? "failed" : "running");
+  return o;
+}
+
+Napi::Value CaptureSession::Levels(Napi::Env env) const {
+  if (!m_meter) return env.Null();
+  return LevelsToJS(env, m_levels.Read());
+}
+
+// ─── N-API: asynchronous start ─────────────────────────────────────────────────
+
+class StartWorker : public Napi::AsyncWorker {
+public:
+  StartWorker(Napi::Env env, CaptureSession &session, uint32_t pid,
+              bool excludeMode, const CaptureOptions &opts, Napi::Object owner)
+      : Napi::AsyncWorker(env, "AudioCaptureStart"),
+        m_deferred(Napi::Promise::Deferred::New(env)), m_session(session),
+        m_pid(pid), m_excludeMode(excludeMode), m_opts(opts) {
+    // Keep a JS owner alive so the session outlives the pending start
+    if (!owner.IsEmpty()) m_owner = Napi::Persistent(owner);
+  }
+
+  Napi::Promise Promise() const { return m_deferred.Promise(); }
+
+protected:
+  void Execute() override {
+    std::string err;
+    if (!m_session.Start(m_pid, m_excludeMode, m_opts, err)) SetError(err);
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    if (m_session.EndStart()) {
+      m_session.Stop();
+      m_deferred.Reject(Napi::Error::New(env, kStopped).Value());
+      return;
+    }
+    m_deferred.Resolve(m_session.Info(env));
+  }
+
+  void OnError(const Napi::Error &e) override {
+    m_deferred.Reject(m_session.EndStart()
+                          ? Napi::Error::New(Env(), kStopped).Value()
+                          : e.Value());
+  }
+
+private:
+  static constexpr const char *kStopped = "Capture stopped before it started";
+
+  Napi::Promise::Deferred m_deferred;
+  Napi::ObjectReference m_owner;
+  CaptureSession &m_session;
+  uint32_t m_pid;
+  bool m_excludeMode;
+  CaptureOptions m_opts;
+};
+
+// start(pid, excludeMode, options?) → Promise<info>. Invalid options throw
+// synchronously; stream failures reject.
+static Napi::Value StartSession(const Napi::CallbackInfo &info,
+                                CaptureSession &session, Napi::Object owner) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsBoolean()) {
+    Napi::TypeError::New(env, "start expects (pid, excludeMode, options?)")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  uint32_t pid = info[0].As<Napi::Number>().Uint32Value();
+  bool excludeMode = info[1].As<Napi::Boolean>().Value();
+
+  CaptureOptions opts;
+  std::string err;
+  if (info.Length() > 2 && info[2].IsObject()) {
+    if (!ParseCaptureOptions(info[2].As<Napi::Object>(), opts, err)) {
+      Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  if (!session.BeginStart()) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::Error::New(env, "Capture already starting").Value());
+    return deferred.Promise();
+  }
+
+  auto *worker = new StartWorker(env, session, pid, excludeMode, opts, owner);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+static void StopSession(CaptureSession &session) {
+  if (!session.CancelStart()) session.Stop();
+}
+
+// onData(cb). The callback can't change under a start or a running capture,
+// whose producer thread still schedules drains on the current one.
+static Napi::Value SetDataCallback(const Napi::CallbackInfo &info,
+                                   CaptureSession &session) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsFunction()) {
+    Napi::TypeError::New(env, "onData expects a function")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!session.SetCallback(env, info[0].As<Napi::Function>())) {
+    Napi::Error::New(env, "Capture already running")
+        .ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+// ─── N-API: CaptureSession class ───────────────────────────────────────────────
+
+class CaptureSessionWrap : public Napi::ObjectWrap<CaptureSessionWrap> {
+public:
+  static Napi::Function Define(Napi::Env env) {
+    return DefineClass(
+        env, "CaptureSession",
+        {
+            InstanceMethod<&CaptureSessionWrap::Start>("start"),
+            InstanceMethod<&CaptureSessionWrap::Stop>("stop"),
+            InstanceMethod<&CaptureSessionWrap::OnData>("onData"),
+            InstanceMethod<&CaptureSessionWrap::OnStateChange>("onStateChange"),
+            InstanceMethod<&CaptureSessionWrap::IsRunning>("isRunning"),
+            InstanceMethod<&CaptureSessionWrap::GetLastError>("getLastError"),
+            InstanceMethod<&CaptureSessionWrap::GetDataCount>("getDataCount"),
+            InstanceMethod<&CaptureSessionWrap::GetDroppedCount>("getDroppedCount"),
+            InstanceMethod<&CaptureSessionWrap::IsZeroCopy>("isZeroCopy"),
+            InstanceMethod<&CaptureSessionWrap::GetTimeToFirstPacket>(
+                "getTimeToFirstPacket"),
+            InstanceMethod<&CaptureSessionWrap::GetStats>("getStats"),
+            InstanceMethod<&CaptureSessionWrap::GetLevels>("getLevels"),
+        });
+  }
+
+  CaptureSessionWrap(const Napi::CallbackInfo &info)
+      : Napi::ObjectWrap<CaptureSessionWrap>(info) {}
+
+private:
+  Napi::Value Start(const Napi::CallbackInfo &info) {
+    return StartSession(info, m_session, Value());
+  }
+  Napi::Value Stop(const Napi::CallbackInfo &info) {
+    StopSession(m_session);
+    return info.Env().Undefined();
+  }
+  Napi::Value OnData(const Napi::CallbackInfo &info) {
+    return SetDataCallback(info, m_session);
+  }
+  Napi::Value OnStateChange(const Napi::CallbackInfo &info) {
+    m_session.SetStateCallback(info.Env(), info[0].As<Napi::Function>());
+    return info.Env().Undefined();
+  }
+  Napi::Value IsRunning(const Napi::CallbackInfo &info) {
+    return Napi::Boolean::New(info.Env(), m_session.IsRunning());
+  }
+  Napi::Value GetLastError(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), m_session.LastError());
+  }
+  Napi::Value GetDataCount(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_session.DataCount());
+  }
+  Napi::Value GetDroppedCount(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_session.DroppedCount());
+  }
+  Napi::Value IsZeroCopy(const Napi::CallbackInfo &info) {
+    return Napi::Boolean::New(info.Env(), m_session.IsZeroCopy());
+  }
+  Napi::Value GetTimeToFirstPacket(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_session.TimeToFirstPacketMs());
+  }
+  Napi::Value GetStats(const Napi::CallbackInfo &info) {
+    return m_session.Stats(info.Env());
+  }
+  Napi::Value GetLevels(const Napi::CallbackInfo &info) {
+    return m_session.Levels(info.Env());
+  }
+
+  CaptureSession m_session;
+};
+
+// ─── N-API: module-level exports ───────────────────────────────────────────────
+
+static constexpr uint32_t kMaxResolveWindows = 1024;
+
+static CaptureSession *g_defaultSession = nullptr;
+
+static CaptureSession &DefaultSession() {
+  return *g_defaultSession;
+}
+
+static Napi::Value StartCapture(const Napi::CallbackInfo &info) {
+  return StartSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value StopCapture(const Napi::CallbackInfo &info) {
+  StopSession(DefaultSession());
+  return info.Env().Undefined();
+}
+
+static Napi::Value OnData(const Napi::CallbackInfo &info) {
+  return SetDataCallback(info, DefaultSession());
+}
+
+static Napi::Value OnStateChange(const Napi::CallbackInfo &info) {
+  DefaultSession().SetStateCallback(info.Env(), info[0].As<Napi::Function>());
+  return info.Env().Undefined();
+}
+
+// resolveWindows(ids) → ({ pid, exe, ancestors } | null)[], like the Windows
+// module's; ancestors is always empty here.
+static Napi::Value ResolveWindows(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "resolveWindows expects an array of window ids")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array list = info[0].As<Napi::Array>();
+  if (list.Length() > kMaxResolveWindows) {
+    Napi::TypeError::New(env, "Too many window ids: " +
+                                  std::to_string(list.Length()) + " (max " +
+                                  std::to_string(kMaxResolveWindows) + ")")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array result = Napi::Array::New(env, list.Length());
+  for (uint32_t i = 0; i < list.Length(); i++) {
+    Napi::Value v = list.Get(i);
+    if (!v.IsNumber()) {
+      Napi::TypeError::New(env, "Invalid window id at index " + std::to_string(i))
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    const uint32_t pid = WindowProcessId(
+        static_cast<uint64_t>(v.As<Napi::Number>().Int64Value()));
+    if (pid == 0) {
+      result.Set(i, env.Null());
+      continue;
+    }
+    Napi::Object w = Napi::Object::New(env);
+    w.Set("pid", static_cast<double>(pid));
+    w.Set("exe", ProcessName(pid));
+    w.Set("ancestors", Napi::Array::New(env, 0));
+    result.Set(i, w);
+  }
+  return result;
+}
+
+static Napi::Value GetError(const Napi::CallbackInfo &info) {
+  return Napi::String::New(info.Env(), DefaultSession().LastError());
+}
+
+static Napi::Value GetDataCount(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), DefaultSession().DataCount());
+}
+
+static Napi::Value GetDroppedCount(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), DefaultSession().DroppedCount());
+}
+
+static Napi::Value IsZeroCopy(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), DefaultSession().IsZeroCopy());
+}
+
+static Napi::Value GetTimeToFirstPacket(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), DefaultSession().TimeToFirstPacketMs());
+}
+
+static Napi::Value GetStats(const Napi::CallbackInfo &info) {
+  return DefaultSession().Stats(info.Env());
+}
+
+static Napi::Value GetLevels(const Napi::CallbackInfo &info) {
+  return DefaultSession().Levels(info.Env());
+}
+
+static Napi::Value IsRunning(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), DefaultSession().IsRunning());
+}
+
+static Napi::Value IsUnavailable(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), false);
+}
+
+static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  if (!g_defaultSession) g_defaultSession = new CaptureSession();
+  // A start still pending is interrupted rather than waited out
+  env.AddCleanupHook([] {
+    g_defaultSession->Interrupt();
+    g_defaultSession->Stop();
+  });
+
+  exports.Set("CaptureSession", CaptureSessionWrap::Define(env));
+  exports.Set("startCapture", Napi::Function::New(env, StartCapture));
+  exports.Set("stopCapture", Napi::Function::New(env, StopCapture));
+  exports.Set("onData", Napi::Function::New(env, OnData));
+  exports.Set("onStateChange", Napi::Function::New(env, OnStateChange));
+  exports.Set("resolveWindows", Napi::Function::New(env, ResolveWindows));
+  exports.Set("getLastError", Napi::Function::New(env, GetError));
+  exports.Set("getDataCount", Napi::Function::New(env, GetDataCount));
+  exports.Set("getDroppedCount", Napi::Function::New(env, GetDroppedCount));
+  exports.Set("isZeroCopy", Napi::Function::New(env, IsZeroCopy));
+  exports.Set("getTimeToFirstPacket",
+              Napi::Function::New(env, GetTimeToFirstPacket));
+  exports.Set("getStats", Napi::Function::New(env, GetStats));
+  exports.Set("getLevels", Napi::Function::New(env, GetLevels));
+  exports.Set("isRunning", Napi::Function::New(env, IsRunning));
+  exports.Set("isOpusAvailable", Napi::Function::New(env, IsUnavailable));
+  exports.Set("isNoiseSuppressionAvailable",
+              Napi::Function::New(env, IsUnavailable));
+  return exports;
+}
+
+NODE_API_MODULE(audio_capture, Init)
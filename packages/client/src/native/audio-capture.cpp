@@ -8,14 +8,35 @@
 #include <mmdeviceapi.h>
 #include <audioclient.h>
 #include <audioclientactivationparams.h>
+#include <avrt.h>
+#include <tlhelp32.h>
 
 #include <atomic>
+#include <cmath>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <napi.h>
 
+#include "audio-mixer.h"
+#include "audio-recorder.h"
+#include "capture-clock.h"
+#include "capture-delivery.h"
+#include "capture-service.h"
+#include "capture-stats.h"
+#include "capture-output.h"
+#include "channel-downmix.h"
+#include "format-converter.h"
+#include "level-meter.h"
+#include "noise-suppressor.h"
+#include "opus-encoder.h"
+#include "packet-pool.h"
+#include "process-cache.h"
+#include "signal-scan.h"
+
 // ─── Completion handler with free-threaded marshaling ──────────────────────────
 
 class ActivateHandler : public IActivateAudioInterfaceCompletionHandler {
@@ -33,6 +54,7 @@ public:
   ~ActivateHandler() {
     if (m_event) CloseHandle(m_event);
     if (m_ftm) m_ftm->Release();
+    if (m_client) m_client->Release(); // completed after its waiter gave up
   }
 
   // IUnknown
@@ -73,11 +95,23 @@ public:
     return S_OK;
   }
 
-  HRESULT Wait(DWORD ms = 5000) {
-    WaitForSingleObject(m_event, ms);
+  // E_ABORT if cancel (optional) is signaled first
+  HRESULT Wait(DWORD ms = 5000, HANDLE cancel = nullptr) {
+    if (!cancel) {
+      WaitForSingleObject(m_event, ms);
+      return m_hr;
+    }
+    const HANDLE handles[] = {m_event, cancel};
+    if (WaitForMultipleObjects(2, handles, FALSE, ms) == WAIT_OBJECT_0 + 1)
+      return E_ABORT;
     return m_hr;
   }
-  IAudioClient *GetClient() { return m_client; }
+  // Hand the activated client to the caller, who then owns its reference.
+  IAudioClient *TakeClient() {
+    IAudioClient *c = m_client;
+    m_client = nullptr;
+    return c;
+  }
 
 private:
   LONG m_ref;
@@ -86,418 +120,3604 @@ private:
   IAudioClient *m_client = nullptr;
   IUnknown *m_ftm;
 };
+// ─── Activation helper ─────────────────────────────────────────────────────────
 
-// ─── Capture state ─────────────────────────────────────────────────────────────
+static constexpr DWORD kActivateTimeoutMs = 5000;
 
-static IAudioClient *g_client = nullptr;
-static IAudioCaptureClient *g_captureClient = nullptr;
-static std::thread g_captureThread;
-static std::atomic<bool> g_running{false};
-static Napi::ThreadSafeFunction *g_tsfn = nullptr;
-static std::mutex g_mutex;
-static std::string g_lastError;
-static std::atomic<int> g_dataCount{0};
+// Start activating a process-loopback IAudioClient without waiting. The
+// caller waits on *handler and releases both *handler and *asyncOp (which may
+// be null). Any number of activations can be in flight at once.
+static HRESULT BeginActivateLoopback(DWORD pid, bool excludeMode,
+                                     ActivateHandler **handler,
+                                     IActivateAudioInterfaceAsyncOperation **asyncOp) {
+  AUDIOCLIENT_ACTIVATION_PARAMS acParams = {};
+  acParams.ActivationType = AUDIOCLIENT_ACTIVATION_TYPE_PROCESS_LOOPBACK;
+  acParams.ProcessLoopbackParams.TargetProcessId = pid;
+  acParams.ProcessLoopbackParams.ProcessLoopbackMode =
+      excludeMode ? PROCESS_LOOPBACK_MODE_EXCLUDE_TARGET_PROCESS_TREE
+                   : PROCESS_LOOPBACK_MODE_INCLUDE_TARGET_PROCESS_TREE;
 
-// Event handles for event-driven capture
-static HANDLE g_bufferEvent = nullptr; // signaled when WASAPI buffer is ready
-static HANDLE g_stopEvent = nullptr;   // signaled to stop capture loop
-static bool g_eventDriven = false;     // true if event-driven mode is active
+  PROPVARIANT activateParams = {};
+  activateParams.vt = VT_BLOB;
+  activateParams.blob.cbSize = sizeof(acParams);
+  activateParams.blob.pBlobData = reinterpret_cast<BYTE *>(&acParams);
 
-static void setError(const char *fmt, HRESULT hr) {
-  char buf[256];
-  snprintf(buf, sizeof(buf), fmt, hr);
-  g_lastError = buf;
+  // The params are copied before ActivateAudioInterfaceAsync returns
+  *handler = new ActivateHandler();
+  *asyncOp = nullptr;
+  return ActivateAudioInterfaceAsync(VIRTUAL_AUDIO_DEVICE_PROCESS_LOOPBACK,
+                                     __uuidof(IAudioClient), &activateParams,
+                                     *handler, asyncOp);
 }
 
-// ─── Send a float buffer to JS via ThreadSafeFunction ───────────────────────
-
-struct CaptureData {
-  float *samples;
-  size_t count;
-};
-
-static void SendToJS(float *samples, size_t sampleCount) {
-  if (!g_tsfn) {
-    delete[] samples;
-    return;
-  }
-  auto *cd = new CaptureData{samples, sampleCount};
-  g_tsfn->NonBlockingCall(cd,
-      [](Napi::Env env, Napi::Function jsCallback, CaptureData *data) {
-        auto ab = Napi::ArrayBuffer::New(env, data->count * sizeof(float));
-        memcpy(ab.Data(), data->samples, data->count * sizeof(float));
-        auto f32 = Napi::Float32Array::New(env, data->count, ab, 0);
-        delete[] data->samples;
-        delete data;
-        jsCallback.Call({f32});
-      });
+// Wait for a BeginActivateLoopback() to complete and take its client. Gives
+// up with E_ABORT if cancel (optional) is signaled first.
+static HRESULT EndActivateLoopback(ActivateHandler *handler, DWORD timeoutMs,
+                                   IAudioClient **out, HANDLE cancel = nullptr) {
+  HRESULT hr = handler->Wait(timeoutMs, cancel);
+  *out = SUCCEEDED(hr) ? handler->TakeClient() : nullptr;
+  if (SUCCEEDED(hr) && !*out) hr = E_FAIL;
+  return hr;
 }
 
-// ─── Drain all available packets from WASAPI buffer ────────────────────────────
-// Returns: -1 on error, 0+ = number of packets drained
+// Activate a process-loopback IAudioClient and wait for the completion
+// handler, or until cancel (optional) is signaled. On failure, *failedStep
+// names the call that failed.
+static HRESULT ActivateLoopback(DWORD pid, bool excludeMode, IAudioClient **out,
+                                const char **failedStep,
+                                HANDLE cancel = nullptr) {
+  *out = nullptr;
+  ActivateHandler *handler = nullptr;
+  IActivateAudioInterfaceAsyncOperation *asyncOp = nullptr;
 
-static int DrainPackets() {
-  UINT32 packetLength = 0;
-  HRESULT hr = g_captureClient->GetNextPacketSize(&packetLength);
-  if (FAILED(hr)) return -1;
+  HRESULT hr = BeginActivateLoopback(pid, excludeMode, &handler, &asyncOp);
+  if (FAILED(hr)) {
+    *failedStep = "ActivateAudioInterfaceAsync";
+  } else {
+    hr = EndActivateLoopback(handler, kActivateTimeoutMs, out, cancel);
+    if (FAILED(hr)) *failedStep = "ActivateCompleted";
+  }
 
-  int count = 0;
-  while (packetLength > 0) {
-    BYTE *pData = nullptr;
-    UINT32 numFrames = 0;
-    DWORD flags = 0;
+  handler->Release();
+  if (asyncOp) asyncOp->Release();
+  return hr;
+}
 
-    hr = g_captureClient->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr);
-    if (FAILED(hr)) return -1;
+// Activate an IAudioClient on an endpoint device: a render endpoint for
+// loopback or a capture endpoint (microphone). An empty id means the
+// default console endpoint for flow. On failure, *failedStep names the call
+// that failed.
+static HRESULT ActivateEndpoint(EDataFlow flow, const std::wstring &id,
+                                IAudioClient **out, const char **failedStep) {
+  *out = nullptr;
+  IMMDeviceEnumerator *enumerator = nullptr;
+  HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr,
+                                CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                                (void **)&enumerator);
+  if (FAILED(hr)) {
+    *failedStep = "CoCreateInstance(MMDeviceEnumerator)";
+    return hr;
+  }
 
-    g_dataCount.fetch_add(1);
-    count++;
+  IMMDevice *device = nullptr;
+  hr = id.empty() ? enumerator->GetDefaultAudioEndpoint(flow, eConsole, &device)
+                  : enumerator->GetDevice(id.c_str(), &device);
+  enumerator->Release();
+  if (FAILED(hr)) {
+    *failedStep = id.empty() ? "GetDefaultAudioEndpoint" : "GetDevice";
+    return hr;
+  }
 
-    size_t sampleCount = numFrames * 2;
-    float *copy = new float[sampleCount];
-    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-      memset(copy, 0, sampleCount * sizeof(float));
-    } else {
-      memcpy(copy, pData, sampleCount * sizeof(float));
-    }
-    SendToJS(copy, sampleCount);
+  hr = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                        (void **)out);
+  device->Release();
+  if (FAILED(hr)) *failedStep = "IMMDevice::Activate";
+  return hr;
+}
 
-    g_captureClient->ReleaseBuffer(numFrames);
-    hr = g_captureClient->GetNextPacketSize(&packetLength);
-    if (FAILED(hr)) return -1;
+// KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, without pulling in ksmedia.h
+static const GUID kSubtypeIeeeFloat = {
+    0x00000003, 0x0000, 0x0010, {0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71}};
+
+// What streams are opened with: 48 kHz float32, stereo unless a native
+// layout is asked for. Pass &Format on; a multichannel format has to be
+// WAVEFORMATEXTENSIBLE, so the engine knows where each channel goes.
+static WAVEFORMATEXTENSIBLE CaptureFormat(WORD channels = 2,
+                                          DWORD channelMask = 0x3) {
+  WAVEFORMATEXTENSIBLE ext = {};
+  WAVEFORMATEX &fmt = ext.Format;
+  fmt.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+  fmt.nChannels = channels;
+  fmt.nSamplesPerSec = 48000;
+  fmt.wBitsPerSample = 32;
+  fmt.nBlockAlign = fmt.nChannels * fmt.wBitsPerSample / 8;
+  fmt.nAvgBytesPerSec = fmt.nSamplesPerSec * fmt.nBlockAlign;
+  if (channels > 2) {
+    fmt.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    fmt.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+    ext.Samples.wValidBitsPerSample = 32;
+    ext.dwChannelMask = channelMask;
+    ext.SubFormat = kSubtypeIeeeFloat;
   }
+  return ext;
+}
 
-  return count;
+// Channel count and mask of the default render endpoint's mix format: the
+// layout the engine mixes every process stream in. Process loopback clients
+// don't report one of their own. False if it can't be read.
+static bool QueryRenderLayout(WORD &channels, DWORD &channelMask) {
+  IAudioClient *client = nullptr;
+  const char *step = "";
+  if (FAILED(ActivateEndpoint(eRender, std::wstring(), &client, &step)))
+    return false;
+  WAVEFORMATEX *mix = nullptr;
+  const HRESULT hr = client->GetMixFormat(&mix);
+  client->Release();
+  if (FAILED(hr) || !mix) return false;
+  channels = mix->nChannels;
+  channelMask = ChannelDownmix::DefaultMask(channels);
+  if (mix->wFormatTag == WAVE_FORMAT_EXTENSIBLE &&
+      mix->cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) {
+    const DWORD mask = reinterpret_cast<WAVEFORMATEXTENSIBLE *>(mix)->dwChannelMask;
+    if (mask != 0) channelMask = mask;
+  }
+  CoTaskMemFree(mix);
+  return true;
 }
 
-// ─── Capture loop: event-driven with polling fallback ──────────────────────────
+// Shared-mode engine period of a stream, in frames at the stream's rate
+// (0 = not reported).
+struct EnginePeriod {
+  bool lowLatency = false; // initialized at minFrames through IAudioClient3
+  UINT32 defaultFrames = 0;
+  UINT32 fundamentalFrames = 0;
+  UINT32 minFrames = 0;
+  UINT32 maxFrames = 0;
+  UINT32 currentFrames = 0; // the period the stream actually runs at
+};
 
-static void CaptureLoop() {
-  if (g_eventDriven) {
-    // Event-driven mode: block until WASAPI has data or stop is signaled.
-    // No silence injection — the AudioWorklet ring buffer outputs zeros on
-    // underrun, and audio resumes instantly when data arrives.
-    HANDLE handles[] = {g_bufferEvent, g_stopEvent};
-    while (true) {
-      DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
-      if (result == WAIT_OBJECT_0 + 1) break; // stop event signaled
-      if (result == WAIT_FAILED) break;
-      if (DrainPackets() < 0) break;
-    }
-  } else {
-    // Polling fallback: used when event-driven mode is not supported.
-    while (g_running.load()) {
-      if (DrainPackets() < 0) break;
-      Sleep(10);
-    }
+// Initialize client at the smallest shared-mode period the engine offers for
+// fmt. *attempted is set once InitializeSharedAudioStream ran: after that a
+// failed client can't be initialized again and has to be re-activated.
+// Process loopback clients often don't implement IAudioClient3 at all.
+static HRESULT InitializeLowLatency(IAudioClient *client, DWORD flags,
+                                    const WAVEFORMATEX &fmt,
+                                    EnginePeriod &period, bool *attempted) {
+  *attempted = false;
+  IAudioClient3 *client3 = nullptr;
+  HRESULT hr = client->QueryInterface(__uuidof(IAudioClient3), (void **)&client3);
+  if (FAILED(hr)) return hr;
+
+  hr = client3->GetSharedModeEnginePeriod(&fmt, &period.defaultFrames,
+                                          &period.fundamentalFrames,
+                                          &period.minFrames, &period.maxFrames);
+  if (SUCCEEDED(hr) && period.minFrames == 0) hr = E_FAIL;
+  if (SUCCEEDED(hr)) {
+    *attempted = true;
+    hr = client3->InitializeSharedAudioStream(flags, period.minFrames, &fmt,
+                                              nullptr);
+  }
+  if (SUCCEEDED(hr)) {
+    WAVEFORMATEX *current = nullptr;
+    if (SUCCEEDED(client3->GetCurrentSharedModeEnginePeriod(
+            &current, &period.currentFrames)))
+      CoTaskMemFree(current);
+    else
+      period.currentFrames = period.minFrames;
   }
+  client3->Release();
+  return hr;
 }
 
-// ─── N-API exports ─────────────────────────────────────────────────────────────
+// Fill in the period of a client initialized the regular way, where only
+// the engine's default period applies.
+static void QueryDevicePeriod(IAudioClient *client, uint32_t rate,
+                              EnginePeriod &period) {
+  REFERENCE_TIME defaultPeriod = 0, minPeriod = 0;
+  if (FAILED(client->GetDevicePeriod(&defaultPeriod, &minPeriod))) return;
+  const UINT32 frames =
+      static_cast<UINT32>(defaultPeriod * rate / 10000000);
+  if (period.defaultFrames == 0) period.defaultFrames = frames;
+  period.currentFrames = frames;
+}
 
-// startCapture runs activation + init synchronously on the JS thread,
-// then spawns a capture loop thread.
-static Napi::Value StartCapture(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
-  std::lock_guard<std::mutex> lock(g_mutex);
+// ─── Shared helpers ────────────────────────────────────────────────────────────
 
-  if (g_running.load()) {
-    Napi::Error::New(env, "Capture already running").ThrowAsJavaScriptException();
-    return env.Undefined();
-  }
+static std::string FormatHr(const char *fmt, HRESULT hr) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), fmt, hr);
+  return buf;
+}
 
-  DWORD pid = info[0].As<Napi::Number>().Uint32Value();
-  bool excludeMode = info[1].As<Napi::Boolean>().Value();
+static std::wstring Utf8ToWide(const std::string &s) {
+  if (s.empty()) return std::wstring();
+  int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
+  std::wstring w(len, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), &w[0], len);
+  return w;
+}
 
-  g_lastError.clear();
-  g_dataCount.store(0);
-  g_eventDriven = false;
+static std::string WideToUtf8(const std::wstring &w) {
+  if (w.empty()) return std::string();
+  int len = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), nullptr, 0,
+                                nullptr, nullptr);
+  std::string s(len, '\0');
+  WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), &s[0], len, nullptr,
+                      nullptr);
+  return s;
+}
 
-  // Ensure COM is initialized on this thread (Node/Electron may already have it)
-  CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+static const char *MmcssPriorityName(AVRT_PRIORITY p) {
+  switch (p) {
+  case AVRT_PRIORITY_VERYLOW: return "verylow";
+  case AVRT_PRIORITY_LOW: return "low";
+  case AVRT_PRIORITY_NORMAL: return "normal";
+  case AVRT_PRIORITY_HIGH: return "high";
+  case AVRT_PRIORITY_CRITICAL: return "critical";
+  }
+  return "normal";
+}
 
-  // ── Activate audio interface ──
-  AUDIOCLIENT_ACTIVATION_PARAMS acParams = {};
-  acParams.ActivationType = AUDIOCLIENT_ACTIVATION_TYPE_PROCESS_LOOPBACK;
-  acParams.ProcessLoopbackParams.TargetProcessId = pid;
-  acParams.ProcessLoopbackParams.ProcessLoopbackMode =
-      excludeMode ? PROCESS_LOOPBACK_MODE_EXCLUDE_TARGET_PROCESS_TREE
-                   : PROCESS_LOOPBACK_MODE_INCLUDE_TARGET_PROCESS_TREE;
+static bool ParseMmcssPriority(const std::string &name, AVRT_PRIORITY &out) {
+  static const AVRT_PRIORITY all[] = {AVRT_PRIORITY_VERYLOW, AVRT_PRIORITY_LOW,
+                                      AVRT_PRIORITY_NORMAL, AVRT_PRIORITY_HIGH,
+                                      AVRT_PRIORITY_CRITICAL};
+  for (AVRT_PRIORITY p : all) {
+    if (name == MmcssPriorityName(p)) {
+      out = p;
+      return true;
+    }
+  }
+  return false;
+}
 
-  PROPVARIANT activateParams = {};
-  activateParams.vt = VT_BLOB;
-  activateParams.blob.cbSize = sizeof(acParams);
-  activateParams.blob.pBlobData = reinterpret_cast<BYTE *>(&acParams);
+// ─── startCapture options ──────────────────────────────────────────────────────
+
+// Bound on one downmix matrix coefficient (+18 dB)
+static constexpr double kMaxDownmixGain = 8.0;
+
+// The delivery options (capture-output.h), plus what only WASAPI has. Its
+// format is 48 kHz float32, stereo unless nativeLayout is set.
+struct CaptureOptions : DeliveryOptions {
+  // MMCSS task class for the capture thread; empty = don't register
+  std::wstring mmcssTask = L"Pro Audio";
+  AVRT_PRIORITY mmcssPriority = AVRT_PRIORITY_HIGH;
+  // Deliver Opus packets instead of PCM (needs a with_opus build)
+  bool opus = false;
+  OpusSettings opusSettings;
+  // RNNoise on the capture stream ahead of conversion (needs a with_rnnoise
+  // build). Tuned for speech; it will mangle music and game audio.
+  bool noiseSuppression = false;
+  // Run at the engine's minimum shared-mode period (IAudioClient3) when the
+  // client supports it, else the regular 20 ms buffer
+  bool lowLatency = false;
+  // Re-activate a stream that fails while running (see Stream recovery)
+  bool recover = true;
+  // Keep the last this many seconds of output in memory for saveReplay()
+  uint32_t replaySeconds = 0;
+  // Capture the render endpoint's own layout rather than engine-downmixed
+  // stereo (process captures only), then downmix it with downmixGains or
+  // deliver every channel (see channel-downmix.h)
+  bool nativeLayout = false;
+  bool passthrough = false;
+  ChannelDownmix::GainTable downmixGains = ChannelDownmix::DefaultGains();
+};
 
-  auto handler = new ActivateHandler();
-  IActivateAudioInterfaceAsyncOperation *asyncOp = nullptr;
+// The delivery options (see ParseDeliveryOptions), and
+// {
+//   mmcssTask?: string, mmcssPriority?: "verylow" | "low" | "normal" |
+//                                       "high" | "critical",
+//   codec?: "pcm" | "opus", opusBitrate?: number, opusFrameMs?: number,
+//   noiseSuppression?: boolean, lowLatency?: boolean, recover?: boolean,
+//   replaySeconds?: number,
+//   captureLayout?: "stereo" | "native",
+//   downmix?: "passthrough" | { [speaker]: [left, right] },
+// }
+static bool ParseCaptureOptions(const Napi::Object &o, CaptureOptions &out,
+                                std::string &err) {
+  if (!ParseDeliveryOptions(o, out, err)) return false;
+  OutputFormat &fmt = out.format;
+
+  if (o.Get("mmcssTask").IsString())
+    out.mmcssTask = Utf8ToWide(o.Get("mmcssTask").As<Napi::String>().Utf8Value());
+  if (o.Get("mmcssPriority").IsString()) {
+    std::string name = o.Get("mmcssPriority").As<Napi::String>().Utf8Value();
+    if (!ParseMmcssPriority(name, out.mmcssPriority)) {
+      err = "Invalid mmcssPriority: " + name;
+      return false;
+    }
+  }
 
-  HRESULT hr = ActivateAudioInterfaceAsync(
-      VIRTUAL_AUDIO_DEVICE_PROCESS_LOOPBACK, __uuidof(IAudioClient),
-      &activateParams, handler, &asyncOp);
+  if (o.Has("noiseSuppression"))
+    out.noiseSuppression = o.Get("noiseSuppression").ToBoolean().Value();
+  if (out.noiseSuppression && !NoiseSuppressor::kAvailable) {
+    err = "RNNoise support not built (rebuild with -Dwith_rnnoise=1)";
+    return false;
+  }
+  if (o.Has("lowLatency"))
+    out.lowLatency = o.Get("lowLatency").ToBoolean().Value();
+  if (o.Has("recover")) out.recover = o.Get("recover").ToBoolean().Value();
+  if (o.Get("replaySeconds").IsNumber()) {
+    double sec = o.Get("replaySeconds").As<Napi::Number>().DoubleValue();
+    if (!(sec >= 0 && sec <= AudioRecorder::kMaxReplaySeconds)) {
+      err = "Invalid replaySeconds: " + std::to_string(sec);
+      return false;
+    }
+    out.replaySeconds = static_cast<uint32_t>(sec);
+  }
 
-  if (FAILED(hr)) {
-    char msg[128];
-    snprintf(msg, sizeof(msg), "ActivateAudioInterfaceAsync: 0x%08lX", hr);
-    g_lastError = msg;
-    handler->Release();
-    if (asyncOp) asyncOp->Release();
-    Napi::Error::New(env, msg).ThrowAsJavaScriptException();
-    return env.Undefined();
+  if (o.Get("codec").IsString()) {
+    std::string codec = o.Get("codec").As<Napi::String>().Utf8Value();
+    if (codec != "pcm" && codec != "opus") {
+      err = "Invalid codec: " + codec;
+      return false;
+    }
+    out.opus = codec == "opus";
+  }
+  if (out.opus) {
+    if (!OpusFrameEncoder::kAvailable) {
+      err = "Opus support not built (rebuild with -Dwith_opus=1)";
+      return false;
+    }
+    if (!OpusSettings::ValidRate(fmt.sampleRate)) {
+      err = "Opus does not support sampleRate: " + std::to_string(fmt.sampleRate);
+      return false;
+    }
+    OpusSettings &opus = out.opusSettings;
+    if (o.Get("opusBitrate").IsNumber()) {
+      opus.bitrate = o.Get("opusBitrate").As<Napi::Number>().Uint32Value();
+      if (!OpusSettings::ValidBitrate(opus.bitrate)) {
+        err = "Invalid opusBitrate: " + std::to_string(opus.bitrate);
+        return false;
+      }
+    }
+    if (o.Get("opusFrameMs").IsNumber()) {
+      double ms = o.Get("opusFrameMs").As<Napi::Number>().DoubleValue();
+      opus.frameUs = static_cast<uint32_t>(ms * 1000 + 0.5);
+      if (!(ms > 0) || !OpusSettings::ValidFrameUs(opus.frameUs)) {
+        err = "Invalid opusFrameMs: " + std::to_string(ms);
+        return false;
+      }
+    }
+    // The encoder takes float input and does its own silence handling
+    fmt.int16 = false;
+    opus.dtx = out.suppressSilence;
+    out.suppressSilence = false;
   }
 
-  hr = handler->Wait(5000);
-  if (FAILED(hr) || !handler->GetClient()) {
-    char msg[128];
-    snprintf(msg, sizeof(msg), "ActivateCompleted: 0x%08lX", hr);
-    g_lastError = msg;
-    handler->Release();
-    if (asyncOp) asyncOp->Release();
-    Napi::Error::New(env, msg).ThrowAsJavaScriptException();
-    return env.Undefined();
+  if (o.Get("captureLayout").IsString()) {
+    std::string name = o.Get("captureLayout").As<Napi::String>().Utf8Value();
+    if (name != "stereo" && name != "native") {
+      err = "Invalid captureLayout: " + name;
+      return false;
+    }
+    out.nativeLayout = name == "native";
+  }
+  const Napi::Value downmix = o.Get("downmix");
+  if (downmix.IsString()) {
+    std::string name = downmix.As<Napi::String>().Utf8Value();
+    if (name != "passthrough") {
+      err = "Invalid downmix: " + name;
+      return false;
+    }
+    out.passthrough = true;
+  } else if (downmix.IsObject()) {
+    // { [speaker]: [left, right] }, over the default gains
+    Napi::Object gains = downmix.As<Napi::Object>();
+    Napi::Array names = gains.GetPropertyNames();
+    for (uint32_t i = 0; i < names.Length(); i++) {
+      const std::string name = names.Get(i).ToString().Utf8Value();
+      const int bit = ChannelDownmix::PositionBit(name);
+      Napi::Value pair = gains.Get(name);
+      if (bit < 0 || !pair.IsArray() || pair.As<Napi::Array>().Length() != 2 ||
+          !pair.As<Napi::Array>().Get(0u).IsNumber() ||
+          !pair.As<Napi::Array>().Get(1u).IsNumber()) {
+        err = "Invalid downmix gain: " + name;
+        return false;
+      }
+      const double l = pair.As<Napi::Array>().Get(0u).As<Napi::Number>().DoubleValue();
+      const double r = pair.As<Napi::Array>().Get(1u).As<Napi::Number>().DoubleValue();
+      if (!(std::fabs(l) <= kMaxDownmixGain && std::fabs(r) <= kMaxDownmixGain)) {
+        err = "Invalid downmix gain: " + name;
+        return false;
+      }
+      out.downmixGains.position[bit].left = static_cast<float>(l);
+      out.downmixGains.position[bit].right = static_cast<float>(r);
+    }
+  }
+  if ((out.passthrough || downmix.IsObject()) && !out.nativeLayout) {
+    err = "downmix needs captureLayout: \"native\"";
+    return false;
+  }
+  // Passthrough delivers the capture layout as is (channels is ignored):
+  // the converter, encoder, denoiser and replay ring are stereo-only
+  if (out.passthrough &&
+      (out.format.sampleRate != FormatConverter::kInRate || out.format.int16 ||
+       out.opus || out.noiseSuppression || out.replaySeconds > 0)) {
+    err = "downmix: \"passthrough\" needs 48 kHz float32 PCM, without "
+          "noiseSuppression or replaySeconds";
+    return false;
   }
+  return true;
+}
 
-  g_client = handler->GetClient();
-  handler->Release();
-  if (asyncOp) asyncOp->Release();
+// ─── startMix sources ──────────────────────────────────────────────────────────
 
-  // ── Initialize audio client: 48kHz stereo float32 ──
-  WAVEFORMATEX fmt = {};
-  fmt.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
-  fmt.nChannels = 2;
-  fmt.nSamplesPerSec = 48000;
-  fmt.wBitsPerSample = 32;
-  fmt.nBlockAlign = fmt.nChannels * fmt.wBitsPerSample / 8;
-  fmt.nAvgBytesPerSec = fmt.nSamplesPerSec * fmt.nBlockAlign;
+// Mixed sources are aligned within kMixJitterMs of their QPC positions and
+// may hold the output back by up to kMixMaxLatencyMs (see audio-mixer.h).
+static constexpr uint32_t kMixMaxLatencyMs = 40;
+static constexpr uint32_t kMixJitterMs = 2;
+static constexpr uint32_t kMixRingMs = 250;
+static constexpr float kMaxMixGain = 8.0f;
 
-  REFERENCE_TIME bufferDuration = 200000; // 20ms
+enum class MixSourceKind { Process, Output, Microphone };
 
-  // ── Create event handles ──
-  g_bufferEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr); // auto-reset
-  g_stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);    // manual-reset
+struct MixSourceSpec {
+  MixSourceKind kind = MixSourceKind::Process;
+  DWORD pid = 0;            // Process
+  bool excludeMode = false; // Process: everything except pid's tree
+  std::wstring deviceId;    // Output/Microphone; empty = default endpoint
+  float gain = 1.0f;
+};
 
-  // ── Try event-driven mode first ──
-  hr = g_client->Initialize(AUDCLNT_SHAREMODE_SHARED,
-                            AUDCLNT_STREAMFLAGS_LOOPBACK |
-                                AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
-                            bufferDuration, 0, &fmt, nullptr);
+static const char *MixSourceKindName(MixSourceKind kind) {
+  switch (kind) {
+  case MixSourceKind::Process: return "process";
+  case MixSourceKind::Output: return "output";
+  case MixSourceKind::Microphone: return "microphone";
+  }
+  return "process";
+}
 
-  if (SUCCEEDED(hr)) {
-    hr = g_client->SetEventHandle(g_bufferEvent);
-    if (SUCCEEDED(hr)) {
-      g_eventDriven = true;
-    } else {
-      // SetEventHandle failed — re-initialize without event callback
-      g_client->Release();
-      g_client = nullptr;
-
-      // Re-activate the audio interface (can't reuse a failed IAudioClient)
-      auto handler2 = new ActivateHandler();
-      IActivateAudioInterfaceAsyncOperation *asyncOp2 = nullptr;
-      hr = ActivateAudioInterfaceAsync(
-          VIRTUAL_AUDIO_DEVICE_PROCESS_LOOPBACK, __uuidof(IAudioClient),
-          &activateParams, handler2, &asyncOp2);
-      if (SUCCEEDED(hr)) {
-        hr = handler2->Wait(5000);
-        if (SUCCEEDED(hr) && handler2->GetClient()) {
-          g_client = handler2->GetClient();
-        }
-      }
-      handler2->Release();
-      if (asyncOp2) asyncOp2->Release();
-
-      if (!g_client) {
-        setError("Re-activation after event mode fallback failed: 0x%08lX", hr);
-        CloseHandle(g_bufferEvent);
-        CloseHandle(g_stopEvent);
-        g_bufferEvent = nullptr;
-        g_stopEvent = nullptr;
-        Napi::Error::New(env, g_lastError).ThrowAsJavaScriptException();
-        return env.Undefined();
+// [
+//   { type: "process", pid: number, excludeMode?: boolean, gain?: number }
+//   | { type: "output" | "microphone", deviceId?: string, gain?: number },
+// ]
+static bool ParseMixSources(const Napi::Array &list,
+                            std::vector<MixSourceSpec> &out, std::string &err) {
+  if (list.Length() == 0 || list.Length() > AudioMixer::kMaxSources) {
+    err = "startMix takes 1 to " + std::to_string(AudioMixer::kMaxSources) +
+          " sources";
+    return false;
+  }
+  for (uint32_t i = 0; i < list.Length(); i++) {
+    const std::string where = "Mix source " + std::to_string(i) + ": ";
+    Napi::Value v = list.Get(i);
+    if (!v.IsObject()) {
+      err = where + "expected an object";
+      return false;
+    }
+    Napi::Object o = v.As<Napi::Object>();
+    MixSourceSpec spec;
+    std::string type =
+        o.Get("type").IsString() ? o.Get("type").As<Napi::String>().Utf8Value() : "";
+    if (type == "process") {
+      spec.kind = MixSourceKind::Process;
+      if (!o.Get("pid").IsNumber()) {
+        err = where + "process sources need a pid";
+        return false;
       }
-
-      hr = g_client->Initialize(AUDCLNT_SHAREMODE_SHARED,
-                                AUDCLNT_STREAMFLAGS_LOOPBACK, bufferDuration, 0,
-                                &fmt, nullptr);
+      spec.pid = o.Get("pid").As<Napi::Number>().Uint32Value();
+      if (o.Has("excludeMode"))
+        spec.excludeMode = o.Get("excludeMode").ToBoolean().Value();
+    } else if (type == "output" || type == "microphone") {
+      spec.kind = type == "output" ? MixSourceKind::Output
+                                   : MixSourceKind::Microphone;
+      if (o.Get("deviceId").IsString())
+        spec.deviceId =
+            Utf8ToWide(o.Get("deviceId").As<Napi::String>().Utf8Value());
+    } else {
+      err = where + "invalid type: " + type;
+      return false;
     }
-  } else {
-    // Event-driven init failed — fall back to polling mode
-    g_client->Release();
-    g_client = nullptr;
-
-    // Re-activate (can't reuse a failed IAudioClient)
-    auto handler2 = new ActivateHandler();
-    IActivateAudioInterfaceAsyncOperation *asyncOp2 = nullptr;
-    hr = ActivateAudioInterfaceAsync(
-        VIRTUAL_AUDIO_DEVICE_PROCESS_LOOPBACK, __uuidof(IAudioClient),
-        &activateParams, handler2, &asyncOp2);
-    if (SUCCEEDED(hr)) {
-      hr = handler2->Wait(5000);
-      if (SUCCEEDED(hr) && handler2->GetClient()) {
-        g_client = handler2->GetClient();
+    if (o.Get("gain").IsNumber()) {
+      double g = o.Get("gain").As<Napi::Number>().DoubleValue();
+      if (!(g >= 0.0 && g <= kMaxMixGain)) {
+        err = where + "invalid gain: " + std::to_string(g);
+        return false;
       }
+      spec.gain = static_cast<float>(g);
     }
-    handler2->Release();
-    if (asyncOp2) asyncOp2->Release();
+    out.push_back(std::move(spec));
+  }
+  return true;
+}
 
-    if (!g_client) {
-      setError("Re-activation failed: 0x%08lX", hr);
-      CloseHandle(g_bufferEvent);
-      CloseHandle(g_stopEvent);
-      g_bufferEvent = nullptr;
-      g_stopEvent = nullptr;
-      Napi::Error::New(env, g_lastError).ThrowAsJavaScriptException();
-      return env.Undefined();
-    }
+// ─── Stream recovery ───────────────────────────────────────────────────────────
+//
+// A running stream fails when its device goes away under it, the audio
+// service restarts, or (include mode) the target process exits. The session
+// then leaves its shared capture thread for a recovery thread of its own,
+// which re-activates the same target with exponential backoff instead of
+// ending the share, and re-attaches the new stream. A target that exited is
+// followed to a restarted instance of the same executable. Every transition
+// is reported to onStateChange() listeners.
+
+static constexpr DWORD kRecoveryBaseDelayMs = 100;
+static constexpr DWORD kRecoveryMaxDelayMs = 5000;
+// Unclassified errors get this many fresh clients before the session fails
+static constexpr uint32_t kMaxRecoveryAttempts = 5;
+// How long to look for a restarted target before giving up
+static constexpr DWORD kProcessRestartWaitMs = 60000;
+// Loop result for an include-mode target that exited
+// (HRESULT_FROM_WIN32(ERROR_PROCESS_ABORTED))
+static constexpr HRESULT kTargetExited = static_cast<HRESULT>(0x8007042BL);
+
+// Errors a fresh client for the same target is expected to get past, so
+// recovery retries them until stopped.
+static bool IsRecoverableStreamError(HRESULT hr) {
+  return hr == AUDCLNT_E_DEVICE_INVALIDATED ||
+         hr == AUDCLNT_E_SERVICE_NOT_RUNNING ||
+         hr == AUDCLNT_E_RESOURCES_INVALIDATED || hr == kTargetExited;
+}
 
-    hr = g_client->Initialize(AUDCLNT_SHAREMODE_SHARED,
-                              AUDCLNT_STREAMFLAGS_LOOPBACK, bufferDuration, 0,
-                              &fmt, nullptr);
+static const char *StreamErrorReason(HRESULT hr) {
+  switch (hr) {
+  case AUDCLNT_E_DEVICE_INVALIDATED: return "device-invalidated";
+  case AUDCLNT_E_SERVICE_NOT_RUNNING: return "service-not-running";
+  case AUDCLNT_E_RESOURCES_INVALIDATED: return "resources-invalidated";
+  case kTargetExited: return "process-exited";
+  default: return "stream-error";
   }
+}
 
-  if (FAILED(hr)) {
-    char msg[128];
-    snprintf(msg, sizeof(msg), "IAudioClient::Initialize: 0x%08lX", hr);
-    g_lastError = msg;
-    g_client->Release();
-    g_client = nullptr;
-    CloseHandle(g_bufferEvent);
-    CloseHandle(g_stopEvent);
-    g_bufferEvent = nullptr;
-    g_stopEvent = nullptr;
-    Napi::Error::New(env, msg).ThrowAsJavaScriptException();
-    return env.Undefined();
+// ─── Hot-swapping the target ───────────────────────────────────────────────────
+//
+// Retarget() switches a running share to another process tree without
+// touching anything downstream: pool, chunking, conversion and JS delivery
+// carry on, so the renderer's ring, worklet and published track never
+// notice. The worker activates and starts the new stream in the session's
+// mode, signalling the same buffer event, and hands it to the capture
+// thread. There each drain first buffers the new stream's frames, then
+// mixes them into the current stream's packets with an equal-power
+// crossfade over kRetargetFadeMs. Once through (or once the current stream
+// has stalled for kRetargetMaxLagMs) the two clients are swapped and the
+// buffered remainder goes out as is. The worker then re-attaches the
+// session, so the wait set picks up the new target's process handle.
+
+static constexpr uint32_t kRetargetFadeMs = 10;
+static constexpr uint32_t kRetargetMaxLagMs = 100;
+// Both streams pace the capture thread, so the fade ends within a few
+// periods; this only bounds a stalled one
+static constexpr DWORD kRetargetTimeoutMs = 2000;
+
+enum class CaptureState { Running, Recovering, Failed };
+
+static const char *CaptureStateName(CaptureState s) {
+  switch (s) {
+  case CaptureState::Running: return "running";
+  case CaptureState::Recovering: return "recovering";
+  case CaptureState::Failed: return "failed";
   }
+  return "failed";
+}
 
-  hr = g_client->GetService(__uuidof(IAudioCaptureClient),
-                            (void **)&g_captureClient);
-  if (FAILED(hr)) {
-    char msg[128];
-    snprintf(msg, sizeof(msg), "GetService: 0x%08lX", hr);
-    g_lastError = msg;
-    g_client->Release();
-    g_client = nullptr;
-    CloseHandle(g_bufferEvent);
-    CloseHandle(g_stopEvent);
-    g_bufferEvent = nullptr;
-    g_stopEvent = nullptr;
-    Napi::Error::New(env, msg).ThrowAsJavaScriptException();
-    return env.Undefined();
+// One state change, allocated by the capture thread and freed by StateToJS.
+struct StateEvent {
+  CaptureState state = CaptureState::Running;
+  HRESULT error = S_OK; // what triggered the recovery
+  uint32_t attempt = 0;
+  DWORD retryInMs = 0;  // Recovering only
+  DWORD pid = 0;        // the target, which may change on a restart
+};
+
+// Full image path of pid, empty if it can't be opened.
+static std::wstring ProcessImagePath(DWORD pid) {
+  HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (!h) return std::wstring();
+  WCHAR path[MAX_PATH];
+  DWORD size = MAX_PATH;
+  std::wstring result;
+  if (QueryFullProcessImageNameW(h, 0, path, &size)) result.assign(path, size);
+  CloseHandle(h);
+  return result;
+}
+
+// Root of a running process tree started from image: a process with that
+// image whose parent isn't one too (a browser, not its renderers), other
+// than skipPid. 0 if none.
+static DWORD FindProcessByImage(const std::wstring &image, DWORD skipPid) {
+  const size_t slash = image.find_last_of(L'\\');
+  const std::wstring exe =
+      slash == std::wstring::npos ? image : image.substr(slash + 1);
+  HANDLE snap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+  if (snap == INVALID_HANDLE_VALUE) return 0;
+
+  std::vector<PROCESSENTRY32W> matches;
+  PROCESSENTRY32W e = {};
+  e.dwSize = sizeof(e);
+  for (BOOL ok = Process32FirstW(snap, &e); ok; ok = Process32NextW(snap, &e)) {
+    if (_wcsicmp(e.szExeFile, exe.c_str()) == 0) matches.push_back(e);
+  }
+  CloseHandle(snap);
+
+  for (const PROCESSENTRY32W &m : matches) {
+    bool childOfMatch = false;
+    for (const PROCESSENTRY32W &p : matches)
+      childOfMatch |= p.th32ProcessID == m.th32ParentProcessID;
+    if (childOfMatch || m.th32ProcessID == skipPid) continue;
+    if (_wcsicmp(ProcessImagePath(m.th32ProcessID).c_str(), image.c_str()) == 0)
+      return m.th32ProcessID;
   }
+  return 0;
+}
 
-  hr = g_client->Start();
-  if (FAILED(hr)) {
-    char msg[128];
-    snprintf(msg, sizeof(msg), "IAudioClient::Start: 0x%08lX", hr);
-    g_lastError = msg;
-    g_captureClient->Release();
-    g_captureClient = nullptr;
-    g_client->Release();
-    g_client = nullptr;
-    CloseHandle(g_bufferEvent);
-    CloseHandle(g_stopEvent);
-    g_bufferEvent = nullptr;
-    g_stopEvent = nullptr;
-    Napi::Error::New(env, msg).ThrowAsJavaScriptException();
-    return env.Undefined();
+// ─── Capture session ───────────────────────────────────────────────────────────
+//
+// One process-loopback stream: its IAudioClient, capture thread, packet pool
+// and JS delivery. Sessions are fully independent, so several can capture
+// different processes at once. A session started with StartMix() runs one
+// stream per source on the same thread instead and delivers their mix.
+//
+// The capture thread never allocates: packets are copied into a preallocated
+// slab and published through a lock-free ring. JS is woken with at most one
+// pending TSFN call and drains every ready packet in that call.
+
+// A retarget in flight: the new target's stream, already started. The
+// capture thread buffers its frames in pending and crossfades them in
+// against the current stream, then swaps the two clients, handing the old
+// one back here for the worker to release.
+struct RetargetStream {
+  enum class Result { Pending, Done, Aborted };
+
+  IAudioClient *client = nullptr;
+  IAudioCaptureClient *capture = nullptr;
+  DWORD pid = 0;
+  bool excludeMode = false;
+  std::wstring image;       // the new target's, if it gets followed
+  HANDLE process = nullptr; // the new target's, include mode only
+  std::vector<float> pending; // capture-format frames not yet mixed
+  uint32_t pendingStart = 0;
+  uint32_t pendingFrames = 0;
+  std::vector<float> mixed;   // one crossfaded packet
+  uint32_t fadeFrames = 0;
+  uint32_t fadePos = 0;
+  bool lagging = false; // pending filled up: the current stream has stalled
+  HRESULT error = S_OK;
+  std::atomic<Result> result{Result::Pending};
+  HANDLE done = nullptr; // set with the result
+};
+
+class CaptureSession;
+static void DrainToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *session, void *data);
+using DrainTsfn = Napi::TypedThreadSafeFunction<CaptureSession, void, DrainToJS>;
+static void StateToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *session, StateEvent *e);
+using StateTsfn =
+    Napi::TypedThreadSafeFunction<CaptureSession, StateEvent, StateToJS>;
+
+class CaptureSession : public CaptureTask {
+public:
+  CaptureSession() {
+    m_cancelEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr); // manual-reset
+  }
+  CaptureSession(const CaptureSession &) = delete;
+  CaptureSession &operator=(const CaptureSession &) = delete;
+  ~CaptureSession() {
+    Stop();
+    if (m_cancelEvent) CloseHandle(m_cancelEvent);
+    if (m_stateTsfn) {
+      m_stateTsfn->Release();
+      delete m_stateTsfn;
+    }
   }
 
-  // ── Start capture loop on background thread ──
-  g_running.store(true);
-  g_captureThread = std::thread(CaptureLoop);
+  // Activate, initialize and attach to a capture thread. Blocks for up to
+  // several seconds, so it runs on a worker thread (see StartWorker). On
+  // failure returns false with the message to reject with in err.
+  bool Start(DWORD pid, bool excludeMode, const CaptureOptions &opts,
+             std::string &err);
+  // Like Start(), but capture every source and deliver their aligned mix.
+  bool StartMix(const std::vector<MixSourceSpec> &sources,
+                const CaptureOptions &opts, std::string &err);
+  // Stop capture, waiting for any Start() still in flight (see Interrupt).
+  // Also drops a prewarmed client.
+  void Stop();
+  // Switch a running single-stream session to another target, crossfading
+  // on the capture thread. Blocks on activation like Start().
+  bool Retarget(DWORD pid, bool excludeMode, std::string &err);
+  // Activate and Initialize ahead of Start() for this target, so the start
+  // itself skips straight to IAudioClient::Start. Blocks like Start().
+  bool Prepare(DWORD pid, bool excludeMode, bool lowLatency, std::string &err);
+
+  // JS thread: bracket an asynchronous Start(), or (Op) a Prepare() or
+  // Retarget(). A stop requested while one is pending interrupts its
+  // activation or crossfade wait and is deferred until the last of them
+  // ends; each End*() reports whether it was stopped. Begin*() fails while a
+  // start is already pending or a stop is deferred.
+  bool BeginStart();
+  bool EndStart();
+  bool BeginOp();
+  bool EndOp();
+  // JS thread: false if nothing is pending, so the caller should Stop() now.
+  bool DeferStop();
+  // Any thread: make a pending activation or retarget give up. Stop() still
+  // waits for the operation to unwind, but no longer for what it waits on.
+  void Interrupt();
+  // False (and unchanged) while a start is pending or the capture runs
+  bool SetCallback(Napi::Env env, Napi::Function cb);
+  // Listener for recovery state changes; kept across starts
+  void SetStateCallback(Napi::Env env, Napi::Function cb);
+  Napi::Object Info(Napi::Env env) const;
+  Napi::Object Stats(Napi::Env env) const;
+  Napi::Object CaptureFormatToJS(Napi::Env env) const;
+  Napi::Value Levels(Napi::Env env) const;
+
+  // Worker thread: record the delivered stream to disk, or write out the
+  // replay ring (see audio-recorder.h). A recording needs a running session.
+  bool StartRecording(const std::wstring &path, const RecordSettings &settings,
+                      std::string &err);
+  bool StopRecording(RecordResult &result, std::string &err);
+  bool SaveReplay(const std::wstring &path, const RecordSettings &settings,
+                  uint32_t seconds, RecordResult &result, std::string &err) {
+    return m_recorder.SaveReplay(path, settings, seconds, result, err);
+  }
 
-  return env.Undefined();
-}
+  bool IsRunning() const { return m_running.load(); }
+  bool IsZeroCopy() const { return m_delivery.ZeroCopy(); }
+  std::string LastError() const {
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+  }
+  int DataCount() const { return m_dataCount.load(); }
+  int DroppedCount() const { return m_droppedCount.load(); }
+  // ms from the start request to the first captured packet, -1 until then
+  double TimeToFirstPacketMs() const {
+    LONGLONG first = m_firstPacketQpc.load(std::memory_order_acquire);
+    if (first == 0) return -1;
+    return (first - m_startQpc.load()) * 1000.0 / QpcFrequency();
+  }
 
-static Napi::Value StopCapture(const Napi::CallbackInfo &info) {
-  std::lock_guard<std::mutex> lock(g_mutex);
+private:
+  friend void DrainToJS(Napi::Env, Napi::Function, CaptureSession *, void *);
+
+  bool Activate(DWORD pid, bool excludeMode, bool lowLatency,
+                std::string &err);
+  bool Interrupted() const;
+  bool ActivateForStart(DWORD pid, bool excludeMode, const CaptureOptions &opts,
+                        std::string &err);
+  bool OpenMixStream(uint32_t index, bool lowLatency, std::string &err);
+  void ResetForStart(const CaptureOptions &opts);
+  bool ConfigureOutput(const CaptureOptions &opts, std::string &err);
+  bool BeginCapture(const CaptureOptions &opts, std::string &err);
+  void ReleaseClient();
+  void ReapFailed();
+  bool Fail(std::string msg, std::string &err);
+  void SetLastError(std::string msg);
+
+  // CaptureTask: on the shared capture thread (see capture-service.h), or
+  // the session's recovery thread while detached
+  DWORD WaitHandles(HANDLE *out) const override;
+  LONGLONG PollPeriod() const override;
+  LONGLONG DeadlineQpc() const override;
+  HRESULT Service(DWORD index) override;
+  void Detached(HRESULT hr) override;
+  DWORD StreamHandles() const;
+  bool AttachToService(CaptureThreadInfo &info, std::string &err);
+  void RecoveryLoop(HRESULT hr, std::thread previous);
+
+  // Capture thread
+  bool Recover(HRESULT hr);
+  HRESULT Reopen();
+  bool TargetExited() const;
+  bool FollowRestartedTarget();
+  void EmitState(CaptureState state, HRESULT error, uint32_t attempt,
+                 DWORD retryInMs);
+  int DrainPackets();
+  int DrainMix();
+  void MixOut();
+  void AppendStream(const BYTE *pData, UINT32 numFrames, bool silent);
+  void AppendNative(const BYTE *pData, UINT32 numFrames, bool silent);
+  bool DrainIncoming(RetargetStream &r);
+  const BYTE *Crossfade(RetargetStream &r, const BYTE *pData, UINT32 &numFrames,
+                        bool silent);
+  void CompleteRetarget(RetargetStream &r);
+  void EndRetarget(RetargetStream &r, RetargetStream::Result result);
+  HRESULT OpenStream(DWORD pid, bool excludeMode, IAudioClient **client,
+                     IAudioCaptureClient **capture, HANDLE cancel = nullptr);
+  void AppendPacket(const BYTE *pData, UINT32 numFrames, bool silent);
+  void AppendCaptured(const BYTE *pData, UINT32 numFrames, bool silent);
+  void AppendOutput(const uint8_t *src, uint32_t frames);
+  void AppendEncoded(const uint8_t *packet, uint32_t bytes);
+  void SuppressSilence(UINT32 numFrames);
+  void ScheduleDrain();
+
+  IAudioClient *m_client = nullptr;
+  IAudioCaptureClient *m_captureClient = nullptr;
+  std::thread m_thread; // recovery, while the stream is off its capture thread
+  std::mutex m_attachMutex; // orders a recovery's re-attach against Stop()
+  std::atomic<bool> m_running{false};
+  DrainTsfn *m_tsfn = nullptr;
+  std::mutex m_mutex; // held for the whole of Start() and Stop()
+  mutable std::mutex m_errorMutex;
+  std::string m_lastError;
+  bool m_starting = false;    // JS thread only
+  int m_pendingOps = 0;       // JS thread only: bracketed starts and prepares
+  bool m_stopDeferred = false; // JS thread only
+  HANDLE m_cancelEvent = nullptr; // Interrupt(); reset when nothing is pending
+  std::atomic<int> m_dataCount{0};
+  std::atomic<int> m_droppedCount{0}; // packets lost to pool exhaustion
+  CaptureStats m_stats;
+  PacketPool m_pool;
+  // Zero-copy lending and the queue policy (see capture-delivery.h)
+  PacketDelivery m_delivery{m_pool, m_stats};
+
+  // Output format. m_convert is false when it matches the capture format,
+  // in which case packets are copied straight into the pool.
+  OutputFormat m_format;
+  bool m_convert = false;
+  FormatConverter m_converter;       // capture thread only while running
+  UINT32 m_convertFrames = 0;        // input frames per Process() call
+  std::vector<uint8_t> m_convertBuf; // one converted block
+
+  // Capture layout. A native-layout stream with more than two channels is
+  // downmixed to stereo ahead of everything else, in blocks of
+  // m_downmixFrames, or delivered as is (m_passthrough), in which case
+  // m_format.channels is the capture channel count and the downmix only
+  // feeds the meter.
+  bool m_nativeLayout = false;
+  WAVEFORMATEXTENSIBLE m_captureFormat = CaptureFormat();
+  bool m_passthrough = false;
+  ChannelDownmix m_downmix;
+  UINT32 m_downmixFrames = 0;
+  std::vector<float> m_downmixBuf; // one stereo block
+
+  // Opus mode: output-format samples are encoded into one pool slot per
+  // packet (sampleBytes == 1) instead of being chunked.
+  bool m_opus = false;
+  OpusSettings m_opusSettings;
+  OpusFrameEncoder m_encoder; // capture thread only while running
+
+  // Noise suppression: the capture stream goes through m_denoiser in whole
+  // 10 ms frames before conversion, so output trails capture by up to one.
+  bool m_denoise = false;
+  NoiseSuppressor m_denoiser; // capture thread only while running
+
+  // Output frames are teed to the recorder's writer thread ahead of
+  // chunking, so pool drops and queue policy never reach a recording.
+  AudioRecorder m_recorder;
+
+  // Metering runs on the raw capture stream ahead of conversion. A
+  // meter-only session stops there and publishes nothing to JS.
+  bool m_meter = false;
+  bool m_meterOnly = false;
+  LevelMeter m_levels;
+
+  // Prewarm: an activated, initialized but not yet started client for
+  // m_preparedPid, kept until the matching Start() (or Stop()).
+  bool m_prepared = false;
+  DWORD m_preparedPid = 0;
+  bool m_preparedExclude = false;
+  bool m_preparedLowLatency = false;
+  bool m_prewarmed = false; // the running session started from a prepare
+  UINT32 m_bufferFrames = 0;
+  // lowLatency as requested, and the period the stream came up with. In mix
+  // mode, m_period is the smallest one among the sources.
+  bool m_lowLatencyRequested = false;
+  EnginePeriod m_period;
+
+  // Time to first packet: m_startQpc when JS asked to start, and the first
+  // packet seen by DrainPackets (0 = none yet).
+  std::atomic<LONGLONG> m_startQpc{0};
+  std::atomic<LONGLONG> m_firstPacketQpc{0};
+
+  // Chunking and silence markers (capture-output.h), fed from the capture
+  // thread with the packet being appended: its capture time and device
+  // position.
+  PacketChunker m_chunker{m_pool, m_stats, m_droppedCount};
+  uint64_t m_packetQpc = 0; // capture time of the packet being appended, 100 ns
+  // Its device position, in capture frames; kNoPosition in mix mode
+  uint64_t m_packetPosition = Packet::kNoPosition;
+
+  // Silence suppression: silent packets go to m_chunker as a run
+  bool m_suppressSilence = false;
+  float m_silenceThreshold = 0.0f;
+
+  // MMCSS: capture threads register with the multimedia class scheduler so
+  // WASAPI events are still serviced when a game pins every core. The
+  // session reports the registration of the thread it was first attached
+  // to, as Start saw it.
+  std::wstring m_mmcssTask;
+  AVRT_PRIORITY m_mmcssPriority = AVRT_PRIORITY_HIGH;
+  bool m_mmcssRegistered = false;
+  DWORD m_mmcssTaskIndex = 0;
+  DWORD m_mmcssError = 0; // Win32 error from registration, 0 if none
+  DWORD m_captureThreadId = 0;
+  bool m_highResTimer = false; // the thread's poll timer is high-resolution
+  // The capture thread serving the session, for getStats() CPU time
+  std::atomic<HANDLE> m_threadHandle{nullptr};
+
+  // Recovery: the target a failed stream is re-activated for. Include-mode
+  // targets are also watched for exit through m_targetProcess, and followed
+  // to a restarted instance of m_targetImage. Capture thread only while
+  // running.
+  bool m_recover = false;
+  DWORD m_targetPid = 0;
+  bool m_targetExclude = false;
+  std::wstring m_targetImage;
+  HANDLE m_targetProcess = nullptr;
+  HRESULT m_streamError = S_OK; // why the last drain failed
+  // Retarget: handed to the capture thread through m_retarget. While
+  // m_retargeting, the old target exiting is no reason to recover, and a
+  // failure that detaches the session sets m_retargetDetached.
+  std::atomic<RetargetStream *> m_retarget{nullptr};
+  std::atomic<bool> m_retargeting{false};
+  std::atomic<bool> m_retargetDetached{false};
+  std::atomic<CaptureState> m_state{CaptureState::Running};
+  StateTsfn *m_stateTsfn = nullptr;
+
+  // Event handles for event-driven capture
+  HANDLE m_bufferEvent = nullptr; // signaled when WASAPI buffer is ready
+  HANDLE m_stopEvent = nullptr;   // signaled to stop capture loop
+  bool m_eventDriven = false;     // true if event-driven mode is active
+
+  // Mix mode: m_client stays null and each source has its own event-driven
+  // stream. The capture thread drains them all into m_mixer and runs its
+  // output through the normal AppendPacket path, one block per Mix().
+  struct MixStream {
+    MixSourceSpec spec;
+    IAudioClient *client = nullptr;
+    IAudioCaptureClient *capture = nullptr;
+    HANDLE event = nullptr;
+    EnginePeriod period;
+    std::atomic<uint64_t> packets{0};
+    std::atomic<HRESULT> error{S_OK}; // set once by the capture thread
+  };
+  bool m_mixing = false;
+  std::vector<std::unique_ptr<MixStream>> m_mixStreams;
+  AudioMixer m_mixer;            // capture thread only while running
+  std::vector<float> m_mixBuf;   // one mixed block, m_bufferFrames long
+};
 
-  g_running.store(false);
+// ─── Deliver pooled packets to JS via ThreadSafeFunction ─────────────────────
 
-  // Signal the stop event so the capture loop exits WaitForMultipleObjects
-  if (g_stopEvent) {
-    SetEvent(g_stopEvent);
+// Runs on the JS thread; see PacketDelivery::Drain. A null env means the
+// TSFN was aborted by Stop(); the session may already be gone.
+static void DrainToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *s, void *) {
+  if (env == nullptr) return;
+  s->m_delivery.Drain(env, jsCallback);
+}
+
+// Runs on the JS thread with one state change:
+//   { state: "running" | "recovering" | "failed", reason?, error?, attempt,
+//     retryInMs?, pid }
+// "running" is only reported after a recovery. A null env means the TSFN is
+// being torn down; the event is still freed.
+static void StateToJS(Napi::Env env, Napi::Function jsCallback,
+                      CaptureSession *, StateEvent *e) {
+  std::unique_ptr<StateEvent> event(e);
+  if (env == nullptr) return;
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("state", CaptureStateName(e->state));
+  if (FAILED(e->error)) {
+    o.Set("reason", StreamErrorReason(e->error));
+    if (e->error != kTargetExited) o.Set("error", FormatHr("0x%08lX", e->error));
   }
+  o.Set("attempt", static_cast<double>(e->attempt));
+  if (e->state == CaptureState::Recovering)
+    o.Set("retryInMs", static_cast<double>(e->retryInMs));
+  o.Set("pid", static_cast<double>(e->pid));
+  jsCallback.Call({o});
+}
+
+// Capture thread: wake JS unless a drain is already queued.
+void CaptureSession::ScheduleDrain() {
+  m_delivery.Schedule(m_tsfn);
+}
 
-  if (g_captureThread.joinable()) {
-    g_captureThread.join();
+// Capture thread: meter one capture-format packet and pass it on.
+void CaptureSession::AppendStream(const BYTE *pData, UINT32 numFrames,
+                                  bool silent) {
+  if (m_captureFormat.Format.nChannels > 2) {
+    AppendNative(pData, numFrames, silent);
+    return;
   }
+  if (m_meter) {
+    m_levels.Process(silent ? nullptr : reinterpret_cast<const float *>(pData),
+                     numFrames);
+  }
+  if (!m_meterOnly) AppendPacket(pData, numFrames, silent);
+}
 
-  if (g_tsfn) {
-    g_tsfn->Release();
-    delete g_tsfn;
-    g_tsfn = nullptr;
+// Capture thread: one native-layout packet. Passed through as is, or
+// downmixed to stereo block by block for the meter and the rest of the
+// pipeline; a block's frames keep their own capture time.
+void CaptureSession::AppendNative(const BYTE *pData, UINT32 numFrames,
+                                  bool silent) {
+  if (m_passthrough) {
+    if (!m_meterOnly) AppendCaptured(pData, numFrames, silent);
+    if (!m_meter) return;
   }
+  const UINT32 channels = m_captureFormat.Format.nChannels;
+  const float *src = silent ? nullptr : reinterpret_cast<const float *>(pData);
+  const uint64_t packetQpc = m_packetQpc;
+  const uint64_t packetPosition = m_packetPosition;
+  UINT32 done = 0;
+  while (done < numFrames) {
+    const UINT32 left = numFrames - done;
+    const UINT32 n = left < m_downmixFrames ? left : m_downmixFrames;
+    const float *stereo = nullptr;
+    if (src) {
+      m_downmix.Process(src + static_cast<size_t>(done) * channels, n,
+                        m_downmixBuf.data());
+      stereo = m_downmixBuf.data();
+    }
+    if (m_meter) m_levels.Process(stereo, n);
+    if (!m_passthrough && !m_meterOnly) {
+      m_packetQpc = packetQpc + uint64_t(done) * 10000000 /
+                                    FormatConverter::kInRate;
+      m_packetPosition = packetPosition != Packet::kNoPosition
+                             ? packetPosition + done
+                             : Packet::kNoPosition;
+      AppendPacket(reinterpret_cast<const BYTE *>(stereo), n, silent);
+    }
+    done += n;
+  }
+  m_packetQpc = packetQpc;
+  m_packetPosition = packetPosition;
+}
 
-  if (g_captureClient) {
-    g_captureClient->Release();
-    g_captureClient = nullptr;
+// Capture thread: pass one capture-format packet on, through the noise
+// suppressor when enabled. Its frames keep their own capture time.
+void CaptureSession::AppendPacket(const BYTE *pData, UINT32 numFrames,
+                                  bool silent) {
+  if (!m_denoise) {
+    AppendCaptured(pData, numFrames, silent);
+    return;
   }
-  if (g_client) {
-    g_client->Stop();
-    g_client->Release();
-    g_client = nullptr;
+  const uint64_t packetQpc = m_packetQpc;
+  const uint64_t packetPosition = m_packetPosition;
+  const uint32_t frames = m_denoiser.Push(
+      silent ? nullptr : reinterpret_cast<const float *>(pData), numFrames,
+      [this, packetQpc, packetPosition](const float *frame, int64_t startOffset) {
+        const int64_t offset = startOffset * 10000000 / NoiseSuppressor::kSampleRate;
+        m_packetQpc = packetQpc + offset;
+        const int64_t position = static_cast<int64_t>(packetPosition) + startOffset;
+        m_packetPosition = packetPosition != Packet::kNoPosition && position >= 0
+                               ? static_cast<uint64_t>(position)
+                               : Packet::kNoPosition;
+        AppendCaptured(reinterpret_cast<const BYTE *>(frame),
+                       NoiseSuppressor::kFrameFrames, false);
+      });
+  m_packetQpc = packetQpc;
+  m_packetPosition = packetPosition;
+  if (frames > 0) {
+    m_stats.denoisedFrames.fetch_add(frames, std::memory_order_relaxed);
+    m_stats.voiceProbability.store(
+        static_cast<uint32_t>(m_denoiser.VoiceProbability() * 1000.0f + 0.5f),
+        std::memory_order_relaxed);
   }
+}
 
-  // Clean up event handles
-  if (g_bufferEvent) {
-    CloseHandle(g_bufferEvent);
-    g_bufferEvent = nullptr;
+// Capture thread: convert one WASAPI packet to the output format (when it
+// differs from the capture format) and pass it on.
+void CaptureSession::AppendCaptured(const BYTE *pData, UINT32 numFrames,
+                                    bool silent) {
+  if (m_suppressSilence) {
+    const uint32_t channels = m_passthrough ? m_format.channels : 2;
+    if (silent || IsSilent(reinterpret_cast<const float *>(pData),
+                           static_cast<size_t>(numFrames) * channels,
+                           m_silenceThreshold)) {
+      SuppressSilence(numFrames);
+      return;
+    }
+    m_chunker.FlushSilence(); // the run ends before this packet's audio
   }
-  if (g_stopEvent) {
-    CloseHandle(g_stopEvent);
-    g_stopEvent = nullptr;
+  if (!m_convert) {
+    AppendOutput(silent ? nullptr : pData, numFrames);
+    return;
+  }
+  const float *src = silent ? nullptr : reinterpret_cast<const float *>(pData);
+  while (numFrames > 0) {
+    UINT32 n = numFrames < m_convertFrames ? numFrames : m_convertFrames;
+    uint32_t outFrames = m_converter.Process(src, n, m_convertBuf.data());
+    AppendOutput(m_convertBuf.data(), outFrames);
+    if (src) src += n * 2;
+    numFrames -= n;
   }
+}
 
-  g_eventDriven = false;
+// Capture thread: hand output-format frames (nullptr = silence) to the Opus
+// encoder or the current chunk.
+void CaptureSession::AppendOutput(const uint8_t *src, uint32_t frames) {
+  m_recorder.Write(src, frames);
+  if (!m_opus) {
+    m_chunker.Append(src, static_cast<size_t>(frames) * m_format.channels,
+                     src == nullptr, m_packetQpc, m_packetPosition);
+    return;
+  }
+  const uint32_t failures = m_encoder.Push(
+      reinterpret_cast<const float *>(src), frames,
+      [this](const uint8_t *packet, uint32_t bytes) {
+        AppendEncoded(packet, bytes);
+      });
+  if (failures > 0)
+    m_stats.encodeErrors.fetch_add(failures, std::memory_order_relaxed);
+}
 
-  return info.Env().Undefined();
+// Capture thread: publish one Opus packet in a slot of its own, so packet
+// boundaries survive to JS.
+void CaptureSession::AppendEncoded(const uint8_t *packet, uint32_t bytes) {
+  Packet *p = m_pool.Acquire();
+  if (!p) {
+    m_droppedCount.fetch_add(1);
+    return;
+  }
+  memcpy(p->data, packet, bytes);
+  p->count = bytes;
+  p->captureQpc = m_packetQpc;
+  p->devicePosition = m_packetPosition;
+  m_pool.Publish(p);
+  m_stats.encodedPackets.fetch_add(1, std::memory_order_relaxed);
+  m_stats.encodedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// Capture thread: account for a silent packet without copying it. The
+// converter still runs (on nullptr input) to keep the resampler phase
+// and output frame count exact; its output is discarded.
+void CaptureSession::SuppressSilence(UINT32 numFrames) {
+  uint32_t outFrames = numFrames;
+  if (m_convert) {
+    outFrames = 0;
+    while (numFrames > 0) {
+      UINT32 n = numFrames < m_convertFrames ? numFrames : m_convertFrames;
+      outFrames += m_converter.Process(nullptr, n, m_convertBuf.data());
+      numFrames -= n;
+    }
+  }
+  m_recorder.Write(nullptr, outFrames);
+  m_chunker.Silence(outFrames, m_packetQpc, m_packetPosition);
 }
 
-static Napi::Value OnData(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
-  Napi::Function cb = info[0].As<Napi::Function>();
 
-  if (g_tsfn) {
-    g_tsfn->Release();
-    delete g_tsfn;
+// ─── Drain all available packets from WASAPI buffer ────────────────────────────
+// Returns: -1 on error, 0+ = number of packets drained
+
+int CaptureSession::DrainPackets() {
+  const LONGLONG drainStart = QpcNow();
+  // Mid-retarget, the incoming stream is buffered first so this drain's
+  // packets have something to fade into
+  RetargetStream *retarget = m_retarget.load(std::memory_order_acquire);
+  if (retarget && !DrainIncoming(*retarget)) {
+    EndRetarget(*retarget, RetargetStream::Result::Aborted);
+    retarget = nullptr;
+  }
+  UINT32 packetLength = 0;
+  HRESULT hr = m_captureClient->GetNextPacketSize(&packetLength);
+  if (FAILED(hr)) {
+    m_streamError = hr;
+    return -1;
   }
 
-  g_tsfn = new Napi::ThreadSafeFunction(
-      Napi::ThreadSafeFunction::New(env, cb, "AudioCaptureData", 0, 1));
+  int count = 0;
+  while (packetLength > 0) {
+    BYTE *pData = nullptr;
+    UINT32 numFrames = 0;
+    DWORD flags = 0;
+    UINT64 devicePosition = 0;
+    UINT64 qpcPosition = 0;
 
-  return env.Undefined();
+    hr = m_captureClient->GetBuffer(&pData, &numFrames, &flags, &devicePosition,
+                                    &qpcPosition);
+    if (FAILED(hr)) break;
+
+    m_stats.RecordPacket(numFrames, devicePosition, qpcPosition,
+                         (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0,
+                         (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) != 0,
+                         (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) != 0);
+
+    if (m_dataCount.fetch_add(1) == 0) {
+      m_firstPacketQpc.store(QpcNow(), std::memory_order_release);
+    }
+    count++;
+
+    const bool silent = (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0;
+    const bool timed = !(flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR);
+    m_packetQpc = qpcPosition != 0 && timed ? qpcPosition : CaptureClockNow();
+    m_packetPosition = timed ? devicePosition : Packet::kNoPosition;
+    if (retarget) {
+      UINT32 frames = numFrames;
+      const BYTE *mixed = Crossfade(*retarget, pData, frames, silent);
+      if (frames > 0) AppendStream(mixed, frames, false);
+    } else {
+      AppendStream(pData, numFrames, silent);
+    }
+
+    m_captureClient->ReleaseBuffer(numFrames);
+    hr = m_captureClient->GetNextPacketSize(&packetLength);
+    if (FAILED(hr)) break;
+  }
+  if (retarget && SUCCEEDED(hr) &&
+      (retarget->fadePos >= retarget->fadeFrames || retarget->lagging))
+    CompleteRetarget(*retarget);
+
+  // One wakeup per drain, however many chunks it completed
+  if (m_chunker.FlushStale(CaptureClockNow()) || m_pool.ReadyCount() > 0)
+    ScheduleDrain();
+
+  if (count > 0) {
+    m_stats.drains.fetch_add(1, std::memory_order_relaxed);
+    const LONGLONG us = (QpcNow() - drainStart) * 1000000 / QpcFrequency();
+    m_stats.drainDuration.Record(static_cast<uint32_t>(us));
+  }
+  if (FAILED(hr)) m_streamError = hr;
+  return FAILED(hr) ? -1 : count;
 }
 
-static Napi::Value HwndToPid(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
-  HWND hwnd = reinterpret_cast<HWND>(
-      static_cast<uintptr_t>(info[0].As<Napi::Number>().Int64Value()));
-  DWORD pid = 0;
-  GetWindowThreadProcessId(hwnd, &pid);
-  return Napi::Number::New(env, static_cast<double>(pid));
+// ─── Mix mode: drain every source into the mixer ───────────────────────────────
+// A source whose stream fails (its device was removed, say) is dropped from
+// the mix; the session only fails once every source has.
+// Returns: -1 when no source is left, 0+ = number of packets drained
+
+int CaptureSession::DrainMix() {
+  const LONGLONG drainStart = QpcNow();
+  int count = 0;
+  uint32_t live = 0;
+  for (uint32_t i = 0; i < m_mixStreams.size(); i++) {
+    MixStream &s = *m_mixStreams[i];
+    if (FAILED(s.error.load(std::memory_order_relaxed))) continue;
+
+    UINT32 packetLength = 0;
+    HRESULT hr = s.capture->GetNextPacketSize(&packetLength);
+    while (SUCCEEDED(hr) && packetLength > 0) {
+      BYTE *pData = nullptr;
+      UINT32 numFrames = 0;
+      DWORD flags = 0;
+      UINT64 devicePosition = 0;
+      UINT64 qpcPosition = 0;
+      hr = s.capture->GetBuffer(&pData, &numFrames, &flags, &devicePosition,
+                                &qpcPosition);
+      if (FAILED(hr)) break;
+
+      const bool silent = (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0;
+      if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+        m_stats.discontinuities.fetch_add(1, std::memory_order_relaxed);
+      if (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) {
+        m_stats.timestampErrors.fetch_add(1, std::memory_order_relaxed);
+        qpcPosition = AudioMixer::kNoTimestamp;
+      }
+      m_mixer.Write(i, silent ? nullptr : reinterpret_cast<const float *>(pData),
+                    numFrames, qpcPosition);
+      s.capture->ReleaseBuffer(numFrames);
+      s.packets.fetch_add(1, std::memory_order_relaxed);
+      count++;
+
+      // Mix as we go, so a burst from one source never outruns the rings
+      MixOut();
+      hr = s.capture->GetNextPacketSize(&packetLength);
+    }
+    if (FAILED(hr)) {
+      s.error.store(hr, std::memory_order_relaxed);
+      m_streamError = hr;
+      continue;
+    }
+    live++;
+  }
+
+  if (m_chunker.FlushStale(CaptureClockNow()) || m_pool.ReadyCount() > 0)
+    ScheduleDrain();
+
+  if (count > 0) {
+    m_stats.drains.fetch_add(1, std::memory_order_relaxed);
+    const LONGLONG us = (QpcNow() - drainStart) * 1000000 / QpcFrequency();
+    m_stats.drainDuration.Record(static_cast<uint32_t>(us));
+  }
+  return live > 0 ? count : -1;
 }
 
-static Napi::Value GetError(const Napi::CallbackInfo &info) {
-  return Napi::String::New(info.Env(), g_lastError);
+// Capture thread: run every block the mixer can emit through the single-
+// stream output path. Each block counts as one packet in the stats.
+void CaptureSession::MixOut() {
+  const uint32_t maxFrames = static_cast<uint32_t>(m_mixBuf.size() / 2);
+  while (uint32_t frames = m_mixer.Mix(m_mixBuf.data(), maxFrames)) {
+    m_stats.packets.fetch_add(1, std::memory_order_relaxed);
+    m_stats.frames.fetch_add(frames, std::memory_order_relaxed);
+    if (m_dataCount.fetch_add(1) == 0) {
+      m_firstPacketQpc.store(QpcNow(), std::memory_order_release);
+    }
+    // The mixer keeps no per-block capture time; count from the mix. The
+    // sources' device positions don't add up to one.
+    m_packetQpc = CaptureClockNow();
+    m_packetPosition = Packet::kNoPosition;
+    if (m_meter) m_levels.Process(m_mixBuf.data(), frames);
+    if (!m_meterOnly) {
+      AppendPacket(reinterpret_cast<const BYTE *>(m_mixBuf.data()), frames,
+                   false);
+    }
+  }
 }
 
-static Napi::Value GetDataCount(const Napi::CallbackInfo &info) {
-  return Napi::Number::New(info.Env(), static_cast<double>(g_dataCount.load()));
+// ─── Capture: serviced on a shared capture thread ──────────────────────────────
+//
+// Event-driven sessions are woken by their buffer event (every source's, in
+// mix mode); polling-mode ones by the capture thread's shared poll timer,
+// paced at the device period.
+// No silence injection: the AudioWorklet ring buffer outputs zeros on
+// underrun, and audio resumes instantly when data arrives. An include-mode
+// target's process handle is waited on last, to notice it exiting.
+
+static_assert(AudioMixer::kMaxSources + 1 <= CaptureTask::kMaxHandles,
+              "a mix and its target process must fit one task's handles");
+
+DWORD CaptureSession::StreamHandles() const {
+  if (m_mixing) return static_cast<DWORD>(m_mixStreams.size());
+  return m_eventDriven ? 1 : 0;
 }
 
-static Napi::Value IsRunning(const Napi::CallbackInfo &info) {
-  return Napi::Boolean::New(info.Env(), g_running.load());
+DWORD CaptureSession::WaitHandles(HANDLE *out) const {
+  DWORD count = 0;
+  if (m_mixing) {
+    for (auto &s : m_mixStreams) out[count++] = s->event;
+  } else if (m_eventDriven) {
+    out[count++] = m_bufferEvent;
+  }
+  if (m_targetProcess) out[count++] = m_targetProcess;
+  return count;
+}
+
+// Poll once per device period, so every poll finds about one packet. The
+// endpoint may not report one; 10 ms is the shared-mode default.
+LONGLONG CaptureSession::PollPeriod() const {
+  if (m_eventDriven) return 0;
+  if (m_period.currentFrames == 0) return CaptureThread::kMaxPollPeriod;
+  return static_cast<LONGLONG>(m_period.currentFrames) * 10000000 /
+         CaptureFormat().Format.nSamplesPerSec;
+}
+
+// While a partial chunk or a silent run is pending, wake up in time to
+// flush it.
+LONGLONG CaptureSession::DeadlineQpc() const {
+  const uint64_t deadline = m_chunker.Deadline();
+  return deadline ? QpcFrom100ns(deadline) : 0;
+}
+
+// Returns S_OK to stay attached, else why the stream failed.
+HRESULT CaptureSession::Service(DWORD index) {
+  if (index == CaptureTask::kTick) {
+    if (!m_eventDriven) return DrainPackets() < 0 ? m_streamError : S_OK;
+    if (m_chunker.FlushStale(CaptureClockNow())) ScheduleDrain();
+    return S_OK;
+  }
+  if (index >= StreamHandles())
+    return m_retargeting.load(std::memory_order_relaxed) ? S_OK : kTargetExited;
+  return (m_mixing ? DrainMix() : DrainPackets()) < 0 ? m_streamError : S_OK;
+}
+
+// Recovery waits out backoff and re-activation, so it leaves the shared
+// thread for one of the session's own, which re-attaches the recovered
+// stream. An earlier one has finished but for returning from its attach;
+// the new thread joins it, since a capture-thread callback must not block.
+void CaptureSession::Detached(HRESULT hr) {
+  if (m_retargeting.load()) {
+    m_retargetDetached.store(true);
+    RetargetStream *r = m_retarget.load(std::memory_order_acquire);
+    if (r) EndRetarget(*r, RetargetStream::Result::Aborted);
+  }
+  std::thread previous = std::move(m_thread);
+  m_thread = std::thread(&CaptureSession::RecoveryLoop, this, hr,
+                         std::move(previous));
+}
+
+// Joining m_thread therefore joins every recovery before it.
+void CaptureSession::RecoveryLoop(HRESULT hr, std::thread previous) {
+  if (previous.joinable()) previous.join();
+  // Recovery activates clients from this thread
+  CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+  if (WaitForSingleObject(m_stopEvent, 0) != WAIT_OBJECT_0 && Recover(hr)) {
+    // Under m_attachMutex, a Stop() already under way can't miss it
+    std::lock_guard<std::mutex> lock(m_attachMutex);
+    CaptureThreadInfo info;
+    std::string err;
+    if (m_running.load() && !AttachToService(info, err)) {
+      SetLastError(err);
+      EmitState(CaptureState::Failed, E_OUTOFMEMORY, 0, 0);
+    }
+  }
+  CoUninitialize();
+}
+
+// Put the session on a capture thread of its MMCSS class.
+bool CaptureSession::AttachToService(CaptureThreadInfo &info,
+                                     std::string &err) {
+  if (!CaptureService::Instance().Attach(this, m_mmcssTask, m_mmcssPriority,
+                                         info, err))
+    return false;
+  m_threadHandle.store(info.thread);
+  return true;
+}
+
+// ─── Recovery (session recovery thread) ────────────────────────────────────────
+
+// Bring a failed stream back for the same target, backing off between
+// attempts. Returns false once stopped, or after reporting the session
+// failed.
+bool CaptureSession::Recover(HRESULT hr) {
+  // Deliver what was captured up to the failure
+  m_chunker.FlushSilence();
+  m_chunker.FlushChunk();
+  if (m_pool.ReadyCount() > 0) ScheduleDrain();
+
+  // A mix already outlives its failed sources; it ends with the last one
+  if (!m_recover || m_mixing) {
+    EmitState(CaptureState::Failed, hr, 0, 0);
+    return false;
+  }
+
+  if (TargetExited()) hr = kTargetExited;
+  const LONGLONG exitQpc = hr == kTargetExited ? QpcNow() : 0;
+  uint32_t attempt = 1;
+  for (;; attempt++) {
+    if (!IsRecoverableStreamError(hr) && attempt > kMaxRecoveryAttempts) break;
+    if (exitQpc != 0 && (QpcNow() - exitQpc) * 1000 / QpcFrequency() >=
+                            static_cast<LONGLONG>(kProcessRestartWaitMs))
+      break;
+
+    const DWORD shift = attempt - 1 < 16 ? attempt - 1 : 16;
+    DWORD delay = kRecoveryBaseDelayMs << shift;
+    if (delay > kRecoveryMaxDelayMs) delay = kRecoveryMaxDelayMs;
+    EmitState(CaptureState::Recovering, hr, attempt, delay);
+    if (WaitForSingleObject(m_stopEvent, delay) == WAIT_OBJECT_0) return false;
+
+    m_stats.recoveryAttempts.fetch_add(1, std::memory_order_relaxed);
+    if (TargetExited() && !FollowRestartedTarget()) continue;
+    const HRESULT reopened = Reopen();
+    if (SUCCEEDED(reopened)) {
+      m_stats.recoveries.fetch_add(1, std::memory_order_relaxed);
+      EmitState(CaptureState::Running, hr, attempt, 0);
+      return true;
+    }
+    // An exited target keeps its restart window; anything else is now
+    // classified by what the fresh client ran into
+    if (hr != kTargetExited) hr = reopened;
+  }
+  EmitState(CaptureState::Failed, hr, attempt - 1, 0);
+  return false;
+}
+
+// Replace the failed client with a fresh one for m_targetPid, in the mode
+// the session started in. Events, pool and the output pipeline carry over.
+HRESULT CaptureSession::Reopen() {
+  if (m_captureClient) {
+    m_captureClient->Release();
+    m_captureClient = nullptr;
+  }
+  if (m_client) {
+    m_client->Stop();
+    m_client->Release();
+    m_client = nullptr;
+  }
+  const HRESULT hr =
+      OpenStream(m_targetPid, m_targetExclude, &m_client, &m_captureClient);
+  if (FAILED(hr)) return hr;
+  return m_client->Start();
+}
+
+// Activate and initialize a client for pid the way the running stream was:
+// same format, period and wakeups (m_bufferEvent, when event-driven). Not
+// started. On failure, whatever was created is released. Activation gives up
+// if cancel (optional) is signaled.
+HRESULT CaptureSession::OpenStream(DWORD pid, bool excludeMode,
+                                   IAudioClient **client,
+                                   IAudioCaptureClient **capture,
+                                   HANDLE cancel) {
+  *capture = nullptr;
+  const char *step = "";
+  HRESULT hr = ActivateLoopback(pid, excludeMode, client, &step, cancel);
+  if (FAILED(hr)) return hr;
+
+  const WAVEFORMATEX &fmt = m_captureFormat.Format;
+  DWORD flags = AUDCLNT_STREAMFLAGS_LOOPBACK;
+  if (m_eventDriven) flags |= AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+  bool attempted = false;
+  if (m_period.lowLatency) {
+    EnginePeriod period;
+    hr = InitializeLowLatency(*client, flags, fmt, period, &attempted);
+  }
+  // Once the low-latency init ran, a failed client can't be initialized
+  // again; the caller's next attempt gets a fresh one
+  if (!m_period.lowLatency || (FAILED(hr) && !attempted)) {
+    hr = (*client)->Initialize(AUDCLNT_SHAREMODE_SHARED, flags, 200000, 0,
+                               &fmt, nullptr);
+  }
+  if (SUCCEEDED(hr) && m_eventDriven) hr = (*client)->SetEventHandle(m_bufferEvent);
+  if (SUCCEEDED(hr)) {
+    hr = (*client)->GetService(__uuidof(IAudioCaptureClient),
+                               (void **)capture);
+  }
+  if (FAILED(hr)) {
+    (*client)->Release();
+    *client = nullptr;
+  }
+  return hr;
+}
+
+bool CaptureSession::TargetExited() const {
+  return m_targetProcess &&
+         WaitForSingleObject(m_targetProcess, 0) == WAIT_OBJECT_0;
+}
+
+// Retarget to a restarted instance of the exited target's executable.
+bool CaptureSession::FollowRestartedTarget() {
+  if (m_targetImage.empty()) return false;
+  const DWORD pid = FindProcessByImage(m_targetImage, m_targetPid);
+  if (pid == 0) return false;
+  HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+  if (!process) return false;
+  CloseHandle(m_targetProcess);
+  m_targetProcess = process;
+  m_targetPid = pid;
+  return true;
+}
+
+// Worker thread, see Hot-swapping the target.
+bool CaptureSession::Retarget(DWORD pid, bool excludeMode, std::string &err) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_running.load()) {
+    err = "Capture not running";
+    return false;
+  }
+  if (m_mixing) {
+    err = "A mix can't be retargeted";
+    return false;
+  }
+  if (m_state.load() != CaptureState::Running) {
+    err = "Capture is recovering";
+    return false;
+  }
+  if (Interrupted()) {
+    err = "Capture stopped";
+    return false;
+  }
+
+  CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+  RetargetStream r;
+  r.pid = pid;
+  r.excludeMode = excludeMode;
+  HRESULT hr =
+      OpenStream(pid, excludeMode, &r.client, &r.capture, m_cancelEvent);
+  if (FAILED(hr)) {
+    err = hr == E_ABORT ? "Capture stopped"
+                        : FormatHr("Retarget activation failed: 0x%08lX", hr);
+    m_stats.retargetFailures.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (!excludeMode) {
+    r.process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (m_recover) r.image = ProcessImagePath(pid);
+  }
+  const uint32_t channels = m_captureFormat.Format.nChannels;
+  const uint32_t rate = m_captureFormat.Format.nSamplesPerSec;
+  r.pending.assign(static_cast<size_t>(rate) * kRetargetMaxLagMs / 1000 * channels,
+                   0.0f);
+  r.mixed.assign(static_cast<size_t>(m_bufferFrames) * channels, 0.0f);
+  r.fadeFrames = rate * kRetargetFadeMs / 1000;
+  r.done = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+  hr = r.done ? r.client->Start() : E_OUTOFMEMORY;
+
+  if (SUCCEEDED(hr)) {
+    m_retargetDetached.store(false);
+    m_retargeting.store(true);
+    m_retarget.store(&r, std::memory_order_release);
+    // A stop cuts the crossfade short; it is undone like a timeout
+    const HANDLE handles[] = {r.done, m_cancelEvent};
+    WaitForMultipleObjects(2, handles, FALSE, kRetargetTimeoutMs);
+
+    // Re-attach for the new wait set, unless a failed stream is already in
+    // recovery, which attaches once this lets go of m_attachMutex
+    std::lock_guard<std::mutex> attach(m_attachMutex);
+    if (!m_retargetDetached.load()) {
+      CaptureService::Instance().Detach(this);
+      // Timed out: the capture thread is off the session now
+      if (m_retarget.exchange(nullptr) == &r)
+        r.result.store(RetargetStream::Result::Aborted);
+      if (!m_retargetDetached.load() && m_running.load()) {
+        CaptureThreadInfo info;
+        std::string attachErr;
+        if (AttachToService(info, attachErr)) {
+          m_captureThreadId = info.threadId;
+          m_highResTimer = info.highResTimer;
+        } else {
+          SetLastError(attachErr);
+          EmitState(CaptureState::Failed, E_OUTOFMEMORY, 0, 0);
+        }
+      }
+    }
+    m_retargeting.store(false);
+  }
+
+  // Whichever client is left over: the old target's, or the new one
+  if (r.client) r.client->Stop();
+  if (r.capture) r.capture->Release();
+  if (r.client) r.client->Release();
+  if (r.process) CloseHandle(r.process);
+  if (r.done) CloseHandle(r.done);
+
+  if (r.result.load() == RetargetStream::Result::Done) {
+    m_stats.retargets.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  m_stats.retargetFailures.fetch_add(1, std::memory_order_relaxed);
+  if (FAILED(hr)) {
+    err = FormatHr("Retarget start failed: 0x%08lX", hr);
+  } else if (FAILED(r.error)) {
+    err = FormatHr("Retarget stream failed: 0x%08lX", r.error);
+  } else if (m_retargetDetached.load()) {
+    err = "Capture failed during retarget";
+  } else {
+    err = Interrupted() ? "Capture stopped" : "Retarget timed out";
+  }
+  return false;
+}
+
+// Capture thread: buffer the incoming stream's packets behind the ones not
+// yet mixed. False if its stream failed.
+bool CaptureSession::DrainIncoming(RetargetStream &r) {
+  const uint32_t channels = m_captureFormat.Format.nChannels;
+  const uint32_t capacity = static_cast<uint32_t>(r.pending.size() / channels);
+  if (r.pendingStart > 0 && r.pendingFrames > 0) {
+    memmove(r.pending.data(),
+            r.pending.data() + static_cast<size_t>(r.pendingStart) * channels,
+            static_cast<size_t>(r.pendingFrames) * channels * sizeof(float));
+  }
+  r.pendingStart = 0;
+
+  UINT32 packetLength = 0;
+  HRESULT hr = r.capture->GetNextPacketSize(&packetLength);
+  while (SUCCEEDED(hr) && packetLength > 0) {
+    BYTE *pData = nullptr;
+    UINT32 numFrames = 0;
+    DWORD flags = 0;
+    hr = r.capture->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr);
+    if (FAILED(hr)) break;
+    UINT32 n = numFrames;
+    if (n > capacity - r.pendingFrames) {
+      n = capacity - r.pendingFrames;
+      r.lagging = true;
+    }
+    float *dst = r.pending.data() + static_cast<size_t>(r.pendingFrames) * channels;
+    const size_t bytes = static_cast<size_t>(n) * channels * sizeof(float);
+    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+      memset(dst, 0, bytes);
+    } else {
+      memcpy(dst, pData, bytes);
+    }
+    r.pendingFrames += n;
+    r.capture->ReleaseBuffer(numFrames);
+    hr = r.capture->GetNextPacketSize(&packetLength);
+  }
+  if (FAILED(hr)) r.error = hr;
+  return SUCCEEDED(hr);
+}
+
+// Capture thread: mix one packet of the current stream with as many
+// buffered incoming frames, fading the current one out. Frames past what
+// has been buffered keep the current gains, or are dropped once the fade
+// is through; numFrames becomes the frames written.
+const BYTE *CaptureSession::Crossfade(RetargetStream &r, const BYTE *pData,
+                                      UINT32 &numFrames, bool silent) {
+  constexpr float kHalfPi = 1.57079633f;
+  const uint32_t channels = m_captureFormat.Format.nChannels;
+  const float *cur = silent ? nullptr : reinterpret_cast<const float *>(pData);
+  const float *next =
+      r.pending.data() + static_cast<size_t>(r.pendingStart) * channels;
+  const uint32_t mixFrames = numFrames < r.pendingFrames ? numFrames : r.pendingFrames;
+  float *out = r.mixed.data();
+  uint32_t i = 0;
+  for (; i < numFrames; i++) {
+    const bool fading = r.fadePos < r.fadeFrames;
+    const bool mixing = i < mixFrames;
+    if (!fading && !mixing) break;
+    const float t = fading ? static_cast<float>(r.fadePos) / r.fadeFrames : 1.0f;
+    const float gCur = fading ? std::cos(t * kHalfPi) : 0.0f;
+    const float gNext = mixing ? std::sin(t * kHalfPi) : 0.0f;
+    if (fading && mixing) r.fadePos++;
+    for (uint32_t c = 0; c < channels; c++) {
+      const size_t k = static_cast<size_t>(i) * channels + c;
+      out[k] = (cur ? cur[k] * gCur : 0.0f) + (mixing ? next[k] * gNext : 0.0f);
+    }
+  }
+  numFrames = i;
+  r.pendingStart += mixFrames;
+  r.pendingFrames -= mixFrames;
+  return reinterpret_cast<const BYTE *>(out);
+}
+
+// Capture thread: the fade is through, or the current stream has stalled.
+// The incoming stream takes over, after the frames it has buffered.
+void CaptureSession::CompleteRetarget(RetargetStream &r) {
+  const uint32_t channels = m_captureFormat.Format.nChannels;
+  const uint32_t rate = m_captureFormat.Format.nSamplesPerSec;
+  const uint64_t buffered = uint64_t(r.pendingFrames) * 10000000 / rate;
+  const uint64_t now = CaptureClockNow();
+  m_packetQpc = now > buffered ? now - buffered : now;
+  m_packetPosition = Packet::kNoPosition;
+  // In blocks of at most a packet, which is what the pipeline is sized for
+  while (r.pendingFrames > 0) {
+    const UINT32 n = r.pendingFrames < m_bufferFrames ? r.pendingFrames
+                                                      : m_bufferFrames;
+    AppendStream(reinterpret_cast<const BYTE *>(
+                     r.pending.data() + static_cast<size_t>(r.pendingStart) * channels),
+                 n, false);
+    m_packetQpc += uint64_t(n) * 10000000 / rate;
+    r.pendingStart += n;
+    r.pendingFrames -= n;
+  }
+  std::swap(m_client, r.client);
+  std::swap(m_captureClient, r.capture);
+  std::swap(m_targetProcess, r.process);
+  m_targetImage.swap(r.image);
+  m_targetPid = r.pid;
+  m_targetExclude = r.excludeMode;
+  EndRetarget(r, RetargetStream::Result::Done);
+}
+
+// Capture thread: give the retarget back to the waiting worker.
+void CaptureSession::EndRetarget(RetargetStream &r,
+                                 RetargetStream::Result result) {
+  m_retarget.store(nullptr, std::memory_order_relaxed);
+  r.result.store(result);
+  SetEvent(r.done);
+}
+
+// Report a state change to the onStateChange() listener. Allocates, which
+// is fine off the packet path. A failed session stops counting as running.
+void CaptureSession::EmitState(CaptureState state, HRESULT error,
+                               uint32_t attempt, DWORD retryInMs) {
+  m_state.store(state);
+  if (state == CaptureState::Failed) {
+    SetLastError(std::string("Capture failed (") + StreamErrorReason(error) +
+                 "): " + FormatHr("0x%08lX", error));
+    m_running.store(false);
+  }
+  if (!m_stateTsfn) return;
+  auto *e = new StateEvent{state, error, attempt, retryInMs, m_targetPid};
+  if (m_stateTsfn->NonBlockingCall(e) != napi_ok) delete e;
+}
+
+// ─── Session lifecycle (JS thread) ─────────────────────────────────────────────
+
+void CaptureSession::ReleaseClient() {
+  if (m_captureClient) {
+    m_captureClient->Release();
+    m_captureClient = nullptr;
+  }
+  if (m_client) {
+    m_client->Release();
+    m_client = nullptr;
+  }
+  if (m_bufferEvent) {
+    CloseHandle(m_bufferEvent);
+    m_bufferEvent = nullptr;
+  }
+  if (m_stopEvent) {
+    CloseHandle(m_stopEvent);
+    m_stopEvent = nullptr;
+  }
+  for (auto &s : m_mixStreams) {
+    if (s->capture) s->capture->Release();
+    if (s->client) {
+      s->client->Stop();
+      s->client->Release();
+    }
+    if (s->event) CloseHandle(s->event);
+  }
+  m_mixStreams.clear();
+  if (m_targetProcess) {
+    CloseHandle(m_targetProcess);
+    m_targetProcess = nullptr;
+  }
+  m_prepared = false;
+}
+
+// A session that failed on its own has ended its thread but still holds
+// its clients; tidy up before the next Start or Prepare. Caller holds
+// m_mutex.
+void CaptureSession::ReapFailed() {
+  if (!m_thread.joinable()) return;
+  m_threadHandle.store(nullptr);
+  m_thread.join();
+  m_chunker.Discard();
+  m_recorder.Stop();
+  if (m_client) m_client->Stop();
+  ReleaseClient();
+}
+
+void CaptureSession::SetLastError(std::string msg) {
+  std::lock_guard<std::mutex> lock(m_errorMutex);
+  m_lastError = std::move(msg);
+}
+
+// Record a Start() failure and undo everything it set up so far.
+bool CaptureSession::Fail(std::string msg, std::string &err) {
+  err = msg;
+  SetLastError(std::move(msg));
+  ReleaseClient();
+  return false;
+}
+
+bool CaptureSession::BeginStart() {
+  if (m_starting || !BeginOp()) return false;
+  m_starting = true;
+  m_startQpc.store(QpcNow());
+  return true;
+}
+
+// Returns true if stop was requested while the start was pending.
+bool CaptureSession::EndStart() {
+  m_starting = false;
+  return EndOp();
+}
+
+bool CaptureSession::BeginOp() {
+  if (m_stopDeferred) return false;
+  if (m_pendingOps++ == 0) ResetEvent(m_cancelEvent);
+  return true;
+}
+
+// Returns true if stop was requested while the operation was pending. The
+// last one to end runs the deferred Stop().
+bool CaptureSession::EndOp() {
+  const bool stopped = m_stopDeferred;
+  if (--m_pendingOps == 0 && m_stopDeferred) {
+    m_stopDeferred = false;
+    Stop();
+  }
+  return stopped;
+}
+
+bool CaptureSession::DeferStop() {
+  if (m_pendingOps == 0) return false;
+  m_stopDeferred = true;
+  Interrupt();
+  return true;
+}
+
+void CaptureSession::Interrupt() { SetEvent(m_cancelEvent); }
+
+// Whether Interrupt() has asked pending operations to give up.
+bool CaptureSession::Interrupted() const {
+  return WaitForSingleObject(m_cancelEvent, 0) == WAIT_OBJECT_0;
+}
+
+// Activate and initialize an IAudioClient for pid, up to (not including)
+// IAudioClient::Start. Blocks on activation; caller holds m_mutex.
+bool CaptureSession::Activate(DWORD pid, bool excludeMode, bool lowLatency,
+                              std::string &err) {
+  m_eventDriven = false;
+  m_period = EnginePeriod();
+
+  // Ensure COM is initialized on this thread (Node/Electron may already have it)
+  CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+  // ── Activate audio interface ──
+  const char *step = "";
+  HRESULT hr = ActivateLoopback(pid, excludeMode, &m_client, &step,
+                                m_cancelEvent);
+  if (FAILED(hr)) {
+    return Fail(FormatHr((std::string(step) + ": 0x%08lX").c_str(), hr), err);
+  }
+
+  // ── Initialize audio client: 48kHz float32, stereo or the native layout ──
+  WORD channels = 2;
+  DWORD channelMask = 0x3;
+  if (m_nativeLayout && QueryRenderLayout(channels, channelMask) &&
+      channels > 2 && channels <= ChannelDownmix::kMaxChannels) {
+    m_captureFormat = CaptureFormat(channels, channelMask);
+  } else {
+    m_captureFormat = CaptureFormat();
+  }
+  const WAVEFORMATEX &fmt = m_captureFormat.Format;
+
+  REFERENCE_TIME bufferDuration = 200000; // 20ms
+
+  // ── Create event handles ──
+  m_bufferEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr); // auto-reset
+  m_stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);    // manual-reset
+
+  // ── Low latency: the engine's minimum period, event-driven only ──
+  if (lowLatency) {
+    bool attempted = false;
+    hr = InitializeLowLatency(m_client,
+                              AUDCLNT_STREAMFLAGS_LOOPBACK |
+                                  AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                              fmt, m_period, &attempted);
+    if (SUCCEEDED(hr)) hr = m_client->SetEventHandle(m_bufferEvent);
+    if (SUCCEEDED(hr)) {
+      m_eventDriven = true;
+      m_period.lowLatency = true;
+    } else if (attempted) {
+      // Fall back to the regular buffer on a fresh client
+      m_client->Release();
+      m_client = nullptr;
+      hr = ActivateLoopback(pid, excludeMode, &m_client, &step,
+                            m_cancelEvent);
+      if (FAILED(hr)) {
+        return Fail(FormatHr("Re-activation after low-latency fallback "
+                             "failed: 0x%08lX",
+                             hr),
+                    err);
+      }
+    }
+  }
+
+  // ── Try event-driven mode first ──
+  const char *fallbackError = nullptr;
+  if (!m_eventDriven) {
+    hr = m_client->Initialize(AUDCLNT_SHAREMODE_SHARED,
+                              AUDCLNT_STREAMFLAGS_LOOPBACK |
+                                  AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                              bufferDuration, 0, &fmt, nullptr);
+    if (SUCCEEDED(hr)) {
+      hr = m_client->SetEventHandle(m_bufferEvent);
+      if (SUCCEEDED(hr)) {
+        m_eventDriven = true;
+      } else {
+        // SetEventHandle failed — re-initialize without event callback
+        fallbackError = "Re-activation after event mode fallback failed: 0x%08lX";
+      }
+    } else {
+      // Event-driven init failed — fall back to polling mode
+      fallbackError = "Re-activation failed: 0x%08lX";
+    }
+  }
+
+  if (!m_eventDriven) {
+    // Re-activate the audio interface (can't reuse a failed IAudioClient)
+    m_client->Release();
+    m_client = nullptr;
+    hr = ActivateLoopback(pid, excludeMode, &m_client, &step,
+                          m_cancelEvent);
+    if (FAILED(hr)) {
+      return Fail(FormatHr(fallbackError, hr), err);
+    }
+    hr = m_client->Initialize(AUDCLNT_SHAREMODE_SHARED,
+                              AUDCLNT_STREAMFLAGS_LOOPBACK, bufferDuration, 0,
+                              &fmt, nullptr);
+  }
+
+  if (FAILED(hr)) {
+    return Fail(FormatHr("IAudioClient::Initialize: 0x%08lX", hr), err);
+  }
+  if (!m_period.lowLatency) QueryDevicePeriod(m_client, fmt.nSamplesPerSec, m_period);
+
+  // A single GetBuffer never returns more than the endpoint buffer holds
+  m_bufferFrames = 0;
+  hr = m_client->GetBufferSize(&m_bufferFrames);
+  if (FAILED(hr) || m_bufferFrames == 0) m_bufferFrames = 48000 / 50; // 20ms
+
+  hr = m_client->GetService(__uuidof(IAudioCaptureClient),
+                            (void **)&m_captureClient);
+  if (FAILED(hr)) {
+    return Fail(FormatHr("GetService: 0x%08lX", hr), err);
+  }
+
+  m_preparedPid = pid;
+  m_preparedExclude = excludeMode;
+  m_preparedLowLatency = lowLatency;
+  m_prepared = true;
+  return true;
+}
+
+// Warm the session for a likely start: the expensive activation and
+// Initialize happen now, so a matching Start() only has to call
+// IAudioClient::Start. A later Prepare or Start for another target replaces
+// the prewarmed client.
+bool CaptureSession::Prepare(DWORD pid, bool excludeMode, bool lowLatency,
+                             std::string &err) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_running.load()) {
+    err = "Capture already running";
+    return false;
+  }
+  if (Interrupted()) {
+    err = "Capture stopped";
+    return false;
+  }
+  ReapFailed();
+  if (m_prepared && m_preparedPid == pid && m_preparedExclude == excludeMode &&
+      m_preparedLowLatency == lowLatency)
+    return true;
+
+  ReleaseClient();
+  SetLastError(std::string());
+  m_nativeLayout = false;
+  return Activate(pid, excludeMode, lowLatency, err);
+}
+
+// Activate a fresh client for Start(): in the device layout if opts ask for
+// it, falling back to stereo when the stream won't take that layout.
+bool CaptureSession::ActivateForStart(DWORD pid, bool excludeMode,
+                                      const CaptureOptions &opts,
+                                      std::string &err) {
+  ReleaseClient();
+  m_nativeLayout = opts.nativeLayout;
+  if (Activate(pid, excludeMode, opts.lowLatency, err)) return true;
+  if (m_captureFormat.Format.nChannels <= 2) return false;
+  // The stream wouldn't take the device layout; capture stereo
+  const std::string nativeErr = err;
+  m_nativeLayout = false;
+  if (!Activate(pid, excludeMode, opts.lowLatency, err)) return false;
+  SetLastError("Native layout unavailable: " + nativeErr);
+  return true;
+}
+
+// Runs activation + init on the calling (worker) thread unless a matching
+// Prepare() already did, then spawns the capture loop thread.
+bool CaptureSession::Start(DWORD pid, bool excludeMode,
+                           const CaptureOptions &opts, std::string &err) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_running.load()) {
+    err = "Capture already running";
+    return false;
+  }
+  if (Interrupted()) {
+    err = "Capture stopped";
+    return false;
+  }
+  ReapFailed();
+
+  ResetForStart(opts);
+  // A prepared stream is always stereo
+  m_prewarmed = m_prepared && m_preparedPid == pid &&
+                m_preparedExclude == excludeMode &&
+                m_preparedLowLatency == opts.lowLatency && !opts.nativeLayout;
+  if (!m_prewarmed && !ActivateForStart(pid, excludeMode, opts, err))
+    return false;
+  if (!ConfigureOutput(opts, err)) return false;
+
+  HRESULT hr = m_client->Start();
+  if (FAILED(hr) && m_prewarmed) {
+    // The prewarmed stream went stale (e.g. the target's audio session was
+    // torn down); activate from scratch once. The fresh client may come up
+    // in another layout or period, so the output is configured again.
+    m_prewarmed = false;
+    if (!ActivateForStart(pid, excludeMode, opts, err) ||
+        !ConfigureOutput(opts, err))
+      return false;
+    hr = m_client->Start();
+  }
+  if (FAILED(hr)) {
+    return Fail(FormatHr("IAudioClient::Start: 0x%08lX", hr), err);
+  }
+  m_prepared = false;
+
+  // What recovery re-activates. Only an include-mode target can exit (an
+  // excluded tree is this process), which ends the stream either way.
+  m_targetPid = pid;
+  m_targetExclude = excludeMode;
+  m_targetImage.clear();
+  if (!excludeMode) {
+    m_targetProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (m_recover) m_targetImage = ProcessImagePath(pid);
+  }
+
+  return BeginCapture(opts, err);
+}
+
+// Every source gets its own event-driven stream; there is no polling
+// fallback, since one thread has to wait on all of them at once. Output
+// endpoints are captured in loopback. Each stream is opened at 48 kHz stereo
+// float32, with the audio engine converting from the device format itself.
+bool CaptureSession::StartMix(const std::vector<MixSourceSpec> &sources,
+                              const CaptureOptions &opts, std::string &err) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_running.load()) {
+    err = "Capture already running";
+    return false;
+  }
+  if (Interrupted()) {
+    err = "Capture stopped";
+    return false;
+  }
+  ReapFailed();
+
+  ResetForStart(opts);
+  m_prewarmed = false;
+  ReleaseClient();
+  m_mixing = true;
+  m_eventDriven = true;
+  m_captureFormat = CaptureFormat();
+  CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+  m_stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr); // manual-reset
+
+  m_bufferFrames = 0;
+  m_period = EnginePeriod();
+  for (uint32_t i = 0; i < sources.size(); i++) {
+    auto stream = std::make_unique<MixStream>();
+    stream->spec = sources[i];
+    m_mixStreams.push_back(std::move(stream));
+    if (!OpenMixStream(i, opts.lowLatency, err)) return false;
+  }
+
+  // The rings must hold the latency bound plus a burst of the largest buffer
+  const uint32_t framesPerMs = AudioMixer::kRate / 1000;
+  uint32_t ringFrames = kMixRingMs * framesPerMs;
+  if (ringFrames < kMixMaxLatencyMs * framesPerMs + 2 * m_bufferFrames)
+    ringFrames = kMixMaxLatencyMs * framesPerMs + 2 * m_bufferFrames;
+  m_mixer.Configure(static_cast<uint32_t>(sources.size()), ringFrames,
+                    kMixMaxLatencyMs * framesPerMs, kMixJitterMs * framesPerMs);
+  for (uint32_t i = 0; i < sources.size(); i++)
+    m_mixer.SetGain(i, sources[i].gain);
+  m_mixBuf.assign(static_cast<size_t>(m_bufferFrames) * 2, 0.0f);
+
+  if (!ConfigureOutput(opts, err)) return false;
+
+  for (uint32_t i = 0; i < m_mixStreams.size(); i++) {
+    HRESULT hr = m_mixStreams[i]->client->Start();
+    if (FAILED(hr)) {
+      return Fail(FormatHr(("Mix source " + std::to_string(i) +
+                            ": IAudioClient::Start: 0x%08lX")
+                               .c_str(),
+                           hr),
+                  err);
+    }
+  }
+
+  return BeginCapture(opts, err);
+}
+
+// Activate and initialize m_mixStreams[index]. Caller holds m_mutex.
+bool CaptureSession::OpenMixStream(uint32_t index, bool lowLatency,
+                                   std::string &err) {
+  MixStream &s = *m_mixStreams[index];
+  const std::string where = "Mix source " + std::to_string(index) + ": ";
+
+  const char *step = "";
+  DWORD flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+  auto activate = [&]() -> HRESULT {
+    if (s.spec.kind == MixSourceKind::Process)
+      return ActivateLoopback(s.spec.pid, s.spec.excludeMode, &s.client, &step,
+                              m_cancelEvent);
+    return ActivateEndpoint(s.spec.kind == MixSourceKind::Output ? eRender
+                                                                 : eCapture,
+                            s.spec.deviceId, &s.client, &step);
+  };
+  if (s.spec.kind == MixSourceKind::Process) {
+    flags |= AUDCLNT_STREAMFLAGS_LOOPBACK;
+  } else {
+    flags |= AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM |
+             AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY;
+    if (s.spec.kind == MixSourceKind::Output)
+      flags |= AUDCLNT_STREAMFLAGS_LOOPBACK;
+  }
+  HRESULT hr = activate();
+  if (FAILED(hr)) {
+    return Fail(FormatHr((where + step + ": 0x%08lX").c_str(), hr), err);
+  }
+
+  const WAVEFORMATEXTENSIBLE capture = CaptureFormat();
+  const WAVEFORMATEX &fmt = capture.Format;
+
+  // Low latency falls back per source, so one loopback client without
+  // IAudioClient3 doesn't cost the others their short period
+  bool initialized = false;
+  if (lowLatency) {
+    bool attempted = false;
+    hr = InitializeLowLatency(s.client, flags, fmt, s.period, &attempted);
+    if (SUCCEEDED(hr)) {
+      initialized = true;
+      s.period.lowLatency = true;
+    } else if (attempted) {
+      s.client->Release();
+      s.client = nullptr;
+      hr = activate();
+      if (FAILED(hr)) {
+        return Fail(FormatHr((where + step + ": 0x%08lX").c_str(), hr), err);
+      }
+    }
+  }
+  if (!initialized) {
+    REFERENCE_TIME bufferDuration = 200000; // 20ms
+    hr = s.client->Initialize(AUDCLNT_SHAREMODE_SHARED, flags, bufferDuration,
+                              0, &fmt, nullptr);
+    if (FAILED(hr)) {
+      return Fail(
+          FormatHr((where + "IAudioClient::Initialize: 0x%08lX").c_str(), hr),
+          err);
+    }
+    QueryDevicePeriod(s.client, fmt.nSamplesPerSec, s.period);
+  }
+  if (m_period.currentFrames == 0 ||
+      (s.period.currentFrames != 0 &&
+       s.period.currentFrames < m_period.currentFrames))
+    m_period = s.period;
+
+  s.event = CreateEvent(nullptr, FALSE, FALSE, nullptr); // auto-reset
+  hr = s.client->SetEventHandle(s.event);
+  if (FAILED(hr)) {
+    return Fail(FormatHr((where + "SetEventHandle: 0x%08lX").c_str(), hr), err);
+  }
+
+  UINT32 frames = 0;
+  hr = s.client->GetBufferSize(&frames);
+  if (FAILED(hr) || frames == 0) frames = AudioMixer::kRate / 50; // 20ms
+  if (frames > m_bufferFrames) m_bufferFrames = frames;
+
+  hr = s.client->GetService(__uuidof(IAudioCaptureClient),
+                            (void **)&s.capture);
+  if (FAILED(hr)) {
+    return Fail(FormatHr((where + "GetService: 0x%08lX").c_str(), hr), err);
+  }
+  return true;
+}
+
+// Clear the previous run's counters and error ahead of a start.
+void CaptureSession::ResetForStart(const CaptureOptions &opts) {
+  SetLastError(std::string());
+  m_dataCount.store(0);
+  m_droppedCount.store(0);
+  m_firstPacketQpc.store(0);
+  m_stats.Reset();
+  m_levels.Reset();
+  m_meter = opts.meter;
+  m_meterOnly = opts.meterOnly;
+  m_mixing = false;
+  m_lowLatencyRequested = opts.lowLatency;
+  m_recover = opts.recover;
+  m_streamError = S_OK;
+  m_state.store(CaptureState::Running);
+}
+
+// Set up conversion, encoding, the packet pool, chunking and silence
+// suppression for packets of up to m_bufferFrames capture frames.
+bool CaptureSession::ConfigureOutput(const CaptureOptions &opts,
+                                     std::string &err) {
+  // ── Output format conversion ──
+  // Packets are converted in blocks of at most one endpoint buffer.
+  m_format = opts.format;
+  const UINT32 captureChannels = m_captureFormat.Format.nChannels;
+  m_passthrough = opts.passthrough && captureChannels > 2;
+  if (m_passthrough) m_format.channels = captureChannels;
+  m_convert = !m_passthrough && m_format != OutputFormat();
+  if (captureChannels > 2) {
+    if (!m_downmix.Configure(m_captureFormat.dwChannelMask, captureChannels,
+                             opts.downmixGains)) {
+      return Fail("Unsupported capture layout: " +
+                      std::to_string(captureChannels) + " channels",
+                  err);
+    }
+    m_downmixFrames = m_bufferFrames;
+    m_downmixBuf.assign(static_cast<size_t>(m_bufferFrames) * 2, 0.0f);
+  }
+  uint32_t bufferOutFrames = m_bufferFrames;
+  if (m_convert) {
+    if (!m_converter.Configure(m_format, m_bufferFrames)) {
+      return Fail("Unsupported output format: " +
+                      std::to_string(m_format.sampleRate) + " Hz",
+                  err);
+    }
+    m_convertFrames = m_bufferFrames;
+    bufferOutFrames = m_converter.MaxOutFrames(m_bufferFrames);
+    m_convertBuf.assign(static_cast<size_t>(bufferOutFrames) *
+                            m_format.BytesPerFrame(),
+                        0);
+  }
+  m_opus = opts.opus;
+  m_opusSettings = opts.opusSettings;
+  if (m_opus) {
+    std::string encErr;
+    if (!m_encoder.Configure(m_format.sampleRate, m_format.channels,
+                             m_opusSettings, encErr)) {
+      return Fail(encErr, err);
+    }
+  }
+
+  m_denoise = opts.noiseSuppression && !m_meterOnly;
+  if (m_denoise) {
+    std::string nsErr;
+    if (!m_denoiser.Configure(nsErr)) return Fail(nsErr, err);
+  }
+
+  // ── Size the packet pool from the negotiated buffer ──
+  // One slot per buffer-worth of output samples avoids splitting packets.
+  // Lent slots come back on GC rather than right after the callback, so
+  // zero-copy gets the whole slab to ride out collection latency.
+  // Opus slots hold one encoded packet each; meter-only sessions never
+  // publish, so they get a token pool.
+  const uint32_t slots =
+      opts.zeroCopy ? PacketPool::kMaxSlots : PacketPool::kDefaultSlots;
+  const bool poolOk =
+      m_meterOnly ? m_pool.Init(1, 1)
+      : m_opus    ? m_pool.Init(slots, OpusFrameEncoder::kMaxPacketBytes, 1)
+                  : m_pool.Init(slots,
+                                (opts.chunkFrames + bufferOutFrames) *
+                                    m_format.channels,
+                                m_format.BytesPerSample());
+  if (!poolOk) {
+    return Fail("Failed to allocate packet pool", err);
+  }
+  m_delivery.Configure(opts.zeroCopy, opts.queuePolicy, opts.maxQueueMs,
+                       m_format.sampleRate, m_format.channels,
+                       static_cast<uint32_t>(uint64_t(m_format.sampleRate) *
+                                             m_opusSettings.frameUs / 1000000));
+  m_chunker.Configure(opts.chunkFrames, m_format.channels, m_format.sampleRate);
+  m_suppressSilence = opts.suppressSilence;
+  m_silenceThreshold = opts.silenceThreshold;
+  m_recorder.Configure(m_format, m_meterOnly ? 0 : opts.replaySeconds);
+  return true;
+}
+
+// Hand the session to a shared capture thread once every stream is running.
+// A thread is registered with MMCSS before it takes sessions, so the result
+// can be reported.
+bool CaptureSession::BeginCapture(const CaptureOptions &opts,
+                                  std::string &err) {
+  m_mmcssTask = opts.mmcssTask;
+  m_mmcssPriority = opts.mmcssPriority;
+  // Capture goes ahead without a replay ring the writer can't back
+  std::string recErr;
+  if (!m_recorder.Start(recErr)) SetLastError("Replay disabled: " + recErr);
+  m_running.store(true);
+  CaptureThreadInfo info;
+  std::string attachErr;
+  if (!AttachToService(info, attachErr)) {
+    m_running.store(false);
+    m_recorder.Stop();
+    if (m_client) m_client->Stop();
+    return Fail(attachErr, err);
+  }
+  m_mmcssRegistered = info.mmcssRegistered;
+  m_mmcssTaskIndex = info.mmcssTaskIndex;
+  m_mmcssError = info.mmcssError;
+  m_captureThreadId = info.threadId;
+  m_highResTimer = info.highResTimer;
+
+  if (m_mmcssError) {
+    SetLastError(FormatHr(m_mmcssRegistered
+                              ? "AvSetMmThreadPriority: 0x%08lX"
+                              : "AvSetMmThreadCharacteristics: 0x%08lX",
+                          HRESULT_FROM_WIN32(m_mmcssError)));
+  }
+  return true;
+}
+
+void CaptureSession::Stop() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_running.store(false);
+
+  // Signal the stop event so a recovery in progress gives up its backoff
+  if (m_stopEvent) {
+    SetEvent(m_stopEvent);
+  }
+
+  // Off the capture thread, then wait out any recovery
+  {
+    std::lock_guard<std::mutex> attach(m_attachMutex);
+    CaptureService::Instance().Detach(this);
+  }
+  m_threadHandle.store(nullptr);
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+  m_chunker.Discard(); // an unflushed partial chunk goes with the pool
+  m_recorder.Stop();  // finishes an open recording with what was teed
+
+  // Abort rather than release: a drain still queued must not run against a
+  // session that may be destroyed right after this.
+  if (m_tsfn) {
+    m_tsfn->Abort();
+    delete m_tsfn;
+    m_tsfn = nullptr;
+  }
+
+  if (m_client) m_client->Stop();
+  ReleaseClient();
+
+  m_eventDriven = false;
+}
+
+// StartRecording() holds m_mutex, so a recording can't start under a
+// concurrent Start() or Stop(). StopRecording() waits on the writer, so it
+// relies on the recorder's own lock instead of stalling a Stop() behind it.
+bool CaptureSession::StartRecording(const std::wstring &path,
+                                    const RecordSettings &settings,
+                                    std::string &err) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_running.load()) {
+    err = "Capture not running";
+    return false;
+  }
+  if (m_meterOnly) {
+    err = "A meterOnly session has no output to record";
+    return false;
+  }
+  if (m_passthrough) {
+    err = "Multichannel passthrough can't be recorded";
+    return false;
+  }
+  return m_recorder.BeginRecording(path, settings, err);
+}
+
+bool CaptureSession::StopRecording(RecordResult &result, std::string &err) {
+  return m_recorder.EndRecording(result, err);
+}
+
+void CaptureSession::SetStateCallback(Napi::Env env, Napi::Function cb) {
+  if (m_stateTsfn) {
+    m_stateTsfn->Release();
+    delete m_stateTsfn;
+  }
+
+  // Unbounded queue: state changes are rare and none may be dropped. The
+  // listener alone doesn't keep the event loop alive.
+  m_stateTsfn =
+      new StateTsfn(StateTsfn::New(env, cb, "AudioCaptureState", 0, 1, this));
+  m_stateTsfn->Unref(env);
+}
+
+// JS thread. A failed capture clears m_running after its last drain.
+bool CaptureSession::SetCallback(Napi::Env env, Napi::Function cb) {
+  if (m_starting || m_running.load()) return false;
+  if (m_tsfn) {
+    m_tsfn->Release();
+    delete m_tsfn;
+  }
+
+  // maxQueueSize 1: ScheduleDrain never queues more than one call
+  m_tsfn = new DrainTsfn(DrainTsfn::New(env, cb, "AudioCaptureData", 1, 1, this));
+  return true;
+}
+
+// { lowLatency, periodFrames, defaultPeriodFrames, fundamentalPeriodFrames,
+//   minPeriodFrames, maxPeriodFrames }, 0 for whatever wasn't reported
+static Napi::Object PeriodToJS(Napi::Env env, const EnginePeriod &p) {
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("lowLatency", p.lowLatency);
+  o.Set("periodFrames", static_cast<double>(p.currentFrames));
+  o.Set("defaultPeriodFrames", static_cast<double>(p.defaultFrames));
+  o.Set("fundamentalPeriodFrames", static_cast<double>(p.fundamentalFrames));
+  o.Set("minPeriodFrames", static_cast<double>(p.minFrames));
+  o.Set("maxPeriodFrames", static_cast<double>(p.maxFrames));
+  return o;
+}
+
+// { channels, channelMask, speakers, mode }: what the stream was opened
+// with. mode is "stereo" when the engine did the downmix, else "downmix" or
+// "passthrough".
+Napi::Object CaptureSession::CaptureFormatToJS(Napi::Env env) const {
+  const WAVEFORMATEX &fmt = m_captureFormat.Format;
+  const DWORD mask = fmt.nChannels > 2 ? m_captureFormat.dwChannelMask
+                                       : ChannelDownmix::DefaultMask(2);
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("sampleRate", static_cast<double>(fmt.nSamplesPerSec));
+  o.Set("channels", static_cast<double>(fmt.nChannels));
+  o.Set("channelMask", static_cast<double>(mask));
+  Napi::Array speakers = Napi::Array::New(env, fmt.nChannels);
+  for (uint32_t c = 0; c < fmt.nChannels; c++) {
+    const int bit = ChannelDownmix::ChannelBit(mask, c);
+    speakers.Set(c, bit < 0 ? env.Null()
+                            : Napi::String::New(env, ChannelDownmix::PositionName(
+                                                         static_cast<uint32_t>(bit))));
+  }
+  o.Set("speakers", speakers);
+  o.Set("mode", fmt.nChannels <= 2 ? "stereo"
+                : m_passthrough    ? "passthrough"
+                                   : "downmix");
+  return o;
+}
+
+// Report how the session actually came up
+Napi::Object CaptureSession::Info(Napi::Env env) const {
+  Napi::Object mmcss = Napi::Object::New(env);
+  mmcss.Set("task", WideToUtf8(m_mmcssTask));
+  mmcss.Set("priority", MmcssPriorityName(m_mmcssPriority));
+  mmcss.Set("registered", m_mmcssRegistered);
+  mmcss.Set("taskIndex", static_cast<double>(m_mmcssTaskIndex));
+  // Sessions of one MMCSS class share capture threads
+  mmcss.Set("threadId", static_cast<double>(m_captureThreadId));
+
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("eventDriven", m_eventDriven);
+  // Polling mode: how often the stream is drained, and whether the ticks
+  // come from a high-resolution timer
+  if (m_eventDriven) {
+    result.Set("poll", env.Null());
+  } else {
+    Napi::Object poll = Napi::Object::New(env);
+    poll.Set("periodMs", PollPeriod() / 10000.0);
+    poll.Set("highResTimer", m_highResTimer);
+    result.Set("poll", poll);
+  }
+  result.Set("zeroCopy", m_delivery.ZeroCopy());
+  result.Set("prewarmed", m_prewarmed);
+
+  Napi::Object format = Napi::Object::New(env);
+  format.Set("sampleRate", static_cast<double>(m_format.sampleRate));
+  format.Set("channels", static_cast<double>(m_format.channels));
+  format.Set("sampleFormat", m_format.int16 ? "int16" : "float32");
+  result.Set("format", format);
+  result.Set("captureFormat", CaptureFormatToJS(env));
+  result.Set("suppressSilence", m_suppressSilence);
+  result.Set("codec", m_opus ? "opus" : "pcm");
+  result.Set("meter", m_meter);
+  result.Set("meterOnly", m_meterOnly);
+  result.Set("noiseSuppression", m_denoise);
+  // Requested; period.lowLatency says whether the stream got it
+  result.Set("lowLatency", m_lowLatencyRequested);
+  Napi::Object queue = Napi::Object::New(env);
+  queue.Set("policy", QueuePolicyName(m_delivery.Policy()));
+  queue.Set("maxQueueMs", static_cast<double>(m_delivery.MaxQueueMs()));
+  result.Set("queue", queue);
+  result.Set("replaySeconds", static_cast<double>(m_recorder.ReplaySeconds()));
+  Napi::Object period = PeriodToJS(env, m_period);
+  period.Set("bufferFrames", static_cast<double>(m_bufferFrames));
+  result.Set("period", period);
+  if (m_opus) {
+    Napi::Object opus = Napi::Object::New(env);
+    opus.Set("bitrate", static_cast<double>(m_opusSettings.bitrate));
+    opus.Set("frameMs", m_opusSettings.frameUs / 1000.0);
+    opus.Set("dtx", m_opusSettings.dtx);
+    result.Set("opus", opus);
+  }
+  if (m_mixing) {
+    Napi::Array mix = Napi::Array::New(env, m_mixStreams.size());
+    for (uint32_t i = 0; i < m_mixStreams.size(); i++) {
+      const MixSourceSpec &spec = m_mixStreams[i]->spec;
+      Napi::Object source = Napi::Object::New(env);
+      source.Set("type", MixSourceKindName(spec.kind));
+      if (spec.kind == MixSourceKind::Process) {
+        source.Set("pid", static_cast<double>(spec.pid));
+        source.Set("excludeMode", spec.excludeMode);
+      } else {
+        source.Set("deviceId", WideToUtf8(spec.deviceId));
+      }
+      source.Set("gain", static_cast<double>(spec.gain));
+      source.Set("period", PeriodToJS(env, m_mixStreams[i]->period));
+      mix.Set(i, source);
+    }
+    result.Set("mix", mix);
+  }
+  result.Set("mmcss", mmcss);
+  return result;
+}
+
+// Snapshot of the lock-free counters; safe to call while capturing.
+Napi::Object CaptureSession::Stats(Napi::Env env) const {
+  auto num = [](const auto &a) { return static_cast<double>(a.load()); };
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("packets", num(m_stats.packets));
+  o.Set("frames", num(m_stats.frames));
+  o.Set("silentPackets", num(m_stats.silentPackets));
+  o.Set("discontinuities", num(m_stats.discontinuities));
+  o.Set("timestampErrors", num(m_stats.timestampErrors));
+  o.Set("positionGaps", num(m_stats.positionGaps));
+  o.Set("gapFrames", num(m_stats.gapFrames));
+  o.Set("devicePosition", num(m_stats.devicePosition));
+  o.Set("qpcPosition", num(m_stats.qpcPosition));
+  o.Set("droppedPackets", num(m_droppedCount));
+  o.Set("drains", num(m_stats.drains));
+  o.Set("suppressedPackets", num(m_stats.suppressedPackets));
+  o.Set("suppressedFrames", num(m_stats.suppressedFrames));
+  o.Set("silenceMarkers", num(m_stats.silenceMarkers));
+  o.Set("encodedPackets", num(m_stats.encodedPackets));
+  o.Set("encodedBytes", num(m_stats.encodedBytes));
+  o.Set("encodeErrors", num(m_stats.encodeErrors));
+  m_delivery.StatsToJS(o);
+  o.Set("packetInterval", HistogramToJS(env, m_stats.packetInterval));
+  o.Set("drainDuration", HistogramToJS(env, m_stats.drainDuration));
+  o.Set("denoisedFrames", num(m_stats.denoisedFrames));
+  o.Set("voiceProbability", num(m_stats.voiceProbability) / 1000.0);
+  o.Set("captureFormat", CaptureFormatToJS(env));
+  o.Set("recording", m_recorder.Recording());
+  o.Set("recordedFrames", static_cast<double>(m_recorder.RecordedFrames()));
+  o.Set("recordDroppedFrames",
+        static_cast<double>(m_recorder.TeeDroppedFrames()));
+  o.Set("replayFrames", static_cast<double>(m_recorder.ReplayFrames()));
+  // Kernel + user time of the (shared) capture thread, -1 when there is none
+  double cpuMs = -1;
+  FILETIME created, exited, kernel, user;
+  if (HANDLE thread = m_threadHandle.load()) {
+    if (GetThreadTimes(thread, &created, &exited, &kernel, &user)) {
+      auto ticks = [](const FILETIME &t) {
+        return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+      };
+      cpuMs = (ticks(kernel) + ticks(user)) / 10000.0; // 100 ns units
+    }
+  }
+  o.Set("captureThreadCpuMs", cpuMs);
+  o.Set("timeToFirstPacketMs", TimeToFirstPacketMs());
+  o.Set("state", CaptureStateName(m_state.load()));
+  o.Set("recoveryAttempts", num(m_stats.recoveryAttempts));
+  o.Set("recoveries", num(m_stats.recoveries));
+  o.Set("retargets", num(m_stats.retargets));
+  o.Set("retargetFailures", num(m_stats.retargetFailures));
+  // The period and streams are only stable while running: Start and
+  // StartMix set them up on a worker
+  if (!m_running.load()) return o;
+  Napi::Object period = PeriodToJS(env, m_period);
+  period.Set("bufferFrames", static_cast<double>(m_bufferFrames));
+  o.Set("period", period);
+  if (m_mixing) {
+    // Per source; the totals above count mixed blocks
+    Napi::Array mix = Napi::Array::New(env, m_mixStreams.size());
+    for (uint32_t i = 0; i < m_mixStreams.size(); i++) {
+      const MixStream &stream = *m_mixStreams[i];
+      const AudioMixer::SourceStats &ms = m_mixer.Stats(i);
+      Napi::Object source = Napi::Object::New(env);
+      source.Set("packets", num(stream.packets));
+      source.Set("frames", num(ms.frames));
+      source.Set("lateFrames", num(ms.lateFrames));
+      source.Set("gapFrames", num(ms.gapFrames));
+      source.Set("resyncs", num(ms.resyncs));
+      const HRESULT hr = stream.error.load();
+      if (FAILED(hr)) source.Set("error", FormatHr("0x%08lX", hr));
+      mix.Set(i, source);
+    }
+    o.Set("mix", mix);
+  }
+  return o;
+}
+
+// Latest metered block, or null unless the session was started with meter or
+// meterOnly. Lock-free, so cheap enough to poll per animation frame.
+Napi::Value CaptureSession::Levels(Napi::Env env) const {
+  if (!m_meter) return env.Null();
+  return LevelsToJS(env, m_levels.Read());
+}
+
+// ─── N-API: asynchronous start / prepare ───────────────────────────────────────
+//
+// Activation waits on ActivateHandler for up to 5 s, and the polling
+// fallback re-activates, so Start() and Prepare() run on the libuv pool
+// instead of the JS thread and return a Promise.
+
+class StartWorker : public Napi::AsyncWorker {
+public:
+  // prepareOnly: run Prepare() and resolve with undefined
+  StartWorker(Napi::Env env, CaptureSession &session, DWORD pid,
+              bool excludeMode, const CaptureOptions &opts, Napi::Object owner,
+              bool prepareOnly = false)
+      : Napi::AsyncWorker(env, prepareOnly ? "AudioCapturePrepare"
+                                           : "AudioCaptureStart"),
+        m_deferred(Napi::Promise::Deferred::New(env)), m_session(session),
+        m_pid(pid), m_excludeMode(excludeMode), m_opts(opts),
+        m_prepareOnly(prepareOnly) {
+    // Keep a JS owner alive so the session outlives the pending start
+    if (!owner.IsEmpty()) m_owner = Napi::Persistent(owner);
+  }
+  // Mixed start: run StartMix() over sources
+  StartWorker(Napi::Env env, CaptureSession &session,
+              std::vector<MixSourceSpec> sources, const CaptureOptions &opts,
+              Napi::Object owner)
+      : StartWorker(env, session, 0, false, opts, owner) {
+    m_sources = std::move(sources);
+  }
+
+  Napi::Promise Promise() const { return m_deferred.Promise(); }
+
+protected:
+  void Execute() override {
+    std::string err;
+    bool ok = m_prepareOnly ? m_session.Prepare(m_pid, m_excludeMode,
+                                                m_opts.lowLatency, err)
+              : !m_sources.empty()
+                  ? m_session.StartMix(m_sources, m_opts, err)
+                  : m_session.Start(m_pid, m_excludeMode, m_opts, err);
+    if (!ok) SetError(err);
+  }
+
+  // A deferred stop has already run if this was the last pending operation
+  void OnOK() override {
+    Napi::Env env = Env();
+    if (End()) {
+      m_deferred.Reject(Napi::Error::New(env, StoppedMessage()).Value());
+      return;
+    }
+    m_deferred.Resolve(m_prepareOnly ? env.Undefined() : m_session.Info(env));
+  }
+
+  void OnError(const Napi::Error &e) override {
+    m_deferred.Reject(
+        End() ? Napi::Error::New(Env(), StoppedMessage()).Value() : e.Value());
+  }
+
+private:
+  Napi::Promise::Deferred m_deferred;
+  Napi::ObjectReference m_owner;
+  CaptureSession &m_session;
+  DWORD m_pid;
+  bool m_excludeMode;
+  CaptureOptions m_opts;
+  bool m_prepareOnly;
+  std::vector<MixSourceSpec> m_sources; // non-empty for a mixed start
+
+  // Close the session's bracket; true if a stop arrived meanwhile
+  bool End() {
+    return m_prepareOnly ? m_session.EndOp() : m_session.EndStart();
+  }
+  const char *StoppedMessage() const {
+    return m_prepareOnly ? "Capture stopped before it was prepared"
+                         : "Capture stopped before it started";
+  }
+};
+
+// start(pid, excludeMode, options?) → Promise<info>. Invalid options throw
+// synchronously; activation failures reject.
+static Napi::Value StartSession(const Napi::CallbackInfo &info,
+                                CaptureSession &session, Napi::Object owner) {
+  Napi::Env env = info.Env();
+
+  DWORD pid = info[0].As<Napi::Number>().Uint32Value();
+  bool excludeMode = info[1].As<Napi::Boolean>().Value();
+
+  CaptureOptions opts;
+  std::string err;
+  if (info.Length() > 2 && info[2].IsObject()) {
+    if (!ParseCaptureOptions(info[2].As<Napi::Object>(), opts, err)) {
+      Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  if (!session.BeginStart()) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::Error::New(env, "Capture already starting").Value());
+    return deferred.Promise();
+  }
+
+  auto *worker = new StartWorker(env, session, pid, excludeMode, opts, owner);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// startMix(sources, options?) → Promise<info>. Takes the same options as
+// start(); see ParseMixSources for the source list.
+static Napi::Value StartMixSession(const Napi::CallbackInfo &info,
+                                   CaptureSession &session, Napi::Object owner) {
+  Napi::Env env = info.Env();
+
+  std::vector<MixSourceSpec> sources;
+  CaptureOptions opts;
+  std::string err;
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "startMix expects an array of sources")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!ParseMixSources(info[0].As<Napi::Array>(), sources, err) ||
+      (info.Length() > 1 && info[1].IsObject() &&
+       !ParseCaptureOptions(info[1].As<Napi::Object>(), opts, err))) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  if (!session.BeginStart()) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::Error::New(env, "Capture already starting").Value());
+    return deferred.Promise();
+  }
+
+  auto *worker = new StartWorker(env, session, std::move(sources), opts, owner);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// prepare(pid, excludeMode, options?) → Promise<void>. Only lowLatency
+// matters here; a prewarm is used by starts that ask for the same.
+static Napi::Value PrepareSession(const Napi::CallbackInfo &info,
+                                  CaptureSession &session, Napi::Object owner) {
+  Napi::Env env = info.Env();
+
+  DWORD pid = info[0].As<Napi::Number>().Uint32Value();
+  bool excludeMode = info[1].As<Napi::Boolean>().Value();
+
+  CaptureOptions opts;
+  std::string err;
+  if (info.Length() > 2 && info[2].IsObject()) {
+    if (!ParseCaptureOptions(info[2].As<Napi::Object>(), opts, err)) {
+      Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  if (!session.BeginOp()) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::Error::New(env, "Capture is stopping").Value());
+    return deferred.Promise();
+  }
+
+  auto *worker =
+      new StartWorker(env, session, pid, excludeMode, opts, owner, true);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// retarget(pid, excludeMode) → Promise<info>. Switches a running share to
+// another target with a crossfade; delivery carries on throughout, so the
+// onData callback sees one continuous stream.
+class RetargetWorker : public Napi::AsyncWorker {
+public:
+  RetargetWorker(Napi::Env env, CaptureSession &session, DWORD pid,
+                 bool excludeMode, Napi::Object owner)
+      : Napi::AsyncWorker(env, "AudioCaptureRetarget"),
+        m_deferred(Napi::Promise::Deferred::New(env)), m_session(session),
+        m_pid(pid), m_excludeMode(excludeMode) {
+    if (!owner.IsEmpty()) m_owner = Napi::Persistent(owner);
+  }
+
+  Napi::Promise Promise() const { return m_deferred.Promise(); }
+
+protected:
+  void Execute() override {
+    std::string err;
+    if (!m_session.Retarget(m_pid, m_excludeMode, err)) SetError(err);
+  }
+
+  // A deferred stop has already run if this was the last pending operation
+  void OnOK() override {
+    if (m_session.EndOp()) {
+      m_deferred.Reject(Napi::Error::New(Env(), kStopped).Value());
+      return;
+    }
+    m_deferred.Resolve(m_session.Info(Env()));
+  }
+  void OnError(const Napi::Error &e) override {
+    m_deferred.Reject(m_session.EndOp()
+                          ? Napi::Error::New(Env(), kStopped).Value()
+                          : e.Value());
+  }
+
+private:
+  static constexpr const char *kStopped =
+      "Capture stopped before the retarget finished";
+
+  Napi::Promise::Deferred m_deferred;
+  Napi::ObjectReference m_owner;
+  CaptureSession &m_session;
+  DWORD m_pid;
+  bool m_excludeMode;
+};
+
+static Napi::Value RetargetSession(const Napi::CallbackInfo &info,
+                                   CaptureSession &session, Napi::Object owner) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsBoolean()) {
+    Napi::TypeError::New(env, "retarget expects (pid, excludeMode)")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  DWORD pid = info[0].As<Napi::Number>().Uint32Value();
+  bool excludeMode = info[1].As<Napi::Boolean>().Value();
+
+  if (!session.BeginOp()) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::Error::New(env, "Capture is stopping").Value());
+    return deferred.Promise();
+  }
+
+  auto *worker = new RetargetWorker(env, session, pid, excludeMode, owner);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// stop() while a start, prepare or retarget is pending returns at once: what
+// they wait on is interrupted, and the stop runs when the last of them lands,
+// rejecting their Promises instead.
+static void StopSession(CaptureSession &session) {
+  if (!session.DeferStop()) session.Stop();
+}
+
+// onData(cb). The callback can't change under a start or a running capture,
+// whose producer thread still schedules drains on the current one.
+static Napi::Value SetDataCallback(const Napi::CallbackInfo &info,
+                                   CaptureSession &session) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsFunction()) {
+    Napi::TypeError::New(env, "onData expects a function")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!session.SetCallback(env, info[0].As<Napi::Function>())) {
+    Napi::Error::New(env, "Capture already running")
+        .ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+// ─── N-API: recording ──────────────────────────────────────────────────────────
+//
+// startRecording(path, options?) → Promise<void>
+// stopRecording() → Promise<{ frames, seconds, bytes }>
+// saveReplay(path, options?) → Promise<{ frames, seconds, bytes }>
+//
+// Opening, finishing and writing out files touch the disk, so they run on
+// the libuv pool. Invalid arguments throw synchronously.
+
+class RecordWorker : public Napi::AsyncWorker {
+public:
+  enum class Op { Start, Stop, SaveReplay };
+
+  RecordWorker(Napi::Env env, CaptureSession &session, Op op,
+               std::wstring path, const RecordSettings &settings,
+               uint32_t seconds, Napi::Object owner)
+      : Napi::AsyncWorker(env, "AudioCaptureRecord"),
+        m_deferred(Napi::Promise::Deferred::New(env)), m_session(session),
+        m_op(op), m_path(std::move(path)), m_settings(settings),
+        m_seconds(seconds) {
+    if (!owner.IsEmpty()) m_owner = Napi::Persistent(owner);
+  }
+
+  Napi::Promise Promise() const { return m_deferred.Promise(); }
+
+protected:
+  void Execute() override {
+    std::string err;
+    bool ok;
+    if (m_op == Op::Start) {
+      ok = m_session.StartRecording(m_path, m_settings, err);
+    } else if (m_op == Op::Stop) {
+      ok = m_session.StopRecording(m_result, err);
+    } else {
+      ok = m_session.SaveReplay(m_path, m_settings, m_seconds, m_result, err);
+    }
+    if (!ok) SetError(err);
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    if (m_op == Op::Start) {
+      m_deferred.Resolve(env.Undefined());
+      return;
+    }
+    Napi::Object o = Napi::Object::New(env);
+    o.Set("frames", static_cast<double>(m_result.frames));
+    const double rate = m_result.sampleRate;
+    o.Set("seconds", rate > 0 ? m_result.frames / rate : 0.0);
+    o.Set("bytes", static_cast<double>(m_result.bytes));
+    m_deferred.Resolve(o);
+  }
+
+  void OnError(const Napi::Error &e) override { m_deferred.Reject(e.Value()); }
+
+private:
+  Napi::Promise::Deferred m_deferred;
+  Napi::ObjectReference m_owner;
+  CaptureSession &m_session;
+  Op m_op;
+  std::wstring m_path;
+  RecordSettings m_settings;
+  uint32_t m_seconds;
+  RecordResult m_result;
+};
+
+// {
+//   format?: "wav" | "ogg",   // ogg = Opus in Ogg, needs a with_opus build
+//   opusBitrate?: number,
+//   seconds?: number,          // saveReplay only; default the whole ring
+// }
+static bool ParseRecordOptions(const Napi::Object &o, RecordSettings &out,
+                               uint32_t &seconds, std::string &err) {
+  if (o.Get("format").IsString()) {
+    std::string name = o.Get("format").As<Napi::String>().Utf8Value();
+    if (name != "wav" && name != "ogg") {
+      err = "Invalid format: " + name;
+      return false;
+    }
+    out.format = name == "ogg" ? RecordFormat::Ogg : RecordFormat::Wav;
+  }
+  if (out.format == RecordFormat::Ogg && !OpusFrameEncoder::kAvailable) {
+    err = "Opus support not built (rebuild with -Dwith_opus=1)";
+    return false;
+  }
+  if (o.Get("opusBitrate").IsNumber()) {
+    out.opusBitrate = o.Get("opusBitrate").As<Napi::Number>().Uint32Value();
+    if (!OpusSettings::ValidBitrate(out.opusBitrate)) {
+      err = "Invalid opusBitrate: " + std::to_string(out.opusBitrate);
+      return false;
+    }
+  }
+  if (o.Get("seconds").IsNumber()) {
+    double sec = o.Get("seconds").As<Napi::Number>().DoubleValue();
+    if (!(sec >= 0 && sec <= AudioRecorder::kMaxReplaySeconds)) {
+      err = "Invalid seconds: " + std::to_string(sec);
+      return false;
+    }
+    seconds = static_cast<uint32_t>(sec);
+  }
+  return true;
+}
+
+// startRecording and saveReplay: (path, options?)
+static Napi::Value RecordToFile(const Napi::CallbackInfo &info,
+                                CaptureSession &session, Napi::Object owner,
+                                RecordWorker::Op op) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Expected a file path")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  RecordSettings settings;
+  uint32_t seconds = 0;
+  std::string err;
+  if (info.Length() > 1 && info[1].IsObject() &&
+      !ParseRecordOptions(info[1].As<Napi::Object>(), settings, seconds, err)) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker = new RecordWorker(
+      env, session, op, Utf8ToWide(info[0].As<Napi::String>().Utf8Value()),
+      settings, seconds, owner);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+static Napi::Value StartRecordingSession(const Napi::CallbackInfo &info,
+                                         CaptureSession &session,
+                                         Napi::Object owner) {
+  return RecordToFile(info, session, owner, RecordWorker::Op::Start);
+}
+
+static Napi::Value SaveReplaySession(const Napi::CallbackInfo &info,
+                                     CaptureSession &session,
+                                     Napi::Object owner) {
+  return RecordToFile(info, session, owner, RecordWorker::Op::SaveReplay);
+}
+
+static Napi::Value StopRecordingSession(const Napi::CallbackInfo &info,
+                                        CaptureSession &session,
+                                        Napi::Object owner) {
+  auto *worker = new RecordWorker(info.Env(), session, RecordWorker::Op::Stop,
+                                  std::wstring(), RecordSettings(), 0, owner);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// ─── N-API: CaptureSession class ───────────────────────────────────────────────
+//
+//   const s = new addon.CaptureSession();
+//   await s.prepare(pid, excludeMode, options);   // optional prewarm
+//   s.onData(cb); const info = await s.start(pid, excludeMode, options); s.stop();
+//   await s.retarget(otherPid, false);             // crossfade to another target
+//   // or: await s.startMix([{ type: "process", pid }, { type: "microphone" }])
+//
+// Each instance owns an independent session; sessions share capture threads
+// (see capture-service.h). A collected instance stops its capture.
+
+class CaptureSessionWrap : public Napi::ObjectWrap<CaptureSessionWrap> {
+public:
+  static Napi::Function Define(Napi::Env env) {
+    return DefineClass(
+        env, "CaptureSession",
+        {
+            InstanceMethod<&CaptureSessionWrap::Start>("start"),
+            InstanceMethod<&CaptureSessionWrap::StartMix>("startMix"),
+            InstanceMethod<&CaptureSessionWrap::Prepare>("prepare"),
+            InstanceMethod<&CaptureSessionWrap::Retarget>("retarget"),
+            InstanceMethod<&CaptureSessionWrap::Stop>("stop"),
+            InstanceMethod<&CaptureSessionWrap::OnData>("onData"),
+            InstanceMethod<&CaptureSessionWrap::OnStateChange>("onStateChange"),
+            InstanceMethod<&CaptureSessionWrap::IsRunning>("isRunning"),
+            InstanceMethod<&CaptureSessionWrap::GetLastError>("getLastError"),
+            InstanceMethod<&CaptureSessionWrap::GetDataCount>("getDataCount"),
+            InstanceMethod<&CaptureSessionWrap::GetDroppedCount>("getDroppedCount"),
+            InstanceMethod<&CaptureSessionWrap::IsZeroCopy>("isZeroCopy"),
+            InstanceMethod<&CaptureSessionWrap::GetTimeToFirstPacket>(
+                "getTimeToFirstPacket"),
+            InstanceMethod<&CaptureSessionWrap::GetStats>("getStats"),
+            InstanceMethod<&CaptureSessionWrap::GetLevels>("getLevels"),
+            InstanceMethod<&CaptureSessionWrap::StartRecording>(
+                "startRecording"),
+            InstanceMethod<&CaptureSessionWrap::StopRecording>("stopRecording"),
+            InstanceMethod<&CaptureSessionWrap::SaveReplay>("saveReplay"),
+        });
+  }
+
+  CaptureSessionWrap(const Napi::CallbackInfo &info)
+      : Napi::ObjectWrap<CaptureSessionWrap>(info) {}
+
+private:
+  Napi::Value Start(const Napi::CallbackInfo &info) {
+    return StartSession(info, m_session, Value());
+  }
+  Napi::Value StartMix(const Napi::CallbackInfo &info) {
+    return StartMixSession(info, m_session, Value());
+  }
+  Napi::Value Prepare(const Napi::CallbackInfo &info) {
+    return PrepareSession(info, m_session, Value());
+  }
+  Napi::Value Retarget(const Napi::CallbackInfo &info) {
+    return RetargetSession(info, m_session, Value());
+  }
+  Napi::Value Stop(const Napi::CallbackInfo &info) {
+    StopSession(m_session);
+    return info.Env().Undefined();
+  }
+  Napi::Value OnData(const Napi::CallbackInfo &info) {
+    return SetDataCallback(info, m_session);
+  }
+  Napi::Value OnStateChange(const Napi::CallbackInfo &info) {
+    m_session.SetStateCallback(info.Env(), info[0].As<Napi::Function>());
+    return info.Env().Undefined();
+  }
+  Napi::Value IsRunning(const Napi::CallbackInfo &info) {
+    return Napi::Boolean::New(info.Env(), m_session.IsRunning());
+  }
+  Napi::Value GetLastError(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), m_session.LastError());
+  }
+  Napi::Value GetDataCount(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_session.DataCount());
+  }
+  Napi::Value GetDroppedCount(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_session.DroppedCount());
+  }
+  Napi::Value IsZeroCopy(const Napi::CallbackInfo &info) {
+    return Napi::Boolean::New(info.Env(), m_session.IsZeroCopy());
+  }
+  Napi::Value GetTimeToFirstPacket(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_session.TimeToFirstPacketMs());
+  }
+  Napi::Value GetStats(const Napi::CallbackInfo &info) {
+    return m_session.Stats(info.Env());
+  }
+  Napi::Value GetLevels(const Napi::CallbackInfo &info) {
+    return m_session.Levels(info.Env());
+  }
+  Napi::Value StartRecording(const Napi::CallbackInfo &info) {
+    return StartRecordingSession(info, m_session, Value());
+  }
+  Napi::Value StopRecording(const Napi::CallbackInfo &info) {
+    return StopRecordingSession(info, m_session, Value());
+  }
+  Napi::Value SaveReplay(const Napi::CallbackInfo &info) {
+    return SaveReplaySession(info, m_session, Value());
+  }
+
+  CaptureSession m_session;
+};
+
+// ─── N-API: activity probe ─────────────────────────────────────────────────────
+//
+// probeProcesses(pids, durationMs?) →
+//   Promise<[{ pid, active, peak, momentaryLufs, packets, error? }]>
+//
+// Briefly captures many processes to find the ones making sound. Every
+// activation is issued before any is waited on, so they complete
+// concurrently and the probe costs one activation delay rather than one per
+// PID. The streams are then drained from this one worker thread, waiting on
+// their buffer events. Per-PID failures are reported, not rejected.
+
+static constexpr uint32_t kMaxProbePids = 256;
+static constexpr uint32_t kDefaultProbeMs = 500;
+static constexpr uint32_t kMaxProbeMs = 5000;
+// Sample peak at which a probed process counts as producing audio (-60 dBFS)
+static constexpr float kProbeActivePeak = 0.001f;
+
+struct ProbeTarget {
+  DWORD pid = 0;
+  ActivateHandler *handler = nullptr;
+  IActivateAudioInterfaceAsyncOperation *asyncOp = nullptr;
+  IAudioClient *client = nullptr;
+  IAudioCaptureClient *capture = nullptr;
+  HANDLE event = nullptr;
+  std::string error;
+  float peak = 0.0f;
+  uint32_t packets = 0;
+  LevelMeter meter;
+};
+
+class ProbeWorker : public Napi::AsyncWorker {
+public:
+  ProbeWorker(Napi::Env env, const std::vector<DWORD> &pids, uint32_t durationMs)
+      : Napi::AsyncWorker(env, "AudioCaptureProbe"),
+        m_deferred(Napi::Promise::Deferred::New(env)), m_targets(pids.size()),
+        m_durationMs(durationMs) {
+    for (size_t i = 0; i < pids.size(); i++) m_targets[i].pid = pids[i];
+  }
+
+  Napi::Promise Promise() const { return m_deferred.Promise(); }
+
+protected:
+  void Execute() override {
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    for (ProbeTarget &t : m_targets) {
+      HRESULT hr = BeginActivateLoopback(t.pid, false, &t.handler, &t.asyncOp);
+      if (FAILED(hr))
+        t.error = FormatHr("ActivateAudioInterfaceAsync: 0x%08lX", hr);
+    }
+
+    // One shared deadline: the activations have been running in parallel
+    const LONGLONG freq = QpcFrequency();
+    const LONGLONG activateDeadline = QpcNow() + freq * kActivateTimeoutMs / 1000;
+    for (ProbeTarget &t : m_targets) {
+      if (!t.error.empty()) continue;
+      const LONGLONG left = activateDeadline - QpcNow();
+      const DWORD ms = left > 0 ? static_cast<DWORD>(left * 1000 / freq) : 0;
+      HRESULT hr = EndActivateLoopback(t.handler, ms, &t.client);
+      if (FAILED(hr)) {
+        t.error = FormatHr("ActivateCompleted: 0x%08lX", hr);
+        continue;
+      }
+      StartStream(t);
+    }
+
+    Sample();
+
+    for (ProbeTarget &t : m_targets) {
+      if (t.client) t.client->Stop();
+      if (t.capture) t.capture->Release();
+      if (t.client) t.client->Release();
+      if (t.event) CloseHandle(t.event);
+      if (t.handler) t.handler->Release();
+      if (t.asyncOp) t.asyncOp->Release();
+      t.capture = nullptr;
+      t.client = nullptr;
+      t.event = nullptr;
+      t.handler = nullptr;
+      t.asyncOp = nullptr;
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Array results = Napi::Array::New(env, m_targets.size());
+    for (size_t i = 0; i < m_targets.size(); i++) {
+      const ProbeTarget &t = m_targets[i];
+      const LevelSnapshot l = t.meter.Read();
+      Napi::Object r = Napi::Object::New(env);
+      r.Set("pid", static_cast<double>(t.pid));
+      r.Set("active", t.peak >= kProbeActivePeak);
+      r.Set("peak", static_cast<double>(t.peak));
+      r.Set("momentaryLufs", static_cast<double>(l.momentaryLufs));
+      r.Set("packets", static_cast<double>(t.packets));
+      if (!t.error.empty()) r.Set("error", t.error);
+      results.Set(static_cast<uint32_t>(i), r);
+    }
+    m_deferred.Resolve(results);
+  }
+
+  void OnError(const Napi::Error &e) override { m_deferred.Reject(e.Value()); }
+
+private:
+  // Event-driven only: a probe has no time for the polling re-activation.
+  void StartStream(ProbeTarget &t) {
+    WAVEFORMATEX fmt = {};
+    fmt.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+    fmt.nChannels = 2;
+    fmt.nSamplesPerSec = 48000;
+    fmt.wBitsPerSample = 32;
+    fmt.nBlockAlign = fmt.nChannels * fmt.wBitsPerSample / 8;
+    fmt.nAvgBytesPerSec = fmt.nSamplesPerSec * fmt.nBlockAlign;
+
+    t.event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    HRESULT hr = t.client->Initialize(
+        AUDCLNT_SHAREMODE_SHARED,
+        AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+        200000, 0, &fmt, nullptr);
+    const char *step = "IAudioClient::Initialize: 0x%08lX";
+    if (SUCCEEDED(hr)) {
+      hr = t.client->SetEventHandle(t.event);
+      step = "SetEventHandle: 0x%08lX";
+    }
+    if (SUCCEEDED(hr)) {
+      hr = t.client->GetService(__uuidof(IAudioCaptureClient),
+                                (void **)&t.capture);
+      step = "GetService: 0x%08lX";
+    }
+    if (SUCCEEDED(hr)) {
+      hr = t.client->Start();
+      step = "IAudioClient::Start: 0x%08lX";
+    }
+    if (FAILED(hr)) {
+      t.error = FormatHr(step, hr);
+      if (t.capture) t.capture->Release();
+      t.capture = nullptr;
+    }
+  }
+
+  // Drain every started stream for m_durationMs. Only MAXIMUM_WAIT_OBJECTS
+  // events fit in one wait; beyond that the wait also times out every 10 ms
+  // so the remaining streams are still drained promptly.
+  void Sample() {
+    std::vector<HANDLE> events;
+    size_t streams = 0;
+    for (ProbeTarget &t : m_targets) {
+      if (!t.capture) continue;
+      streams++;
+      if (events.size() < MAXIMUM_WAIT_OBJECTS) events.push_back(t.event);
+    }
+    if (streams == 0) return;
+
+    const LONGLONG freq = QpcFrequency();
+    const LONGLONG end = QpcNow() + freq * m_durationMs / 1000;
+    for (LONGLONG now = QpcNow(); now < end; now = QpcNow()) {
+      DWORD wait = static_cast<DWORD>((end - now) * 1000 / freq) + 1;
+      if (streams > events.size() && wait > 10) wait = 10;
+      DWORD r = WaitForMultipleObjects(static_cast<DWORD>(events.size()),
+                                       events.data(), FALSE, wait);
+      if (r == WAIT_FAILED) break;
+      for (ProbeTarget &t : m_targets) {
+        if (t.capture) Drain(t);
+      }
+    }
+  }
+
+  static void Drain(ProbeTarget &t) {
+    UINT32 packetLength = 0;
+    if (FAILED(t.capture->GetNextPacketSize(&packetLength))) return;
+    while (packetLength > 0) {
+      BYTE *data = nullptr;
+      UINT32 frames = 0;
+      DWORD flags = 0;
+      if (FAILED(t.capture->GetBuffer(&data, &frames, &flags, nullptr, nullptr)))
+        return;
+      const float *x = (flags & AUDCLNT_BUFFERFLAGS_SILENT)
+                           ? nullptr
+                           : reinterpret_cast<const float *>(data);
+      if (x) {
+        const StereoLevel l = ScanStereo(x, frames);
+        for (float p : l.peak) {
+          if (p > t.peak) t.peak = p;
+        }
+      }
+      t.meter.Process(x, frames);
+      t.packets++;
+      t.capture->ReleaseBuffer(frames);
+      if (FAILED(t.capture->GetNextPacketSize(&packetLength))) return;
+    }
+  }
+
+  Napi::Promise::Deferred m_deferred;
+  std::vector<ProbeTarget> m_targets;
+  uint32_t m_durationMs;
+};
+
+static Napi::Value ProbeProcesses(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "probeProcesses expects an array of PIDs")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array list = info[0].As<Napi::Array>();
+  if (list.Length() > kMaxProbePids) {
+    Napi::TypeError::New(env, "Too many PIDs: " + std::to_string(list.Length()) +
+                                  " (max " + std::to_string(kMaxProbePids) + ")")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  std::vector<DWORD> pids;
+  for (uint32_t i = 0; i < list.Length(); i++) {
+    Napi::Value v = list.Get(i);
+    if (!v.IsNumber() || v.As<Napi::Number>().Uint32Value() == 0) {
+      Napi::TypeError::New(env, "Invalid PID at index " + std::to_string(i))
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    pids.push_back(v.As<Napi::Number>().Uint32Value());
+  }
+  uint32_t durationMs = kDefaultProbeMs;
+  if (info.Length() > 1 && info[1].IsNumber())
+    durationMs = info[1].As<Napi::Number>().Uint32Value();
+  if (durationMs > kMaxProbeMs) durationMs = kMaxProbeMs;
+
+  auto *worker = new ProbeWorker(env, pids, durationMs);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// ─── N-API: module-level exports ───────────────────────────────────────────────
+//
+// startCapture/stopCapture/... drive a default session, kept for callers
+// that only ever need one stream.
+
+static CaptureSession *g_defaultSession = nullptr;
+
+static CaptureSession &DefaultSession() {
+  return *g_defaultSession;
+}
+
+static Napi::Value StartCapture(const Napi::CallbackInfo &info) {
+  return StartSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value StartMixCapture(const Napi::CallbackInfo &info) {
+  return StartMixSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value PrepareCapture(const Napi::CallbackInfo &info) {
+  return PrepareSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value RetargetCapture(const Napi::CallbackInfo &info) {
+  return RetargetSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value StopCapture(const Napi::CallbackInfo &info) {
+  StopSession(DefaultSession());
+  return info.Env().Undefined();
+}
+
+static Napi::Value OnData(const Napi::CallbackInfo &info) {
+  return SetDataCallback(info, DefaultSession());
+}
+
+static Napi::Value OnStateChange(const Napi::CallbackInfo &info) {
+  DefaultSession().SetStateCallback(info.Env(), info[0].As<Napi::Function>());
+  return info.Env().Undefined();
+}
+
+static Napi::Value HwndToPid(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  HWND hwnd = reinterpret_cast<HWND>(
+      static_cast<uintptr_t>(info[0].As<Napi::Number>().Int64Value()));
+  DWORD pid = 0;
+  GetWindowThreadProcessId(hwnd, &pid);
+  return Napi::Number::New(env, static_cast<double>(pid));
+}
+
+// Enough for every top-level window the picker lists
+static constexpr uint32_t kMaxResolveWindows = 1024;
+
+// resolveWindows(hwnds) → ({ pid, exe, ancestors: { pid, exe }[] } | null)[]
+//
+// hwndToPid for a whole list at once, plus each window's executable and
+// the chain of processes that started it, nearest first. One call, and at
+// most one process snapshot, however many windows there are. null for a
+// window that no longer exists.
+static Napi::Value ResolveWindows(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "resolveWindows expects an array of HWNDs")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array list = info[0].As<Napi::Array>();
+  if (list.Length() > kMaxResolveWindows) {
+    Napi::TypeError::New(env, "Too many HWNDs: " + std::to_string(list.Length()) +
+                                  " (max " + std::to_string(kMaxResolveWindows) + ")")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  std::vector<DWORD> pids;
+  for (uint32_t i = 0; i < list.Length(); i++) {
+    Napi::Value v = list.Get(i);
+    if (!v.IsNumber()) {
+      Napi::TypeError::New(env, "Invalid HWND at index " + std::to_string(i))
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    HWND hwnd = reinterpret_cast<HWND>(
+        static_cast<uintptr_t>(v.As<Napi::Number>().Int64Value()));
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    pids.push_back(pid);
+  }
+
+  const auto chains = ProcessCache::Instance().Resolve(pids);
+  Napi::Array result = Napi::Array::New(env, pids.size());
+  for (uint32_t i = 0; i < pids.size(); i++) {
+    if (pids[i] == 0) {
+      result.Set(i, env.Null());
+      continue;
+    }
+    // A window whose process just exited keeps its PID, with no name
+    const auto &chain = chains[i];
+    Napi::Object w = Napi::Object::New(env);
+    w.Set("pid", static_cast<double>(pids[i]));
+    w.Set("exe", chain.empty() ? std::string() : WideToUtf8(chain[0].exe));
+    Napi::Array ancestors =
+        Napi::Array::New(env, chain.empty() ? 0 : chain.size() - 1);
+    for (size_t k = 1; k < chain.size(); k++) {
+      Napi::Object a = Napi::Object::New(env);
+      a.Set("pid", static_cast<double>(chain[k].pid));
+      a.Set("exe", WideToUtf8(chain[k].exe));
+      ancestors.Set(static_cast<uint32_t>(k - 1), a);
+    }
+    w.Set("ancestors", ancestors);
+    result.Set(i, w);
+  }
+  return result;
+}
+
+static Napi::Value GetError(const Napi::CallbackInfo &info) {
+  return Napi::String::New(info.Env(), DefaultSession().LastError());
+}
+
+static Napi::Value GetDataCount(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(),
+                           static_cast<double>(DefaultSession().DataCount()));
+}
+
+static Napi::Value GetDroppedCount(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(),
+                           static_cast<double>(DefaultSession().DroppedCount()));
+}
+
+static Napi::Value IsZeroCopy(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), DefaultSession().IsZeroCopy());
+}
+
+static Napi::Value GetTimeToFirstPacket(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), DefaultSession().TimeToFirstPacketMs());
+}
+
+static Napi::Value GetStats(const Napi::CallbackInfo &info) {
+  return DefaultSession().Stats(info.Env());
+}
+
+static Napi::Value GetLevels(const Napi::CallbackInfo &info) {
+  return DefaultSession().Levels(info.Env());
+}
+
+static Napi::Value IsRunning(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), DefaultSession().IsRunning());
+}
+
+static Napi::Value StartRecording(const Napi::CallbackInfo &info) {
+  return StartRecordingSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value StopRecording(const Napi::CallbackInfo &info) {
+  return StopRecordingSession(info, DefaultSession(), Napi::Object());
+}
+
+static Napi::Value SaveReplay(const Napi::CallbackInfo &info) {
+  return SaveReplaySession(info, DefaultSession(), Napi::Object());
+}
+
+// Whether this build can deliver codec: "opus"
+static Napi::Value IsOpusAvailable(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), OpusFrameEncoder::kAvailable);
+}
+
+// Whether this build can run noiseSuppression
+static Napi::Value IsNoiseSuppressionAvailable(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), NoiseSuppressor::kAvailable);
 }
 
 static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  // The default session outlives any JS object, so stop it (joining its
+  // thread and aborting its TSFN) while the environment is still alive.
+  if (!g_defaultSession) g_defaultSession = new CaptureSession();
+  // Workers can't complete after teardown, so nothing defers this stop; just
+  // cut short whatever activation it would otherwise wait out.
+  env.AddCleanupHook([] {
+    g_defaultSession->Interrupt();
+    g_defaultSession->Stop();
+  });
+
+  exports.Set("CaptureSession", CaptureSessionWrap::Define(env));
   exports.Set("startCapture", Napi::Function::New(env, StartCapture));
+  exports.Set("startMixCapture", Napi::Function::New(env, StartMixCapture));
+  exports.Set("prepareCapture", Napi::Function::New(env, PrepareCapture));
+  exports.Set("retargetCapture", Napi::Function::New(env, RetargetCapture));
   exports.Set("stopCapture", Napi::Function::New(env, StopCapture));
   exports.Set("onData", Napi::Function::New(env, OnData));
+  exports.Set("onStateChange", Napi::Function::New(env, OnStateChange));
   exports.Set("hwndToPid", Napi::Function::New(env, HwndToPid));
+  exports.Set("resolveWindows", Napi::Function::New(env, ResolveWindows));
   exports.Set("getLastError", Napi::Function::New(env, GetError));
   exports.Set("getDataCount", Napi::Function::New(env, GetDataCount));
+  exports.Set("getDroppedCount", Napi::Function::New(env, GetDroppedCount));
+  exports.Set("isZeroCopy", Napi::Function::New(env, IsZeroCopy));
+  exports.Set("getTimeToFirstPacket",
+              Napi::Function::New(env, GetTimeToFirstPacket));
+  exports.Set("getStats", Napi::Function::New(env, GetStats));
+  exports.Set("getLevels", Napi::Function::New(env, GetLevels));
+  exports.Set("probeProcesses", Napi::Function::New(env, ProbeProcesses));
   exports.Set("isRunning", Napi::Function::New(env, IsRunning));
+  exports.Set("startRecording", Napi::Function::New(env, StartRecording));
+  exports.Set("stopRecording", Napi::Function::New(env, StopRecording));
+  exports.Set("saveReplay", Napi::Function::New(env, SaveReplay));
+  exports.Set("isOpusAvailable", Napi::Function::New(env, IsOpusAvailable));
+  exports.Set("isNoiseSuppressionAvailable",
+              Napi::Function::New(env, IsNoiseSuppressionAvailable));
   return exports;
 }
 
@@ -0,0 +1,257 @@
+// Timestamp-aligned mixing of several 48 kHz stereo float32 capture streams.
+//
+// Every source writes into its own ring, indexed by absolute frame number on
+// one shared timeline derived from the packets' QPC capture positions
+// (100 ns units, as returned by IAudioCaptureClient::GetBuffer). Frame 0 is
+// the first packet seen from any source. Packets from one source normally
+// land back to back. A source is only re-placed at its QPC position when it
+// drifts more than jitterFrames from it, so timestamp jitter never tears
+// the signal while clock drift between devices stays bounded.
+//
+// Mix() emits every frame all live sources have reached. A source that
+// stalls (a process that stopped rendering, a device that went away) holds
+// the output back by at most maxLatencyFrames; past that it is mixed as
+// silence and stops holding the output until it writes again. When every
+// source has stalled, the dead air is skipped rather than emitted as a burst
+// of zeros on resume. Gain and mixing use SSE, and the mixed output is
+// clamped to [-1, 1].
+//
+// All methods run on the capture thread except Configure/SetGain (before
+// start) and the stats accessors, which may be read from any thread.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#ifndef MIGO_HAVE_SSE2
+#define MIGO_HAVE_SSE2 1
+#endif
+#endif
+
+class AudioMixer {
+public:
+  static constexpr uint32_t kRate = 48000;
+  static constexpr uint32_t kMaxSources = 8;
+  // Write() timestamp for a packet without a usable one (WASAPI flagged a
+  // timestamp error): it continues where the source left off.
+  static constexpr uint64_t kNoTimestamp = UINT64_MAX;
+
+  struct SourceStats {
+    std::atomic<uint64_t> frames{0};     // written by the source
+    std::atomic<uint64_t> lateFrames{0}; // arrived behind the output, dropped
+    std::atomic<uint64_t> gapFrames{0};  // zero-filled on a forward re-place
+    std::atomic<uint32_t> resyncs{0};    // re-placed at its QPC position
+  };
+
+  // ringFrames must cover maxLatencyFrames plus the largest packet.
+  bool Configure(uint32_t sourceCount, uint32_t ringFrames,
+                 uint32_t maxLatencyFrames, uint32_t jitterFrames) {
+    if (sourceCount == 0 || sourceCount > kMaxSources) return false;
+    if (ringFrames <= maxLatencyFrames) return false;
+    m_sources.clear();
+    for (uint32_t i = 0; i < sourceCount; i++) {
+      auto s = std::make_unique<Source>();
+      s->ring.assign(static_cast<size_t>(ringFrames) * 2, 0.0f);
+      m_sources.push_back(std::move(s));
+    }
+    m_ringFrames = ringFrames;
+    m_maxLatency = maxLatencyFrames;
+    m_jitter = jitterFrames;
+    m_haveBase = false;
+    m_baseQpc = 0;
+    m_readPos = 0;
+    return true;
+  }
+
+  void SetGain(uint32_t source, float gain) { m_sources[source]->gain = gain; }
+  uint32_t SourceCount() const { return static_cast<uint32_t>(m_sources.size()); }
+  const SourceStats &Stats(uint32_t source) const {
+    return m_sources[source]->stats;
+  }
+
+  // Append one packet (nullptr = silence) of source s, whose first frame
+  // was captured at qpc100ns.
+  void Write(uint32_t s, const float *x, uint32_t frames, uint64_t qpc100ns) {
+    Source &src = *m_sources[s];
+    if (qpc100ns == kNoTimestamp) {
+      if (!src.started) {
+        src.started = true;
+        src.cursor = m_readPos;
+      }
+      src.stats.frames.fetch_add(frames, std::memory_order_relaxed);
+      Fill(src, x, frames);
+      return;
+    }
+    if (!m_haveBase) {
+      m_haveBase = true;
+      m_baseQpc = qpc100ns;
+    }
+    const int64_t at = FrameAt(qpc100ns);
+    // Everything written so far has been mixed: skip the dead air
+    if (at > m_readPos + m_jitter && !Pending()) m_readPos = at;
+    if (!src.started) {
+      src.started = true;
+      src.cursor = at;
+    } else if (at > src.cursor + m_jitter || at < src.cursor - m_jitter) {
+      src.stats.resyncs.fetch_add(1, std::memory_order_relaxed);
+      // The part of the gap the output already passed needs no filling
+      if (src.cursor < m_readPos) src.cursor = m_readPos;
+      if (at > src.cursor) {
+        src.stats.gapFrames.fetch_add(static_cast<uint64_t>(at - src.cursor),
+                                      std::memory_order_relaxed);
+        Fill(src, nullptr, at - src.cursor);
+      }
+      src.cursor = at;
+    }
+    src.stats.frames.fetch_add(frames, std::memory_order_relaxed);
+    Fill(src, x, frames);
+  }
+
+  // Mix up to maxFrames ready frames into out (interleaved stereo).
+  // Returns the number of frames written.
+  uint32_t Mix(float *out, uint32_t maxFrames) {
+    // A source the output has already passed is stalled and doesn't hold it
+    int64_t lead = INT64_MIN;
+    int64_t ready = INT64_MAX;
+    for (auto &s : m_sources) {
+      if (!s->started || s->cursor < m_readPos) continue;
+      lead = std::max(lead, s->cursor);
+      ready = std::min(ready, s->cursor);
+    }
+    if (lead == INT64_MIN) return 0;
+    // Never read further back than the rings reach
+    if (lead - m_readPos > m_ringFrames) m_readPos = lead - m_ringFrames;
+
+    int64_t end = std::max(ready, lead - static_cast<int64_t>(m_maxLatency));
+    end = std::min(end, m_readPos + static_cast<int64_t>(maxFrames));
+    if (end <= m_readPos) return 0;
+    const uint32_t n = static_cast<uint32_t>(end - m_readPos);
+
+    memset(out, 0, static_cast<size_t>(n) * 2 * sizeof(float));
+    for (auto &s : m_sources) {
+      if (!s->started || s->cursor <= m_readPos) continue;
+      const uint32_t have =
+          static_cast<uint32_t>(std::min<int64_t>(s->cursor - m_readPos, n));
+      // The ring may wrap inside the block
+      uint32_t pos = RingIndex(m_readPos);
+      uint32_t done = 0;
+      while (done < have) {
+        const uint32_t run = std::min(have - done, m_ringFrames - pos);
+        MixAdd(out + static_cast<size_t>(done) * 2,
+               s->ring.data() + static_cast<size_t>(pos) * 2,
+               static_cast<size_t>(run) * 2, s->gain);
+        done += run;
+        pos = 0;
+      }
+    }
+    Clamp(out, static_cast<size_t>(n) * 2);
+    m_readPos = end;
+    return n;
+  }
+
+  // out[i] += gain * in[i]
+  static void MixAdd(float *out, const float *in, size_t n, float gain) {
+    size_t i = 0;
+#if MIGO_HAVE_SSE2
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= n; i += 8) {
+      __m128 a = _mm_loadu_ps(out + i);
+      __m128 b = _mm_loadu_ps(out + i + 4);
+      a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(in + i), g));
+      b = _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(in + i + 4), g));
+      _mm_storeu_ps(out + i, a);
+      _mm_storeu_ps(out + i + 4, b);
+    }
+#endif
+    for (; i < n; i++) out[i] += gain * in[i];
+  }
+
+  static void Clamp(float *x, size_t n) {
+    size_t i = 0;
+#if MIGO_HAVE_SSE2
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    for (; i + 4 <= n; i += 4) {
+      _mm_storeu_ps(x + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(x + i), lo), hi));
+    }
+#endif
+    for (; i < n; i++) x[i] = std::min(1.0f, std::max(-1.0f, x[i]));
+  }
+
+private:
+  struct Source {
+    std::vector<float> ring;
+    int64_t cursor = 0; // absolute frame of the next write
+    bool started = false;
+    float gain = 1.0f;
+    SourceStats stats;
+  };
+
+  int64_t FrameAt(uint64_t qpc100ns) const {
+    // 100 ns ticks to 48 kHz frames: * 48000 / 10^7 = * 3 / 625
+    const int64_t ticks =
+        static_cast<int64_t>(qpc100ns) - static_cast<int64_t>(m_baseQpc);
+    return ticks * 3 / 625;
+  }
+
+  // True if some source has frames the output hasn't mixed yet.
+  bool Pending() const {
+    for (auto &s : m_sources) {
+      if (s->started && s->cursor > m_readPos) return true;
+    }
+    return false;
+  }
+
+  uint32_t RingIndex(int64_t frame) const {
+    int64_t i = frame % static_cast<int64_t>(m_ringFrames);
+    return static_cast<uint32_t>(i < 0 ? i + m_ringFrames : i);
+  }
+
+  // Write frames at src.cursor, dropping any the output has already passed
+  // and, if the source runs more than a ring ahead, the oldest ones.
+  void Fill(Source &src, const float *x, int64_t frames) {
+    if (src.cursor < m_readPos) {
+      const int64_t late = std::min(frames, m_readPos - src.cursor);
+      src.stats.lateFrames.fetch_add(static_cast<uint64_t>(late),
+                                     std::memory_order_relaxed);
+      if (x) x += late * 2;
+      frames -= late;
+      src.cursor += late;
+    }
+    if (frames > m_ringFrames) {
+      const int64_t skip = frames - m_ringFrames;
+      if (x) x += skip * 2;
+      frames -= skip;
+      src.cursor += skip;
+    }
+    while (frames > 0) {
+      const uint32_t pos = RingIndex(src.cursor);
+      const uint32_t run = static_cast<uint32_t>(
+          std::min<int64_t>(frames, m_ringFrames - pos));
+      float *dst = src.ring.data() + static_cast<size_t>(pos) * 2;
+      if (x) {
+        memcpy(dst, x, static_cast<size_t>(run) * 2 * sizeof(float));
+        x += static_cast<size_t>(run) * 2;
+      } else {
+        memset(dst, 0, static_cast<size_t>(run) * 2 * sizeof(float));
+      }
+      frames -= run;
+      src.cursor += run;
+    }
+  }
+
+  std::vector<std::unique_ptr<Source>> m_sources;
+  uint32_t m_ringFrames = 0;
+  uint32_t m_maxLatency = 0;
+  uint32_t m_jitter = 0;
+  bool m_haveBase = false;
+  uint64_t m_baseQpc = 0;
+  int64_t m_readPos = 0; // absolute frame of the next output frame
+};
@@ -0,0 +1,521 @@
+// Local recording and replay of the delivered stream.
+//
+// The capture thread only tees output-format PCM into an SPSC byte ring, so
+// it never waits on the disk. A writer thread, running while there is
+// something to write to, drains the ring every kWriterPollMs. It keeps the
+// last replaySeconds in a fixed in-memory replay ring and appends to the
+// open recording, if any:
+//   wav  the output format as is (16-bit PCM or IEEE float) in large
+//        sequential writes. The RIFF and data sizes are rewritten after
+//        every block, so a crash loses at most the last block.
+//   ogg  Opus in Ogg (needs a with_opus build), encoded on the writer
+//        thread. Pages close about once a second and each stands alone.
+// SaveReplay() snapshots the replay ring and writes it out the same way on
+// the calling (worker) thread.
+//
+// If the writer falls kTeeMs behind (a stalled disk), the capture thread
+// drops what doesn't fit and counts it rather than block.
+
+#pragma once
+
+#include <windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "format-converter.h"
+#include "ogg-opus-muxer.h"
+#include "opus-encoder.h"
+#include "spsc-ring.h"
+
+enum class RecordFormat { Wav, Ogg };
+
+struct RecordSettings {
+  RecordFormat format = RecordFormat::Wav;
+  uint32_t opusBitrate = 128000; // ogg only
+};
+
+struct RecordResult {
+  uint64_t frames = 0;
+  uint64_t bytes = 0; // file size
+  uint32_t sampleRate = 0;
+};
+
+// One output file, written by a single thread at a time.
+class RecordingFile {
+public:
+  RecordingFile() = default;
+  RecordingFile(const RecordingFile &) = delete;
+  RecordingFile &operator=(const RecordingFile &) = delete;
+  ~RecordingFile() {
+    if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+  }
+
+  bool Open(const std::wstring &path, const OutputFormat &fmt,
+            const RecordSettings &settings, std::string &err) {
+    m_fmt = fmt;
+    m_format = settings.format;
+    if (m_format == RecordFormat::Ogg) {
+      OpusSettings opus;
+      opus.bitrate = settings.opusBitrate;
+      if (!OpusSettings::ValidRate(fmt.sampleRate)) {
+        err = "Opus does not support sampleRate: " +
+              std::to_string(fmt.sampleRate);
+        return false;
+      }
+      if (!m_encoder.Configure(fmt.sampleRate, fmt.channels, opus, err))
+        return false;
+      m_frames48k = static_cast<uint32_t>(uint64_t(m_encoder.FrameFrames()) *
+                                          OggOpusMuxer::kGranuleRate /
+                                          fmt.sampleRate);
+    }
+    m_file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                         CREATE_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                         nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+      err = "CreateFile failed: " + std::to_string(GetLastError());
+      return false;
+    }
+    m_stage.reserve(kBlockBytes + OpusFrameEncoder::kMaxPacketBytes);
+    if (m_format == RecordFormat::Wav) {
+      m_stage.resize(kWavHeaderBytes);
+      WriteWavHeader(m_stage.data());
+    } else {
+      const uint32_t preSkip = static_cast<uint32_t>(
+          uint64_t(m_encoder.Lookahead()) * OggOpusMuxer::kGranuleRate /
+          fmt.sampleRate);
+      m_ogg.Begin(GetTickCount(), fmt.channels, fmt.sampleRate, preSkip,
+                  m_stage);
+    }
+    return FlushBlock();
+  }
+
+  // Append output-format frames (nullptr = silence).
+  void Write(const uint8_t *samples, uint32_t frames) {
+    if (m_failed) return;
+    m_framesWritten += frames;
+    if (m_format == RecordFormat::Wav) {
+      const size_t bytes = static_cast<size_t>(frames) * m_fmt.BytesPerFrame();
+      const size_t at = m_stage.size();
+      m_stage.resize(at + bytes);
+      if (samples) {
+        memcpy(m_stage.data() + at, samples, bytes);
+      } else {
+        memset(m_stage.data() + at, 0, bytes);
+      }
+      m_dataBytes += bytes;
+    } else {
+      EncodeOgg(samples, frames);
+    }
+    if (m_stage.size() >= kBlockBytes) FlushBlock();
+  }
+
+  // Write out everything staged; Ogg ends its stream.
+  bool Close(RecordResult &result, std::string &err) {
+    if (m_format == RecordFormat::Ogg) m_ogg.Flush(true, m_stage);
+    FlushBlock();
+    result.frames = m_framesWritten;
+    result.bytes = m_fileBytes;
+    result.sampleRate = m_fmt.sampleRate;
+    CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+    if (m_failed) err = "WriteFile failed: " + std::to_string(m_error);
+    return !m_failed;
+  }
+
+  uint64_t Frames() const { return m_framesWritten; }
+
+private:
+  // Staged bytes go out once this much has gathered
+  static constexpr size_t kBlockBytes = 256 * 1024;
+  static constexpr uint32_t kWavHeaderBytes = 44;
+  static constexpr uint32_t kConvertFrames = 1024;
+
+  static void Put16(uint8_t *p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+  }
+  static void Put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+  }
+
+  void WriteWavHeader(uint8_t *h) const {
+    const uint32_t dataBytes =
+        m_dataBytes > UINT32_MAX - kWavHeaderBytes
+            ? UINT32_MAX - kWavHeaderBytes
+            : static_cast<uint32_t>(m_dataBytes);
+    memcpy(h, "RIFF", 4);
+    Put32(h + 4, dataBytes + kWavHeaderBytes - 8);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    Put32(h + 16, 16);
+    Put16(h + 20, m_fmt.int16 ? 1 : 3); // PCM / IEEE float
+    Put16(h + 22, m_fmt.channels);
+    Put32(h + 24, m_fmt.sampleRate);
+    Put32(h + 28, m_fmt.sampleRate * m_fmt.BytesPerFrame());
+    Put16(h + 32, m_fmt.BytesPerFrame());
+    Put16(h + 34, m_fmt.BytesPerSample() * 8);
+    memcpy(h + 36, "data", 4);
+    Put32(h + 40, dataBytes);
+  }
+
+  void EncodeOgg(const uint8_t *samples, uint32_t frames) {
+    auto emit = [this](const uint8_t *packet, uint32_t bytes) {
+      m_ogg.Packet(packet, bytes, m_frames48k, m_stage);
+    };
+    if (!samples || !m_fmt.int16) {
+      m_encoder.Push(reinterpret_cast<const float *>(samples), frames, emit);
+      return;
+    }
+    // The encoder takes float
+    const int16_t *in = reinterpret_cast<const int16_t *>(samples);
+    m_convert.resize(static_cast<size_t>(kConvertFrames) * m_fmt.channels);
+    while (frames > 0) {
+      const uint32_t n = frames < kConvertFrames ? frames : kConvertFrames;
+      const size_t count = static_cast<size_t>(n) * m_fmt.channels;
+      for (size_t i = 0; i < count; i++)
+        m_convert[i] = in[i] * (1.0f / 32768.0f);
+      m_encoder.Push(m_convert.data(), n, emit);
+      in += count;
+      frames -= n;
+    }
+  }
+
+  // Positioned writes keep the file pointer out of it, so the WAV header can
+  // be rewritten in place between blocks.
+  bool WriteAt(uint64_t offset, const uint8_t *data, size_t bytes) {
+    while (bytes > 0) {
+      OVERLAPPED ov = {};
+      ov.Offset = static_cast<DWORD>(offset);
+      ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      const DWORD n =
+          bytes > (1u << 30) ? (1u << 30) : static_cast<DWORD>(bytes);
+      DWORD written = 0;
+      if (!WriteFile(m_file, data, n, &written, &ov) || written == 0) {
+        m_failed = true;
+        m_error = GetLastError();
+        return false;
+      }
+      offset += written;
+      data += written;
+      bytes -= written;
+    }
+    return true;
+  }
+
+  bool FlushBlock() {
+    if (m_failed) return false;
+    if (!m_stage.empty()) {
+      if (!WriteAt(m_fileBytes, m_stage.data(), m_stage.size())) return false;
+      m_fileBytes += m_stage.size();
+      m_stage.clear();
+    }
+    if (m_format == RecordFormat::Wav) {
+      uint8_t header[kWavHeaderBytes];
+      WriteWavHeader(header);
+      return WriteAt(0, header, sizeof(header));
+    }
+    return true;
+  }
+
+  HANDLE m_file = INVALID_HANDLE_VALUE;
+  OutputFormat m_fmt;
+  RecordFormat m_format = RecordFormat::Wav;
+  std::vector<uint8_t> m_stage;
+  uint64_t m_fileBytes = 0;
+  uint64_t m_dataBytes = 0; // wav
+  uint64_t m_framesWritten = 0;
+  bool m_failed = false;
+  DWORD m_error = 0;
+  // ogg
+  OpusFrameEncoder m_encoder;
+  OggOpusMuxer m_ogg;
+  uint32_t m_frames48k = 0; // per Opus packet
+  std::vector<float> m_convert;
+};
+
+class AudioRecorder {
+public:
+  static constexpr uint32_t kMaxReplaySeconds = 300;
+  // Tee ring depth, and how often the writer drains it
+  static constexpr uint32_t kTeeMs = 2000;
+  static constexpr DWORD kWriterPollMs = 50;
+
+  AudioRecorder() = default;
+  AudioRecorder(const AudioRecorder &) = delete;
+  AudioRecorder &operator=(const AudioRecorder &) = delete;
+  ~AudioRecorder() { Stop(); }
+
+  // Before capture starts. replaySeconds == 0 keeps no replay ring.
+  bool Configure(const OutputFormat &fmt, uint32_t replaySeconds) {
+    Stop();
+    m_teeDroppedFrames.store(0);
+    std::lock_guard<std::mutex> lock(m_replayMutex);
+    m_fmt = fmt;
+    m_replayWritten = 0;
+    m_replay.assign(static_cast<size_t>(replaySeconds) * fmt.sampleRate *
+                        fmt.BytesPerFrame(),
+                    0);
+    return true;
+  }
+
+  // JS thread, once capture runs: a replay ring needs the writer from the
+  // start, a recording brings it up on demand.
+  bool Start(std::string &err) {
+    if (m_replay.empty()) return true;
+    return EnsureWriter(err);
+  }
+
+  // After the capture thread stopped: drain, close any recording, join.
+  void Stop() {
+    m_tee.store(false, std::memory_order_release);
+    if (m_thread.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+      }
+      SetEvent(m_wake);
+      m_thread.join();
+    }
+    // Closing here also releases an EndRecording() the writer left waiting
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_writerRunning = false;
+      CloseRecording();
+      m_closeRequested = false;
+      m_stopping = false;
+    }
+    m_closed.notify_all();
+    if (m_wake) {
+      CloseHandle(m_wake);
+      m_wake = nullptr;
+    }
+  }
+
+  // Capture thread: output-format frames (nullptr = silence).
+  void Write(const uint8_t *samples, uint32_t frames) {
+    if (!m_tee.load(std::memory_order_acquire)) return;
+    if (!m_ring.Write(samples, frames * m_fmt.BytesPerFrame()))
+      m_teeDroppedFrames.fetch_add(frames, std::memory_order_relaxed);
+  }
+
+  // Worker thread: record into path from here on. Audio teed up to one
+  // writer poll earlier but not yet drained lands in it too.
+  bool BeginRecording(const std::wstring &path, const RecordSettings &settings,
+                      std::string &err) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_recording) {
+        err = "Already recording";
+        return false;
+      }
+    }
+    if (!EnsureWriter(err)) return false;
+    auto file = std::make_unique<RecordingFile>();
+    if (!file->Open(path, m_fmt, settings, err)) return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_recording = std::move(file);
+    m_isRecording.store(true);
+    m_recordedFrames.store(0);
+    m_result = RecordResult();
+    m_resultError.clear();
+    m_resultPending = false;
+    return true;
+  }
+
+  // Worker thread: write out what the writer still holds and close the
+  // recording. A recording Stop() already closed is reported once; fails if
+  // there is neither. Safe against a concurrent Stop(), which closes the
+  // recording itself if the writer exits first.
+  bool EndRecording(RecordResult &result, std::string &err) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_recording && !m_resultPending) {
+      err = "Not recording";
+      return false;
+    }
+    if (m_recording && m_writerRunning) {
+      m_closeRequested = true;
+      SetEvent(m_wake);
+      m_closed.wait(lock, [this] { return !m_recording; });
+    } else {
+      CloseRecording();
+    }
+    m_resultPending = false;
+    result = m_result;
+    err = m_resultError;
+    return err.empty();
+  }
+
+  // Worker thread: write the last `seconds` of the replay ring (0 = all of
+  // it) to path.
+  bool SaveReplay(const std::wstring &path, const RecordSettings &settings,
+                  uint32_t seconds, RecordResult &result, std::string &err) {
+    std::vector<uint8_t> clip;
+    OutputFormat fmt;
+    {
+      std::lock_guard<std::mutex> lock(m_replayMutex);
+      fmt = m_fmt;
+      if (m_replay.empty()) {
+        err = "No replay buffer (start with replaySeconds)";
+        return false;
+      }
+      const uint64_t held =
+          std::min<uint64_t>(m_replayWritten, m_replay.size());
+      uint64_t bytes =
+          seconds > 0 ? uint64_t(seconds) * fmt.sampleRate * fmt.BytesPerFrame()
+                      : held;
+      if (bytes > held) bytes = held;
+      clip.resize(static_cast<size_t>(bytes));
+      const size_t size = m_replay.size();
+      const size_t start =
+          static_cast<size_t>((m_replayWritten - bytes) % size);
+      const size_t first = std::min(clip.size(), size - start);
+      memcpy(clip.data(), m_replay.data() + start, first);
+      memcpy(clip.data() + first, m_replay.data(), clip.size() - first);
+    }
+    RecordingFile file;
+    if (!file.Open(path, fmt, settings, err)) return false;
+    const uint32_t bpf = fmt.BytesPerFrame();
+    const uint32_t step = fmt.sampleRate; // a second at a time
+    for (size_t at = 0; at < clip.size();) {
+      const uint32_t frames = static_cast<uint32_t>(
+          std::min<size_t>(step, (clip.size() - at) / bpf));
+      if (frames == 0) break;
+      file.Write(clip.data() + at, frames);
+      at += static_cast<size_t>(frames) * bpf;
+    }
+    return file.Close(result, err);
+  }
+
+  // Safe from the JS thread: never waits on the writer.
+  bool Recording() const { return m_isRecording.load(); }
+  uint64_t RecordedFrames() const { return m_recordedFrames.load(); }
+  uint64_t ReplayFrames() const {
+    std::lock_guard<std::mutex> lock(m_replayMutex);
+    const uint64_t held = std::min<uint64_t>(m_replayWritten, m_replay.size());
+    return held / m_fmt.BytesPerFrame();
+  }
+  uint32_t ReplaySeconds() const {
+    std::lock_guard<std::mutex> lock(m_replayMutex);
+    const uint64_t perSecond =
+        uint64_t(m_fmt.sampleRate) * m_fmt.BytesPerFrame();
+    return static_cast<uint32_t>(m_replay.size() / perSecond);
+  }
+  uint64_t TeeDroppedFrames() const { return m_teeDroppedFrames.load(); }
+
+private:
+  bool EnsureWriter(std::string &err) {
+    if (m_thread.joinable()) return true;
+    const uint32_t bytes = static_cast<uint32_t>(
+        uint64_t(kTeeMs) * m_fmt.sampleRate / 1000 * m_fmt.BytesPerFrame());
+    if (!m_ring.Init(bytes)) {
+      err = "Failed to allocate recording buffer";
+      return false;
+    }
+    m_wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!m_wake) {
+      err = "CreateEvent failed: " + std::to_string(GetLastError());
+      return false;
+    }
+    m_thread = std::thread([this] { WriterLoop(); });
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_writerRunning = true;
+    }
+    m_tee.store(true, std::memory_order_release);
+    return true;
+  }
+
+  void WriterLoop() {
+    for (;;) {
+      WaitForSingleObject(m_wake, kWriterPollMs);
+      Drain();
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_closeRequested) {
+        CloseRecording();
+        m_closeRequested = false;
+        m_closed.notify_all();
+      }
+      if (m_stopping) break;
+    }
+    Drain();
+  }
+
+  // Writer thread: move everything teed so far into the replay ring and
+  // the open recording. Frames never straddle the ring's wrap: its capacity
+  // is a power of two, and so is every frame size.
+  void Drain() {
+    const uint32_t bpf = m_fmt.BytesPerFrame();
+    const uint8_t *data = nullptr;
+    while (uint32_t bytes = m_ring.Peek(&data)) {
+      AppendReplay(data, bytes);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_recording) {
+          m_recording->Write(data, bytes / bpf);
+          m_recordedFrames.store(m_recording->Frames(),
+                                 std::memory_order_relaxed);
+        }
+      }
+      m_ring.Consume(bytes);
+    }
+  }
+
+  void AppendReplay(const uint8_t *src, uint32_t bytes) {
+    std::lock_guard<std::mutex> lock(m_replayMutex);
+    const size_t size = m_replay.size();
+    if (size == 0) return;
+    if (bytes > size) {
+      src += bytes - size;
+      bytes = static_cast<uint32_t>(size);
+    }
+    const size_t at = static_cast<size_t>(m_replayWritten % size);
+    const size_t first = std::min<size_t>(bytes, size - at);
+    memcpy(m_replay.data() + at, src, first);
+    memcpy(m_replay.data(), src + first, bytes - first);
+    m_replayWritten += bytes;
+  }
+
+  // With m_mutex held.
+  void CloseRecording() {
+    if (!m_recording) return;
+    m_resultError.clear();
+    m_recording->Close(m_result, m_resultError);
+    m_recording.reset();
+    m_resultPending = true;
+    m_isRecording.store(false);
+    m_recordedFrames.store(m_result.frames);
+  }
+
+  OutputFormat m_fmt;
+  SpscByteRing m_ring;
+  std::atomic<bool> m_tee{false};
+  std::atomic<uint64_t> m_teeDroppedFrames{0};
+  std::thread m_thread;
+  HANDLE m_wake = nullptr;
+
+  // Recording state, shared by the writer and the JS-side workers
+  mutable std::mutex m_mutex;
+  std::condition_variable m_closed;
+  std::unique_ptr<RecordingFile> m_recording;
+  bool m_closeRequested = false;
+  bool m_stopping = false;
+  bool m_writerRunning = false; // m_thread and m_wake are live
+  std::atomic<bool> m_isRecording{false};
+  std::atomic<uint64_t> m_recordedFrames{0};
+  RecordResult m_result; // of the last recording closed
+  std::string m_resultError;
+  bool m_resultPending = false; // closed, not yet reported by EndRecording
+
+  mutable std::mutex m_replayMutex;
+  std::vector<uint8_t> m_replay;
+  uint64_t m_replayWritten = 0; // bytes ever appended
+};
@@ -0,0 +1,360 @@
+// Benchmark / soak harness for the capture pipeline, on any backend.
+// Run with: node src/native/bench-capture.cjs [options]
+//
+// Captures a known source for as long as asked and records, per interval:
+// capture-to-callback delivery latency, capture thread CPU time, TSFN queue
+// depth, drops, JS memory and copies, and the glitch rate of the signal.
+// Every record is appended to a JSON Lines file as it is taken, so an
+// interrupted soak keeps what it measured. Compare runs of different
+// builds or delivery modes by diffing their summary records.
+//
+// Sources:
+//   tone    a sine captured in include mode: build/Release/tone_generator.exe
+//           on Windows, pw-cat on Linux. It's predictable sample by sample,
+//           so a phase jump or a silent run is a glitch.
+//   system  everything except this process (no glitch detection; not on
+//           Linux, where PipeWire can't exclude a process).
+//
+// Options:
+//   --duration <s>        run time (default 60; soak with e.g. 14400)
+//   --interval <s>        sample period (default 10)
+//   --source tone|system  (default tone)
+//   --frequency <Hz>      tone frequency (default 1000)
+//   --amplitude <0..1>    tone amplitude (default 0.25)
+//   --chunk-ms <ms>       capture option chunkMs
+//   --zero-copy           capture option zeroCopy
+//   --sample-rate <Hz>, --channels <1|2>, --sample-format float32|int16
+//   --codec pcm|opus      opus disables glitch detection
+//   --suppress-silence, --low-latency
+//   --queue-policy drop-oldest|drop-newest|merge, --max-queue-ms <ms>
+//   --stall-every <s> --stall-ms <ms>
+//                         block the event loop periodically, as a busy main
+//                         thread would, to watch the queue grow and drain
+//   --out <file>          JSON Lines output (default bench-<time>.jsonl)
+
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const { spawn } = require("child_process");
+
+const BUILD_DIR = path.join(__dirname, "../../build/Release");
+const ADDON_PATH = path.join(BUILD_DIR, "audio_capture.node");
+const TONE_PATH = path.join(BUILD_DIR, "tone_generator.exe");
+
+// ─── Options ───────────────────────────────────────────────────────────────────
+
+function parseArgs(argv) {
+  const flags = new Set(["zero-copy", "suppress-silence", "low-latency"]);
+  const args = {};
+  for (let i = 0; i < argv.length; i++) {
+    const key = argv[i].replace(/^--/, "");
+    args[key] = flags.has(key) ? true : argv[++i];
+  }
+  return {
+    duration: Number(args.duration ?? 60),
+    interval: Number(args.interval ?? 10),
+    source: args.source ?? "tone",
+    frequency: Number(args.frequency ?? 1000),
+    amplitude: Number(args.amplitude ?? 0.25),
+    stallEvery: Number(args["stall-every"] ?? 0),
+    stallMs: Number(args["stall-ms"] ?? 0),
+    out: args.out ?? `bench-${new Date().toISOString().replace(/[:.]/g, "-")}.jsonl`,
+    capture: {
+      zeroCopy: !!args["zero-copy"],
+      chunkMs: Number(args["chunk-ms"] ?? 0),
+      ...(args["sample-rate"] && { sampleRate: Number(args["sample-rate"]) }),
+      ...(args.channels && { channels: Number(args.channels) }),
+      ...(args["sample-format"] && { sampleFormat: args["sample-format"] }),
+      ...(args.codec && { codec: args.codec }),
+      suppressSilence: !!args["suppress-silence"],
+      lowLatency: !!args["low-latency"],
+      ...(args["queue-policy"] && { queuePolicy: args["queue-policy"] }),
+      ...(args["max-queue-ms"] && { maxQueueMs: Number(args["max-queue-ms"]) }),
+    },
+  };
+}
+
+const opts = parseArgs(process.argv.slice(2));
+
+function record(obj) {
+  fs.appendFileSync(opts.out, JSON.stringify(obj) + "\n");
+}
+
+function sleep(ms) {
+  return new Promise((resolve) => setTimeout(resolve, ms));
+}
+
+// ─── Glitch detection ──────────────────────────────────────────────────────────
+
+/**
+ * Follows the tone on the first channel. A clean sine never moves more than
+ * amplitude * 2π f / rate between samples, so a larger step is a
+ * discontinuity. A silence marker on a tone source is a gap. Consecutive
+ * bad samples count as one glitch.
+ */
+class ToneChecker {
+  constructor(frequency, amplitude, sampleRate, channels, int16) {
+    const quantum = int16 ? 2 / 32768 : 1e-6;
+    this.maxStep = amplitude * 2 * Math.PI * frequency / sampleRate * 1.05 + quantum;
+    this.channels = channels;
+    this.scale = int16 ? 1 / 32768 : 1;
+    this.prev = null;
+    this.inGlitch = false;
+    this.glitches = 0;
+    this.gapFrames = 0;
+  }
+
+  samples(data) {
+    for (let i = 0; i < data.length; i += this.channels) {
+      const v = data[i] * this.scale;
+      if (this.prev !== null) {
+        const bad = Math.abs(v - this.prev) > this.maxStep;
+        if (bad && !this.inGlitch) this.glitches++;
+        this.inGlitch = bad;
+      }
+      this.prev = v;
+    }
+  }
+
+  silence(frames) {
+    this.gapFrames += frames;
+    if (!this.inGlitch) this.glitches++;
+    this.inGlitch = true;
+    this.prev = 0;
+  }
+}
+
+// ─── Histogram deltas ──────────────────────────────────────────────────────────
+
+/** Upper edge (µs) of the bucket holding quantile q of the counts added since prev; null if in the open last bucket. */
+function quantileUs(hist, prev, q) {
+  const delta = hist.counts.map((c, i) => c - (prev ? prev.counts[i] : 0));
+  const total = delta.reduce((a, b) => a + b, 0);
+  if (total === 0) return null;
+  let seen = 0;
+  for (let i = 0; i < delta.length; i++) {
+    seen += delta[i];
+    if (seen >= q * total) return i < hist.edgesUs.length ? hist.edgesUs[i] : null;
+  }
+  return null;
+}
+
+// ─── Run ───────────────────────────────────────────────────────────────────────
+
+// Writes the tone as 48 kHz stereo float32 to stdout, paced by the reader.
+// A process of its own: the harness's event loop is stalled on purpose.
+const TONE_WRITER = `
+const [f, a] = process.argv.slice(1).map(Number);
+const block = 960;
+const buf = Buffer.alloc(block * 8);
+const step = (2 * Math.PI * f) / 48000;
+let phase = 0;
+const write = () => {
+  for (let i = 0; i < block; i++) {
+    const v = a * Math.sin(phase);
+    phase = (phase + step) % (2 * Math.PI);
+    buf.writeFloatLE(v, i * 8);
+    buf.writeFloatLE(v, i * 8 + 4);
+  }
+  if (process.stdout.write(buf)) setImmediate(write);
+  else process.stdout.once("drain", write);
+};
+write();
+`;
+
+async function startPwTone() {
+  const player = spawn("pw-cat", ["--playback", "--format", "f32", "--rate", "48000", "--channels", "2", "-"], {
+    stdio: ["pipe", "ignore", "inherit"],
+  });
+  const writer = spawn(process.execPath, ["-e", TONE_WRITER, String(opts.frequency), String(opts.amplitude)], {
+    stdio: ["ignore", player.stdin, "inherit"],
+  });
+  await new Promise((resolve, reject) => {
+    player.once("error", (err) => reject(new Error(`pw-cat: ${err.message}`)));
+    player.once("exit", (code) => reject(new Error(`pw-cat exited (${code})`)));
+    // pw-cat prints nothing on start; give its stream time to link
+    setTimeout(resolve, 500);
+  });
+  return {
+    pid: player.pid,
+    kill() {
+      writer.kill();
+      player.kill();
+    },
+  };
+}
+
+async function startTone() {
+  if (process.platform === "linux") return startPwTone();
+  if (process.platform !== "win32") throw new Error("--source tone needs Windows or Linux; use --source system");
+  if (!fs.existsSync(TONE_PATH)) throw new Error(`${TONE_PATH} not found; run node-gyp rebuild`);
+  const child = spawn(TONE_PATH, [String(opts.frequency), String(opts.amplitude)], {
+    stdio: ["ignore", "pipe", "inherit"],
+  });
+  await new Promise((resolve, reject) => {
+    child.once("exit", (code) => reject(new Error(`tone_generator exited (${code})`)));
+    child.stdout.on("data", (d) => {
+      if (d.toString().includes("ready")) resolve();
+    });
+  });
+  return child;
+}
+
+async function main() {
+  const mod = { exports: {} };
+  process.dlopen(mod, ADDON_PATH);
+  const addon = mod.exports;
+
+  const tone = opts.source === "tone" ? await startTone() : null;
+  const session = new addon.CaptureSession();
+
+  let checker = null;
+  let callbacks = 0;
+  let samples = 0;
+  let bytes = 0;
+  session.onData((data) => {
+    callbacks++;
+    if (typeof data === "number") {
+      checker?.silence(data);
+      return;
+    }
+    samples += data.length;
+    bytes += data.byteLength;
+    checker?.samples(data);
+  });
+  const states = [];
+  session.onStateChange((ev) => states.push({ t: Date.now(), ...ev }));
+
+  const info = tone
+    ? await session.start(tone.pid, false, opts.capture)
+    : await session.start(process.pid, true, opts.capture);
+  // The first second covers the tone's own start-up
+  await sleep(1000);
+  if (tone && info.codec === "pcm") {
+    checker = new ToneChecker(opts.frequency, opts.amplitude, info.format.sampleRate,
+      info.format.channels, info.format.sampleFormat === "int16");
+  }
+
+  record({
+    type: "config",
+    time: new Date().toISOString(),
+    ...opts,
+    info,
+    node: process.version,
+    cpu: os.cpus()[0]?.model,
+    os: `${os.type()} ${os.release()}`,
+  });
+  console.log(`Benchmarking ${opts.source} for ${opts.duration}s → ${opts.out}`);
+
+  const stall = opts.stallEvery > 0 && opts.stallMs > 0
+    ? setInterval(() => {
+        const end = Date.now() + opts.stallMs;
+        while (Date.now() < end) {}
+      }, opts.stallEvery * 1000)
+    : null;
+
+  const t0 = Date.now();
+  let prev = session.getStats();
+  let prevAt = t0;
+  let prevCallbacks = 0;
+  let prevGlitches = 0;
+  let peakDepth = 0;
+  let peakRss = 0;
+  const latencyP99 = [];
+  while (Date.now() - t0 < opts.duration * 1000 && session.isRunning()) {
+    await sleep(Math.min(opts.interval * 1000, opts.duration * 1000 - (Date.now() - t0)));
+    const now = Date.now();
+    const s = session.getStats();
+    const mem = process.memoryUsage();
+    const glitches = checker ? checker.glitches : null;
+    const p99 = quantileUs(s.deliveryLatency, prev.deliveryLatency, 0.99);
+    if (p99 !== null) latencyP99.push(p99);
+    peakDepth = Math.max(peakDepth, s.maxReadyDepth);
+    peakRss = Math.max(peakRss, mem.rss);
+    const sample = {
+      type: "sample",
+      t: (now - t0) / 1000,
+      packets: s.packets - prev.packets,
+      callbacks: callbacks - prevCallbacks,
+      droppedPackets: s.droppedPackets - prev.droppedPackets,
+      discontinuities: s.discontinuities - prev.discontinuities,
+      positionGaps: s.positionGaps - prev.positionGaps,
+      glitches: glitches === null ? null : glitches - prevGlitches,
+      latencyUs: {
+        p50: quantileUs(s.deliveryLatency, prev.deliveryLatency, 0.5),
+        p99,
+        max: s.maxDeliveryLatencyUs,
+      },
+      cpuPct: s.captureThreadCpuMs >= 0 && prev.captureThreadCpuMs >= 0
+        ? (100 * (s.captureThreadCpuMs - prev.captureThreadCpuMs)) / (now - prevAt)
+        : null,
+      tsfn: {
+        calls: s.tsfnCalls - prev.tsfnCalls,
+        failures: s.tsfnCallFailures - prev.tsfnCallFailures,
+        readyDepth: s.readyDepth,
+        maxReadyDepth: s.maxReadyDepth,
+      },
+      copiedPackets: s.copiedPackets - prev.copiedPackets,
+      queueDroppedPackets: s.queueDroppedPackets - prev.queueDroppedPackets,
+      queueMergedPackets: s.queueMergedPackets - prev.queueMergedPackets,
+      lentSlots: s.lentSlots,
+      memory: { rss: mem.rss, heapUsed: mem.heapUsed, external: mem.external, arrayBuffers: mem.arrayBuffers },
+    };
+    record(sample);
+    console.log(
+      `  t=${sample.t.toFixed(0)}s packets=${sample.packets} p99=${p99 ?? "-"}µs ` +
+        `cpu=${sample.cpuPct?.toFixed(2) ?? "-"}% depth=${s.readyDepth}/${s.maxReadyDepth} ` +
+        `glitches=${sample.glitches ?? "-"} rss=${(mem.rss / 1048576).toFixed(1)}MB`,
+    );
+    prev = s;
+    prevAt = now;
+    prevCallbacks = callbacks;
+    prevGlitches = glitches ?? 0;
+  }
+
+  if (stall) clearInterval(stall);
+  const final = session.getStats();
+  const elapsed = (Date.now() - t0) / 1000;
+  session.stop();
+  tone?.kill();
+
+  latencyP99.sort((a, b) => a - b);
+  const summary = {
+    type: "summary",
+    seconds: elapsed,
+    packets: final.packets,
+    callbacks,
+    samples,
+    bytes,
+    droppedPackets: final.droppedPackets,
+    discontinuities: final.discontinuities,
+    positionGaps: final.positionGaps,
+    glitches: checker ? checker.glitches : null,
+    glitchesPerHour: checker ? (checker.glitches * 3600) / elapsed : null,
+    gapFrames: checker ? checker.gapFrames : null,
+    deliveryLatency: final.deliveryLatency,
+    maxDeliveryLatencyUs: final.maxDeliveryLatencyUs,
+    medianIntervalP99Us: latencyP99.length ? latencyP99[latencyP99.length >> 1] : null,
+    captureThreadCpuMs: final.captureThreadCpuMs,
+    captureThreadCpuPct: final.captureThreadCpuMs >= 0 ? (100 * final.captureThreadCpuMs) / (elapsed * 1000) : null,
+    maxReadyDepth: peakDepth,
+    tsfnCallFailures: final.tsfnCallFailures,
+    queueDroppedPackets: final.queueDroppedPackets,
+    queueDroppedFrames: final.queueDroppedFrames,
+    queueMerges: final.queueMerges,
+    queueMergedPackets: final.queueMergedPackets,
+    copiedPackets: final.copiedPackets,
+    copiedBytes: final.copiedBytes,
+    peakRss,
+    recoveries: final.recoveries,
+    states,
+  };
+  record(summary);
+  console.log(`\n--- ${elapsed.toFixed(0)}s: ${summary.packets} packets, ${summary.glitches ?? "-"} glitches, ` +
+    `max latency ${summary.maxDeliveryLatencyUs}µs, capture CPU ${summary.captureThreadCpuPct?.toFixed(2) ?? "-"}% ---\n`);
+}
+
+main().catch((err) => {
+  console.error("bench-capture:", err.message);
+  process.exit(1);
+});
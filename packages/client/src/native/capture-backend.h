@@ -0,0 +1,114 @@
+// Per-OS capture backends for the POSIX addon (audio-capture-posix.cpp).
+//
+// A backend opens one per-application loopback stream and hands its audio
+// to a Sink as 48 kHz interleaved stereo float32, the same capture format
+// WASAPI runs at on Windows, so the shared core (format-converter.h,
+// level-meter.h, packet-pool.h, capture-delivery.h) sees identical input on
+// every platform:
+//
+//   macOS  screencapturekit-backend.mm: an SCStream with capturesAudio over
+//          a content filter of the target application (include) or of the
+//          display minus it (exclude)
+//   Linux  pipewire-backend.cpp: a pw_stream capturing the target's
+//          playback nodes (include only; PipeWire has no "everything but
+//          this client" mix)
+//
+// Each backend TU also provides WindowProcessId and ProcessName, for the
+// window → process resolution desktopCapturer ids need.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct CaptureTarget {
+  uint32_t pid = 0;
+  // Capture everything except pid's audio instead of only pid's
+  bool excludeMode = false;
+};
+
+class CaptureBackend {
+public:
+  static constexpr uint32_t kSampleRate = 48000;
+  static constexpr uint32_t kChannels = 2;
+  // How often a pending Start() looks at its cancel flag
+  static constexpr uint32_t kCancelPollMs = 50;
+
+  // Called on the backend's own realtime thread, never concurrently.
+  class Sink {
+  public:
+    virtual ~Sink() = default;
+    // frames × 2 samples, nullptr for a silent buffer. captureTime is the
+    // first frame's, on the capture clock (capture-clock.h, 0 = unknown);
+    // position counts frames since the stream started.
+    virtual void OnAudio(const float *frames, uint32_t numFrames,
+                         uint64_t captureTime, uint64_t position) = 0;
+    // The stream ended on its own: reason is "process-exited" when the
+    // target went away, else "stream-error". No OnAudio follows.
+    virtual void OnFailed(const char *reason, const std::string &message) = 0;
+  };
+
+  virtual ~CaptureBackend() = default;
+  virtual const char *Name() const = 0;
+  // Worker thread. Blocks until the stream delivers or fails to open, or
+  // until another thread sets cancel; on failure returns false with the
+  // message to reject with in err.
+  virtual bool Start(const CaptureTarget &target, Sink *sink,
+                     const std::atomic<bool> &cancel, std::string &err) = 0;
+  // Any thread. Once it returns, no Sink call is running or will start.
+  virtual void Stop() = 0;
+};
+
+// Keeps a backend's stream continuous. WASAPI hands out silent packets
+// while the target is quiet; PipeWire and ScreenCaptureKit may deliver
+// nothing at all (no linked node, a suspended stream), which would leave the
+// renderer's buffer level and partial chunks hanging. A backend reports
+// every buffer to Delivered() and calls Gap() from a kTickMs timer on the
+// same thread; a gap longer than kMaxGapMs is returned as silence.
+class CaptureTimeline {
+public:
+  static constexpr uint32_t kTickMs = 20;
+  static constexpr uint32_t kMaxGapMs = 60;
+  static constexpr uint32_t kMaxFillMs = 1000; // per tick, after a stall
+
+  void Reset(uint64_t now) {
+    m_until = now;
+    m_position = 0;
+  }
+
+  // A buffer of frames captured at captureTime; returns its position.
+  uint64_t Delivered(uint64_t captureTime, uint32_t frames) {
+    const uint64_t position = m_position;
+    m_position += frames;
+    const uint64_t end =
+        captureTime + uint64_t(frames) * 10000000 / CaptureBackend::kSampleRate;
+    if (end > m_until) m_until = end;
+    return position;
+  }
+
+  // Frames of silence owed at now (0 if none), and their start time.
+  uint32_t Gap(uint64_t now, uint64_t &start) const {
+    if (now < m_until + uint64_t(kMaxGapMs) * 10000) return 0;
+    uint64_t gap = now - m_until;
+    if (gap > uint64_t(kMaxFillMs) * 10000) gap = uint64_t(kMaxFillMs) * 10000;
+    start = m_until;
+    return static_cast<uint32_t>(gap * CaptureBackend::kSampleRate / 10000000);
+  }
+
+private:
+  uint64_t m_until = 0;    // capture time just past the last frame delivered
+  uint64_t m_position = 0; // frames delivered since Reset()
+};
+
+// The platform's backend; nullptr where there is none.
+std::unique_ptr<CaptureBackend> CreateCaptureBackend();
+
+// The process owning a desktopCapturer window id (the number in
+// "window:<id>:0"), 0 if it can't be resolved: an X11 XID on Linux (Wayland
+// portal ids carry no process), a CGWindowID on macOS.
+uint32_t WindowProcessId(uint64_t windowId);
+
+// pid's executable name, empty if it's gone.
+std::string ProcessName(uint32_t pid);
@@ -0,0 +1,85 @@
+// The capture clock: a monotonic timestamp in 100 ns units.
+//
+// Packets are stamped with the time their first frame was captured, and JS
+// measures delivery latency against the same clock. On Windows that's QPC,
+// which WASAPI already stamps packets with; ScreenCaptureKit sample buffers
+// carry mach host time and PipeWire buffers CLOCK_MONOTONIC, so each
+// backend's own timestamps map onto this clock without a conversion at
+// delivery.
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(_WIN32)
+
+inline LONGLONG QpcNow() {
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return t.QuadPart;
+}
+
+inline LONGLONG QpcFrequency() {
+  static const LONGLONG freq = [] {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return f.QuadPart;
+  }();
+  return freq;
+}
+
+// QPC ticks to the 100 ns units WASAPI stamps packets with, without
+// overflowing after long uptimes.
+inline uint64_t QpcTo100ns(LONGLONG qpc) {
+  const LONGLONG freq = QpcFrequency();
+  return static_cast<uint64_t>(qpc / freq * 10000000 +
+                               qpc % freq * 10000000 / freq);
+}
+
+// The inverse, for turning capture-clock deadlines back into QPC ticks.
+inline LONGLONG QpcFrom100ns(uint64_t t) {
+  const LONGLONG freq = QpcFrequency();
+  const LONGLONG v = static_cast<LONGLONG>(t);
+  return v / 10000000 * freq + v % 10000000 * freq / 10000000;
+}
+
+inline uint64_t CaptureClockNow() { return QpcTo100ns(QpcNow()); }
+
+#elif defined(__APPLE__)
+
+// mach_absolute_time ticks (the host time of CMSampleBuffer timestamps) to
+// 100 ns units.
+inline uint64_t MachTo100ns(uint64_t ticks) {
+  static const mach_timebase_info_data_t tb = [] {
+    mach_timebase_info_data_t info;
+    mach_timebase_info(&info);
+    return info;
+  }();
+  // numer/denom is ns per tick (1/1 on Intel, 125/3 on Apple silicon)
+  const uint64_t denom = uint64_t(tb.denom) * 100;
+  return ticks / denom * tb.numer + ticks % denom * tb.numer / denom;
+}
+
+inline uint64_t CaptureClockNow() { return MachTo100ns(mach_absolute_time()); }
+
+#else
+
+inline uint64_t MonotonicTo100ns(const timespec &t) {
+  return uint64_t(t.tv_sec) * 10000000 + uint64_t(t.tv_nsec) / 100;
+}
+
+inline uint64_t CaptureClockNow() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return MonotonicTo100ns(t);
+}
+
+#endif
@@ -0,0 +1,309 @@
+// JS-thread delivery of captured packets, shared by every capture backend.
+//
+// A backend's producer thread fills PacketPool slots and publishes them to
+// the ready ring, then calls Schedule() to wake JS through the session's
+// ThreadSafeFunction. Drain() runs on the JS thread and hands each ready
+// packet to the onData callback, lending the slot as an external ArrayBuffer
+// where the runtime allows it (zero-copy) or copying it otherwise. Packets
+// that waited past maxQueueMs for a stalled event loop are dropped or merged
+// per the queue policy, so a stall costs packets instead of lasting latency.
+//
+// The TSFN queue never holds more than one call: the backlog lives in the
+// ready ring, bounded by the pool.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <napi.h>
+
+#include "capture-clock.h"
+#include "capture-stats.h"
+#include "packet-pool.h"
+
+// What the JS thread does with ready packets that waited too long, e.g.
+// while the event loop was stalled:
+//   DropOldest  discard them, so delivery resumes at the live edge
+//   DropNewest  keep the first maxQueueMs of the backlog, discard the rest
+//   Merge       hand the whole backlog to one callback (PCM only; Opus
+//               packets can't be joined and fall back to DropOldest)
+enum class QueuePolicy { DropOldest, DropNewest, Merge };
+
+inline const char *QueuePolicyName(QueuePolicy policy) {
+  switch (policy) {
+  case QueuePolicy::DropOldest: return "drop-oldest";
+  case QueuePolicy::DropNewest: return "drop-newest";
+  case QueuePolicy::Merge: return "merge";
+  }
+  return "drop-oldest";
+}
+
+inline bool ParseQueuePolicy(const std::string &name, QueuePolicy &out) {
+  static const QueuePolicy all[] = {QueuePolicy::DropOldest,
+                                    QueuePolicy::DropNewest, QueuePolicy::Merge};
+  for (QueuePolicy p : all) {
+    if (name == QueuePolicyName(p)) {
+      out = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+// JS thread: the second onData argument,
+//   { captureTime, devicePosition, latencyMs }
+// captureTime is when the first frame was captured, in ms on the capture
+// clock (comparable across processes on the machine); devicePosition is its
+// stream position in 48 kHz capture frames, null if unknown (and always in
+// mix mode); latencyMs is how long it took from capture to this call.
+inline Napi::Object TimingToJS(Napi::Env env, const Packet *p) {
+  Napi::Object o = Napi::Object::New(env);
+  if (p->captureQpc != 0) {
+    o.Set("captureTime", p->captureQpc / 10000.0);
+    const uint64_t now = CaptureClockNow();
+    o.Set("latencyMs",
+          now > p->captureQpc ? (now - p->captureQpc) / 10000.0 : 0.0);
+  } else {
+    o.Set("captureTime", env.Null());
+    o.Set("latencyMs", env.Null());
+  }
+  if (p->devicePosition != Packet::kNoPosition) {
+    o.Set("devicePosition", static_cast<double>(p->devicePosition));
+  } else {
+    o.Set("devicePosition", env.Null());
+  }
+  return o;
+}
+
+template <size_t N>
+Napi::Object HistogramToJS(Napi::Env env, const Histogram<N> &h) {
+  Napi::Array edges = Napi::Array::New(env, N - 1);
+  Napi::Array counts = Napi::Array::New(env, N);
+  for (size_t i = 0; i < N; i++) {
+    if (i < N - 1) edges.Set(i, static_cast<double>(h.EdgeList()[i]));
+    counts.Set(i, static_cast<double>(h.Count(i)));
+  }
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("edgesUs", edges);
+  o.Set("counts", counts);
+  return o;
+}
+
+class PacketDelivery {
+public:
+  PacketDelivery(PacketPool &pool, CaptureStats &stats)
+      : m_pool(pool), m_stats(stats) {}
+
+  // Worker thread, before the producer starts. Packets carry channels ×
+  // frames samples at sampleRate; an Opus packet (sampleBytes == 1) covers
+  // opusFrames.
+  void Configure(bool zeroCopy, QueuePolicy policy, uint32_t maxQueueMs,
+                 uint32_t sampleRate, uint32_t channels, uint32_t opusFrames) {
+    m_drainPending.store(false);
+    m_zeroCopy = zeroCopy;
+    m_policy = policy;
+    m_maxQueueMs = maxQueueMs;
+    m_queueBound = uint64_t(maxQueueMs) * 10000;
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_opusFrames = opusFrames;
+  }
+
+  bool ZeroCopy() const { return m_zeroCopy; }
+  QueuePolicy Policy() const { return m_policy; }
+  uint32_t MaxQueueMs() const { return m_maxQueueMs; }
+
+  // Producer thread: wake JS unless a drain is already queued.
+  template <typename Tsfn> void Schedule(Tsfn *tsfn) {
+    if (!tsfn) return;
+    if (m_drainPending.exchange(true, std::memory_order_acq_rel)) return;
+    const bool ok = tsfn->NonBlockingCall() == napi_ok;
+    if (!ok) m_drainPending.store(false, std::memory_order_release);
+    m_stats.RecordWakeup(ok, m_pool.ReadyCount());
+  }
+
+  // JS thread. Clears the pending flag before draining so a packet
+  // published mid-drain always schedules another call.
+  void Drain(Napi::Env env, Napi::Function &jsCallback) {
+    m_drainPending.store(false, std::memory_order_release);
+
+    const uint64_t now = CaptureClockNow();
+    // DropNewest: packets captured after this are discarded (0 = not tripped)
+    uint64_t cutoff = 0;
+    while (Packet *p = m_pool.Consume()) {
+      if (Overdue(p, now)) {
+        switch (m_policy) {
+        case QueuePolicy::Merge:
+          if (p->sampleBytes != 1) {
+            DeliverMerged(env, jsCallback, p);
+            continue;
+          }
+          [[fallthrough]];
+        case QueuePolicy::DropOldest:
+          DropQueued(p);
+          continue;
+        case QueuePolicy::DropNewest:
+          if (cutoff == 0) cutoff = p->captureQpc + m_queueBound;
+          break;
+        }
+      }
+      if (cutoff != 0 && p->captureQpc > cutoff) {
+        DropQueued(p);
+        continue;
+      }
+      if (p->count == 0) {
+        // Silence marker: JS synthesizes the zeros itself
+        const uint32_t frames = p->silentFrames;
+        Napi::Object timing = TimingToJS(env, p);
+        PacketPool::Release(p);
+        jsCallback.Call({Napi::Number::New(env, frames), timing});
+        continue;
+      }
+      const size_t count = p->count;
+      const uint32_t sampleBytes = p->sampleBytes;
+      const uint64_t captureQpc = p->captureQpc;
+      const size_t bytes = p->Bytes();
+      Napi::Object timing = TimingToJS(env, p);
+      Napi::ArrayBuffer ab;
+      bool copied = false;
+      if (!m_zeroCopy || !Lend(env, p, ab)) {
+        ab = Napi::ArrayBuffer::New(env, bytes);
+        memcpy(ab.Data(), p->data, bytes);
+        PacketPool::Release(p);
+        copied = true;
+      }
+      m_stats.RecordDelivery(captureQpc, CaptureClockNow(), copied, bytes);
+      CallWithSamples(env, jsCallback, ab, count, sampleBytes, timing);
+    }
+  }
+
+  // The JS delivery counters of getStats(), shared by every backend.
+  void StatsToJS(Napi::Object o) const {
+    Napi::Env env = o.Env();
+    auto num = [](const auto &a) { return static_cast<double>(a.load()); };
+    o.Set("tsfnCalls", num(m_stats.tsfnCalls));
+    o.Set("tsfnCallFailures", num(m_stats.tsfnCallFailures));
+    o.Set("readyDepth", num(m_stats.readyDepth));
+    o.Set("maxReadyDepth", num(m_stats.maxReadyDepth));
+    o.Set("lentSlots", static_cast<double>(m_pool.LentCount()));
+    o.Set("deliveryLatency", HistogramToJS(env, m_stats.deliveryLatency));
+    o.Set("maxDeliveryLatencyUs", num(m_stats.maxDeliveryLatencyUs));
+    o.Set("copiedPackets", num(m_stats.copiedPackets));
+    o.Set("copiedBytes", num(m_stats.copiedBytes));
+    o.Set("queueDroppedPackets", num(m_stats.queueDroppedPackets));
+    o.Set("queueDroppedFrames", num(m_stats.queueDroppedFrames));
+    o.Set("queueMerges", num(m_stats.queueMerges));
+    o.Set("queueMergedPackets", num(m_stats.queueMergedPackets));
+  }
+
+private:
+  static void FinalizeLent(napi_env, void *, void *hint) {
+    PacketPool::Release(static_cast<Packet *>(hint));
+  }
+
+  // JS thread: wrap delivered samples in the typed array for their format.
+  static void CallWithSamples(Napi::Env env, Napi::Function &jsCallback,
+                              Napi::ArrayBuffer ab, size_t count,
+                              uint32_t sampleBytes, Napi::Object timing) {
+    if (sampleBytes == 1) {
+      jsCallback.Call({Napi::Uint8Array::New(env, count, ab, 0), timing});
+    } else if (sampleBytes == sizeof(int16_t)) {
+      jsCallback.Call({Napi::Int16Array::New(env, count, ab, 0), timing});
+    } else {
+      jsCallback.Call({Napi::Float32Array::New(env, count, ab, 0), timing});
+    }
+  }
+
+  // Wrap a slot as an external ArrayBuffer that returns it to the pool when
+  // collected. Electron builds with the V8 memory cage reject external
+  // buffers; in that case zero-copy is switched off for the rest of the
+  // session.
+  bool Lend(Napi::Env env, Packet *p, Napi::ArrayBuffer &out) {
+    napi_value ab = nullptr;
+    m_pool.Lend(p);
+    napi_status status = napi_create_external_arraybuffer(
+        env, p->data, p->Bytes(), FinalizeLent, p, &ab);
+    if (status != napi_ok) {
+      if (status == napi_no_external_buffers_allowed) m_zeroCopy = false;
+      PacketPool::Release(p);
+      return false;
+    }
+    out = Napi::ArrayBuffer(env, ab);
+    return true;
+  }
+
+  // Output frames a ready packet covers.
+  uint32_t PacketFrames(const Packet *p) const {
+    if (p->count == 0) return p->silentFrames;
+    if (p->sampleBytes == 1) return m_opusFrames;
+    return p->count / m_channels;
+  }
+
+  // True if p's last frame was captured more than maxQueueMs ago.
+  bool Overdue(const Packet *p, uint64_t now100ns) const {
+    if (m_queueBound == 0 || p->captureQpc == 0) return false;
+    const uint64_t duration =
+        uint64_t(PacketFrames(p)) * 10000000 / m_sampleRate;
+    return now100ns > p->captureQpc + duration + m_queueBound;
+  }
+
+  // Discard a ready packet under the queue policy.
+  void DropQueued(Packet *p) {
+    m_stats.RecordQueueDrop(PacketFrames(p));
+    PacketPool::Release(p);
+  }
+
+  // Deliver `first` and everything behind it in the ready ring as one
+  // copied buffer, silence markers expanded to zeros.
+  void DeliverMerged(Napi::Env env, Napi::Function &jsCallback, Packet *first) {
+    Packet *run[PacketPool::kMaxSlots];
+    uint32_t n = 0;
+    run[n++] = first;
+    while (n < PacketPool::kMaxSlots) {
+      Packet *p = m_pool.Consume();
+      if (!p) break;
+      run[n++] = p;
+    }
+    size_t samples = 0;
+    for (uint32_t i = 0; i < n; i++)
+      samples += static_cast<size_t>(PacketFrames(run[i])) * m_channels;
+    const uint32_t sampleBytes = first->sampleBytes;
+    const uint64_t captureQpc = first->captureQpc;
+    Napi::Object timing = TimingToJS(env, first);
+    const size_t bytes = samples * sampleBytes;
+    Napi::ArrayBuffer ab = Napi::ArrayBuffer::New(env, bytes);
+    uint8_t *dst = static_cast<uint8_t *>(ab.Data());
+    for (uint32_t i = 0; i < n; i++) {
+      Packet *p = run[i];
+      const size_t len =
+          static_cast<size_t>(PacketFrames(p)) * m_channels * sampleBytes;
+      if (p->count > 0) {
+        memcpy(dst, p->data, len);
+      } else {
+        memset(dst, 0, len);
+      }
+      dst += len;
+      PacketPool::Release(p);
+    }
+    m_stats.queueMerges.fetch_add(1, std::memory_order_relaxed);
+    m_stats.queueMergedPackets.fetch_add(n, std::memory_order_relaxed);
+    m_stats.RecordDelivery(captureQpc, CaptureClockNow(), true, bytes);
+    CallWithSamples(env, jsCallback, ab, samples, sampleBytes, timing);
+  }
+
+  PacketPool &m_pool;
+  CaptureStats &m_stats;
+  std::atomic<bool> m_drainPending{false};
+  bool m_zeroCopy = false; // lend pool slots to JS as external buffers
+  // Queue bound: how long after its last frame a ready packet may wait for
+  // JS, in 100 ns units (0 = only the pool's size)
+  QueuePolicy m_policy = QueuePolicy::DropOldest;
+  uint32_t m_maxQueueMs = 0;
+  uint64_t m_queueBound = 0;
+  uint32_t m_sampleRate = 48000;
+  uint32_t m_channels = 2;
+  uint32_t m_opusFrames = 0; // output frames per Opus packet
+};
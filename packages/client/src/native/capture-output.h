@@ -0,0 +1,317 @@
+// What a capture session delivers, shared by the WASAPI build
+// (audio-capture.cpp) and the POSIX one (audio-capture-posix.cpp): the
+// startCapture options that shape the output, and the PacketChunker that
+// packs output-format frames into PacketPool slots on the producer thread.
+//
+// Output frames are gathered into one slot until it holds chunkFrames, or
+// until the partial chunk is older than its own duration; chunkFrames == 0
+// publishes every append at once. With suppressSilence, silent input only
+// advances a run counter, published as a count == 0 marker slot when audio
+// resumes, the run reaches a chunk (and at least kSilenceMarkerMs), or it
+// goes stale. Ages are on the capture clock (capture-clock.h): a marker
+// carries the capture time of the run's first packet, and its age counts
+// from when the producer saw it. getLevels() reads the meter through
+// LevelsToJS in both builds.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <napi.h>
+
+#include "capture-clock.h"
+#include "capture-delivery.h"
+#include "capture-stats.h"
+#include "format-converter.h"
+#include "level-meter.h"
+#include "packet-pool.h"
+
+// ─── startCapture options ──────────────────────────────────────────────────────
+
+static constexpr uint32_t kMaxChunkMs = 500;
+// A silent run is reported at least this often, so the renderer's buffer
+// level keeps tracking the capture clock through long pauses.
+static constexpr uint32_t kSilenceMarkerMs = 100;
+// Ready packets older than this (beyond their own duration) trip the queue
+// policy. The renderer skips anything past 250 ms of backlog anyway.
+static constexpr uint32_t kDefaultMaxQueueMs = 200;
+static constexpr uint32_t kMaxQueueMs = 5000;
+
+// The options every build supports; each addon extends it with its own.
+struct DeliveryOptions {
+  // Lend pool slots to JS as external ArrayBuffers instead of copying
+  bool zeroCopy = false;
+  // Coalesce packets into chunks of this many output frames (0 = every packet)
+  uint32_t chunkFrames = 0;
+  // Delivered format; every backend captures 48 kHz float32 stereo (WASAPI
+  // may capture more channels, see audio-capture.cpp)
+  OutputFormat format;
+  // Collapse silent packets into "N frames of silence" markers; a packet is
+  // silent if the backend flags it or no sample exceeds silenceThreshold
+  bool suppressSilence = false;
+  float silenceThreshold = 0.0f;
+  // Keep peak/RMS/loudness for getLevels(); meterOnly never delivers data
+  bool meter = false;
+  bool meterOnly = false;
+  // Bound on how long a packet may wait for JS (0 = only the pool's size)
+  QueuePolicy queuePolicy = QueuePolicy::DropOldest;
+  uint32_t maxQueueMs = kDefaultMaxQueueMs;
+};
+
+// {
+//   zeroCopy?: boolean,
+//   chunkMs?: number, chunkFrames?: number,   // whichever is reached first
+//   sampleRate?: number, channels?: 1 | 2,
+//   sampleFormat?: "float32" | "int16",
+//   suppressSilence?: boolean, silenceThreshold?: number,   // linear peak
+//   meter?: boolean, meterOnly?: boolean,
+//   queuePolicy?: "drop-oldest" | "drop-newest" | "merge", maxQueueMs?: number,
+// }
+inline bool ParseDeliveryOptions(const Napi::Object &o, DeliveryOptions &out,
+                                 std::string &err) {
+  if (o.Has("zeroCopy")) out.zeroCopy = o.Get("zeroCopy").ToBoolean().Value();
+
+  OutputFormat &fmt = out.format;
+  if (o.Get("sampleRate").IsNumber()) {
+    fmt.sampleRate = o.Get("sampleRate").As<Napi::Number>().Uint32Value();
+    if (fmt.sampleRate < OutputFormat::kMinRate ||
+        fmt.sampleRate > OutputFormat::kMaxRate) {
+      err = "Invalid sampleRate: " + std::to_string(fmt.sampleRate);
+      return false;
+    }
+  }
+  if (o.Get("channels").IsNumber()) {
+    fmt.channels = o.Get("channels").As<Napi::Number>().Uint32Value();
+    if (fmt.channels != 1 && fmt.channels != 2) {
+      err = "Invalid channels: " + std::to_string(fmt.channels);
+      return false;
+    }
+  }
+  if (o.Get("sampleFormat").IsString()) {
+    std::string name = o.Get("sampleFormat").As<Napi::String>().Utf8Value();
+    if (name != "float32" && name != "int16") {
+      err = "Invalid sampleFormat: " + name;
+      return false;
+    }
+    fmt.int16 = name == "int16";
+  }
+
+  uint32_t chunkMs = 0;
+  uint32_t chunkFrames = 0;
+  if (o.Get("chunkMs").IsNumber())
+    chunkMs = o.Get("chunkMs").As<Napi::Number>().Uint32Value();
+  if (o.Get("chunkFrames").IsNumber())
+    chunkFrames = o.Get("chunkFrames").As<Napi::Number>().Uint32Value();
+  if (chunkMs > kMaxChunkMs) chunkMs = kMaxChunkMs;
+  const uint32_t framesPerMs = fmt.sampleRate / 1000;
+  if (chunkMs > 0) {
+    uint32_t msFrames = chunkMs * framesPerMs;
+    chunkFrames = chunkFrames > 0 && chunkFrames < msFrames ? chunkFrames : msFrames;
+  }
+  if (chunkFrames > kMaxChunkMs * framesPerMs) chunkFrames = kMaxChunkMs * framesPerMs;
+  out.chunkFrames = chunkFrames;
+
+  if (o.Has("suppressSilence"))
+    out.suppressSilence = o.Get("suppressSilence").ToBoolean().Value();
+  if (o.Get("silenceThreshold").IsNumber()) {
+    double t = o.Get("silenceThreshold").As<Napi::Number>().DoubleValue();
+    if (!(t >= 0.0 && t < 1.0)) {
+      err = "Invalid silenceThreshold: " + std::to_string(t);
+      return false;
+    }
+    out.silenceThreshold = static_cast<float>(t);
+  }
+
+  if (o.Has("meter")) out.meter = o.Get("meter").ToBoolean().Value();
+  if (o.Has("meterOnly"))
+    out.meterOnly = o.Get("meterOnly").ToBoolean().Value();
+  if (out.meterOnly) out.meter = true;
+  if (o.Get("queuePolicy").IsString()) {
+    std::string name = o.Get("queuePolicy").As<Napi::String>().Utf8Value();
+    if (!ParseQueuePolicy(name, out.queuePolicy)) {
+      err = "Invalid queuePolicy: " + name;
+      return false;
+    }
+  }
+  if (o.Get("maxQueueMs").IsNumber()) {
+    double ms = o.Get("maxQueueMs").As<Napi::Number>().DoubleValue();
+    if (!(ms >= 0 && ms <= kMaxQueueMs)) {
+      err = "Invalid maxQueueMs: " + std::to_string(ms);
+      return false;
+    }
+    out.maxQueueMs = static_cast<uint32_t>(ms);
+  }
+  return true;
+}
+
+// ─── Chunking and silence markers ──────────────────────────────────────────────
+
+class PacketChunker {
+public:
+  // dropped counts packets lost to pool exhaustion
+  PacketChunker(PacketPool &pool, CaptureStats &stats, std::atomic<int> &dropped)
+      : m_pool(pool), m_stats(stats), m_dropped(dropped) {}
+  PacketChunker(const PacketChunker &) = delete;
+  PacketChunker &operator=(const PacketChunker &) = delete;
+
+  // Before capture starts, for output frames of channels at sampleRate.
+  void Configure(uint32_t chunkFrames, uint32_t channels, uint32_t sampleRate) {
+    Discard();
+    m_chunkSamples = chunkFrames * channels;
+    // Partial chunks are flushed after their target duration; in immediate
+    // mode nothing is ever left partial.
+    m_chunkMaxAge = uint64_t(chunkFrames) * 10000000 / sampleRate;
+    // Silent runs are reported once per chunk, but no less often than
+    // kSilenceMarkerMs.
+    m_silenceMaxFrames = chunkFrames > 0 ? chunkFrames : 1;
+    const uint32_t markerFrames = kSilenceMarkerMs * sampleRate / 1000;
+    if (m_silenceMaxFrames < markerFrames) m_silenceMaxFrames = markerFrames;
+    m_silenceMaxAge = uint64_t(m_silenceMaxFrames) * 10000000 / sampleRate;
+  }
+
+  // Forget a partial chunk and silent run without publishing them, once the
+  // producer has stopped; the slot goes back with the next pool Init().
+  void Discard() {
+    m_chunk = nullptr;
+    m_silenceRun = 0;
+  }
+
+  // Producer thread: append output-format samples (src unused when silent)
+  // captured at captureTime, position (capture frames). Starts a new slot
+  // when needed; slots hold a full chunk plus one producer block, so a block
+  // only splits across slots at a chunk boundary. Drops and counts on pool
+  // exhaustion.
+  void Append(const uint8_t *src, size_t sampleCount, bool silent,
+              uint64_t captureTime, uint64_t position) {
+    while (sampleCount > 0) {
+      if (!m_chunk) {
+        m_chunk = m_pool.Acquire();
+        if (!m_chunk) {
+          m_dropped.fetch_add(1);
+          return;
+        }
+        m_chunk->count = 0;
+        m_chunk->captureQpc = captureTime;
+        m_chunk->devicePosition = position;
+        m_chunkStart = CaptureClockNow();
+      }
+      size_t room = m_chunk->capacity - m_chunk->count;
+      size_t n = sampleCount < room ? sampleCount : room;
+      const size_t bytes = n * m_chunk->sampleBytes;
+      uint8_t *dst = m_chunk->data + m_chunk->Bytes();
+      if (silent) {
+        memset(dst, 0, bytes);
+      } else {
+        memcpy(dst, src, bytes);
+        src += bytes;
+      }
+      m_chunk->count += static_cast<uint32_t>(n);
+      sampleCount -= n;
+      if (m_chunk->count == m_chunk->capacity) FlushChunk();
+    }
+    if (m_chunk && m_chunk->count >= m_chunkSamples) FlushChunk();
+  }
+
+  // Producer thread: account for outFrames of suppressed silence captured at
+  // captureTime, position. The partial chunk ahead of the run goes out first
+  // so ordering is preserved.
+  void Silence(uint32_t outFrames, uint64_t captureTime, uint64_t position) {
+    if (m_silenceRun == 0) {
+      FlushChunk();
+      m_silenceStart = CaptureClockNow();
+      m_silenceCaptureTime = captureTime;
+      m_silenceStartPosition = position;
+    }
+    m_silenceRun += outFrames;
+    m_stats.suppressedPackets.fetch_add(1, std::memory_order_relaxed);
+    m_stats.suppressedFrames.fetch_add(outFrames, std::memory_order_relaxed);
+    if (m_silenceRun >= m_silenceMaxFrames) FlushSilence();
+  }
+
+  // Producer thread: publish the pending silent run as a marker slot. A
+  // marker lost to pool exhaustion only costs the renderer an underrun.
+  void FlushSilence() {
+    if (m_silenceRun == 0) return;
+    Packet *p = m_pool.Acquire();
+    if (p) {
+      p->count = 0;
+      p->silentFrames = m_silenceRun;
+      p->captureQpc = m_silenceCaptureTime;
+      p->devicePosition = m_silenceStartPosition;
+      m_pool.Publish(p);
+      m_stats.silenceMarkers.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      m_dropped.fetch_add(1);
+    }
+    m_silenceRun = 0;
+  }
+
+  // Producer thread: hand the chunk being filled to JS.
+  void FlushChunk() {
+    if (!m_chunk) return;
+    m_pool.Publish(m_chunk);
+    m_chunk = nullptr;
+  }
+
+  // Producer thread: flush a partial chunk (or silent run) that has waited
+  // long enough at now, so a source that goes quiet mid-chunk doesn't
+  // strand its tail. Returns whether anything was published.
+  bool FlushStale(uint64_t now) {
+    if (m_silenceRun > 0 && now - m_silenceStart >= m_silenceMaxAge) {
+      FlushSilence();
+      return true;
+    }
+    if (!m_chunk || now - m_chunkStart < m_chunkMaxAge) return false;
+    FlushChunk();
+    return true;
+  }
+
+  // When FlushStale() will next have something to do (0 = nothing pending).
+  uint64_t Deadline() const {
+    if (m_silenceRun > 0) return m_silenceStart + m_silenceMaxAge;
+    if (m_chunk) return m_chunkStart + m_chunkMaxAge;
+    return 0;
+  }
+
+private:
+  PacketPool &m_pool;
+  CaptureStats &m_stats;
+  std::atomic<int> &m_dropped;
+
+  uint32_t m_chunkSamples = 0;
+  uint64_t m_chunkMaxAge = 0;
+  uint32_t m_silenceMaxFrames = 0;
+  uint64_t m_silenceMaxAge = 0;
+
+  // Producer thread only while running
+  Packet *m_chunk = nullptr;
+  uint64_t m_chunkStart = 0;
+  uint32_t m_silenceRun = 0; // output frames
+  uint64_t m_silenceStart = 0;
+  uint64_t m_silenceCaptureTime = 0; // the run's first packet's capture time
+  uint64_t m_silenceStartPosition = Packet::kNoPosition;
+};
+
+// ─── getLevels ─────────────────────────────────────────────────────────────────
+
+// { peak: [l, r], rms: [l, r], momentaryLufs, shortTermLufs, active, blocks }
+inline Napi::Object LevelsToJS(Napi::Env env, const LevelSnapshot &l) {
+  Napi::Array peak = Napi::Array::New(env, 2);
+  Napi::Array rms = Napi::Array::New(env, 2);
+  for (uint32_t c = 0; c < 2; c++) {
+    peak.Set(c, static_cast<double>(l.peak[c]));
+    rms.Set(c, static_cast<double>(l.rms[c]));
+  }
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("peak", peak);
+  o.Set("rms", rms);
+  o.Set("momentaryLufs", static_cast<double>(l.momentaryLufs));
+  o.Set("shortTermLufs", static_cast<double>(l.shortTermLufs));
+  // Above the BS.1770 absolute gate over the last 400 ms
+  o.Set("active", l.momentaryLufs > LevelMeter::kAbsoluteGateLufs);
+  o.Set("blocks", static_cast<double>(l.blocks));
+  return o;
+}
@@ -0,0 +1,471 @@
+// Shared capture threads.
+//
+// Running sessions don't get a thread each. A capture thread waits with
+// WaitForMultipleObjects on the buffer events (and include-mode target
+// processes) of every session attached to it, plus a control event for
+// attach/detach and one waitable timer that ticks every polling-mode session
+// at once. N sessions then cost one MMCSS-registered thread and one wakeup
+// per signal instead of N threads.
+//
+// The poll timer is high-resolution where the OS has those (Windows 10 1803
+// on), so ticks land within a fraction of a millisecond instead of on the
+// 15.6 ms system tick. Ticks are paced at the shortest device period among
+// the polled sessions, on a QPC schedule: every tick re-arms the timer for
+// the next slot of that schedule, so one late wakeup doesn't push back the
+// ones after it.
+//
+// A thread registers with MMCSS once, so sessions are grouped by the MMCSS
+// class they ask for. A wait takes at most MAXIMUM_WAIT_OBJECTS handles: a
+// session that doesn't fit on any thread of its class gets a new one. Threads
+// live as long as the process and block on their control event while idle.
+//
+// CaptureTask callbacks run on the shared thread and must not block. A task
+// whose Service() fails is detached and handed the error through Detached(),
+// so a stream re-activating (which waits seconds) never stalls the others.
+
+#pragma once
+
+#include <windows.h>
+#include <avrt.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Windows 10 1803+; older SDKs don't define it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+class CaptureTask {
+public:
+  // A mix's buffer events plus a target process
+  static constexpr DWORD kMaxHandles = 10;
+  // Service() index for a timer tick or a reached deadline
+  static constexpr DWORD kTick = MAXIMUM_WAIT_OBJECTS;
+
+  // Handles to wait on, fixed while attached.
+  virtual DWORD WaitHandles(HANDLE *out) const = 0;
+  // Serviced on timer ticks at least this often (100-ns units), whether or
+  // not a handle is signaled; 0 = event-driven, no ticks. Fixed while
+  // attached.
+  virtual LONGLONG PollPeriod() const = 0;
+  // QPC time at which the task needs servicing even if nothing is signaled;
+  // 0 = none.
+  virtual LONGLONG DeadlineQpc() const = 0;
+  // index into WaitHandles(), or kTick. A failure detaches the task.
+  virtual HRESULT Service(DWORD index) = 0;
+  // The task was detached because Service() returned hr.
+  virtual void Detached(HRESULT hr) = 0;
+
+protected:
+  ~CaptureTask() = default;
+};
+
+// What a session learns about the thread it was attached to.
+struct CaptureThreadInfo {
+  HANDLE thread = nullptr; // for GetThreadTimes
+  DWORD threadId = 0;
+  bool mmcssRegistered = false;
+  DWORD mmcssTaskIndex = 0;
+  DWORD mmcssError = 0; // Win32 error from registration, 0 if none
+  bool highResTimer = false; // poll ticks from a high-resolution timer
+};
+
+class CaptureThread {
+public:
+  // Bounds on the poll period: a tick per millisecond at most, and often
+  // enough that a 20 ms endpoint buffer can't overflow between two
+  static constexpr LONGLONG kMinPollPeriod = 10000;
+  static constexpr LONGLONG kMaxPollPeriod = 100000;
+  // The control event and the poll timer take two of the wait slots
+  static constexpr DWORD kTaskHandles = MAXIMUM_WAIT_OBJECTS - 2;
+
+  CaptureThread(std::wstring mmcssTask, AVRT_PRIORITY mmcssPriority)
+      : m_mmcssTask(std::move(mmcssTask)), m_mmcssPriority(mmcssPriority) {}
+  CaptureThread(const CaptureThread &) = delete;
+  CaptureThread &operator=(const CaptureThread &) = delete;
+  // Only reached for a thread that failed to launch
+  ~CaptureThread() {
+    if (m_control) CloseHandle(m_control);
+    if (m_timer) CloseHandle(m_timer);
+  }
+
+  // Spawn the thread and wait for its MMCSS registration.
+  bool Launch(std::string &err) {
+    m_control = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    // Older Windows rejects the high-resolution flag
+    m_timer = CreateWaitableTimerExW(nullptr, nullptr,
+                                     CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                     TIMER_ALL_ACCESS);
+    m_info.highResTimer = m_timer != nullptr;
+    if (!m_timer)
+      m_timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    HANDLE ready = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (!m_control || !m_timer || !ready) {
+      err = "CreateEvent failed: " + std::to_string(GetLastError());
+      if (ready) CloseHandle(ready);
+      return false;
+    }
+    m_ready = ready;
+    m_thread = CreateThread(nullptr, 0, &CaptureThread::ThreadProc, this, 0,
+                            &m_info.threadId);
+    if (!m_thread) {
+      err = "CreateThread failed: " + std::to_string(GetLastError());
+      CloseHandle(ready);
+      m_ready = nullptr;
+      return false;
+    }
+    m_info.thread = m_thread;
+    WaitForSingleObject(ready, INFINITE);
+    CloseHandle(ready);
+    m_ready = nullptr;
+    return true;
+  }
+
+  bool Serves(const std::wstring &mmcssTask,
+              AVRT_PRIORITY mmcssPriority) const {
+    return m_mmcssTask == mmcssTask && m_mmcssPriority == mmcssPriority;
+  }
+  const CaptureThreadInfo &Info() const { return m_info; }
+
+  // Wait slots left, reserved by CaptureService under its lock before
+  // attaching and handed back by the thread as tasks leave.
+  DWORD FreeHandles() const { return m_free.load(); }
+  void Reserve(DWORD handles) { m_free.fetch_sub(handles); }
+
+  // Any thread but this one: add or remove a task, returning once done. A
+  // task that already left is not an error.
+  void Attach(CaptureTask *task) { Post(Op::Attach, task); }
+  void Detach(CaptureTask *task) { Post(Op::Detach, task); }
+
+private:
+  enum class Op { Attach, Detach };
+  struct Command {
+    Op op;
+    CaptureTask *task;
+    bool done;
+  };
+  struct Entry {
+    CaptureTask *task;
+    DWORD first; // its first slot in the wait array
+    DWORD count;
+    LONGLONG pollPeriod; // 100-ns units, 0 if event-driven
+    bool live;
+  };
+
+  void Post(Op op, CaptureTask *task) {
+    Command cmd{op, task, false};
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_commands.push_back(&cmd);
+    SetEvent(m_control);
+    m_done.wait(lock, [&cmd] { return cmd.done; });
+  }
+
+  static DWORD WINAPI ThreadProc(void *self) {
+    static_cast<CaptureThread *>(self)->Run();
+    return 0;
+  }
+
+  void RegisterMmcss() {
+    if (m_mmcssTask.empty()) return;
+    DWORD taskIndex = 0;
+    HANDLE h = AvSetMmThreadCharacteristicsW(m_mmcssTask.c_str(), &taskIndex);
+    if (!h) {
+      m_info.mmcssError = GetLastError();
+      return;
+    }
+    if (!AvSetMmThreadPriority(h, m_mmcssPriority))
+      m_info.mmcssError = GetLastError();
+    m_info.mmcssRegistered = true;
+    m_info.mmcssTaskIndex = taskIndex;
+  }
+
+  void Run() {
+    // Sessions activate and query their clients from here
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    RegisterMmcss();
+    SetEvent(m_ready);
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    m_qpcFreq = freq.QuadPart;
+    for (;;) {
+      if (m_dirty) Rebuild();
+      const DWORD result = WaitForMultipleObjects(m_handleCount, m_handles,
+                                                  FALSE, NextTimeoutMs());
+      if (result == WAIT_FAILED) {
+        // Some task's handle went bad; nothing can be told apart any more
+        const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        for (Entry &e : m_entries)
+          if (e.live) Fail(e, hr);
+        continue;
+      }
+      // Serve every signaled handle, not just the lowest one, so a busy
+      // task early in the array can't starve the rest. Once a task has
+      // left, its handles may already be closed: wait again on a fresh
+      // array instead.
+      DWORD from = 0;
+      DWORD r = result;
+      while (r < WAIT_OBJECT_0 + m_handleCount - from) {
+        Dispatch(from + r - WAIT_OBJECT_0);
+        from += r - WAIT_OBJECT_0 + 1;
+        if (from >= m_handleCount || m_dirty) break;
+        r = WaitForMultipleObjects(m_handleCount - from, m_handles + from,
+                                   FALSE, 0);
+      }
+      ServeDeadlines();
+    }
+  }
+
+  // Slot 0 is the control event, slot 1 the poll timer.
+  void Dispatch(DWORD slot) {
+    if (slot == 0) {
+      RunCommands();
+      return;
+    }
+    if (slot == 1) {
+      for (Entry &e : m_entries)
+        if (e.live && e.pollPeriod) Serve(e, CaptureTask::kTick);
+      if (m_polled) NextTick();
+      return;
+    }
+    Entry &e = m_entries[m_slotEntry[slot]];
+    if (e.live) Serve(e, slot - e.first);
+  }
+
+  void ServeDeadlines() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    for (Entry &e : m_entries) {
+      if (!e.live || e.pollPeriod) continue;
+      const LONGLONG deadline = e.task->DeadlineQpc();
+      if (deadline != 0 && deadline <= now.QuadPart)
+        Serve(e, CaptureTask::kTick);
+    }
+  }
+
+  DWORD NextTimeoutMs() const {
+    LONGLONG next = 0;
+    for (const Entry &e : m_entries) {
+      if (!e.live || e.pollPeriod) continue;
+      const LONGLONG deadline = e.task->DeadlineQpc();
+      if (deadline != 0 && (next == 0 || deadline < next)) next = deadline;
+    }
+    if (next == 0) return INFINITE;
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if (next <= now.QuadPart) return 0;
+    return static_cast<DWORD>((next - now.QuadPart) * 1000 / m_qpcFreq) + 1;
+  }
+
+  // ── Poll pacing ──
+
+  // The period the polled tasks need: the shortest any of them asks for.
+  void UpdatePollPeriod() {
+    LONGLONG period = 0;
+    for (const Entry &e : m_entries) {
+      if (!e.live || !e.pollPeriod) continue;
+      if (period == 0 || e.pollPeriod < period) period = e.pollPeriod;
+    }
+    if (period < kMinPollPeriod) period = kMinPollPeriod;
+    if (period > kMaxPollPeriod) period = kMaxPollPeriod;
+    const LONGLONG periodQpc = period * m_qpcFreq / 10000000;
+    // A shorter period applies from now rather than from the next tick
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if (m_pollPeriodQpc == 0 || now.QuadPart + periodQpc < m_nextTickQpc) {
+      m_nextTickQpc = now.QuadPart + periodQpc;
+      ArmTimer(now.QuadPart);
+    }
+    m_pollPeriodQpc = periodQpc;
+  }
+
+  // Advance the schedule past the tick just served. Fallen behind by a whole
+  // period (a long drain, a preempted thread): skip those, since a drain
+  // takes whatever has queued up anyway, rather than tick back to back.
+  void NextTick() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    m_nextTickQpc += m_pollPeriodQpc;
+    if (m_nextTickQpc <= now.QuadPart)
+      m_nextTickQpc = now.QuadPart + m_pollPeriodQpc;
+    ArmTimer(now.QuadPart);
+  }
+
+  // One-shot, relative to now: QPC is the clock that counts, and re-arming
+  // every tick keeps the timer's own drift out of the schedule.
+  void ArmTimer(LONGLONG nowQpc) {
+    LARGE_INTEGER due;
+    due.QuadPart = -((m_nextTickQpc - nowQpc) * 10000000 / m_qpcFreq);
+    if (due.QuadPart >= 0) due.QuadPart = -1;
+    SetWaitableTimer(m_timer, &due, 0, nullptr, nullptr, FALSE);
+  }
+
+  void Serve(Entry &e, DWORD index) {
+    const HRESULT hr = e.task->Service(index);
+    if (hr != S_OK) Fail(e, hr);
+  }
+
+  void Fail(Entry &e, HRESULT hr) {
+    Remove(e);
+    e.task->Detached(hr);
+  }
+
+  void Remove(Entry &e) {
+    e.live = false;
+    m_free.fetch_add(e.count);
+    if (e.pollPeriod && --m_polled == 0) {
+      CancelWaitableTimer(m_timer);
+      m_pollPeriodQpc = 0;
+    } else if (e.pollPeriod) {
+      UpdatePollPeriod();
+    }
+    m_dirty = true;
+  }
+
+  void RunCommands() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Command *cmd : m_commands) {
+      if (cmd->op == Op::Attach) {
+        HANDLE handles[CaptureTask::kMaxHandles];
+        Entry e{cmd->task, 0, cmd->task->WaitHandles(handles),
+                cmd->task->PollPeriod(), true};
+        m_entries.push_back(e);
+        if (e.pollPeriod) {
+          m_polled++;
+          UpdatePollPeriod();
+        }
+        m_dirty = true;
+      } else {
+        for (Entry &e : m_entries)
+          if (e.live && e.task == cmd->task) Remove(e);
+      }
+      cmd->done = true;
+    }
+    m_commands.clear();
+    m_done.notify_all();
+  }
+
+  // Drop departed tasks and lay the wait array out again.
+  void Rebuild() {
+    size_t kept = 0;
+    for (size_t i = 0; i < m_entries.size(); i++)
+      if (m_entries[i].live) m_entries[kept++] = m_entries[i];
+    m_entries.resize(kept);
+    m_handles[0] = m_control;
+    m_handles[1] = m_timer;
+    m_handleCount = 2;
+    for (size_t i = 0; i < m_entries.size(); i++) {
+      Entry &e = m_entries[i];
+      e.first = m_handleCount;
+      e.task->WaitHandles(m_handles + m_handleCount);
+      for (DWORD k = 0; k < e.count; k++)
+        m_slotEntry[m_handleCount + k] = static_cast<uint32_t>(i);
+      m_handleCount += e.count;
+    }
+    m_dirty = false;
+  }
+
+  const std::wstring m_mmcssTask;
+  const AVRT_PRIORITY m_mmcssPriority;
+  CaptureThreadInfo m_info;
+  HANDLE m_thread = nullptr;
+  HANDLE m_ready = nullptr;
+  HANDLE m_control = nullptr;
+  HANDLE m_timer = nullptr; // armed while any polled task is attached
+  std::atomic<DWORD> m_free{kTaskHandles};
+
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  std::vector<Command *> m_commands;
+
+  // Capture thread only
+  std::vector<Entry> m_entries;
+  HANDLE m_handles[MAXIMUM_WAIT_OBJECTS];
+  uint32_t m_slotEntry[MAXIMUM_WAIT_OBJECTS];
+  DWORD m_handleCount = 2;
+  uint32_t m_polled = 0;
+  LONGLONG m_qpcFreq = 1;
+  LONGLONG m_pollPeriodQpc = 0; // 0 while nothing is polled
+  LONGLONG m_nextTickQpc = 0;
+  bool m_dirty = true;
+};
+
+class CaptureService {
+public:
+  // Leaked like the default session: the threads never exit.
+  static CaptureService &Instance() {
+    static CaptureService *service = new CaptureService();
+    return *service;
+  }
+
+  // Attach task to a thread of its MMCSS class with room for its handles,
+  // starting one if none has. Not while the task is attached already.
+  bool Attach(CaptureTask *task, const std::wstring &mmcssTask,
+              AVRT_PRIORITY mmcssPriority, CaptureThreadInfo &info,
+              std::string &err) {
+    HANDLE handles[CaptureTask::kMaxHandles];
+    const DWORD needed = task->WaitHandles(handles);
+    CaptureThread *thread = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto &t : m_threads) {
+        if (t->Serves(mmcssTask, mmcssPriority) && t->FreeHandles() >= needed) {
+          thread = t.get();
+          break;
+        }
+      }
+      if (!thread) {
+        auto t = std::make_unique<CaptureThread>(mmcssTask, mmcssPriority);
+        if (!t->Launch(err)) return false;
+        thread = t.get();
+        m_threads.push_back(std::move(t));
+      }
+      thread->Reserve(needed);
+      SetOwner(task, thread);
+    }
+    thread->Attach(task);
+    info = thread->Info();
+    return true;
+  }
+
+  // Returns once the task is off its thread and no callback is running.
+  void Detach(CaptureTask *task) {
+    CaptureThread *thread = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (size_t i = 0; i < m_owners.size(); i++) {
+        if (m_owners[i].first != task) continue;
+        thread = m_owners[i].second;
+        m_owners.erase(m_owners.begin() + i);
+        break;
+      }
+    }
+    if (thread) thread->Detach(task);
+  }
+
+private:
+  CaptureService() = default;
+
+  // With m_mutex held. A task detached by a failure keeps its old entry
+  // until it is attached again or detached.
+  void SetOwner(CaptureTask *task, CaptureThread *thread) {
+    for (auto &o : m_owners) {
+      if (o.first == task) {
+        o.second = thread;
+        return;
+      }
+    }
+    m_owners.emplace_back(task, thread);
+  }
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<CaptureThread>> m_threads;
+  std::vector<std::pair<CaptureTask *, CaptureThread *>> m_owners;
+};
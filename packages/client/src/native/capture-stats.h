@@ -0,0 +1,212 @@
+// Lock-free capture telemetry.
+//
+// Every field is written only by the capture thread, except the delivery
+// fields the JS thread records as it hands packets to the callback, and read
+// from the JS thread by getStats(). Updates are relaxed atomic adds and stores, so
+// recording costs a few uncontended instructions per packet and never blocks
+// the real-time path. Readers may see fields from slightly
+// different instants; that's fine for telemetry.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-bucket histogram. Bucket i counts values <= edges[i]; the last bucket
+// counts everything above the final edge.
+template <size_t Buckets> class Histogram {
+  static_assert(Buckets >= 2, "Histogram needs at least two buckets");
+
+public:
+  using Edges = std::array<uint32_t, Buckets - 1>;
+
+  explicit Histogram(const Edges &edges) : m_edges(edges) {}
+
+  void Record(uint32_t value) {
+    size_t i = 0;
+    while (i < Buckets - 1 && value > m_edges[i]) i++;
+    m_counts[i].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint32_t Count(size_t i) const {
+    return m_counts[i].load(std::memory_order_relaxed);
+  }
+  const Edges &EdgeList() const { return m_edges; }
+  static constexpr size_t size() { return Buckets; }
+
+  void Reset() {
+    for (auto &c : m_counts) c.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  Edges m_edges;
+  std::array<std::atomic<uint32_t>, Buckets> m_counts{};
+};
+
+struct CaptureStats {
+  // Per-packet, from GetBuffer
+  std::atomic<uint64_t> packets{0};
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint32_t> silentPackets{0};   // AUDCLNT_BUFFERFLAGS_SILENT
+  std::atomic<uint32_t> discontinuities{0}; // AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY
+  std::atomic<uint32_t> timestampErrors{0}; // AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR
+  std::atomic<uint32_t> positionGaps{0};    // device position skipped ahead
+  std::atomic<uint64_t> gapFrames{0};       // frames lost to those skips
+  std::atomic<uint64_t> devicePosition{0};  // of the latest packet, in frames
+  std::atomic<uint64_t> qpcPosition{0};     // of the latest packet, 100 ns units
+
+  // Interval between successive packets' QPC positions, in µs
+  Histogram<10> packetInterval{
+      {1000, 2000, 5000, 10000, 15000, 20000, 30000, 50000, 100000}};
+  // Time spent in one DrainPackets pass, in µs
+  Histogram<9> drainDuration{{10, 20, 50, 100, 200, 500, 1000, 5000}};
+  std::atomic<uint32_t> drains{0};
+
+  // Silence suppression: packets collapsed into markers instead of shipped
+  std::atomic<uint32_t> suppressedPackets{0}; // flagged or scanned silent
+  std::atomic<uint64_t> suppressedFrames{0};  // output frames they covered
+  std::atomic<uint32_t> silenceMarkers{0};
+
+  // Opus mode
+  std::atomic<uint32_t> encodedPackets{0};
+  std::atomic<uint64_t> encodedBytes{0};
+  std::atomic<uint32_t> encodeErrors{0}; // opus_encode_float failures
+
+  // Noise suppression: frames through RNNoise, and its voice probability
+  // for the latest frame in 1/1000
+  std::atomic<uint64_t> denoisedFrames{0};
+  std::atomic<uint32_t> voiceProbability{0};
+
+  // JS delivery
+  std::atomic<uint32_t> tsfnCalls{0};        // NonBlockingCall succeeded
+  std::atomic<uint32_t> tsfnCallFailures{0}; // NonBlockingCall returned an error
+  std::atomic<uint32_t> readyDepth{0};       // ready ring depth at last wakeup
+  std::atomic<uint32_t> maxReadyDepth{0};
+
+  // Delivery (JS thread): capture QPC of a packet's first frame to its
+  // callback, in µs, and packets copied into a fresh JS ArrayBuffer rather
+  // than lent
+  Histogram<10> deliveryLatency{
+      {1000, 2000, 5000, 10000, 20000, 30000, 50000, 100000, 250000}};
+  std::atomic<uint32_t> maxDeliveryLatencyUs{0};
+  std::atomic<uint64_t> copiedPackets{0};
+  std::atomic<uint64_t> copiedBytes{0};
+
+  // Queue policy (JS thread): ready packets discarded or folded into one
+  // callback because they waited longer than maxQueueMs
+  std::atomic<uint32_t> queueDroppedPackets{0};
+  std::atomic<uint64_t> queueDroppedFrames{0};
+  std::atomic<uint32_t> queueMerges{0};        // merged callbacks
+  std::atomic<uint32_t> queueMergedPackets{0}; // packets they carried
+
+  // Recovery: fresh clients tried after the stream failed, and how many of
+  // them brought it back
+  std::atomic<uint32_t> recoveryAttempts{0};
+  std::atomic<uint32_t> recoveries{0};
+  // Target switches crossfaded in by retarget(), and ones that fell through
+  std::atomic<uint32_t> retargets{0};
+  std::atomic<uint32_t> retargetFailures{0};
+
+  // Capture thread: account for one packet returned by GetBuffer.
+  void RecordPacket(uint32_t numFrames, uint64_t devPos, uint64_t qpcPos,
+                    bool silent, bool discontinuity, bool timestampError) {
+    const uint64_t n = packets.load(std::memory_order_relaxed);
+    if (n > 0) {
+      const uint64_t expected =
+          devicePosition.load(std::memory_order_relaxed) + m_lastFrames;
+      if (devPos > expected) {
+        positionGaps.fetch_add(1, std::memory_order_relaxed);
+        gapFrames.fetch_add(devPos - expected, std::memory_order_relaxed);
+      }
+      const uint64_t lastQpc = qpcPosition.load(std::memory_order_relaxed);
+      if (qpcPos > lastQpc) {
+        const uint64_t us = (qpcPos - lastQpc) / 10;
+        packetInterval.Record(us > UINT32_MAX ? UINT32_MAX
+                                              : static_cast<uint32_t>(us));
+      }
+    }
+    packets.store(n + 1, std::memory_order_relaxed);
+    frames.fetch_add(numFrames, std::memory_order_relaxed);
+    if (silent) silentPackets.fetch_add(1, std::memory_order_relaxed);
+    if (discontinuity) discontinuities.fetch_add(1, std::memory_order_relaxed);
+    if (timestampError) timestampErrors.fetch_add(1, std::memory_order_relaxed);
+    devicePosition.store(devPos, std::memory_order_relaxed);
+    qpcPosition.store(qpcPos, std::memory_order_relaxed);
+    m_lastFrames = numFrames;
+  }
+
+  // Capture thread: account for a wakeup handed to the TSFN.
+  void RecordWakeup(bool ok, uint32_t depth) {
+    (ok ? tsfnCalls : tsfnCallFailures).fetch_add(1, std::memory_order_relaxed);
+    readyDepth.store(depth, std::memory_order_relaxed);
+    if (depth > maxReadyDepth.load(std::memory_order_relaxed))
+      maxReadyDepth.store(depth, std::memory_order_relaxed);
+  }
+
+  // JS thread: account for one packet handed to the callback at now100ns.
+  void RecordDelivery(uint64_t captureQpc, uint64_t now100ns, bool copied,
+                      size_t bytes) {
+    if (copied) {
+      copiedPackets.fetch_add(1, std::memory_order_relaxed);
+      copiedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    if (captureQpc == 0 || now100ns < captureQpc) return;
+    const uint64_t us = (now100ns - captureQpc) / 10;
+    const uint32_t v = us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+    deliveryLatency.Record(v);
+    if (v > maxDeliveryLatencyUs.load(std::memory_order_relaxed))
+      maxDeliveryLatencyUs.store(v, std::memory_order_relaxed);
+  }
+
+  // JS thread: account for one ready packet discarded by the queue policy.
+  void RecordQueueDrop(uint32_t numFrames) {
+    queueDroppedPackets.fetch_add(1, std::memory_order_relaxed);
+    queueDroppedFrames.fetch_add(numFrames, std::memory_order_relaxed);
+  }
+
+  // Only while the capture thread is not running.
+  void Reset() {
+    packets = 0;
+    frames = 0;
+    silentPackets = 0;
+    discontinuities = 0;
+    timestampErrors = 0;
+    positionGaps = 0;
+    gapFrames = 0;
+    devicePosition = 0;
+    qpcPosition = 0;
+    packetInterval.Reset();
+    drainDuration.Reset();
+    drains = 0;
+    suppressedPackets = 0;
+    suppressedFrames = 0;
+    silenceMarkers = 0;
+    encodedPackets = 0;
+    encodedBytes = 0;
+    encodeErrors = 0;
+    denoisedFrames = 0;
+    voiceProbability = 0;
+    tsfnCalls = 0;
+    tsfnCallFailures = 0;
+    readyDepth = 0;
+    maxReadyDepth = 0;
+    deliveryLatency.Reset();
+    maxDeliveryLatencyUs = 0;
+    copiedPackets = 0;
+    copiedBytes = 0;
+    queueDroppedPackets = 0;
+    queueDroppedFrames = 0;
+    queueMerges = 0;
+    queueMergedPackets = 0;
+    recoveryAttempts = 0;
+    recoveries = 0;
+    retargets = 0;
+    retargetFailures = 0;
+    m_lastFrames = 0;
+  }
+
+private:
+  uint32_t m_lastFrames = 0; // capture thread only
+};
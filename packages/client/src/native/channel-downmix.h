@@ -0,0 +1,151 @@
+// Multichannel-to-stereo downmix for native-layout capture.
+//
+// A session opened with captureLayout: "native" captures the render
+// endpoint's own channel layout (5.1, 7.1, ...) instead of letting the audio
+// engine fold it to stereo. ChannelDownmix then applies a 2 × N gain matrix
+// on the capture thread, so everything downstream (meter, noise suppressor,
+// converter, encoder) still sees 48 kHz interleaved stereo float32.
+//
+// Channels arrive in WAVEFORMATEXTENSIBLE order: one per set bit of the
+// channel mask, lowest bit first. Each speaker position has a (left, right)
+// gain pair; the defaults follow ITU-R BS.775 (centre and surrounds at
+// -3 dB, LFE dropped). The matrix isn't normalized, so a loud full-range mix
+// can exceed ±1.0; the int16 pack saturates it.
+//
+// Per frame the kernel broadcasts channel pairs against interleaved gain
+// pairs (l0 r0 l1 r1), so 5.1 costs three multiply-adds and one fold with
+// SSE. Configure() fills everything, so Process() never allocates.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIGO_HAVE_SSE2 1
+#endif
+
+class ChannelDownmix {
+public:
+  static constexpr uint32_t kMaxChannels = 8;
+  // Speaker positions, in channel-mask bit order (SPEAKER_FRONT_LEFT = bit 0)
+  static constexpr uint32_t kPositions = 18;
+
+  struct Gain {
+    float left = 0.0f;
+    float right = 0.0f;
+  };
+  struct GainTable {
+    Gain position[kPositions];
+  };
+
+  static const char *PositionName(uint32_t bit) {
+    static const char *const names[kPositions] = {
+        "FL", "FR", "FC", "LFE", "BL", "BR", "FLC", "FRC", "BC",
+        "SL", "SR", "TC", "TFL", "TFC", "TFR", "TBL", "TBC", "TBR"};
+    return bit < kPositions ? names[bit] : "";
+  }
+
+  // Bit of a position name, or -1.
+  static int PositionBit(const std::string &name) {
+    for (uint32_t bit = 0; bit < kPositions; bit++)
+      if (name == PositionName(bit)) return static_cast<int>(bit);
+    return -1;
+  }
+
+  static GainTable DefaultGains() {
+    constexpr float h = 0.70710678f; // -3 dB
+    GainTable t;
+    const Gain gains[kPositions] = {
+        {1, 0},           {0, 1},           {h, h},    {0, 0},
+        {h, 0},           {0, h},           {0.92387953f, 0.38268343f},
+        {0.38268343f, 0.92387953f},         {0.5f, 0.5f},
+        {h, 0},           {0, h},           {0.5f, 0.5f},
+        {h, 0},           {0.5f, 0.5f},     {0, h},
+        {h, 0},           {0.5f, 0.5f},     {0, h}};
+    memcpy(t.position, gains, sizeof(gains));
+    return t;
+  }
+
+  // The usual mask for a channel count, for mix formats that don't carry
+  // one (plain WAVEFORMATEX): KSAUDIO_SPEAKER_QUAD, _5POINT1, _7POINT1_SURROUND.
+  static uint32_t DefaultMask(uint32_t channels) {
+    switch (channels) {
+    case 1: return 0x4;
+    case 2: return 0x3;
+    case 4: return 0x33;
+    case 6: return 0x3F;
+    case 8: return 0x63F;
+    default: return channels >= 32 ? ~0u : (1u << channels) - 1;
+    }
+  }
+
+  // Bit of the position channel index carries under mask, or -1 for a
+  // channel the mask doesn't assign.
+  static int ChannelBit(uint32_t mask, uint32_t index) {
+    for (uint32_t bit = 0; bit < 32; bit++) {
+      if (!(mask & (1u << bit))) continue;
+      if (index == 0) return static_cast<int>(bit);
+      index--;
+    }
+    return -1;
+  }
+
+  // JS/worker thread, before capture starts. Channels the mask doesn't
+  // assign are dropped. Returns false for an unsupported channel count.
+  bool Configure(uint32_t mask, uint32_t channels, const GainTable &gains) {
+    if (channels < 1 || channels > kMaxChannels) return false;
+    m_channels = channels;
+    memset(m_gains, 0, sizeof(m_gains));
+    for (uint32_t c = 0; c < channels; c++) {
+      const int bit = ChannelBit(mask, c);
+      if (bit < 0 || bit >= static_cast<int>(kPositions)) continue;
+      m_gains[2 * c] = gains.position[bit].left;
+      m_gains[2 * c + 1] = gains.position[bit].right;
+    }
+    return true;
+  }
+
+  uint32_t Channels() const { return m_channels; }
+
+  // Capture thread. frames of interleaved capture-layout float into
+  // interleaved stereo.
+  void Process(const float *in, uint32_t frames, float *out) const {
+    const uint32_t n = m_channels;
+#if MIGO_HAVE_SSE2
+    for (uint32_t i = 0; i < frames; i++, in += n, out += 2) {
+      __m128 acc = _mm_setzero_ps();
+      uint32_t c = 0;
+      for (; c + 2 <= n; c += 2) {
+        __m128 x = _mm_castpd_ps(
+            _mm_load_sd(reinterpret_cast<const double *>(in + c))); // x0 x1
+        x = _mm_unpacklo_ps(x, x);                                  // x0 x0 x1 x1
+        acc = _mm_add_ps(acc, _mm_mul_ps(x, _mm_load_ps(&m_gains[2 * c])));
+      }
+      // An odd last channel: the gains past it are zero
+      if (c < n)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(in[c]),
+                                         _mm_load_ps(&m_gains[2 * c])));
+      acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+      _mm_storel_pi(reinterpret_cast<__m64 *>(out), acc);
+    }
+#else
+    for (uint32_t i = 0; i < frames; i++, in += n, out += 2) {
+      float l = 0.0f, r = 0.0f;
+      for (uint32_t c = 0; c < n; c++) {
+        l += in[c] * m_gains[2 * c];
+        r += in[c] * m_gains[2 * c + 1];
+      }
+      out[0] = l;
+      out[1] = r;
+    }
+#endif
+  }
+
+private:
+  uint32_t m_channels = 2;
+  // (left, right) per channel, zero-padded to a whole number of SSE loads
+  alignas(16) float m_gains[kMaxChannels * 2] = {};
+};
@@ -0,0 +1,326 @@
+// Output format conversion for the capture path.
+//
+// WASAPI always hands us 48 kHz interleaved stereo float32 (the format the
+// loopback client is initialized with). FormatConverter turns that into the
+// session's requested output format in one pass on the capture thread:
+//
+//   interleaved stereo ─► downmix/deinterleave ─► polyphase resample ─►
+//   interleave + float32/int16 pack
+//
+// The resampler is a rational L/M polyphase windowed-sinc filter: each output
+// frame is one dot product of a precomputed phase against the input history,
+// vectorized with SSE (the x64 baseline, so no runtime dispatch is needed).
+// All buffers are sized in Configure(), so Process() never allocates.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIGO_HAVE_SSE2 1
+#endif
+
+struct OutputFormat {
+  static constexpr uint32_t kMinRate = 8000;
+  static constexpr uint32_t kMaxRate = 96000;
+
+  uint32_t sampleRate = 48000;
+  uint32_t channels = 2; // 1 or 2; the capture layout's in passthrough
+  bool int16 = false;    // false = float32
+
+  uint32_t BytesPerSample() const { return int16 ? 2 : 4; }
+  uint32_t BytesPerFrame() const { return channels * BytesPerSample(); }
+  bool operator==(const OutputFormat &o) const {
+    return sampleRate == o.sampleRate && channels == o.channels &&
+           int16 == o.int16;
+  }
+  bool operator!=(const OutputFormat &o) const { return !(*this == o); }
+};
+
+class FormatConverter {
+public:
+  static constexpr uint32_t kInRate = 48000;
+  static constexpr uint32_t kInChannels = 2;
+
+  // JS/worker thread, before capture starts. maxInFrames bounds one
+  // Process() call. Returns false for an unsupported format.
+  bool Configure(const OutputFormat &fmt, uint32_t maxInFrames) {
+    if (fmt.channels < 1 || fmt.channels > 2) return false;
+    if (fmt.sampleRate < OutputFormat::kMinRate ||
+        fmt.sampleRate > OutputFormat::kMaxRate)
+      return false;
+
+    const uint32_t g = Gcd(fmt.sampleRate, kInRate);
+    const uint32_t L = fmt.sampleRate / g;
+    const uint32_t M = kInRate / g;
+    if (L > kMaxPhases) return false;
+
+    m_fmt = fmt;
+    m_L = L;
+    m_M = M;
+    m_maxInFrames = maxInFrames;
+    m_resample = L != M;
+
+    if (m_resample) {
+      // Longer filters when decimating keep the transition band the same
+      // width relative to the output rate. Multiple of 8 for the SIMD loop.
+      const double ratio = M > L ? static_cast<double>(M) / L : 1.0;
+      m_taps = (static_cast<uint32_t>(std::ceil(kBaseTaps * ratio)) + 7) & ~7u;
+      BuildFilter();
+    } else {
+      m_taps = 1;
+      m_coeffs.clear();
+    }
+
+    const size_t hist = m_taps - 1;
+    for (uint32_t c = 0; c < fmt.channels; c++) {
+      m_in[c].assign(hist + maxInFrames, 0.0f);
+      m_out[c].assign(MaxOutFrames(maxInFrames), 0.0f);
+    }
+    Reset();
+    return true;
+  }
+
+  // Upper bound on output frames for inFrames of input.
+  uint32_t MaxOutFrames(uint32_t inFrames) const {
+    if (!m_resample) return inFrames;
+    return static_cast<uint32_t>(
+               (static_cast<uint64_t>(inFrames) * m_L + m_M - 1) / m_M) + 1;
+  }
+
+  // Forget filter history (e.g. at stream start).
+  void Reset() {
+    for (auto &ch : m_in) std::fill(ch.begin(), ch.end(), 0.0f);
+    m_t = 0;
+  }
+
+  const OutputFormat &Format() const { return m_fmt; }
+
+  // Capture thread. Converts inFrames of 48 kHz interleaved stereo float
+  // (nullptr = digital silence) into out, interleaved in the output format.
+  // Returns the number of output frames written.
+  uint32_t Process(const float *in, uint32_t inFrames, void *out) {
+    if (inFrames > m_maxInFrames) inFrames = m_maxInFrames;
+    const uint32_t ch = m_fmt.channels;
+    const size_t hist = m_taps - 1;
+
+    // ── Deinterleave (stereo) or downmix (mono) behind the history ──
+    float *l = m_in[0].data() + hist;
+    float *r = ch == 2 ? m_in[1].data() + hist : nullptr;
+    if (!in) {
+      memset(l, 0, inFrames * sizeof(float));
+      if (r) memset(r, 0, inFrames * sizeof(float));
+    } else if (r) {
+      Deinterleave(in, inFrames, l, r);
+    } else {
+      Downmix(in, inFrames, l);
+    }
+
+    // ── Resample each channel ──
+    uint32_t outFrames = inFrames;
+    const float *planar[2] = {l, r};
+    if (m_resample) {
+      const uint64_t end = static_cast<uint64_t>(inFrames) * m_L;
+      uint64_t t = m_t;
+      for (uint32_t c = 0; c < ch; c++) {
+        const float *w = m_in[c].data();
+        float *o = m_out[c].data();
+        uint32_t n = 0;
+        for (t = m_t; t < end; t += m_M) {
+          const uint32_t i = static_cast<uint32_t>(t / m_L);
+          const uint32_t p = static_cast<uint32_t>(t % m_L);
+          o[n++] = Dot(&m_coeffs[static_cast<size_t>(p) * m_taps], w + i);
+        }
+        outFrames = n;
+        planar[c] = o;
+        // Keep the last taps-1 input frames as history for the next block
+        memmove(m_in[c].data(), m_in[c].data() + inFrames, hist * sizeof(float));
+      }
+      m_t = t - end;
+    }
+
+    // ── Interleave and pack ──
+    if (m_fmt.int16) {
+      PackInt16(planar, ch, outFrames, static_cast<int16_t *>(out));
+    } else {
+      float *dst = static_cast<float *>(out);
+      if (ch == 1) {
+        memcpy(dst, planar[0], outFrames * sizeof(float));
+      } else {
+        Interleave(planar[0], planar[1], outFrames, dst);
+      }
+    }
+    return outFrames;
+  }
+
+private:
+  static constexpr uint32_t kMaxPhases = 512;
+  static constexpr uint32_t kBaseTaps = 32;
+  static constexpr double kRolloff = 0.91; // passband edge, fraction of Nyquist
+
+  static uint32_t Gcd(uint32_t a, uint32_t b) {
+    while (b) {
+      uint32_t t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  // Blackman-windowed sinc prototype at L × 48 kHz, split into L phases of
+  // m_taps coefficients each. Phases are stored reversed so each output is a
+  // forward dot product over the input history, and normalized to unity DC
+  // gain so no phase adds a ripple of its own.
+  void BuildFilter() {
+    const size_t N = static_cast<size_t>(m_taps) * m_L;
+    const double minRate = m_L < m_M ? m_L : m_M; // in units of kInRate / M
+    // Cutoff as a fraction of the prototype's sample rate (L × input)
+    const double fc = kRolloff * 0.5 * minRate / (static_cast<double>(m_L) * m_M);
+    const double center = (N - 1) / 2.0;
+    const double pi = 3.14159265358979323846;
+
+    m_coeffs.assign(N, 0.0f);
+    std::vector<double> phase(m_taps);
+    for (uint32_t p = 0; p < m_L; p++) {
+      double sum = 0;
+      for (uint32_t k = 0; k < m_taps; k++) {
+        const double j = static_cast<double>(k) * m_L + p;
+        const double x = j - center;
+        const double sinc =
+            x == 0 ? 2 * fc : std::sin(2 * pi * fc * x) / (pi * x);
+        const double win = 0.42 - 0.5 * std::cos(2 * pi * j / (N - 1)) +
+                           0.08 * std::cos(4 * pi * j / (N - 1));
+        phase[k] = sinc * win;
+        sum += phase[k];
+      }
+      float *dst = &m_coeffs[static_cast<size_t>(p) * m_taps];
+      for (uint32_t k = 0; k < m_taps; k++) {
+        dst[m_taps - 1 - k] = static_cast<float>(phase[k] / sum);
+      }
+    }
+  }
+
+  float Dot(const float *c, const float *x) const {
+#if MIGO_HAVE_SSE2
+    __m128 a0 = _mm_setzero_ps();
+    __m128 a1 = _mm_setzero_ps();
+    for (uint32_t k = 0; k < m_taps; k += 8) {
+      a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(c + k), _mm_loadu_ps(x + k)));
+      a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(c + k + 4),
+                                     _mm_loadu_ps(x + k + 4)));
+    }
+    a0 = _mm_add_ps(a0, a1);
+    a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+    a0 = _mm_add_ss(a0, _mm_shuffle_ps(a0, a0, 1));
+    return _mm_cvtss_f32(a0);
+#else
+    float acc = 0;
+    for (uint32_t k = 0; k < m_taps; k++) acc += c[k] * x[k];
+    return acc;
+#endif
+  }
+
+  static void Deinterleave(const float *in, uint32_t frames, float *l,
+                           float *r) {
+    uint32_t i = 0;
+#if MIGO_HAVE_SSE2
+    for (; i + 4 <= frames; i += 4) {
+      __m128 a = _mm_loadu_ps(in + 2 * i);     // l0 r0 l1 r1
+      __m128 b = _mm_loadu_ps(in + 2 * i + 4); // l2 r2 l3 r3
+      _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#endif
+    for (; i < frames; i++) {
+      l[i] = in[2 * i];
+      r[i] = in[2 * i + 1];
+    }
+  }
+
+  static void Downmix(const float *in, uint32_t frames, float *mono) {
+    uint32_t i = 0;
+#if MIGO_HAVE_SSE2
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= frames; i += 4) {
+      __m128 a = _mm_loadu_ps(in + 2 * i);
+      __m128 b = _mm_loadu_ps(in + 2 * i + 4);
+      __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(mono + i, _mm_mul_ps(_mm_add_ps(l, r), half));
+    }
+#endif
+    for (; i < frames; i++) mono[i] = (in[2 * i] + in[2 * i + 1]) * 0.5f;
+  }
+
+  static void Interleave(const float *l, const float *r, uint32_t frames,
+                         float *out) {
+    uint32_t i = 0;
+#if MIGO_HAVE_SSE2
+    for (; i + 4 <= frames; i += 4) {
+      __m128 a = _mm_loadu_ps(l + i);
+      __m128 b = _mm_loadu_ps(r + i);
+      _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(a, b));
+      _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(a, b));
+    }
+#endif
+    for (; i < frames; i++) {
+      out[2 * i] = l[i];
+      out[2 * i + 1] = r[i];
+    }
+  }
+
+  // Scale to int16 with round-to-nearest; out-of-range samples saturate.
+  static void PackInt16(const float *const *planar, uint32_t ch,
+                        uint32_t frames, int16_t *out) {
+    uint32_t i = 0;
+#if MIGO_HAVE_SSE2
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    // Clamp before the convert: past the int32 range cvtps yields INT_MIN,
+    // which would pack to -32768 even for large positive samples.
+    auto scaled = [&](const float *p) {
+      return _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(p), scale), lo), hi);
+    };
+    if (ch == 1) {
+      for (; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_cvtps_epi32(scaled(planar[0] + i));
+        __m128i b = _mm_cvtps_epi32(scaled(planar[0] + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packs_epi32(a, b));
+      }
+    } else {
+      for (; i + 4 <= frames; i += 4) {
+        __m128 l = scaled(planar[0] + i);
+        __m128 r = scaled(planar[1] + i);
+        __m128i a = _mm_cvtps_epi32(_mm_unpacklo_ps(l, r));
+        __m128i b = _mm_cvtps_epi32(_mm_unpackhi_ps(l, r));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                         _mm_packs_epi32(a, b));
+      }
+    }
+#endif
+    for (; i < frames; i++) {
+      for (uint32_t c = 0; c < ch; c++) {
+        float v = planar[c][i] * 32767.0f;
+        v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+        out[i * ch + c] = static_cast<int16_t>(std::lrint(v));
+      }
+    }
+  }
+
+  OutputFormat m_fmt;
+  uint32_t m_L = 1, m_M = 1;
+  uint32_t m_taps = 1;
+  uint32_t m_maxInFrames = 0;
+  bool m_resample = false;
+  uint64_t m_t = 0; // next output position, in 1/L input frames
+  std::vector<float> m_coeffs;
+  std::vector<float> m_in[2];  // taps-1 history + one block, per channel
+  std::vector<float> m_out[2]; // resampled block, per channel
+};
@@ -0,0 +1,182 @@
+// Lock-free level metering on the capture thread.
+//
+// Runs on the 48 kHz stereo float32 capture stream, before any output
+// conversion, so readings don't depend on the delivered format. Samples are
+// measured in 100 ms blocks. Each completed block publishes, through relaxed
+// atomics:
+//   - per-channel sample peak and RMS of that block
+//   - momentary (400 ms) and short-term (3 s) loudness per ITU-R BS.1770: a
+//     K-weighting filter followed by mean square, in LUFS
+// getLevels() on the JS thread just loads the atomics. A reader may see one
+// block's peak with the previous block's loudness; fine for a meter.
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "signal-scan.h"
+
+struct LevelSnapshot {
+  float peak[2];
+  float rms[2];
+  float momentaryLufs;
+  float shortTermLufs;
+  uint32_t blocks; // completed blocks since Reset()
+};
+
+class LevelMeter {
+public:
+  static constexpr uint32_t kRate = 48000;
+  static constexpr uint32_t kBlockFrames = kRate / 10;    // 100 ms
+  static constexpr uint32_t kMomentaryBlocks = 4;         // 400 ms
+  static constexpr uint32_t kShortTermBlocks = 30;        // 3 s
+  static constexpr float kSilenceLufs = -120.0f;          // reported for silence
+  static constexpr float kAbsoluteGateLufs = -70.0f;      // BS.1770 gate
+
+  LevelMeter() { Reset(); }
+
+  // Only while the capture thread is not running.
+  void Reset() {
+    for (auto &s : m_filter) s = Biquads{};
+    for (double &b : m_blockPower) b = 0.0;
+    m_blockIndex = 0;
+    m_blockFill = 0;
+    m_acc = Accum{};
+    for (int c = 0; c < 2; c++) {
+      m_peak[c].store(0.0f, std::memory_order_relaxed);
+      m_rms[c].store(0.0f, std::memory_order_relaxed);
+    }
+    m_momentary.store(kSilenceLufs, std::memory_order_relaxed);
+    m_shortTerm.store(kSilenceLufs, std::memory_order_relaxed);
+    m_blocks.store(0, std::memory_order_relaxed);
+  }
+
+  // Capture thread: meter frames of interleaved stereo (nullptr = silence).
+  void Process(const float *x, uint32_t frames) {
+    while (frames > 0) {
+      uint32_t n = kBlockFrames - m_blockFill;
+      if (n > frames) n = frames;
+      Accumulate(x, n);
+      if (x) x += static_cast<size_t>(n) * 2;
+      frames -= n;
+      m_blockFill += n;
+      if (m_blockFill == kBlockFrames) CompleteBlock();
+    }
+  }
+
+  // Any thread.
+  LevelSnapshot Read() const {
+    LevelSnapshot s;
+    for (int c = 0; c < 2; c++) {
+      s.peak[c] = m_peak[c].load(std::memory_order_relaxed);
+      s.rms[c] = m_rms[c].load(std::memory_order_relaxed);
+    }
+    s.momentaryLufs = m_momentary.load(std::memory_order_relaxed);
+    s.shortTermLufs = m_shortTerm.load(std::memory_order_relaxed);
+    s.blocks = m_blocks.load(std::memory_order_relaxed);
+    return s;
+  }
+
+private:
+  // BS.1770 K-weighting at 48 kHz: high-shelf pre-filter, then RLB high-pass.
+  // Transposed direct form II, per channel.
+  struct Biquads {
+    double s1[2] = {0.0, 0.0};
+    double s2[2] = {0.0, 0.0};
+  };
+  struct Coeffs {
+    double b0, b1, b2, a1, a2;
+  };
+  static constexpr Coeffs kShelf = {1.53512485958697, -2.69169618940638,
+                                    1.19839281085285, -1.69065929318241,
+                                    0.73248077421585};
+  static constexpr Coeffs kHighPass = {1.0, -2.0, 1.0, -1.99004745483398,
+                                       0.99007225036621};
+
+  static double Step(const Coeffs &k, double x, double &s1, double &s2) {
+    const double y = k.b0 * x + s1;
+    s1 = k.b1 * x - k.a1 * y + s2;
+    s2 = k.b2 * x - k.a2 * y;
+    return y;
+  }
+
+  struct Accum {
+    float peak[2] = {0.0f, 0.0f};
+    double sumSquares[2] = {0.0, 0.0};
+    double weighted = 0.0; // K-weighted sum of squares, both channels
+  };
+
+  void Accumulate(const float *x, uint32_t frames) {
+    if (x) {
+      const StereoLevel l = ScanStereo(x, frames);
+      for (int c = 0; c < 2; c++) {
+        if (l.peak[c] > m_acc.peak[c]) m_acc.peak[c] = l.peak[c];
+        m_acc.sumSquares[c] += l.sumSquares[c];
+      }
+    }
+    // The filters have to run on silence too, so their tails decay
+    double weighted = 0.0;
+    for (int c = 0; c < 2; c++) {
+      Biquads &shelf = m_filter[0];
+      Biquads &hp = m_filter[1];
+      for (uint32_t i = 0; i < frames; i++) {
+        const double in = x ? x[static_cast<size_t>(i) * 2 + c] : 0.0;
+        const double y = Step(kHighPass, Step(kShelf, in, shelf.s1[c], shelf.s2[c]),
+                              hp.s1[c], hp.s2[c]);
+        weighted += y * y;
+      }
+    }
+    m_acc.weighted += weighted;
+  }
+
+  static float ToLufs(double meanSquare) {
+    if (meanSquare <= 0.0) return kSilenceLufs;
+    const double l = -0.691 + 10.0 * std::log10(meanSquare);
+    return l < kSilenceLufs ? kSilenceLufs : static_cast<float>(l);
+  }
+
+  void CompleteBlock() {
+    for (int c = 0; c < 2; c++) {
+      m_peak[c].store(m_acc.peak[c], std::memory_order_relaxed);
+      m_rms[c].store(
+          static_cast<float>(std::sqrt(m_acc.sumSquares[c] / kBlockFrames)),
+          std::memory_order_relaxed);
+    }
+    // Left and right both have channel weight 1.0
+    m_blockPower[m_blockIndex] = m_acc.weighted / kBlockFrames;
+    m_blockIndex = (m_blockIndex + 1) % kShortTermBlocks;
+    const uint32_t done = m_blocks.load(std::memory_order_relaxed) + 1;
+
+    double momentary = 0.0, shortTerm = 0.0;
+    const uint32_t have = done < kShortTermBlocks ? done : kShortTermBlocks;
+    for (uint32_t i = 1; i <= have; i++) {
+      const double p =
+          m_blockPower[(m_blockIndex + kShortTermBlocks - i) % kShortTermBlocks];
+      shortTerm += p;
+      if (i <= kMomentaryBlocks) momentary += p;
+    }
+    const uint32_t mBlocks = have < kMomentaryBlocks ? have : kMomentaryBlocks;
+    m_momentary.store(ToLufs(momentary / mBlocks), std::memory_order_relaxed);
+    m_shortTerm.store(ToLufs(shortTerm / have), std::memory_order_relaxed);
+    m_blocks.store(done, std::memory_order_relaxed);
+
+    m_acc = Accum{};
+    m_blockFill = 0;
+  }
+
+  // Capture thread only
+  Biquads m_filter[2]; // [0] shelf, [1] high-pass
+  double m_blockPower[kShortTermBlocks];
+  uint32_t m_blockIndex = 0;
+  uint32_t m_blockFill = 0; // frames into the current block
+  Accum m_acc;
+
+  // Published per block
+  std::atomic<float> m_peak[2];
+  std::atomic<float> m_rms[2];
+  std::atomic<float> m_momentary;
+  std::atomic<float> m_shortTerm;
+  std::atomic<uint32_t> m_blocks;
+};
@@ -0,0 +1,132 @@
+// Optional RNNoise noise suppression for the capture path.
+//
+// Built only with `node-gyp rebuild -- -Dwith_rnnoise=1 -Drnnoise_dir=<rnnoise>`,
+// which defines MIGO_WITH_RNNOISE. Otherwise NoiseSuppressor is a stub whose
+// Configure() always fails, so callers need no #ifdefs.
+//
+// Runs on the capture thread over the raw 48 kHz stereo float stream, with
+// one RNNoise state per channel. Samples are gathered into RNNoise's fixed
+// 10 ms frames in preallocated buffers, so Push() never allocates; the
+// de-interleave/scale loops are plain enough for the compiler to vectorize,
+// and RNNoise itself should be built with its SIMD (x86 RTCD) kernels. A
+// stereo frame costs roughly 0.1 ms, well inside the 10 ms WASAPI period.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef MIGO_WITH_RNNOISE
+#include <rnnoise.h>
+#endif
+
+class NoiseSuppressor {
+public:
+#ifdef MIGO_WITH_RNNOISE
+  static constexpr bool kAvailable = true;
+#else
+  static constexpr bool kAvailable = false;
+#endif
+  // RNNoise only runs at 48 kHz, in frames of 480 samples
+  static constexpr uint32_t kSampleRate = 48000;
+  static constexpr uint32_t kFrameFrames = 480;
+  static constexpr uint32_t kChannels = 2;
+
+  NoiseSuppressor() = default;
+  NoiseSuppressor(const NoiseSuppressor &) = delete;
+  NoiseSuppressor &operator=(const NoiseSuppressor &) = delete;
+  ~NoiseSuppressor() { Release(); }
+
+  // JS/worker thread, before capture starts.
+  bool Configure(std::string &err) {
+    Release();
+#ifdef MIGO_WITH_RNNOISE
+    for (uint32_t c = 0; c < kChannels; c++) {
+      m_state[c] = rnnoise_create(nullptr);
+      if (!m_state[c]) {
+        Release();
+        err = "rnnoise_create failed";
+        return false;
+      }
+    }
+    return true;
+#else
+    err = "RNNoise support not built (rebuild with -Dwith_rnnoise=1)";
+    return false;
+#endif
+  }
+
+  void Release() {
+#ifdef MIGO_WITH_RNNOISE
+    for (DenoiseState *&s : m_state) {
+      if (s) rnnoise_destroy(s);
+      s = nullptr;
+    }
+#endif
+    m_filled = 0;
+    m_voice = 0.0f;
+  }
+
+  // Voice probability RNNoise reported for the latest frame (max over
+  // channels), 0..1.
+  float VoiceProbability() const { return m_voice; }
+
+  // Capture thread: append interleaved stereo samples (nullptr = silence)
+  // and call emit(const float *frame, int64_t startOffset) with every
+  // denoised frame of kFrameFrames completed. startOffset is where the frame
+  // begins relative to this call's first input frame; it is negative for
+  // the part gathered by earlier calls. Returns the frames emitted.
+  template <typename Emit>
+  uint32_t Push(const float *in, uint32_t frames, Emit &&emit) {
+    uint32_t emitted = 0;
+    int64_t start = -static_cast<int64_t>(m_filled);
+    while (frames > 0) {
+      uint32_t n = kFrameFrames - m_filled;
+      if (n > frames) n = frames;
+      float *dst = m_frame + static_cast<size_t>(m_filled) * kChannels;
+      const size_t samples = static_cast<size_t>(n) * kChannels;
+      if (in) {
+        memcpy(dst, in, samples * sizeof(float));
+        in += samples;
+      } else {
+        memset(dst, 0, samples * sizeof(float));
+      }
+      m_filled += n;
+      frames -= n;
+      if (m_filled < kFrameFrames) break;
+      m_filled = 0;
+      DenoiseFrame();
+      emit(static_cast<const float *>(m_frame), start);
+      start += kFrameFrames;
+      emitted += kFrameFrames;
+    }
+    return emitted;
+  }
+
+private:
+  // In place on m_frame. RNNoise works on one channel at 16-bit scale.
+  void DenoiseFrame() {
+#ifdef MIGO_WITH_RNNOISE
+    float voice = 0.0f;
+    for (uint32_t c = 0; c < kChannels; c++) {
+      for (uint32_t i = 0; i < kFrameFrames; i++)
+        m_in[i] = m_frame[i * kChannels + c] * 32768.0f;
+      const float p = rnnoise_process_frame(m_state[c], m_out, m_in);
+      if (p > voice) voice = p;
+      for (uint32_t i = 0; i < kFrameFrames; i++)
+        m_frame[i * kChannels + c] = m_out[i] * (1.0f / 32768.0f);
+    }
+    m_voice = voice;
+#endif
+  }
+
+#ifdef MIGO_WITH_RNNOISE
+  DenoiseState *m_state[kChannels] = {};
+  float m_in[kFrameFrames];
+  float m_out[kFrameFrames];
+#endif
+  uint32_t m_filled = 0; // frames gathered toward the current frame
+  float m_voice = 0.0f;
+  float m_frame[kFrameFrames * kChannels];
+};
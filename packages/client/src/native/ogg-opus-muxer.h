@@ -0,0 +1,137 @@
+// Minimal Ogg encapsulation of one Opus stream (RFC 3533, RFC 7845).
+//
+// Produces the OpusHead and OpusTags header pages, then audio pages of whole
+// packets. A page is closed once it covers about a second of audio (or its
+// segment table fills), so every page on disk is complete and a recording
+// cut short by a crash still plays up to its last page. Pages are appended
+// to a caller-owned buffer; nothing here touches files.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class OggOpusMuxer {
+public:
+  // Granule positions always count 48 kHz samples, whatever the input rate
+  static constexpr uint32_t kGranuleRate = 48000;
+
+  // Header pages for channels at inputRate; preSkip is the encoder's
+  // lookahead in 48 kHz samples.
+  void Begin(uint32_t serial, uint32_t channels, uint32_t inputRate,
+             uint32_t preSkip, std::vector<uint8_t> &out) {
+    m_serial = serial;
+    m_sequence = 0;
+    m_granule = preSkip;
+    m_segments.clear();
+    m_payload.clear();
+
+    uint8_t head[19] = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1};
+    head[9] = static_cast<uint8_t>(channels);
+    Put16(head + 10, preSkip);
+    Put32(head + 12, inputRate);
+    // Output gain 0, mapping family 0 (mono/stereo)
+    AddPacket(head, sizeof(head));
+    WritePage(out, kBos, 0);
+
+    static const char vendor[] = "migo";
+    uint8_t tags[8 + 4 + sizeof(vendor) - 1 + 4] = {'O', 'p', 'u', 's',
+                                                    'T', 'a', 'g', 's'};
+    Put32(tags + 8, sizeof(vendor) - 1);
+    memcpy(tags + 12, vendor, sizeof(vendor) - 1);
+    Put32(tags + 12 + sizeof(vendor) - 1, 0); // no user comments
+    AddPacket(tags, sizeof(tags));
+    WritePage(out, 0, 0);
+  }
+
+  // One Opus packet covering frames48k samples at 48 kHz.
+  void Packet(const uint8_t *data, uint32_t bytes, uint32_t frames48k,
+              std::vector<uint8_t> &out) {
+    // A packet needs bytes / 255 + 1 lacing values; close the page first if
+    // they won't fit
+    if (m_segments.size() + bytes / 255 + 1 > kMaxSegments)
+      WritePage(out, 0, m_granule);
+    AddPacket(data, bytes);
+    m_granule += frames48k;
+    m_pageFrames += frames48k;
+    if (m_pageFrames >= kGranuleRate) WritePage(out, 0, m_granule);
+  }
+
+  // Close the open page, if any; with eos, always write a last page.
+  void Flush(bool eos, std::vector<uint8_t> &out) {
+    if (!m_segments.empty() || eos) WritePage(out, eos ? kEos : 0, m_granule);
+  }
+
+private:
+  static constexpr uint8_t kBos = 0x02;
+  static constexpr uint8_t kEos = 0x04;
+  static constexpr size_t kMaxSegments = 255;
+
+  static void Put16(uint8_t *p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+  }
+  static void Put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+  }
+
+  void AddPacket(const uint8_t *data, uint32_t bytes) {
+    uint32_t left = bytes;
+    while (left >= 255) {
+      m_segments.push_back(255);
+      left -= 255;
+    }
+    m_segments.push_back(static_cast<uint8_t>(left));
+    m_payload.insert(m_payload.end(), data, data + bytes);
+  }
+
+  void WritePage(std::vector<uint8_t> &out, uint8_t flags, uint64_t granule) {
+    const size_t start = out.size();
+    out.resize(start + 27 + m_segments.size() + m_payload.size());
+    uint8_t *p = out.data() + start;
+    memcpy(p, "OggS", 4);
+    p[4] = 0; // version
+    p[5] = flags;
+    Put32(p + 6, static_cast<uint32_t>(granule));
+    Put32(p + 10, static_cast<uint32_t>(granule >> 32));
+    Put32(p + 14, m_serial);
+    Put32(p + 18, m_sequence++);
+    Put32(p + 22, 0); // CRC, filled in below
+    p[26] = static_cast<uint8_t>(m_segments.size());
+    if (!m_segments.empty())
+      memcpy(p + 27, m_segments.data(), m_segments.size());
+    if (!m_payload.empty())
+      memcpy(p + 27 + m_segments.size(), m_payload.data(), m_payload.size());
+    Put32(p + 22, Crc(p, out.size() - start));
+    m_segments.clear();
+    m_payload.clear();
+    m_pageFrames = 0;
+  }
+
+  // CRC-32, polynomial 0x04C11DB7, unreflected, zero initial value
+  static uint32_t Crc(const uint8_t *data, size_t len) {
+    static const struct Table {
+      uint32_t v[256];
+      Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+          uint32_t r = i << 24;
+          for (int j = 0; j < 8; j++)
+            r = (r & 0x80000000u) ? (r << 1) ^ 0x04C11DB7u : r << 1;
+          v[i] = r;
+        }
+      }
+    } table;
+    uint32_t crc = 0;
+    for (size_t i = 0; i < len; i++)
+      crc = (crc << 8) ^ table.v[((crc >> 24) ^ data[i]) & 0xFF];
+    return crc;
+  }
+
+  uint32_t m_serial = 0;
+  uint32_t m_sequence = 0;
+  uint64_t m_granule = 0;
+  uint32_t m_pageFrames = 0; // audio on the open page, 48 kHz samples
+  std::vector<uint8_t> m_segments;
+  std::vector<uint8_t> m_payload;
+};
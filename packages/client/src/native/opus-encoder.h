@@ -0,0 +1,157 @@
+// Optional Opus encoding for the capture path.
+//
+// Built only with `node-gyp rebuild -- -Dwith_opus=1 -Dopus_dir=<libopus>`,
+// which defines MIGO_WITH_OPUS. Otherwise OpusFrameEncoder is a stub whose
+// Configure() always fails, so callers need no #ifdefs.
+//
+// Output-format float samples are gathered into whole Opus frames and each
+// frame is encoded as soon as it completes, on the capture thread. One 20 ms
+// stereo frame takes well under a millisecond to encode, far inside the
+// 10 ms WASAPI period. Push() never allocates.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef MIGO_WITH_OPUS
+#include <opus.h>
+#endif
+
+struct OpusSettings {
+  uint32_t bitrate = 128000; // bits/s
+  uint32_t frameUs = 20000;  // 2.5, 5, 10, 20, 40 or 60 ms
+  bool dtx = false;          // let the encoder collapse silence itself
+
+  static bool ValidBitrate(uint32_t b) { return b >= 6000 && b <= 510000; }
+  static bool ValidFrameUs(uint32_t us) {
+    return us == 2500 || us == 5000 || us == 10000 || us == 20000 ||
+           us == 40000 || us == 60000;
+  }
+  static bool ValidRate(uint32_t rate) {
+    return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 ||
+           rate == 48000;
+  }
+};
+
+class OpusFrameEncoder {
+public:
+#ifdef MIGO_WITH_OPUS
+  static constexpr bool kAvailable = true;
+#else
+  static constexpr bool kAvailable = false;
+#endif
+  // libopus' recommended upper bound for one packet
+  static constexpr uint32_t kMaxPacketBytes = 4000;
+
+  OpusFrameEncoder() = default;
+  OpusFrameEncoder(const OpusFrameEncoder &) = delete;
+  OpusFrameEncoder &operator=(const OpusFrameEncoder &) = delete;
+  ~OpusFrameEncoder() { Release(); }
+
+  // JS/worker thread, before capture starts.
+  bool Configure(uint32_t sampleRate, uint32_t channels,
+                 const OpusSettings &settings, std::string &err) {
+    Release();
+#ifdef MIGO_WITH_OPUS
+    int e = OPUS_OK;
+    m_enc = opus_encoder_create(static_cast<opus_int32>(sampleRate),
+                                static_cast<int>(channels),
+                                OPUS_APPLICATION_AUDIO, &e);
+    if (e != OPUS_OK || !m_enc) {
+      m_enc = nullptr;
+      err = std::string("opus_encoder_create: ") + opus_strerror(e);
+      return false;
+    }
+    opus_encoder_ctl(m_enc, OPUS_SET_BITRATE(static_cast<opus_int32>(settings.bitrate)));
+    opus_encoder_ctl(m_enc, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+    opus_encoder_ctl(m_enc, OPUS_SET_DTX(settings.dtx ? 1 : 0));
+    m_channels = channels;
+    m_frameFrames =
+        static_cast<uint32_t>(uint64_t(sampleRate) * settings.frameUs / 1000000);
+    m_frame.assign(static_cast<size_t>(m_frameFrames) * channels, 0.0f);
+    m_filled = 0;
+    return true;
+#else
+    (void)sampleRate;
+    (void)channels;
+    (void)settings;
+    err = "Opus support not built (rebuild with -Dwith_opus=1)";
+    return false;
+#endif
+  }
+
+  void Release() {
+#ifdef MIGO_WITH_OPUS
+    if (m_enc) opus_encoder_destroy(m_enc);
+    m_enc = nullptr;
+#endif
+    m_filled = 0;
+  }
+
+  uint32_t FrameFrames() const { return m_frameFrames; }
+
+  // Encoder delay in input frames, for an Ogg pre-skip
+  uint32_t Lookahead() const {
+#ifdef MIGO_WITH_OPUS
+    opus_int32 frames = 0;
+    if (m_enc) opus_encoder_ctl(m_enc, OPUS_GET_LOOKAHEAD(&frames));
+    return static_cast<uint32_t>(frames);
+#else
+    return 0;
+#endif
+  }
+
+  // Capture thread: append interleaved samples (nullptr = silence) and call
+  // emit(const uint8_t *packet, uint32_t bytes) for every frame completed.
+  // Returns the number of frames that failed to encode.
+  template <typename Emit>
+  uint32_t Push(const float *in, uint32_t frames, Emit &&emit) {
+    uint32_t failures = 0;
+    while (frames > 0) {
+      uint32_t n = m_frameFrames - m_filled;
+      if (n > frames) n = frames;
+      float *dst = m_frame.data() + static_cast<size_t>(m_filled) * m_channels;
+      const size_t samples = static_cast<size_t>(n) * m_channels;
+      if (in) {
+        memcpy(dst, in, samples * sizeof(float));
+        in += samples;
+      } else {
+        memset(dst, 0, samples * sizeof(float));
+      }
+      m_filled += n;
+      frames -= n;
+      if (m_filled < m_frameFrames) break;
+      m_filled = 0;
+      const int bytes = EncodeFrame();
+      if (bytes > 0) {
+        emit(m_packet, static_cast<uint32_t>(bytes));
+      } else if (bytes < 0) {
+        failures++;
+      }
+    }
+    return failures;
+  }
+
+private:
+  int EncodeFrame() {
+#ifdef MIGO_WITH_OPUS
+    return opus_encode_float(m_enc, m_frame.data(),
+                             static_cast<int>(m_frameFrames), m_packet,
+                             static_cast<opus_int32>(kMaxPacketBytes));
+#else
+    return -1;
+#endif
+  }
+
+#ifdef MIGO_WITH_OPUS
+  OpusEncoder *m_enc = nullptr;
+#endif
+  uint32_t m_channels = 2;
+  uint32_t m_frameFrames = 0;
+  uint32_t m_filled = 0; // frames gathered toward the current frame
+  std::vector<float> m_frame;
+  uint8_t m_packet[kMaxPacketBytes];
+};
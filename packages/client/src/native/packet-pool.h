@@ -0,0 +1,183 @@
+// Preallocated packet slab shared between the capture thread and JS.
+//
+// All sample memory is allocated by Init() before the capture thread starts
+// (on the start worker, off the JS thread) and recycled through two SPSC rings:
+//   free  ring: JS thread (Release)  -> capture thread (Acquire)
+//   ready ring: capture thread (Publish) -> JS thread (Consume)
+// so the real-time path never touches the heap.
+//
+// Slots can also be lent to JS as external ArrayBuffers. A lent slot comes
+// back through Release() from the buffer's finalizer on the JS thread, which
+// may run long after the session that produced it stopped and concurrently
+// with a re-Init() on the worker. The free ring therefore lives in the slab,
+// and the slab is reference-counted — one reference for the pool while it is
+// current, one per lent slot — so a finalizer only ever touches its own slab,
+// and whichever side drops the last reference deletes it.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "spsc-ring.h"
+
+struct PacketSlab;
+
+struct Packet {
+  static constexpr uint64_t kNoPosition = ~uint64_t(0);
+
+  uint8_t *data;        // points into the pool slab, cache-line aligned
+  uint32_t capacity;    // in samples (interleaved)
+  uint32_t count;       // valid samples in this packet
+  uint32_t sampleBytes; // 4 = float32, 2 = int16, 1 = encoded bytes
+  uint32_t silentFrames; // count == 0: a marker for this many silent frames
+  uint64_t captureQpc;  // capture time of the first frame, 100 ns (0 = unknown)
+  uint64_t devicePosition; // stream position of the first frame, in capture
+                           // frames (kNoPosition = unknown)
+  PacketSlab *slab;     // owning slab (JS thread bookkeeping only)
+  bool lent;            // true while JS holds it as an external ArrayBuffer
+
+  size_t Bytes() const { return static_cast<size_t>(count) * sampleBytes; }
+};
+
+struct PacketSlab {
+  static constexpr uint32_t kMaxSlots = 128;
+
+  uint8_t *data = nullptr;
+  uint32_t slotCount = 0;
+  uint32_t stride = 0; // bytes
+  std::atomic<uint32_t> refs{1}; // the pool's reference + one per lent slot
+  SpscRing<Packet *, kMaxSlots> free;
+  Packet slots[kMaxSlots] = {};
+
+  ~PacketSlab() { FreeData(); }
+
+  // Point the slab at fresh storage for slotCount slots of stride bytes.
+  // Only while no slot is queued, published or lent.
+  bool Allocate(uint32_t count, uint32_t bytes) {
+    if (data && count == slotCount && bytes == stride) return true;
+    FreeData();
+    data = static_cast<uint8_t *>(::operator new[](
+        static_cast<size_t>(bytes) * count, std::align_val_t(MIGO_CACHE_LINE),
+        std::nothrow));
+    slotCount = data ? count : 0;
+    stride = data ? bytes : 0;
+    return data != nullptr;
+  }
+
+  // Drop one reference; the last one deletes the slab.
+  static void Unref(PacketSlab *slab) {
+    if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete slab;
+  }
+
+private:
+  void FreeData() {
+    if (data) ::operator delete[](data, std::align_val_t(MIGO_CACHE_LINE));
+    data = nullptr;
+  }
+};
+
+class PacketPool {
+public:
+  static constexpr uint32_t kMaxSlots = PacketSlab::kMaxSlots;
+  static constexpr uint32_t kDefaultSlots = 64;
+
+  PacketPool() = default;
+  PacketPool(const PacketPool &) = delete;
+  PacketPool &operator=(const PacketPool &) = delete;
+  ~PacketPool() {
+    if (m_slab) PacketSlab::Unref(m_slab);
+  }
+
+  // (Re)allocate the slab. Must not be called while the capture thread or the
+  // delivery drain runs; lent slots may still be returning on the JS thread.
+  bool Init(uint32_t slotCount, uint32_t samplesPerSlot,
+            uint32_t sampleBytes = sizeof(float)) {
+    if (slotCount == 0 || slotCount > kMaxSlots || samplesPerSlot == 0 ||
+        sampleBytes == 0)
+      return false;
+
+    // Round every slot up to a whole number of cache lines so neighbouring
+    // packets never share one.
+    const uint32_t bytes = samplesPerSlot * sampleBytes;
+    const uint32_t stride =
+        (bytes + MIGO_CACHE_LINE - 1) / MIGO_CACHE_LINE * MIGO_CACHE_LINE;
+
+    // Reuse the current slab only once nothing is on loan. Otherwise hand it
+    // to the outstanding loans — the last finalizer deletes it — unless they
+    // all came back between the check and giving up the pool's reference.
+    if (m_slab && m_slab->refs.load(std::memory_order_acquire) != 1 &&
+        m_slab->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      m_slab = nullptr;
+    }
+    if (!m_slab) m_slab = new (std::nothrow) PacketSlab();
+    if (!m_slab) return false;
+    m_slab->refs.store(1, std::memory_order_relaxed);
+    if (!m_slab->Allocate(slotCount, stride)) return false;
+
+    m_slab->free.Reset();
+    m_ready.Reset();
+    for (uint32_t i = 0; i < slotCount; i++) {
+      Packet &p = m_slab->slots[i];
+      p.data = m_slab->data + static_cast<size_t>(i) * stride;
+      p.capacity = samplesPerSlot;
+      p.count = 0;
+      p.silentFrames = 0;
+      p.sampleBytes = sampleBytes;
+      p.slab = m_slab;
+      p.lent = false;
+      m_slab->free.Push(&p);
+    }
+    return true;
+  }
+
+  // Capture thread: take an empty slot, or nullptr if JS holds them all.
+  Packet *Acquire() {
+    Packet *p = nullptr;
+    return m_slab && m_slab->free.Pop(p) ? p : nullptr;
+  }
+
+  // Capture thread: hand a filled slot to the JS thread.
+  void Publish(Packet *p) { m_ready.Push(p); }
+
+  // JS thread: take the oldest filled slot, or nullptr when drained.
+  Packet *Consume() {
+    Packet *p = nullptr;
+    return m_ready.Pop(p) ? p : nullptr;
+  }
+
+  // JS thread: mark a consumed slot as owned by an external ArrayBuffer.
+  void Lend(Packet *p) {
+    p->lent = true;
+    p->slab->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // JS thread: return a slot, either after its samples were copied out or
+  // from the finalizer of the external ArrayBuffer it was lent to. Touches
+  // only the packet's own slab, never the pool.
+  static void Release(Packet *p) {
+    PacketSlab *slab = p->slab;
+    const bool lent = p->lent;
+    p->lent = false;
+    p->count = 0;
+    p->silentFrames = 0;
+    slab->free.Push(p);
+    if (lent) PacketSlab::Unref(slab);
+  }
+
+  uint32_t ReadyCount() const { return m_ready.Size(); }
+  uint32_t LentCount() const {
+    return m_slab ? m_slab->refs.load(std::memory_order_relaxed) - 1 : 0;
+  }
+  uint32_t SlotCount() const { return m_slab ? m_slab->slotCount : 0; }
+  uint32_t SlotCapacity() const {
+    return m_slab ? m_slab->slots[0].capacity : 0;
+  }
+
+private:
+  PacketSlab *m_slab = nullptr;
+  SpscRing<Packet *, kMaxSlots> m_ready;
+};
@@ -0,0 +1,440 @@
+// PipeWire capture backend (Linux).
+//
+// Per-application capture without a virtual sink: the registry is watched
+// for playback streams (media.class Stream/Output/Audio) whose
+// application.process.id is the target or one of its descendants (browsers
+// and Electron apps play from a helper process), and a capture pw_stream is
+// pointed at the first one through target.object. The session manager links
+// it like any recorder; the stream's adapter converts whatever the app plays
+// to 48 kHz interleaved stereo float32. When that node goes away (the app
+// closed its output) the next matching one is picked up, and until then the
+// CaptureTimeline fills silence.
+//
+// Excluding one client from the desktop mix has no PipeWire equivalent
+// short of relinking every other stream, so excludeMode is refused: a
+// screen share on Linux goes without native audio.
+//
+// Everything runs on one pw_thread_loop per backend (no RT_PROCESS flag),
+// so stream, registry and timer callbacks, and with them every Sink call,
+// are serialized on that thread.
+
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "capture-backend.h"
+#include "capture-clock.h"
+
+// ─── Process tree ──────────────────────────────────────────────────────────────
+
+static constexpr int kMaxDepth = 32;
+
+static uint32_t ParentPid(uint32_t pid) {
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  if (!std::getline(stat, line)) return 0;
+  // "pid (comm) state ppid ...": comm may itself contain spaces and parens
+  const size_t close = line.rfind(')');
+  if (close == std::string::npos) return 0;
+  char state = 0;
+  unsigned ppid = 0;
+  if (sscanf(line.c_str() + close + 1, " %c %u", &state, &ppid) != 2) return 0;
+  return ppid;
+}
+
+// True if pid is root or runs under it.
+static bool InTree(uint32_t pid, uint32_t root) {
+  for (int depth = 0; pid > 1 && depth < kMaxDepth; depth++) {
+    if (pid == root) return true;
+    pid = ParentPid(pid);
+  }
+  return false;
+}
+
+static bool ProcessAlive(uint32_t pid) {
+  return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+}
+
+// ─── Backend ───────────────────────────────────────────────────────────────────
+
+class PipeWireBackend : public CaptureBackend {
+public:
+  static constexpr int kStartTimeoutSec = 5;
+
+  ~PipeWireBackend() override { Stop(); }
+
+  const char *Name() const override { return "pipewire"; }
+
+  bool Start(const CaptureTarget &target, Sink *sink,
+             const std::atomic<bool> &cancel, std::string &err) override {
+    if (target.excludeMode) {
+      err = "PipeWire can't exclude a process from the desktop mix; capture "
+            "a window instead";
+      return false;
+    }
+    m_pid = target.pid;
+    m_sink = sink;
+
+    m_loop = pw_thread_loop_new("migo-capture", nullptr);
+    if (!m_loop) {
+      err = "pw_thread_loop_new failed";
+      return false;
+    }
+    m_context = pw_context_new(pw_thread_loop_get_loop(m_loop), nullptr, 0);
+    if (!m_context || pw_thread_loop_start(m_loop) < 0) {
+      err = "Failed to start the PipeWire loop";
+      Stop();
+      return false;
+    }
+
+    pw_thread_loop_lock(m_loop);
+    m_core = pw_context_connect(m_context, nullptr, 0);
+    if (!m_core) {
+      pw_thread_loop_unlock(m_loop);
+      err = "Can't connect to PipeWire";
+      Stop();
+      return false;
+    }
+    m_coreEvents.version = PW_VERSION_CORE_EVENTS;
+    m_coreEvents.done = &PipeWireBackend::OnCoreDone;
+    m_coreEvents.error = &PipeWireBackend::OnCoreError;
+    pw_core_add_listener(m_core, &m_coreListener, &m_coreEvents, this);
+
+    m_registry = pw_core_get_registry(m_core, PW_VERSION_REGISTRY, 0);
+    m_registryEvents.version = PW_VERSION_REGISTRY_EVENTS;
+    m_registryEvents.global = &PipeWireBackend::OnGlobal;
+    m_registryEvents.global_remove = &PipeWireBackend::OnGlobalRemove;
+    pw_registry_add_listener(m_registry, &m_registryListener,
+                             &m_registryEvents, this);
+
+    // The initial globals are announced before this sync completes. It's
+    // waited for in kCancelPollMs slices so a stop can cut it short.
+    m_timeline.Reset(CaptureClockNow());
+    m_syncSeq = pw_core_sync(m_core, PW_ID_CORE, 0);
+    uint32_t waitedMs = 0;
+    while (!m_synced && m_error.empty() && !cancel.load() &&
+           waitedMs < uint32_t(kStartTimeoutSec) * 1000) {
+      timespec slice;
+      pw_thread_loop_get_time(m_loop, &slice,
+                              int64_t(kCancelPollMs) * SPA_NSEC_PER_MSEC);
+      if (pw_thread_loop_timed_wait_full(m_loop, &slice) != 0)
+        waitedMs += kCancelPollMs;
+    }
+    if (!m_synced || !m_error.empty()) {
+      err = !m_error.empty() ? m_error
+            : cancel.load()  ? "Capture stopped"
+                             : "PipeWire registry sync timed out";
+      pw_thread_loop_unlock(m_loop);
+      Stop();
+      return false;
+    }
+    if (!ProcessAlive(m_pid)) {
+      pw_thread_loop_unlock(m_loop);
+      err = "Target process not running";
+      Stop();
+      return false;
+    }
+
+    m_timer = pw_loop_add_timer(pw_thread_loop_get_loop(m_loop),
+                                &PipeWireBackend::OnTick, this);
+    timespec interval{0, long(CaptureTimeline::kTickMs) * 1000000};
+    pw_loop_update_timer(pw_thread_loop_get_loop(m_loop), m_timer, &interval,
+                         &interval, false);
+    pw_thread_loop_unlock(m_loop);
+    return true;
+  }
+
+  void Stop() override {
+    if (!m_loop) return;
+    pw_thread_loop_lock(m_loop);
+    DestroyStream();
+    if (m_timer) {
+      pw_loop_destroy_source(pw_thread_loop_get_loop(m_loop), m_timer);
+      m_timer = nullptr;
+    }
+    if (m_registry) {
+      spa_hook_remove(&m_registryListener);
+      pw_proxy_destroy(reinterpret_cast<pw_proxy *>(m_registry));
+      m_registry = nullptr;
+    }
+    if (m_core) {
+      spa_hook_remove(&m_coreListener);
+      pw_core_disconnect(m_core);
+      m_core = nullptr;
+    }
+    pw_thread_loop_unlock(m_loop);
+    // Joins the loop thread, so no callback is running past this
+    pw_thread_loop_stop(m_loop);
+    if (m_context) pw_context_destroy(m_context);
+    m_context = nullptr;
+    pw_thread_loop_destroy(m_loop);
+    m_loop = nullptr;
+    m_nodes.clear();
+    m_synced = false;
+    m_failed = false;
+    m_error.clear();
+  }
+
+private:
+  // ── Registry ──
+
+  static void OnGlobal(void *data, uint32_t id, uint32_t, const char *type,
+                       uint32_t, const spa_dict *props) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    if (!props || strcmp(type, PW_TYPE_INTERFACE_Node) != 0) return;
+    const char *mediaClass = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
+    const char *appPid = spa_dict_lookup(props, PW_KEY_APP_PROCESS_ID);
+    const char *serial = spa_dict_lookup(props, PW_KEY_OBJECT_SERIAL);
+    if (!mediaClass || strcmp(mediaClass, "Stream/Output/Audio") != 0 ||
+        !appPid || !serial)
+      return;
+    if (!InTree(static_cast<uint32_t>(strtoul(appPid, nullptr, 10)),
+                self->m_pid))
+      return;
+    self->m_nodes[id] = serial;
+    if (!self->m_stream && !self->m_failed) self->Connect(id);
+  }
+
+  static void OnGlobalRemove(void *data, uint32_t id) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    if (self->m_nodes.erase(id) == 0) return;
+    if (id != self->m_node) return;
+    // The app closed the stream we follow: move to the next one, if any
+    self->DestroyStream();
+    if (!self->m_nodes.empty() && !self->m_failed)
+      self->Connect(self->m_nodes.begin()->first);
+  }
+
+  static void OnCoreDone(void *data, uint32_t id, int seq) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    if (id != PW_ID_CORE || seq != self->m_syncSeq) return;
+    self->m_synced = true;
+    pw_thread_loop_signal(self->m_loop, false);
+  }
+
+  static void OnCoreError(void *data, uint32_t id, int, int res,
+                          const char *message) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    if (id != PW_ID_CORE) return;
+    const std::string msg = std::string(message ? message : "") + " (" +
+                            spa_strerror(res) + ")";
+    if (!self->m_synced) {
+      self->m_error = "PipeWire: " + msg;
+      pw_thread_loop_signal(self->m_loop, false);
+      return;
+    }
+    // res == -EPIPE: the daemon went away
+    self->Failed("stream-error", msg);
+  }
+
+  // ── Stream ──
+
+  void Connect(uint32_t node) {
+    pw_properties *props = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_CATEGORY, "Capture",
+        PW_KEY_MEDIA_ROLE, "Screen", PW_KEY_NODE_NAME, "migo-capture",
+        PW_KEY_TARGET_OBJECT, m_nodes[node].c_str(),
+        // A vanished target is handled here, not by the session manager
+        PW_KEY_NODE_DONT_RECONNECT, "true", nullptr);
+    m_stream = pw_stream_new(m_core, "Migo audio capture", props);
+    if (!m_stream) return;
+    m_streamEvents.version = PW_VERSION_STREAM_EVENTS;
+    m_streamEvents.process = &PipeWireBackend::OnProcess;
+    m_streamEvents.state_changed = &PipeWireBackend::OnStateChanged;
+    pw_stream_add_listener(m_stream, &m_streamListener, &m_streamEvents, this);
+
+    uint8_t buffer[1024];
+    spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+    spa_audio_info_raw info{};
+    info.format = SPA_AUDIO_FORMAT_F32; // interleaved
+    info.rate = kSampleRate;
+    info.channels = kChannels;
+    info.position[0] = SPA_AUDIO_CHANNEL_FL;
+    info.position[1] = SPA_AUDIO_CHANNEL_FR;
+    const spa_pod *params[1] = {
+        spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info)};
+    const int res = pw_stream_connect(
+        m_stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+        static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
+                                     PW_STREAM_FLAG_MAP_BUFFERS),
+        params, 1);
+    if (res < 0) {
+      DestroyStream();
+      return;
+    }
+    m_node = node;
+  }
+
+  void DestroyStream() {
+    if (!m_stream) return;
+    spa_hook_remove(&m_streamListener);
+    pw_stream_destroy(m_stream);
+    m_stream = nullptr;
+    m_node = SPA_ID_INVALID;
+  }
+
+  static void OnStateChanged(void *data, pw_stream_state, pw_stream_state state,
+                             const char *error) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    if (state != PW_STREAM_STATE_ERROR) return;
+    // Usually the target node going away mid-link; OnGlobalRemove or the
+    // exit check in OnTick follows. Anything else ends the capture.
+    if (self->m_nodes.count(self->m_node)) {
+      self->Failed("stream-error", error ? error : "pw_stream error");
+    }
+  }
+
+  static void OnProcess(void *data) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    pw_buffer *b = pw_stream_dequeue_buffer(self->m_stream);
+    if (!b) return;
+    const spa_data &d = b->buffer->datas[0];
+    if (d.data && d.chunk && !self->m_failed) {
+      const uint32_t offset = SPA_MIN(d.chunk->offset, d.maxsize);
+      const uint32_t size = SPA_MIN(d.chunk->size, d.maxsize - offset);
+      const uint32_t frames = size / (sizeof(float) * kChannels);
+      if (frames > 0) {
+        const bool silent = (d.chunk->flags & SPA_CHUNK_FLAG_EMPTY) != 0;
+        const uint64_t captureTime = self->CaptureTime();
+        const uint64_t position = self->m_timeline.Delivered(captureTime, frames);
+        self->m_sink->OnAudio(
+            silent ? nullptr
+                   : reinterpret_cast<const float *>(
+                         static_cast<const uint8_t *>(d.data) + offset),
+            frames, captureTime, position);
+      }
+    }
+    pw_stream_queue_buffer(self->m_stream, b);
+  }
+
+  // When the buffer being processed was captured: now, less what's still
+  // queued in the graph ahead of us.
+  uint64_t CaptureTime() const {
+    pw_time t{};
+    const uint64_t now = CaptureClockNow();
+    if (pw_stream_get_time_n(m_stream, &t, sizeof(t)) < 0 || t.rate.denom == 0)
+      return now;
+    const uint64_t delay = t.delay > 0 ? uint64_t(t.delay) * t.rate.num *
+                                             10000000 / t.rate.denom
+                                       : 0;
+    return now > delay ? now - delay : now;
+  }
+
+  // ── Timer: exit check, silence fill and failed-stream teardown ──
+
+  static void OnTick(void *data, uint64_t) {
+    auto *self = static_cast<PipeWireBackend *>(data);
+    if (self->m_failed) {
+      self->DestroyStream(); // left to us by Failed()
+      return;
+    }
+    if (!ProcessAlive(self->m_pid)) {
+      self->Failed("process-exited", "Target process exited");
+      return;
+    }
+    uint64_t start = 0;
+    const uint32_t frames = self->m_timeline.Gap(CaptureClockNow(), start);
+    if (frames == 0) return;
+    const uint64_t position = self->m_timeline.Delivered(start, frames);
+    self->m_sink->OnAudio(nullptr, frames, start, position);
+  }
+
+  // Ends the capture. This may run inside the stream's own emission
+  // (OnStateChanged) or the core's (OnCoreError), where destroying the
+  // stream would free it under its caller. An invoke from the loop thread
+  // runs inline, so the next tick (or Stop) destroys it instead; until then
+  // m_failed keeps its buffers from the sink and no other stream connects.
+  void Failed(const char *reason, const std::string &message) {
+    if (m_failed) return;
+    m_failed = true;
+    m_sink->OnFailed(reason, message);
+  }
+
+  uint32_t m_pid = 0;
+  Sink *m_sink = nullptr;
+  pw_thread_loop *m_loop = nullptr;
+  pw_context *m_context = nullptr;
+  pw_core *m_core = nullptr;
+  pw_registry *m_registry = nullptr;
+  pw_stream *m_stream = nullptr;
+  spa_source *m_timer = nullptr;
+  spa_hook m_coreListener{};
+  spa_hook m_registryListener{};
+  spa_hook m_streamListener{};
+  pw_core_events m_coreEvents{};
+  pw_registry_events m_registryEvents{};
+  pw_stream_events m_streamEvents{};
+  int m_syncSeq = 0;
+  bool m_synced = false;
+  std::string m_error; // a core error before the registry synced
+  bool m_failed = false;
+  // Matching playback nodes (global id → object.serial), and the one the
+  // stream is linked to
+  std::map<uint32_t, std::string> m_nodes;
+  uint32_t m_node = SPA_ID_INVALID;
+  CaptureTimeline m_timeline;
+};
+
+std::unique_ptr<CaptureBackend> CreateCaptureBackend() {
+  static std::once_flag init;
+  std::call_once(init, [] { pw_init(nullptr, nullptr); });
+  return std::make_unique<PipeWireBackend>();
+}
+
+// ─── Window → process ──────────────────────────────────────────────────────────
+
+// _NET_WM_PID of an X11 window. The connection is opened on first use and
+// kept; without an X server (a pure Wayland session) nothing resolves.
+uint32_t WindowProcessId(uint64_t windowId) {
+  static std::mutex mutex;
+  static Display *display = nullptr;
+  static bool opened = false;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!opened) {
+    opened = true;
+    XInitThreads();
+    display = XOpenDisplay(nullptr);
+  }
+  if (!display || windowId == 0) return 0;
+  const Atom pidAtom = XInternAtom(display, "_NET_WM_PID", True);
+  if (pidAtom == None) return 0;
+  // A stale XID raises BadWindow, which the default handler turns into exit
+  XErrorHandler previous =
+      XSetErrorHandler([](Display *, XErrorEvent *) { return 0; });
+  Atom type = None;
+  int format = 0;
+  unsigned long count = 0, after = 0;
+  unsigned char *prop = nullptr;
+  uint32_t pid = 0;
+  if (XGetWindowProperty(display, static_cast<Window>(windowId), pidAtom, 0, 1,
+                         False, XA_CARDINAL, &type, &format, &count, &after,
+                         &prop) == Success &&
+      prop && type == XA_CARDINAL && format == 32 && count == 1) {
+    // Format-32 properties come back as longs
+    pid = static_cast<uint32_t>(*reinterpret_cast<unsigned long *>(prop));
+  }
+  if (prop) XFree(prop);
+  XSync(display, False);
+  XSetErrorHandler(previous);
+  return pid;
+}
+
+std::string ProcessName(uint32_t pid) {
+  std::ifstream comm("/proc/" + std::to_string(pid) + "/comm");
+  std::string name;
+  std::getline(comm, name);
+  return name;
+}
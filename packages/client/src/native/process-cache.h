@@ -0,0 +1,143 @@
+// Process facts for window → process resolution, cached per PID.
+//
+// The screen-share picker resolves dozens of windows at once, and every
+// window's executable and parent chain would otherwise cost a Toolhelp
+// snapshot of the whole system. Misses are filled from one snapshot per
+// batch. An entry is dropped when its process exits (a thread-pool wait on
+// the process handle), so a PID reused by a later process never finds a
+// stale entry.
+
+#pragma once
+
+#include <windows.h>
+#include <tlhelp32.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ProcessCache {
+public:
+  struct Process {
+    DWORD pid = 0;
+    std::wstring exe; // image file name, e.g. L"chrome.exe"
+    DWORD parentPid = 0;
+    uint64_t created = 0; // FILETIME ticks; 0 if the process can't be opened
+  };
+
+  // Ancestor chains longer than this are cut off (PID reuse can make loops)
+  static constexpr size_t kMaxDepth = 32;
+
+  // Leaked like the capture service: exit waits may fire at any time.
+  static ProcessCache &Instance() {
+    static ProcessCache *cache = new ProcessCache();
+    return *cache;
+  }
+
+  // For each pid: its process, then its running ancestors, nearest first.
+  // Empty for a pid of 0 or a process that isn't running any more.
+  std::vector<std::vector<Process>> Resolve(const std::vector<DWORD> &pids) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unordered_map<DWORD, Process> snapshot;
+    bool snapped = false;
+    std::vector<std::vector<Process>> out(pids.size());
+    for (size_t i = 0; i < pids.size(); i++) {
+      std::vector<Process> &chain = out[i];
+      DWORD pid = pids[i];
+      while (pid != 0 && chain.size() < kMaxDepth) {
+        const Process *p = Find(pid);
+        if (!p) {
+          if (!snapped) {
+            TakeSnapshot(snapshot);
+            snapped = true;
+          }
+          auto it = snapshot.find(pid);
+          if (it == snapshot.end()) break; // exited
+          p = Watch(it->second);
+          if (!p) p = &it->second; // can't be opened: not cached
+        }
+        // A parent created after its child is a later process that reused
+        // the PID; the real parent is gone
+        if (!chain.empty() && p->created && chain.back().created &&
+            p->created > chain.back().created)
+          break;
+        chain.push_back(*p);
+        if (p->parentPid == pid) break;
+        pid = p->parentPid;
+      }
+    }
+    return out;
+  }
+
+private:
+  struct Entry {
+    Process process;
+    HANDLE handle = nullptr;
+    HANDLE wait = nullptr;
+  };
+
+  ProcessCache() = default;
+
+  // With m_mutex held.
+  const Process *Find(DWORD pid) const {
+    auto it = m_entries.find(pid);
+    return it == m_entries.end() ? nullptr : &it->second->process;
+  }
+
+  static void TakeSnapshot(std::unordered_map<DWORD, Process> &out) {
+    HANDLE snap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snap == INVALID_HANDLE_VALUE) return;
+    PROCESSENTRY32W e = {};
+    e.dwSize = sizeof(e);
+    for (BOOL ok = Process32FirstW(snap, &e); ok;
+         ok = Process32NextW(snap, &e)) {
+      Process &p = out[e.th32ProcessID];
+      p.pid = e.th32ProcessID;
+      p.exe = e.szExeFile;
+      p.parentPid = e.th32ParentProcessID;
+    }
+    CloseHandle(snap);
+  }
+
+  // Cache proc until its process exits. With m_mutex held, which OnExit
+  // takes first, so the wait handle is stored before the callback reads it.
+  // nullptr if the process can't be opened (protected, or gone already).
+  const Process *Watch(const Process &proc) {
+    HANDLE h = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION,
+                           FALSE, proc.pid);
+    if (!h) return nullptr;
+    auto *e = new Entry{proc, h, nullptr};
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(h, &created, &exited, &kernel, &user))
+      e->process.created =
+          (static_cast<uint64_t>(created.dwHighDateTime) << 32) |
+          created.dwLowDateTime;
+    if (!RegisterWaitForSingleObject(&e->wait, h, &ProcessCache::OnExit, e,
+                                     INFINITE, WT_EXECUTEONLYONCE)) {
+      CloseHandle(h);
+      delete e;
+      return nullptr;
+    }
+    m_entries[proc.pid] = e;
+    return &e->process;
+  }
+
+  // Thread pool: the process exited.
+  static void CALLBACK OnExit(void *context, BOOLEAN) {
+    auto *e = static_cast<Entry *>(context);
+    ProcessCache &cache = Instance();
+    std::lock_guard<std::mutex> lock(cache.m_mutex);
+    auto it = cache.m_entries.find(e->process.pid);
+    if (it != cache.m_entries.end() && it->second == e)
+      cache.m_entries.erase(it);
+    // Non-blocking, as it must be from the wait's own callback
+    UnregisterWaitEx(e->wait, nullptr);
+    CloseHandle(e->handle);
+    delete e;
+  }
+
+  std::mutex m_mutex;
+  std::unordered_map<DWORD, Entry *> m_entries;
+};
@@ -0,0 +1,421 @@
+// ScreenCaptureKit capture backend (macOS 13+).
+//
+// An SCStream with capturesAudio over a content filter of the main display:
+// including the target application (and any running under it: browsers and
+// Electron apps play from a helper process) for a window share, or
+// excluding it for a screen share, which ScreenCaptureKit supports
+// natively. The stream still has to carry video, so it's configured at
+// 2×2 px and one frame per second, and no screen output is attached.
+//
+// Audio, the exit watch and the silence timer all run on one serial
+// dispatch queue, which serializes every Sink call. Built with ARC.
+
+#import <CoreGraphics/CoreGraphics.h>
+#import <CoreMedia/CoreMedia.h>
+#import <Foundation/Foundation.h>
+#import <ScreenCaptureKit/ScreenCaptureKit.h>
+
+#include <libproc.h>
+#include <sys/sysctl.h>
+
+#include <string>
+#include <vector>
+
+#include "capture-backend.h"
+#include "capture-clock.h"
+
+class ScreenCaptureKitBackend;
+
+API_AVAILABLE(macos(13.0))
+@interface MigoAudioOutput : NSObject <SCStreamOutput, SCStreamDelegate>
+- (instancetype)initWithBackend:(ScreenCaptureKitBackend *)backend;
+@end
+
+// ─── Process tree ──────────────────────────────────────────────────────────────
+
+static constexpr int kMaxDepth = 32;
+
+static pid_t ParentPid(pid_t pid) {
+  kinfo_proc info{};
+  size_t size = sizeof(info);
+  int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PID, pid};
+  if (sysctl(mib, 4, &info, &size, nullptr, 0) != 0 || size == 0) return 0;
+  return info.kp_eproc.e_ppid;
+}
+
+// True if pid is root or runs under it.
+static bool InTree(pid_t pid, pid_t root) {
+  for (int depth = 0; pid > 1 && depth < kMaxDepth; depth++) {
+    if (pid == root) return true;
+    pid = ParentPid(pid);
+  }
+  return false;
+}
+
+// ─── Backend ───────────────────────────────────────────────────────────────────
+
+class API_AVAILABLE(macos(13.0)) ScreenCaptureKitBackend
+    : public CaptureBackend {
+public:
+  static constexpr int64_t kStartTimeoutSec = 5;
+
+  ScreenCaptureKitBackend() {
+    m_queue = dispatch_queue_create(
+        "migo.capture",
+        dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL,
+                                                QOS_CLASS_USER_INTERACTIVE, 0));
+  }
+  ~ScreenCaptureKitBackend() override { Stop(); }
+
+  const char *Name() const override { return "screencapturekit"; }
+  dispatch_queue_t Queue() const { return m_queue; }
+
+  bool Start(const CaptureTarget &target, Sink *sink,
+             const std::atomic<bool> &cancel, std::string &err) override {
+    m_pid = static_cast<pid_t>(target.pid);
+    m_sink = sink;
+
+    SCContentFilter *filter = MakeFilter(target, cancel, err);
+    if (!filter) return false;
+
+    SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
+    config.capturesAudio = YES;
+    config.sampleRate = kSampleRate;
+    config.channelCount = kChannels;
+    // Migo's own output (voice chat) never goes out with the share
+    config.excludesCurrentProcessAudio = YES;
+    config.width = 2;
+    config.height = 2;
+    config.minimumFrameInterval = CMTimeMake(1, 1);
+    config.queueDepth = 3;
+
+    m_output = [[MigoAudioOutput alloc] initWithBackend:this];
+    m_stream = [[SCStream alloc] initWithFilter:filter
+                                  configuration:config
+                                       delegate:m_output];
+    NSError *addError = nil;
+    if (![m_stream addStreamOutput:m_output
+                              type:SCStreamOutputTypeAudio
+                sampleHandlerQueue:m_queue
+                             error:&addError]) {
+      err = "addStreamOutput failed: " + Describe(addError);
+      Stop();
+      return false;
+    }
+
+    dispatch_sync(m_queue, ^{
+      m_active = true;
+      m_failed = false;
+      m_timeline.Reset(CaptureClockNow());
+    });
+    __block NSError *startError = nil;
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    [m_stream startCaptureWithCompletionHandler:^(NSError *error) {
+      startError = error;
+      dispatch_semaphore_signal(started);
+    }];
+    if (!Wait(started, cancel)) {
+      err = cancel.load() ? "Capture stopped" : "SCStream start timed out";
+      Stop();
+      return false;
+    }
+    if (startError) {
+      err = "SCStream start failed: " + Describe(startError);
+      Stop();
+      return false;
+    }
+
+    // A process-exit source for window shares; a screen share excludes
+    // Migo itself, which outlives it.
+    if (!target.excludeMode) {
+      m_exit = dispatch_source_create(DISPATCH_SOURCE_TYPE_PROC, m_pid,
+                                      DISPATCH_PROC_EXIT, m_queue);
+      dispatch_source_set_event_handler(m_exit, ^{
+        Failed("process-exited", "Target process exited");
+      });
+      dispatch_resume(m_exit);
+    }
+    m_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, m_queue);
+    const uint64_t tick = uint64_t(CaptureTimeline::kTickMs) * NSEC_PER_MSEC;
+    dispatch_source_set_timer(m_timer, dispatch_time(DISPATCH_TIME_NOW, tick),
+                              tick, tick / 10);
+    dispatch_source_set_event_handler(m_timer, ^{
+      OnTick();
+    });
+    dispatch_resume(m_timer);
+    return true;
+  }
+
+  void Stop() override {
+    // Nothing reaches the sink once this ran on the queue
+    dispatch_sync(m_queue, ^{
+      m_active = false;
+    });
+    if (m_stream) {
+      dispatch_semaphore_t stopped = dispatch_semaphore_create(0);
+      [m_stream stopCaptureWithCompletionHandler:^(NSError *) {
+        dispatch_semaphore_signal(stopped);
+      }];
+      dispatch_semaphore_wait(stopped, Deadline());
+      [m_stream removeStreamOutput:m_output
+                              type:SCStreamOutputTypeAudio
+                             error:nil];
+      m_stream = nil;
+    }
+    if (m_exit) dispatch_source_cancel(m_exit);
+    if (m_timer) dispatch_source_cancel(m_timer);
+    m_exit = nil;
+    m_timer = nil;
+    // Let any callback already queued finish before the sink goes away
+    dispatch_sync(m_queue, ^{
+    });
+    m_output = nil;
+  }
+
+  // ── Queue callbacks ──
+
+  void OnSampleBuffer(CMSampleBufferRef sb) {
+    if (!m_active || m_failed || !CMSampleBufferDataIsReady(sb)) return;
+    const CMItemCount frames = CMSampleBufferGetNumSamples(sb);
+    if (frames <= 0) return;
+    const AudioStreamBasicDescription *asbd =
+        CMAudioFormatDescriptionGetStreamBasicDescription(
+            CMSampleBufferGetFormatDescription(sb));
+    if (!asbd || asbd->mFormatID != kAudioFormatLinearPCM ||
+        !(asbd->mFormatFlags & kAudioFormatFlagIsFloat) ||
+        asbd->mBitsPerChannel != 32)
+      return;
+
+    // Room for a planar buffer per channel
+    struct {
+      AudioBufferList list;
+      AudioBuffer extra[kChannels - 1];
+    } abl;
+    CMBlockBufferRef block = nullptr;
+    if (CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer(
+            sb, nullptr, &abl.list, sizeof(abl), kCFAllocatorDefault,
+            kCFAllocatorDefault,
+            kCMSampleBufferFlag_AudioBufferList_Assure16ByteAlignment,
+            &block) != noErr)
+      return;
+
+    const uint32_t n = static_cast<uint32_t>(frames);
+    const float *interleaved = Interleave(abl.list, *asbd, n);
+    if (interleaved) {
+      const uint64_t captureTime = CaptureTime(sb);
+      const uint64_t position = m_timeline.Delivered(captureTime, n);
+      m_sink->OnAudio(interleaved, n, captureTime, position);
+    }
+    CFRelease(block);
+  }
+
+  void OnStopped(NSError *error) {
+    if (!m_active) return;
+    Failed("stream-error", Describe(error));
+  }
+
+private:
+  static dispatch_time_t Deadline() {
+    return dispatch_time(DISPATCH_TIME_NOW, kStartTimeoutSec * NSEC_PER_SEC);
+  }
+
+  // Wait for a completion handler's signal for up to kStartTimeoutSec, in
+  // kCancelPollMs slices so a stop can cut it short. False if it never came.
+  static bool Wait(dispatch_semaphore_t done, const std::atomic<bool> &cancel) {
+    const int64_t slice = int64_t(kCancelPollMs) * NSEC_PER_MSEC;
+    for (int64_t waited = 0; waited < kStartTimeoutSec * NSEC_PER_SEC;
+         waited += slice) {
+      if (cancel.load()) return false;
+      if (dispatch_semaphore_wait(done,
+                                  dispatch_time(DISPATCH_TIME_NOW, slice)) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  static std::string Describe(NSError *error) {
+    if (!error) return "unknown error";
+    return std::string(error.localizedDescription.UTF8String ?: "") + " (" +
+           std::to_string(error.code) + ")";
+  }
+
+  // The main display, with the target's applications in or out.
+  SCContentFilter *MakeFilter(const CaptureTarget &target,
+                              const std::atomic<bool> &cancel,
+                              std::string &err) {
+    __block SCShareableContent *content = nil;
+    __block NSError *contentError = nil;
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    [SCShareableContent
+        getShareableContentExcludingDesktopWindows:NO
+                               onScreenWindowsOnly:NO
+                                 completionHandler:^(SCShareableContent *c,
+                                                     NSError *error) {
+                                   content = c;
+                                   contentError = error;
+                                   dispatch_semaphore_signal(done);
+                                 }];
+    if (!Wait(done, cancel)) {
+      err = cancel.load() ? "Capture stopped" : "SCShareableContent timed out";
+      return nil;
+    }
+    if (!content) {
+      // Usually the Screen Recording permission
+      err = "SCShareableContent unavailable: " + Describe(contentError);
+      return nil;
+    }
+
+    SCDisplay *display = nil;
+    const CGDirectDisplayID mainId = CGMainDisplayID();
+    for (SCDisplay *d in content.displays) {
+      if (d.displayID == mainId) display = d;
+    }
+    if (!display) display = content.displays.firstObject;
+    if (!display) {
+      err = "No display to capture";
+      return nil;
+    }
+
+    NSMutableArray<SCRunningApplication *> *apps = [NSMutableArray array];
+    for (SCRunningApplication *app in content.applications) {
+      if (InTree(app.processID, m_pid)) [apps addObject:app];
+    }
+    if (target.excludeMode) {
+      return [[SCContentFilter alloc] initWithDisplay:display
+                                excludingApplications:apps
+                                     exceptingWindows:@[]];
+    }
+    if (apps.count == 0) {
+      err = "Target process has no shareable application";
+      return nil;
+    }
+    return [[SCContentFilter alloc] initWithDisplay:display
+                              includingApplications:apps
+                                   exceptingWindows:@[]];
+  }
+
+  // ScreenCaptureKit delivers planar float; the sink takes interleaved
+  // stereo. Mono is duplicated to both channels.
+  const float *Interleave(const AudioBufferList &list,
+                          const AudioStreamBasicDescription &asbd,
+                          uint32_t frames) {
+    const bool planar = asbd.mFormatFlags & kAudioFormatFlagIsNonInterleaved;
+    if (!planar && asbd.mChannelsPerFrame == kChannels &&
+        list.mNumberBuffers == 1 &&
+        list.mBuffers[0].mDataByteSize >= frames * kChannels * sizeof(float)) {
+      return static_cast<const float *>(list.mBuffers[0].mData);
+    }
+    if (!planar || list.mNumberBuffers == 0) return nullptr;
+    for (UInt32 b = 0; b < list.mNumberBuffers; b++) {
+      if (list.mBuffers[b].mDataByteSize < frames * sizeof(float))
+        return nullptr;
+    }
+    const float *left = static_cast<const float *>(list.mBuffers[0].mData);
+    const float *right =
+        list.mNumberBuffers > 1
+            ? static_cast<const float *>(list.mBuffers[1].mData)
+            : left;
+    m_interleaved.resize(size_t(frames) * kChannels);
+    float *out = m_interleaved.data();
+    for (uint32_t i = 0; i < frames; i++) {
+      out[i * 2] = left[i];
+      out[i * 2 + 1] = right[i];
+    }
+    return out;
+  }
+
+  // The presentation time is on the host clock; its mach ticks are the
+  // capture clock's source.
+  static uint64_t CaptureTime(CMSampleBufferRef sb) {
+    const CMTime pts = CMSampleBufferGetPresentationTimeStamp(sb);
+    if (!CMTIME_IS_NUMERIC(pts)) return CaptureClockNow();
+    return MachTo100ns(CMClockConvertHostTimeToSystemUnits(pts));
+  }
+
+  void OnTick() {
+    if (!m_active || m_failed) return;
+    uint64_t start = 0;
+    const uint32_t frames = m_timeline.Gap(CaptureClockNow(), start);
+    if (frames == 0) return;
+    const uint64_t position = m_timeline.Delivered(start, frames);
+    m_sink->OnAudio(nullptr, frames, start, position);
+  }
+
+  void Failed(const char *reason, const std::string &message) {
+    if (!m_active || m_failed) return;
+    m_failed = true;
+    m_sink->OnFailed(reason, message);
+  }
+
+  pid_t m_pid = 0;
+  Sink *m_sink = nullptr;
+  dispatch_queue_t m_queue;
+  SCStream *m_stream = nil;
+  MigoAudioOutput *m_output = nil;
+  dispatch_source_t m_exit = nil;
+  dispatch_source_t m_timer = nil;
+  // Queue only: the sink may be called, and the stream ended on its own
+  bool m_active = false;
+  bool m_failed = false;
+  CaptureTimeline m_timeline;
+  std::vector<float> m_interleaved;
+};
+
+@implementation MigoAudioOutput {
+  ScreenCaptureKitBackend *_backend;
+}
+
+- (instancetype)initWithBackend:(ScreenCaptureKitBackend *)backend {
+  if ((self = [super init])) _backend = backend;
+  return self;
+}
+
+- (void)stream:(SCStream *)stream
+    didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
+                   ofType:(SCStreamOutputType)type {
+  if (type == SCStreamOutputTypeAudio) _backend->OnSampleBuffer(sampleBuffer);
+}
+
+// Not on the sample queue; hop onto it so the sink sees one thread.
+- (void)stream:(SCStream *)stream didStopWithError:(NSError *)error {
+  ScreenCaptureKitBackend *backend = _backend;
+  dispatch_async(backend->Queue(), ^{
+    backend->OnStopped(error);
+  });
+}
+
+@end
+
+std::unique_ptr<CaptureBackend> CreateCaptureBackend() {
+  if (@available(macOS 13.0, *)) {
+    return std::make_unique<ScreenCaptureKitBackend>();
+  }
+  return nullptr;
+}
+
+// ─── Window → process ──────────────────────────────────────────────────────────
+
+uint32_t WindowProcessId(uint64_t windowId) {
+  if (windowId == 0 || windowId > UINT32_MAX) return 0;
+  CFArrayRef windows = CGWindowListCopyWindowInfo(
+      kCGWindowListOptionIncludingWindow, static_cast<CGWindowID>(windowId));
+  if (!windows) return 0;
+  uint32_t pid = 0;
+  if (CFArrayGetCount(windows) > 0) {
+    auto info =
+        static_cast<CFDictionaryRef>(CFArrayGetValueAtIndex(windows, 0));
+    auto owner = static_cast<CFNumberRef>(
+        CFDictionaryGetValue(info, kCGWindowOwnerPID));
+    int32_t value = 0;
+    if (owner && CFNumberGetValue(owner, kCFNumberSInt32Type, &value))
+      pid = static_cast<uint32_t>(value);
+  }
+  CFRelease(windows);
+  return pid;
+}
+
+std::string ProcessName(uint32_t pid) {
+  char name[2 * MAXCOMLEN + 1] = {};
+  if (proc_name(static_cast<int>(pid), name, sizeof(name)) <= 0) return "";
+  return name;
+}
@@ -0,0 +1,113 @@
+// Vectorized level scans over float32 samples.
+//
+// The capture thread runs these on every WASAPI packet when silence
+// suppression or metering is on, so they have to stay a few hundred
+// nanoseconds for a 10 ms stereo packet. SSE2 is the x64 baseline; IsSilent
+// also has an AVX2 path for builds that target it.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIGO_HAVE_AVX2 1
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#ifndef MIGO_HAVE_SSE2
+#define MIGO_HAVE_SSE2 1
+#endif
+#endif
+
+// True if no sample's magnitude exceeds threshold. Bails out at the first
+// block that does, so audible packets cost almost nothing; a threshold of 0
+// accepts only exact digital silence (either sign of zero).
+inline bool IsSilent(const float *x, size_t n, float threshold) {
+  size_t i = 0;
+#if MIGO_HAVE_AVX2
+  const __m256 absMask8 = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 t8 = _mm256_set1_ps(threshold);
+  for (; i + 32 <= n; i += 32) {
+    __m256 a = _mm256_and_ps(_mm256_loadu_ps(x + i), absMask8);
+    __m256 b = _mm256_and_ps(_mm256_loadu_ps(x + i + 8), absMask8);
+    __m256 c = _mm256_and_ps(_mm256_loadu_ps(x + i + 16), absMask8);
+    __m256 d = _mm256_and_ps(_mm256_loadu_ps(x + i + 24), absMask8);
+    __m256 m = _mm256_max_ps(_mm256_max_ps(a, b), _mm256_max_ps(c, d));
+    if (_mm256_movemask_ps(_mm256_cmp_ps(m, t8, _CMP_GT_OQ)) != 0) return false;
+  }
+#endif
+#if MIGO_HAVE_SSE2
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 t = _mm_set1_ps(threshold);
+  for (; i + 16 <= n; i += 16) {
+    __m128 a = _mm_and_ps(_mm_loadu_ps(x + i), absMask);
+    __m128 b = _mm_and_ps(_mm_loadu_ps(x + i + 4), absMask);
+    __m128 c = _mm_and_ps(_mm_loadu_ps(x + i + 8), absMask);
+    __m128 d = _mm_and_ps(_mm_loadu_ps(x + i + 12), absMask);
+    __m128 m = _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d));
+    if (_mm_movemask_ps(_mm_cmpgt_ps(m, t)) != 0) return false;
+  }
+#endif
+  for (; i < n; i++) {
+    if (std::fabs(x[i]) > threshold) return false;
+  }
+  return true;
+}
+
+// Per-channel peak magnitude and sum of squares of interleaved stereo. An
+// SSE register holds two frames (L R L R), so even lanes are left and odd
+// lanes right; four registers in flight hide the max/add latency.
+struct StereoLevel {
+  float peak[2] = {0.0f, 0.0f};
+  double sumSquares[2] = {0.0, 0.0};
+};
+
+inline StereoLevel ScanStereo(const float *x, size_t frames) {
+  StereoLevel level;
+  const size_t n = frames * 2;
+  size_t i = 0;
+  float peak[2] = {0.0f, 0.0f};
+  double sum[2] = {0.0, 0.0};
+#if MIGO_HAVE_SSE2
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 p0 = _mm_setzero_ps(), p1 = _mm_setzero_ps();
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  // Float sums are flushed to double every 256 frames to bound rounding.
+  while (i + 8 <= n) {
+    const size_t end = n - i > 512 ? i + 512 : n;
+    for (; i + 8 <= end; i += 8) {
+      __m128 a = _mm_loadu_ps(x + i);
+      __m128 b = _mm_loadu_ps(x + i + 4);
+      p0 = _mm_max_ps(p0, _mm_and_ps(a, absMask));
+      p1 = _mm_max_ps(p1, _mm_and_ps(b, absMask));
+      s0 = _mm_add_ps(s0, _mm_mul_ps(a, a));
+      s1 = _mm_add_ps(s1, _mm_mul_ps(b, b));
+    }
+    alignas(16) float sv[4];
+    _mm_store_ps(sv, _mm_add_ps(s0, s1));
+    sum[0] += static_cast<double>(sv[0]) + sv[2];
+    sum[1] += static_cast<double>(sv[1]) + sv[3];
+    s0 = _mm_setzero_ps();
+    s1 = _mm_setzero_ps();
+  }
+  alignas(16) float pv[4];
+  _mm_store_ps(pv, _mm_max_ps(p0, p1));
+  peak[0] = pv[0] > pv[2] ? pv[0] : pv[2];
+  peak[1] = pv[1] > pv[3] ? pv[1] : pv[3];
+#endif
+  for (; i + 2 <= n; i += 2) {
+    for (int c = 0; c < 2; c++) {
+      const float a = std::fabs(x[i + c]);
+      if (a > peak[c]) peak[c] = a;
+      sum[c] += static_cast<double>(x[i + c]) * x[i + c];
+    }
+  }
+  for (int c = 0; c < 2; c++) {
+    level.peak[c] = peak[c];
+    level.sumSquares[c] = sum[c];
+  }
+  return level;
+}
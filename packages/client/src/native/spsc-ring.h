@@ -0,0 +1,139 @@
+// Lock-free single-producer single-consumer rings: SpscRing of trivially
+// copyable items, and SpscByteRing for byte streams sized at run time.
+//
+// The producer only writes m_head and the consumer only writes m_tail, so the
+// two indices live on separate cache lines to keep the capture thread and the
+// JS thread from false-sharing on every push/pop.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#ifndef MIGO_CACHE_LINE
+#define MIGO_CACHE_LINE 64
+#endif
+
+template <typename T, uint32_t Capacity> class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SpscRing items must be trivially copyable");
+
+public:
+  // Producer side. Returns false when the ring is full.
+  bool Push(const T &item) {
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    const uint32_t tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail >= Capacity) return false;
+    m_items[head & kMask] = item;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when the ring is empty.
+  bool Pop(T &out) {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    const uint32_t head = m_head.load(std::memory_order_acquire);
+    if (head == tail) return false;
+    out = m_items[tail & kMask];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate occupancy; exact when called from either endpoint thread.
+  uint32_t Size() const {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+  }
+
+  static constexpr uint32_t capacity() { return Capacity; }
+
+  // Only safe while neither endpoint is active.
+  void Reset() {
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr uint32_t kMask = Capacity - 1;
+
+  alignas(MIGO_CACHE_LINE) std::atomic<uint32_t> m_head{0};
+  alignas(MIGO_CACHE_LINE) std::atomic<uint32_t> m_tail{0};
+  alignas(MIGO_CACHE_LINE) T m_items[Capacity];
+};
+
+class SpscByteRing {
+public:
+  // Allocate at least minBytes (rounded up to a power of two). Only while
+  // neither endpoint is active.
+  bool Init(uint32_t minBytes) {
+    uint32_t bytes = 2;
+    while (bytes < minBytes && bytes < (1u << 31)) bytes <<= 1;
+    if (bytes != m_capacity) {
+      m_data.reset(new (std::nothrow) uint8_t[bytes]);
+      m_capacity = m_data ? bytes : 0;
+    }
+    Reset();
+    return m_data != nullptr;
+  }
+
+  // Producer side: append bytes (src == nullptr appends zeros). All or
+  // nothing; returns false when they don't fit.
+  bool Write(const void *src, uint32_t bytes) {
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    const uint32_t tail = m_tail.load(std::memory_order_acquire);
+    if (bytes > m_capacity - (head - tail)) return false;
+    const uint32_t at = head & (m_capacity - 1);
+    const uint32_t first = bytes < m_capacity - at ? bytes : m_capacity - at;
+    const uint8_t *in = static_cast<const uint8_t *>(src);
+    if (in) {
+      memcpy(m_data.get() + at, in, first);
+      memcpy(m_data.get(), in + first, bytes - first);
+    } else {
+      memset(m_data.get() + at, 0, first);
+      memset(m_data.get(), 0, bytes - first);
+    }
+    m_head.store(head + bytes, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side: the contiguous readable run at the tail, which may be
+  // shorter than Size() where it wraps. Follow with Consume().
+  uint32_t Peek(const uint8_t **data) const {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    const uint32_t head = m_head.load(std::memory_order_acquire);
+    const uint32_t at = tail & (m_capacity - 1);
+    const uint32_t ready = head - tail;
+    *data = m_data.get() + at;
+    return ready < m_capacity - at ? ready : m_capacity - at;
+  }
+
+  void Consume(uint32_t bytes) {
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + bytes,
+                 std::memory_order_release);
+  }
+
+  uint32_t Size() const {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+  }
+  uint32_t Capacity() const { return m_capacity; }
+
+  // Only safe while neither endpoint is active.
+  void Reset() {
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  alignas(MIGO_CACHE_LINE) std::atomic<uint32_t> m_head{0};
+  alignas(MIGO_CACHE_LINE) std::atomic<uint32_t> m_tail{0};
+  alignas(MIGO_CACHE_LINE) std::unique_ptr<uint8_t[]> m_data;
+  uint32_t m_capacity = 0;
+};
@@ -29,7 +29,7 @@ app.whenReady().then(async () => {
   // Try EXCLUDE mode (capture system audio except self)
   console.log("\nStarting capture (EXCLUDE self, PID=" + process.pid + ")...");
   try {
-    addon.startCapture(process.pid, true);
+    await addon.startCapture(process.pid, true);
     console.log("startCapture succeeded, isRunning:", addon.isRunning());
   } catch (err) {
     console.log("startCapture FAILED:", err.message);
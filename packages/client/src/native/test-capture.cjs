@@ -4,8 +4,10 @@
 // Tests each function in isolation, then does an end-to-end capture test.
 // Exits with code 0 if all tests pass, 1 if any fail.
 
+const fs = require("fs");
+const os = require("os");
 const path = require("path");
-const { execSync } = require("child_process");
+const { execSync, spawn } = require("child_process");
 
 const ADDON_PATH = path.join(__dirname, "../../build/Release/audio_capture.node");
 
@@ -71,9 +73,10 @@ test("addon loads via process.dlopen", () => {
 });
 
 test("exports all expected functions", () => {
-  for (const fn of ["startCapture", "stopCapture", "onData", "hwndToPid", "getLastError", "getDataCount", "isRunning"]) {
+  for (const fn of ["startCapture", "stopCapture", "onData", "hwndToPid", "getLastError", "getDataCount", "getDroppedCount", "isZeroCopy", "isRunning", "prepareCapture", "getTimeToFirstPacket", "getStats", "isOpusAvailable", "getLevels", "probeProcesses", "startMixCapture", "onStateChange", "isNoiseSuppressionAvailable", "startRecording", "stopRecording", "saveReplay", "resolveWindows", "retargetCapture"]) {
     assert(typeof addon[fn] === "function", `${fn} is not a function`);
   }
+  assert(typeof addon.CaptureSession === "function", "CaptureSession is not a class");
 });
 
 // ─── hwndToPid tests ───────────────────────────────────────────────────────────
@@ -98,6 +101,28 @@ test("resolves a real window HWND to PID", () => {
   console.log(`    HWND=${hwnd} -> PID=${realPid}`);
 });
 
+test("resolveWindows batches HWND lookups with exe and ancestors", () => {
+  const [real, gone] = addon.resolveWindows([realHwnd, 0]);
+  assert(gone === null, "HWND 0 should resolve to null");
+  assert(real && real.pid === realPid, `Expected PID ${realPid}, got ${real && real.pid}`);
+  assert(/\.exe$/i.test(real.exe), `Expected an executable name, got "${real.exe}"`);
+  assert(Array.isArray(real.ancestors), "ancestors should be an array");
+  console.log(`    ${real.exe} <- ${real.ancestors.map((a) => `${a.exe}(${a.pid})`).join(" <- ")}`);
+  // Cached now: a repeat is the same answer
+  const [again] = addon.resolveWindows([realHwnd]);
+  assert(JSON.stringify(again) === JSON.stringify(real), "Cached lookup differs");
+});
+
+test("resolveWindows rejects a non-array", () => {
+  let threw = false;
+  try {
+    addon.resolveWindows(realHwnd);
+  } catch (e) {
+    threw = e instanceof TypeError;
+  }
+  assert(threw, "Expected a TypeError");
+});
+
 // ─── onData / stopCapture safety ───────────────────────────────────────────────
 
 console.log("\n--- onData / stopCapture safety ---\n");
@@ -131,11 +156,13 @@ async function testExcludeCapture() {
   let nonSilentChunks = 0;
   const callbackTimestamps = [];
   const intervals = [];
+  const timings = [];
 
-  addon.onData((buffer) => {
+  addon.onData((buffer, timing) => {
     const now = performance.now();
     jsCallbackCount++;
     totalSamples += buffer.length;
+    timings.push({ ...timing, frames: buffer.length / 2 });
 
     // Track silence vs non-silence
     let isSilent = true;
@@ -155,7 +182,14 @@ async function testExcludeCapture() {
     callbackTimestamps.push(now);
   });
 
-  addon.startCapture(process.pid, true); // exclude self
+  const info = await addon.startCapture(process.pid, true); // exclude self
+
+  await testAsync("startCapture reports MMCSS registration", async () => {
+    console.log(`    eventDriven=${info.eventDriven}, poll=${JSON.stringify(info.poll)}, mmcss=${JSON.stringify(info.mmcss)}`);
+    assert((info.poll === null) === info.eventDriven, "poll reported for an event-driven stream");
+    assert(info.mmcss.task === "Pro Audio", `Unexpected task ${info.mmcss.task}`);
+    assert(info.mmcss.registered, `MMCSS registration failed: ${addon.getLastError()}`);
+  });
 
   // Give the worker thread time to initialize
   await sleep(500);
@@ -183,11 +217,35 @@ async function testExcludeCapture() {
     assert(cppDataCount > 0, `C++ loop sent 0 packets. Error: ${err || "none"}`);
   });
 
+  await testAsync("packet pool never ran dry (getDroppedCount === 0)", async () => {
+    const dropped = addon.getDroppedCount();
+    console.log(`    droppedCount=${dropped}`);
+    assert(dropped === 0, `${dropped} packets dropped — JS drain fell behind the pool`);
+  });
+
   await testAsync("JS onData callback received Float32Array buffers", async () => {
     console.log(`    jsCallbackCount=${jsCallbackCount}, totalSamples=${totalSamples}`);
     assert(jsCallbackCount > 0, `JS callback received 0 calls`);
   });
 
+  await testAsync("every buffer carries its capture timing", async () => {
+    assert(timings.length > 0, "No buffers delivered");
+    let positionGaps = 0;
+    for (let i = 1; i < timings.length; i++) {
+      const a = timings[i - 1];
+      const b = timings[i];
+      assert(b.captureTime >= a.captureTime, `captureTime went backwards at ${i}`);
+      // Contiguous packets follow on in device position, bar discontinuities
+      if (a.devicePosition !== null && b.devicePosition !== null && b.devicePosition !== a.devicePosition + a.frames)
+        positionGaps++;
+    }
+    const latencies = timings.map((t) => t.latencyMs).sort((x, y) => x - y);
+    const median = latencies[Math.floor(latencies.length / 2)];
+    console.log(`    median capture→JS latency=${median.toFixed(2)} ms, device position gaps=${positionGaps}`);
+    assert(median >= 0 && median < 100, `Implausible latency ${median} ms`);
+    assert(positionGaps <= 2, `${positionGaps} device position gaps`);
+  });
+
   // ─── Jitter analysis ───
   console.log("\n--- Callback jitter analysis (EXCLUDE mode) ---\n");
 
@@ -195,13 +253,14 @@ async function testExcludeCapture() {
 
   await testAsync("callback timing jitter analysis", async () => {
     console.log(`    Callbacks: ${jsCallbackCount}`);
+    console.log(`    Mode: ${info.eventDriven ? "event-driven" : `polling every ${info.poll.periodMs} ms`}`);
     console.log(`    Silent chunks: ${silentChunks}, Non-silent: ${nonSilentChunks}`);
     console.log(`    Inter-callback interval (ms):`);
     console.log(`      min=${stats.min.toFixed(2)}, max=${stats.max.toFixed(2)}`);
     console.log(`      mean=${stats.mean.toFixed(2)}, stddev=${stats.stddev.toFixed(2)}`);
     console.log(`      gaps >15ms: ${stats.gapsOver15ms} / ${intervals.length}`);
-    // This is informational — we log the stats but don't fail on jitter
-    // After implementing event-driven WASAPI, re-run to verify improvement
+    // This is informational — we log the stats but don't fail on jitter.
+    // A polling-mode machine (info.poll set) should come close to event mode.
     assert(true);
   });
 
@@ -226,7 +285,7 @@ async function testIncludeCapture() {
     lastTime = now;
   });
 
-  addon.startCapture(realPid || process.pid, false); // include target
+  await addon.startCapture(realPid || process.pid, false); // include target
 
   await sleep(500);
 
@@ -259,10 +318,1047 @@ async function testIncludeCapture() {
   }
 }
 
+// ─── Zero-copy delivery (external ArrayBuffers) ────────────────────────────────
+
+async function testZeroCopyCapture() {
+  console.log("\n--- Zero-copy delivery ---\n");
+
+  let callbacks = 0;
+  let badLength = 0;
+  addon.onData((buffer) => {
+    callbacks++;
+    // External buffers are sized exactly to the packet
+    if (buffer.buffer.byteLength !== buffer.length * 4) badLength++;
+  });
+
+  await addon.startCapture(process.pid, true, { zeroCopy: true });
+  await sleep(1500);
+  const zeroCopy = addon.isZeroCopy();
+  addon.stopCapture();
+
+  // Give the GC a chance to run finalizers that return lent slots
+  if (global.gc) global.gc();
+
+  await testAsync("zero-copy mode delivers packets", async () => {
+    console.log(`    callbacks=${callbacks}, isZeroCopy=${zeroCopy}, dropped=${addon.getDroppedCount()}`);
+    assert(callbacks > 0, "No callbacks in zero-copy mode");
+    assert(badLength === 0, `${badLength} buffers had a mismatched byteLength`);
+  });
+}
+
+// ─── Coalesced delivery (chunkMs) ─────────────────────────────────────────────
+
+async function testCoalescedCapture() {
+  console.log("\n--- Coalesced delivery (chunkMs: 50) ---\n");
+
+  const intervals = [];
+  let lastTime = null;
+  let maxFrames = 0;
+  addon.onData((buffer) => {
+    const now = performance.now();
+    if (lastTime !== null) intervals.push(now - lastTime);
+    lastTime = now;
+    maxFrames = Math.max(maxFrames, buffer.length / 2);
+  });
+
+  await addon.startCapture(process.pid, true, { chunkMs: 50 });
+  await sleep(2000);
+  const packets = addon.getDataCount();
+  addon.stopCapture();
+
+  await testAsync("chunks are larger than single WASAPI packets", async () => {
+    const callbacks = intervals.length + 1;
+    console.log(`    wasapiPackets=${packets}, callbacks=${callbacks}, maxFrames=${maxFrames}`);
+    assert(callbacks > 0 && lastTime !== null, "No callbacks with chunkMs");
+    assert(callbacks < packets, `Expected fewer callbacks than packets (${callbacks} >= ${packets})`);
+    assert(maxFrames >= 2400, `Largest chunk only ${maxFrames} frames (< 50ms)`);
+  });
+
+  if (intervals.length > 0) {
+    const stats = computeJitterStats(intervals);
+    console.log(`    Inter-callback interval (ms): mean=${stats.mean.toFixed(2)}, max=${stats.max.toFixed(2)}`);
+  }
+}
+
+// ─── MMCSS options ─────────────────────────────────────────────────────────────
+
+async function testMmcssOptions() {
+  console.log("\n--- MMCSS options ---\n");
+
+  addon.onData(() => {});
+
+  await testAsync("mmcssTask \"\" skips registration", async () => {
+    const info = await addon.startCapture(process.pid, true, { mmcssTask: "" });
+    addon.stopCapture();
+    assert(info.mmcss.registered === false, "Registered despite empty task");
+  });
+
+  await testAsync("mmcssPriority is applied and reported", async () => {
+    const info = await addon.startCapture(process.pid, true, { mmcssTask: "Audio", mmcssPriority: "critical" });
+    addon.stopCapture();
+    console.log(`    mmcss=${JSON.stringify(info.mmcss)}`);
+    assert(info.mmcss.task === "Audio" && info.mmcss.priority === "critical", "Options not reflected");
+  });
+
+  test("invalid mmcssPriority throws", () => {
+    let threw = false;
+    try {
+      addon.startCapture(process.pid, true, { mmcssPriority: "realtime" });
+    } catch {
+      threw = true;
+    }
+    assert(threw, "Expected TypeError");
+  });
+}
+
+// ─── Concurrent sessions (CaptureSession) ─────────────────────────────────────
+
+async function testConcurrentSessions() {
+  console.log("\n--- Concurrent CaptureSession instances ---\n");
+
+  const a = new addon.CaptureSession();
+  const b = new addon.CaptureSession();
+  let callbacksA = 0;
+  let callbacksB = 0;
+  a.onData(() => callbacksA++);
+  b.onData(() => callbacksB++);
+
+  const [infoA, infoB] = await Promise.all([
+    a.start(process.pid, true), // system audio minus self
+    b.start(realPid || process.pid, false, { chunkMs: 20 }), // target process
+  ]);
+
+  await testAsync("sessions run independently of the default session", async () => {
+    assert(a.isRunning() && b.isRunning(), "A session failed to start");
+    assert(addon.isRunning() === false, "Default session reports running");
+  });
+
+  await testAsync("sessions of one MMCSS class share a capture thread", async () => {
+    console.log(`    a: thread ${infoA.mmcss.threadId}, b: thread ${infoB.mmcss.threadId}`);
+    assert(infoA.mmcss.threadId === infoB.mmcss.threadId, "Sessions on different threads");
+    const c = new addon.CaptureSession();
+    const infoC = await c.start(process.pid, true, { mmcssTask: "" });
+    c.stop();
+    assert(infoC.mmcss.threadId !== infoA.mmcss.threadId, "Unregistered session on the MMCSS thread");
+  });
+
+  await sleep(1500);
+  const packetsA = a.getDataCount();
+  a.stop();
+
+  await testAsync("stopping one session leaves the other running", async () => {
+    assert(!a.isRunning() && b.isRunning(), `a=${a.isRunning()}, b=${b.isRunning()}`);
+  });
+
+  b.stop();
+
+  await testAsync("both sessions delivered data", async () => {
+    console.log(`    a: packets=${packetsA}, callbacks=${callbacksA}, lastError="${a.getLastError()}"`);
+    console.log(`    b: packets=${b.getDataCount()}, callbacks=${callbacksB}, lastError="${b.getLastError()}"`);
+    assert(packetsA > 0 && callbacksA > 0, "Session A received no data");
+    // The INCLUDE target may be silent, but WASAPI still delivers packets
+    assert(b.getDataCount() > 0, "Session B received no packets");
+  });
+
+  await testAsync("second start on a running session rejects", async () => {
+    const s = new addon.CaptureSession();
+    await s.start(process.pid, true);
+    let rejected = false;
+    try {
+      await s.start(process.pid, true);
+    } catch {
+      rejected = true;
+    }
+    s.stop();
+    assert(rejected, "Expected 'Capture already running'");
+  });
+
+  await testAsync("onData can't replace the callback of a running session", async () => {
+    const s = new addon.CaptureSession();
+    let first = 0;
+    let second = 0;
+    s.onData(() => first++);
+    await s.start(process.pid, true);
+    let threw = false;
+    try {
+      s.onData(() => second++);
+    } catch {
+      threw = true;
+    }
+    const before = first;
+    await sleep(200);
+    s.stop();
+    assert(threw, "onData accepted a new callback while running");
+    assert(first > before && second === 0, `first=${first} (${before} before), second=${second}`);
+    s.onData(() => {}); // fine again once stopped
+  });
+}
+
+// ─── Asynchronous start ────────────────────────────────────────────────────────
+
+async function testAsyncStart() {
+  console.log("\n--- Asynchronous startCapture ---\n");
+
+  addon.onData(() => {});
+
+  await testAsync("startCapture returns a Promise without blocking the event loop", async () => {
+    let ticks = 0;
+    const timer = setInterval(() => ticks++, 1);
+    const t0 = performance.now();
+    const pending = addon.startCapture(process.pid, true);
+    const syncMs = performance.now() - t0;
+    assert(pending instanceof Promise, "startCapture did not return a Promise");
+    await pending;
+    clearInterval(timer);
+    addon.stopCapture();
+    console.log(`    synchronous part=${syncMs.toFixed(2)}ms, event loop ticks during start=${ticks}`);
+    assert(syncMs < 5, `startCapture blocked for ${syncMs.toFixed(2)}ms`);
+  });
+
+  await testAsync("stopCapture during a pending start rejects it", async () => {
+    const pending = addon.startCapture(process.pid, true);
+    addon.stopCapture();
+    let rejected = false;
+    try {
+      await pending;
+    } catch {
+      rejected = true;
+    }
+    assert(rejected, "Pending start resolved after stopCapture");
+    assert(addon.isRunning() === false, "Still running after cancelled start");
+  });
+}
+
+// ─── Prewarm (prepareCapture) ──────────────────────────────────────────────────
+
+async function testPrewarm() {
+  console.log("\n--- Prewarmed start (prepareCapture) ---\n");
+
+  addon.onData(() => {});
+
+  let t0 = performance.now();
+  const cold = await addon.startCapture(process.pid, true);
+  const coldStartMs = performance.now() - t0;
+  await sleep(500);
+  const coldFirstPacket = addon.getTimeToFirstPacket();
+  addon.stopCapture();
+
+  await addon.prepareCapture(process.pid, true);
+  addon.onData(() => {});
+  t0 = performance.now();
+  const warm = await addon.startCapture(process.pid, true);
+  const warmStartMs = performance.now() - t0;
+  await sleep(500);
+  const warmFirstPacket = addon.getTimeToFirstPacket();
+  addon.stopCapture();
+
+  await testAsync("prepared start reuses the warm client", async () => {
+    console.log(`    cold: start=${coldStartMs.toFixed(1)}ms firstPacket=${coldFirstPacket.toFixed(1)}ms prewarmed=${cold.prewarmed}`);
+    console.log(`    warm: start=${warmStartMs.toFixed(1)}ms firstPacket=${warmFirstPacket.toFixed(1)}ms prewarmed=${warm.prewarmed}`);
+    assert(cold.prewarmed === false, "Cold start reported prewarmed");
+    assert(warm.prewarmed === true, "Prepared start was not prewarmed");
+  });
+
+  await testAsync("time to first packet is measured", async () => {
+    assert(coldFirstPacket >= 0 && warmFirstPacket >= 0, "No first packet recorded");
+  });
+
+  await testAsync("prepare for another target is replaced by start", async () => {
+    await addon.prepareCapture(realPid || process.pid, false);
+    addon.onData(() => {});
+    const info = await addon.startCapture(process.pid, true);
+    addon.stopCapture();
+    assert(info.prewarmed === false, "Started from a client prepared for another target");
+  });
+
+  await testAsync("stopCapture during a pending prepare returns at once", async () => {
+    const pending = addon.prepareCapture(process.pid, true);
+    const t = performance.now();
+    addon.stopCapture();
+    const stopMs = performance.now() - t;
+    let rejected = false;
+    try {
+      await pending;
+    } catch {
+      rejected = true;
+    }
+    assert(stopMs < 5, `stopCapture blocked for ${stopMs.toFixed(2)}ms`);
+    assert(rejected, "Pending prepare resolved after stopCapture");
+  });
+}
+
+// ─── Telemetry (getStats) ──────────────────────────────────────────────────────
+
+async function testStats() {
+  console.log("\n--- Capture telemetry (getStats) ---\n");
+
+  addon.onData(() => {});
+  await addon.startCapture(process.pid, true);
+  await sleep(1500);
+  const live = addon.getStats();
+  addon.stopCapture();
+
+  await testAsync("getStats reports packets, positions and flags", async () => {
+    console.log(`    packets=${live.packets}, frames=${live.frames}, devicePosition=${live.devicePosition}`);
+    console.log(`    discontinuities=${live.discontinuities}, timestampErrors=${live.timestampErrors}, gaps=${live.positionGaps} (${live.gapFrames} frames)`);
+    console.log(`    tsfnCalls=${live.tsfnCalls}, failures=${live.tsfnCallFailures}, maxReadyDepth=${live.maxReadyDepth}`);
+    assert(live.packets === addon.getDataCount(), `packets ${live.packets} != getDataCount ${addon.getDataCount()}`);
+    assert(live.packets > 0 && live.frames > 0, "No packets counted");
+    assert(live.qpcPosition > 0, "QPC position not captured");
+    assert(live.tsfnCalls > 0, "No TSFN wakeups counted");
+  });
+
+  await testAsync("histograms cover every packet interval and drain", async () => {
+    const sum = (h) => h.counts.reduce((a, b) => a + b, 0);
+    assert(live.packetInterval.counts.length === live.packetInterval.edgesUs.length + 1, "Bucket/edge mismatch");
+    console.log(`    packetInterval=${JSON.stringify(live.packetInterval.counts)}`);
+    console.log(`    drainDuration=${JSON.stringify(live.drainDuration.counts)}`);
+    assert(sum(live.packetInterval) <= live.packets - 1, "More intervals than packets");
+    assert(sum(live.drainDuration) === live.drains, "Drain histogram doesn't match drain count");
+  });
+}
+
+// ─── Output format (sampleRate / channels / sampleFormat) ──────────────────────
+
+async function testOutputFormat() {
+  console.log("\n--- Output format conversion ---\n");
+
+  for (const format of [
+    { sampleRate: 16000, channels: 1, sampleFormat: "int16" },
+    { sampleRate: 44100, channels: 2, sampleFormat: "float32" },
+  ]) {
+    let samples = 0;
+    let wrongType = 0;
+    const Expected = format.sampleFormat === "int16" ? Int16Array : Float32Array;
+    addon.onData((buffer) => {
+      if (!(buffer instanceof Expected)) wrongType++;
+      samples += buffer.length;
+    });
+
+    const info = await addon.startCapture(process.pid, true, format);
+    const t0 = performance.now();
+    await sleep(2000);
+    const elapsed = (performance.now() - t0) / 1000;
+    const stats = addon.getStats();
+    addon.stopCapture();
+
+    const label = `${format.sampleRate} Hz / ${format.channels}ch / ${format.sampleFormat}`;
+    await testAsync(`${label}: buffers arrive in the requested format`, async () => {
+      assert(info.format.sampleRate === format.sampleRate, `info.format=${JSON.stringify(info.format)}`);
+      assert(info.format.channels === format.channels && info.format.sampleFormat === format.sampleFormat, `info.format=${JSON.stringify(info.format)}`);
+      assert(samples > 0, "No samples delivered");
+      assert(wrongType === 0, `${wrongType} buffers were not ${Expected.name}`);
+    });
+
+    await testAsync(`${label}: output rate matches the WASAPI frame count`, async () => {
+      const outFrames = samples / format.channels;
+      const expected = (stats.frames * format.sampleRate) / 48000;
+      console.log(`    outFrames=${outFrames}, expected≈${expected.toFixed(0)}, ~${(outFrames / elapsed).toFixed(0)} frames/s`);
+      // Allow for resampler history and the final partial block
+      assert(Math.abs(outFrames - expected) < format.sampleRate * 0.05, "Output frame count off by >50ms");
+    });
+  }
+
+  test("invalid sampleRate throws", () => {
+    let threw = false;
+    try {
+      addon.startCapture(process.pid, true, { sampleRate: 1000 });
+    } catch {
+      threw = true;
+    }
+    assert(threw, "Expected TypeError");
+  });
+}
+
+async function testNativeLayout() {
+  console.log("\n--- Native capture layout ---\n");
+
+  for (const options of [{ captureLayout: "native" }, { captureLayout: "native", downmix: "passthrough" }]) {
+    let samples = 0;
+    addon.onData((buffer) => {
+      if (typeof buffer !== "number") samples += buffer.length;
+    });
+    const info = await addon.startCapture(process.pid, true, options);
+    await sleep(1000);
+    const stats = addon.getStats();
+    addon.stopCapture();
+
+    const label = options.downmix ?? "downmix";
+    await testAsync(`${label}: the capture format is reported`, async () => {
+      const cf = info.captureFormat;
+      console.log(`    captureFormat=${JSON.stringify(cf)}, lastError=${addon.getLastError()}`);
+      assert(cf.sampleRate === 48000 && cf.speakers.length === cf.channels, `captureFormat=${JSON.stringify(cf)}`);
+      assert(JSON.stringify(stats.captureFormat) === JSON.stringify(cf), `stats.captureFormat=${JSON.stringify(stats.captureFormat)}`);
+      // Stereo devices (and streams that won't take the device layout) stay stereo
+      const expected = cf.channels <= 2 ? "stereo" : options.downmix ?? "downmix";
+      assert(cf.mode === expected, `mode=${cf.mode}, expected ${expected}`);
+    });
+
+    await testAsync(`${label}: delivered channels follow the mode`, async () => {
+      const channels = info.captureFormat.mode === "passthrough" ? info.captureFormat.channels : 2;
+      assert(info.format.channels === channels, `format.channels=${info.format.channels}, expected ${channels}`);
+      assert(samples > 0 && samples % channels === 0, `samples=${samples}`);
+    });
+  }
+
+  test("invalid layout options throw", () => {
+    const cases = [
+      { downmix: "passthrough" },
+      { captureLayout: "surround" },
+      { captureLayout: "native", downmix: { XX: [1, 0] } },
+      { captureLayout: "native", downmix: { FC: [1] } },
+      { captureLayout: "native", downmix: "passthrough", sampleRate: 24000 },
+      { captureLayout: "native", downmix: "passthrough", noiseSuppression: true },
+    ];
+    for (const options of cases) {
+      let threw = false;
+      try {
+        addon.startCapture(process.pid, true, options);
+      } catch (e) {
+        threw = e instanceof TypeError;
+      }
+      assert(threw, `Expected TypeError for ${JSON.stringify(options)}`);
+    }
+  });
+}
+
+async function testSilenceSuppression() {
+  console.log("\n--- Silence suppression ---\n");
+
+  let audioFrames = 0;
+  let silentFrames = 0;
+  let markers = 0;
+  let badMarkers = 0;
+  addon.onData((data) => {
+    if (typeof data === "number") {
+      markers++;
+      if (!(data > 0)) badMarkers++;
+      silentFrames += data;
+    } else {
+      audioFrames += data.length / 2;
+    }
+  });
+
+  const info = await addon.startCapture(process.pid, true, { suppressSilence: true, chunkMs: 20 });
+  await sleep(2000);
+  const stats = addon.getStats();
+  addon.stopCapture();
+
+  await testAsync("silent runs arrive as frame-count markers", async () => {
+    assert(info.suppressSilence === true, `info.suppressSilence=${info.suppressSilence}`);
+    console.log(`    audio=${audioFrames} silent=${silentFrames} markers=${markers} suppressedPackets=${stats.suppressedPackets}`);
+    assert(badMarkers === 0, `${badMarkers} markers were not a positive frame count`);
+    // Markers published after the stats snapshot may still be in flight
+    assert(markers <= stats.silenceMarkers, `markers=${markers}, stats.silenceMarkers=${stats.silenceMarkers}`);
+    assert(silentFrames <= stats.suppressedFrames, `silentFrames=${silentFrames}, suppressedFrames=${stats.suppressedFrames}`);
+  });
+
+  await testAsync("audio plus silence covers every captured frame", async () => {
+    // Only the unflushed tail at stop may be missing
+    const delivered = audioFrames + silentFrames;
+    assert(delivered <= stats.frames, `delivered=${delivered} > frames=${stats.frames}`);
+    assert(stats.frames - delivered < 48000 * 0.2, `delivered=${delivered}, frames=${stats.frames}`);
+  });
+
+  test("invalid silenceThreshold throws", () => {
+    let threw = false;
+    try {
+      addon.startCapture(process.pid, true, { suppressSilence: true, silenceThreshold: 2 });
+    } catch {
+      threw = true;
+    }
+    assert(threw, "Expected TypeError");
+  });
+}
+
+async function testOpus() {
+  console.log("\n--- Opus encoding ---\n");
+
+  if (!addon.isOpusAvailable()) {
+    test("codec \"opus\" throws without a with_opus build", () => {
+      let threw = false;
+      try {
+        addon.startCapture(process.pid, true, { codec: "opus" });
+      } catch {
+        threw = true;
+      }
+      assert(threw, "Expected TypeError");
+    });
+    return;
+  }
+
+  let packets = 0;
+  let bytes = 0;
+  let wrongType = 0;
+  addon.onData((data) => {
+    if (!(data instanceof Uint8Array)) wrongType++;
+    packets++;
+    bytes += data.length;
+  });
+
+  const info = await addon.startCapture(process.pid, true, { codec: "opus", opusBitrate: 64000, opusFrameMs: 20 });
+  await sleep(2000);
+  const stats = addon.getStats();
+  addon.stopCapture();
+
+  await testAsync("delivers one Uint8Array per Opus packet", async () => {
+    assert(info.codec === "opus" && info.opus.frameMs === 20, `info=${JSON.stringify(info)}`);
+    assert(packets > 0, "No packets delivered");
+    assert(wrongType === 0, `${wrongType} deliveries were not Uint8Array`);
+    assert(stats.encodeErrors === 0, `encodeErrors=${stats.encodeErrors}`);
+  });
+
+  await testAsync("packet count and bitrate match the frame size", async () => {
+    const expected = stats.frames / 960; // 20 ms at 48 kHz
+    console.log(`    packets=${packets}, expected≈${expected.toFixed(0)}, ~${((bytes * 8) / 2000).toFixed(1)} kbit/s`);
+    assert(Math.abs(stats.encodedPackets - expected) <= 1, `encodedPackets=${stats.encodedPackets}`);
+    assert(packets <= stats.encodedPackets, `packets=${packets} > encodedPackets=${stats.encodedPackets}`);
+  });
+
+  test("invalid opusFrameMs throws", () => {
+    let threw = false;
+    try {
+      addon.startCapture(process.pid, true, { codec: "opus", opusFrameMs: 15 });
+    } catch {
+      threw = true;
+    }
+    assert(threw, "Expected TypeError");
+  });
+}
+
+// ─── Noise suppression (RNNoise) ───────────────────────────────────────────────
+
+async function testNoiseSuppression() {
+  console.log("\n--- Noise suppression ---\n");
+
+  if (!addon.isNoiseSuppressionAvailable()) {
+    test("noiseSuppression throws without a with_rnnoise build", () => {
+      let threw = false;
+      try {
+        addon.startCapture(process.pid, true, { noiseSuppression: true });
+      } catch {
+        threw = true;
+      }
+      assert(threw, "Expected TypeError");
+    });
+    return;
+  }
+
+  let samples = 0;
+  let maxLength = 0;
+  addon.onData((data) => {
+    if (typeof data === "number") return;
+    samples += data.length;
+    maxLength = Math.max(maxLength, data.length);
+  });
+  const info = await addon.startCapture(process.pid, true, { noiseSuppression: true });
+  await sleep(2000);
+  const stats = addon.getStats();
+  addon.stopCapture();
+
+  await testAsync("audio passes through whole RNNoise frames", async () => {
+    console.log(`    frames=${stats.frames} denoised=${stats.denoisedFrames} voice=${stats.voiceProbability.toFixed(3)} delivered=${samples / 2}`);
+    assert(info.noiseSuppression === true, `info=${JSON.stringify(info)}`);
+    assert(stats.denoisedFrames > 0 && stats.denoisedFrames % 480 === 0, `denoisedFrames=${stats.denoisedFrames}`);
+    // At most one partial frame is still held back
+    assert(stats.frames - stats.denoisedFrames < 480, `${stats.frames - stats.denoisedFrames} frames held back`);
+    assert(samples / 2 <= stats.denoisedFrames, "Delivered more than was denoised");
+    assert(stats.voiceProbability >= 0 && stats.voiceProbability <= 1, `voiceProbability=${stats.voiceProbability}`);
+  });
+}
+
+async function testMetering() {
+  console.log("\n--- Native metering ---\n");
+
+  await addon.startCapture(process.pid, true, {});
+  await sleep(300);
+  const unmetered = addon.getLevels();
+  addon.stopCapture();
+  test("getLevels is null without meter", () => {
+    assert(unmetered === null, `getLevels()=${JSON.stringify(unmetered)}`);
+  });
+
+  const session = new addon.CaptureSession();
+  let deliveries = 0;
+  session.onData(() => deliveries++);
+  const info = await session.start(process.pid, true, { meterOnly: true });
+  await sleep(1000);
+  const levels = session.getLevels();
+  const stats = session.getStats();
+  session.stop();
+
+  await testAsync("meter-only session reports levels without delivering data", async () => {
+    assert(info.meter === true && info.meterOnly === true, `info=${JSON.stringify(info)}`);
+    assert(deliveries === 0, `${deliveries} deliveries from a meter-only session`);
+    assert(stats.packets > 0, "No packets captured");
+    console.log(`    blocks=${levels.blocks} peak=${levels.peak.map((p) => p.toFixed(4))} M=${levels.momentaryLufs.toFixed(1)} LUFS active=${levels.active}`);
+    // 100 ms blocks, allowing for the activation delay
+    assert(levels.blocks >= 5, `Only ${levels.blocks} blocks metered`);
+  });
+
+  test("levels are in range", () => {
+    for (let c = 0; c < 2; c++) {
+      assert(levels.peak[c] >= 0 && levels.rms[c] >= 0 && levels.rms[c] <= levels.peak[c] + 1e-6, `channel ${c}: peak=${levels.peak[c]} rms=${levels.rms[c]}`);
+    }
+    assert(levels.momentaryLufs >= -120 && levels.shortTermLufs >= -120, "LUFS below floor");
+    assert(levels.active === levels.momentaryLufs > -70, "active disagrees with the -70 LUFS gate");
+  });
+}
+
+async function testProbe() {
+  console.log("\n--- Parallel activity probe ---\n");
+
+  // Our own PID plus a batch of bogus ones: all activations overlap, so the
+  // whole probe costs about one activation plus the sampling window.
+  const pids = [process.pid, ...Array.from({ length: 16 }, (_, i) => 0x7ffff000 + i * 4)];
+  const t0 = performance.now();
+  const results = await addon.probeProcesses(pids, 300);
+  const elapsed = performance.now() - t0;
+
+  await testAsync("returns one result per PID, in order", async () => {
+    assert(Array.isArray(results) && results.length === pids.length, `results.length=${results?.length}`);
+    results.forEach((r, i) => assert(r.pid === pids[i], `results[${i}].pid=${r.pid}`));
+    for (const r of results) {
+      assert(typeof r.active === "boolean" && r.peak >= 0, `bad result ${JSON.stringify(r)}`);
+    }
+  });
+
+  await testAsync("own process probe activates", async () => {
+    const own = results[0];
+    console.log(`    own: packets=${own.packets} peak=${own.peak.toFixed(4)} error=${own.error ?? "-"}`);
+    assert(!own.error, own.error);
+  });
+
+  await testAsync("activations overlap instead of running serially", async () => {
+    console.log(`    ${pids.length} PIDs probed in ${elapsed.toFixed(0)}ms`);
+    assert(elapsed < 300 + 5000, `Probe took ${elapsed.toFixed(0)}ms`);
+  });
+
+  test("non-array argument throws", () => {
+    let threw = false;
+    try {
+      addon.probeProcesses(1234);
+    } catch {
+      threw = true;
+    }
+    assert(threw, "Expected TypeError");
+  });
+}
+
+async function testMix() {
+  console.log("\n--- Mixed capture ---\n");
+
+  // Two sources every test machine has: system audio minus us, and the
+  // default output endpoint. A microphone may not exist, so it isn't used.
+  const session = new addon.CaptureSession();
+  let samples = 0;
+  session.onData((data) => {
+    samples += typeof data === "number" ? data * 2 : data.length;
+  });
+  let info;
+  await testAsync("startMix brings up every source", async () => {
+    info = await session.startMix([
+      { type: "process", pid: process.pid, excludeMode: true },
+      { type: "output", gain: 0.5 },
+    ]);
+    assert(info.eventDriven === true, "mixing is always event-driven");
+    assert(Array.isArray(info.mix) && info.mix.length === 2, `info.mix=${JSON.stringify(info.mix)}`);
+    assert(info.mix[0].type === "process" && info.mix[1].type === "output", "source types");
+    assert(info.mix[1].gain === 0.5, `gain=${info.mix[1].gain}`);
+  });
+  if (!info) return;
+
+  await sleep(1000);
+  const stats = session.getStats();
+  session.stop();
+
+  await testAsync("mixed stream is delivered at the capture rate", async () => {
+    console.log(`    ${samples} samples, ${stats.packets} blocks`);
+    for (const [i, s] of stats.mix.entries()) {
+      console.log(`    source ${i}: packets=${s.packets} frames=${s.frames} late=${s.lateFrames} gap=${s.gapFrames} resyncs=${s.resyncs} error=${s.error ?? "-"}`);
+      assert(!s.error, `source ${i}: ${s.error}`);
+    }
+    assert(stats.packets > 0, "No mixed blocks");
+    // A source that idles holds the mix back by at most 40 ms
+    assert(stats.frames <= 48000 * 1.2, `frames=${stats.frames} for ~1 s`);
+  });
+
+  test("invalid sources throw", () => {
+    for (const bad of [[], [{ type: "speaker" }], [{ type: "process" }], [{ type: "output", gain: -1 }], new Array(9).fill({ type: "output" })]) {
+      let threw = false;
+      try {
+        session.startMix(bad);
+      } catch {
+        threw = true;
+      }
+      assert(threw, `Expected TypeError for ${JSON.stringify(bad)}`);
+    }
+  });
+}
+
+// ─── Low latency (IAudioClient3 minimum period) ────────────────────────────────
+
+async function testLowLatency() {
+  console.log("\n--- Low-latency mode ---\n");
+
+  addon.onData(() => {});
+  const regular = await addon.startCapture(process.pid, true);
+  addon.stopCapture();
+
+  addon.onData(() => {});
+  let info;
+  await testAsync("lowLatency starts, falling back if unsupported", async () => {
+    info = await addon.startCapture(process.pid, true, { lowLatency: true });
+    const p = info.period;
+    console.log(`    lowLatency=${p.lowLatency} period=${p.periodFrames} (default ${p.defaultPeriodFrames}, min ${p.minPeriodFrames}) buffer=${p.bufferFrames}`);
+    console.log(`    regular: period=${regular.period.periodFrames} buffer=${regular.period.bufferFrames}`);
+    assert(info.lowLatency === true, "Requested lowLatency not reported");
+    assert(regular.period.lowLatency === false, "Regular start reported low latency");
+    assert(p.bufferFrames > 0, "No buffer size reported");
+    if (p.lowLatency) {
+      assert(p.periodFrames >= p.minPeriodFrames && p.periodFrames <= p.defaultPeriodFrames, "Period outside the engine's range");
+      assert(p.bufferFrames <= regular.period.bufferFrames, "Low-latency buffer larger than the regular one");
+    }
+  });
+  if (!info) return;
+
+  await sleep(500);
+  const stats = addon.getStats();
+  addon.stopCapture();
+
+  await testAsync("stats report the period while capturing", async () => {
+    assert(stats.packets > 0, "No packets in low-latency mode");
+    assert(stats.period && stats.period.bufferFrames === info.period.bufferFrames, `stats.period=${JSON.stringify(stats.period)}`);
+    assert(addon.getStats().period === undefined, "Period reported after stop");
+  });
+
+  await testAsync("a prewarm only serves starts with the same lowLatency", async () => {
+    await addon.prepareCapture(process.pid, true);
+    addon.onData(() => {});
+    const other = await addon.startCapture(process.pid, true, { lowLatency: true });
+    addon.stopCapture();
+    await addon.prepareCapture(process.pid, true, { lowLatency: true });
+    addon.onData(() => {});
+    const same = await addon.startCapture(process.pid, true, { lowLatency: true });
+    addon.stopCapture();
+    assert(other.prewarmed === false, "Regular prewarm used for a low-latency start");
+    assert(same.prewarmed === true, "Low-latency prewarm not used");
+  });
+}
+
+// ─── Recovery (target restart) ─────────────────────────────────────────────────
+
+async function testRecovery() {
+  console.log("\n--- Stream recovery ---\n");
+
+  // ping.exe stands in for an app: capture its tree, kill it, relaunch it
+  const launch = () => spawn("ping", ["-n", "60", "127.0.0.1"], { stdio: "ignore" });
+  const waitFor = async (events, pred, ms) => {
+    for (let t = 0; t < ms && !events.some(pred); t += 50) await sleep(50);
+    return events.find(pred);
+  };
+
+  const session = new addon.CaptureSession();
+  const events = [];
+  session.onStateChange((ev) => events.push(ev));
+  session.onData(() => {});
+
+  let target = launch();
+  await sleep(300);
+  await session.start(target.pid, false);
+  target.kill();
+
+  await testAsync("a target exit is reported as recovering", async () => {
+    const ev = await waitFor(events, (e) => e.state === "recovering", 3000);
+    assert(ev, `No recovering event: ${JSON.stringify(events)}`);
+    assert(ev.reason === "process-exited", `reason=${ev.reason}`);
+    assert(ev.attempt === 1 && ev.retryInMs > 0, JSON.stringify(ev));
+    assert(session.isRunning(), "Session stopped while recovering");
+  });
+
+  target = launch();
+  await testAsync("the restarted target is followed", async () => {
+    const ev = await waitFor(events, (e) => e.state === "running", 5000);
+    assert(ev, `No running event: ${JSON.stringify(events)}`);
+    assert(ev.pid === target.pid, `Followed pid ${ev.pid}, restarted ${target.pid}`);
+    const stats = session.getStats();
+    console.log(`    ${events.length} events, recoveries=${stats.recoveries}/${stats.recoveryAttempts}`);
+    assert(stats.state === "running" && stats.recoveries === 1, JSON.stringify(stats.state));
+  });
+  session.stop();
+  target.kill();
+
+  await testAsync("recover: false fails the session instead", async () => {
+    events.length = 0;
+    target = launch();
+    await sleep(300);
+    session.onData(() => {});
+    await session.start(target.pid, false, { recover: false });
+    target.kill();
+    const ev = await waitFor(events, (e) => e.state === "failed", 3000);
+    assert(ev && ev.reason === "process-exited", `events=${JSON.stringify(events)}`);
+    assert(!session.isRunning(), "Failed session still running");
+    assert(session.getLastError().includes("process-exited"), session.getLastError());
+    // A failed session can be started again without an explicit stop
+    session.onData(() => {});
+    await session.start(process.pid, true);
+    session.stop();
+  });
+}
+
+// ─── Hot-swapping the target ───────────────────────────────────────────────────
+
+async function testRetarget() {
+  console.log("\n--- Retarget ---\n");
+
+  const launch = () => spawn("ping", ["-n", "60", "127.0.0.1"], { stdio: "ignore" });
+  const session = new addon.CaptureSession();
+  const events = [];
+  session.onStateChange((ev) => events.push(ev));
+  let packets = 0;
+  session.onData(() => packets++);
+
+  const first = launch();
+  const second = launch();
+  await sleep(300);
+  await session.start(first.pid, false);
+
+  await testAsync("retarget switches the stream without restarting it", async () => {
+    await sleep(200);
+    const before = packets;
+    await session.retarget(second.pid, false);
+    assert(session.isRunning(), "Session stopped by retarget");
+    await sleep(300);
+    assert(packets > before, `No packets after retarget (${before} → ${packets})`);
+    const stats = session.getStats();
+    console.log(`    retargets=${stats.retargets} failures=${stats.retargetFailures}`);
+    assert(stats.retargets === 1 && stats.retargetFailures === 0, JSON.stringify(stats));
+    assert(!events.some((e) => e.state !== "running"), `events=${JSON.stringify(events)}`);
+  });
+
+  await testAsync("the old target exiting no longer affects the share", async () => {
+    first.kill();
+    await sleep(500);
+    assert(!events.some((e) => e.state === "recovering"), `events=${JSON.stringify(events)}`);
+    assert(session.isRunning(), "Session stopped after the old target exited");
+  });
+
+  await testAsync("retarget back to an exclude-mode target", async () => {
+    await session.retarget(process.pid, true);
+    assert(session.getStats().retargets === 2, "Second retarget not counted");
+  });
+
+  test("retarget rejects bad arguments", () => {
+    let threw = false;
+    try {
+      session.retarget("1234", false);
+    } catch (e) {
+      threw = e instanceof TypeError;
+    }
+    assert(threw, "Expected a TypeError");
+  });
+
+  await testAsync("stop during a pending retarget returns at once", async () => {
+    const pending = session.retarget(second.pid, false);
+    const t = performance.now();
+    session.stop();
+    const stopMs = performance.now() - t;
+    let rejected = false;
+    await pending.catch(() => (rejected = true));
+    assert(stopMs < 5, `stop blocked for ${stopMs.toFixed(2)}ms`);
+    assert(rejected, "Pending retarget resolved after stop");
+    assert(!session.isRunning(), "Still running after the deferred stop");
+  });
+
+  session.stop();
+  second.kill();
+
+  await testAsync("retarget on a stopped session rejects", async () => {
+    let rejected = false;
+    await session.retarget(process.pid, true).catch(() => (rejected = true));
+    assert(rejected, "retarget of a stopped session resolved");
+  });
+}
+
+// ─── Queue policy (stalled event loop) ─────────────────────────────────────────
+
+async function testQueuePolicy() {
+  console.log("\n--- Queue policy ---\n");
+
+  const stall = (ms) => {
+    const end = Date.now() + ms;
+    while (Date.now() < end) {}
+  };
+  const run = async (options) => {
+    const session = new addon.CaptureSession();
+    const sizes = [];
+    session.onData((data) => sizes.push(typeof data === "number" ? 0 : data.length));
+    const info = await session.start(process.pid, true, options);
+    await sleep(300);
+    stall(1000);
+    await sleep(300);
+    const stats = session.getStats();
+    session.stop();
+    return { info, stats, sizes };
+  };
+
+  await testAsync("drop-oldest discards the stalled backlog", async () => {
+    const { info, stats } = await run({ maxQueueMs: 100 });
+    console.log(`    policy=${info.queue.policy} dropped=${stats.queueDroppedPackets} (${stats.queueDroppedFrames} frames) maxLatency=${stats.maxDeliveryLatencyUs}µs`);
+    assert(info.queue.policy === "drop-oldest" && info.queue.maxQueueMs === 100, JSON.stringify(info.queue));
+    assert(stats.queueDroppedPackets > 0, "Nothing dropped after a 1 s stall");
+    // The 64-slot pool holds ~640 ms of 10 ms packets; the rest never queued
+    assert(stats.queueDroppedFrames >= 48000 * 0.4, `Only ${stats.queueDroppedFrames} frames dropped`);
+  });
+
+  await testAsync("drop-newest keeps the head of the backlog", async () => {
+    const { stats } = await run({ queuePolicy: "drop-newest", maxQueueMs: 100 });
+    console.log(`    dropped=${stats.queueDroppedPackets} maxLatency=${stats.maxDeliveryLatencyUs}µs`);
+    assert(stats.queueDroppedPackets > 0, "Nothing dropped after a 1 s stall");
+    // The oldest packets went out, about a stall late
+    assert(stats.maxDeliveryLatencyUs >= 800000, `maxDeliveryLatencyUs=${stats.maxDeliveryLatencyUs}`);
+  });
+
+  await testAsync("merge delivers the backlog in one callback", async () => {
+    const { stats, sizes } = await run({ queuePolicy: "merge", maxQueueMs: 100 });
+    const largest = Math.max(...sizes);
+    console.log(`    merges=${stats.queueMerges} (${stats.queueMergedPackets} packets) largest=${largest} samples`);
+    assert(stats.queueMerges >= 1 && stats.queueMergedPackets > 1, JSON.stringify(stats.queueMerges));
+    assert(stats.queueDroppedPackets === 0, `${stats.queueDroppedPackets} dropped`);
+    assert(largest >= 48000 * 2 * 0.4, `Largest callback only ${largest} samples`);
+  });
+
+  await testAsync("maxQueueMs: 0 only bounds by the pool", async () => {
+    const { stats } = await run({ maxQueueMs: 0 });
+    assert(stats.queueDroppedPackets === 0 && stats.queueMerges === 0, "Queue policy ran while disabled");
+  });
+
+  test("invalid queue options are rejected", () => {
+    let threw = 0;
+    for (const options of [{ queuePolicy: "drop-random" }, { maxQueueMs: -1 }, { maxQueueMs: 60000 }]) {
+      try {
+        addon.startCapture(process.pid, true, options);
+      } catch (e) {
+        if (e instanceof TypeError) threw++;
+      }
+    }
+    assert(threw === 3, `Only ${threw} of 3 rejected`);
+  });
+}
+
+// ─── Recording and replay ──────────────────────────────────────────────────────
+
+async function testRecording() {
+  console.log("\n--- Recording and replay ---\n");
+
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), "migo-capture-"));
+  const wavPath = path.join(dir, "recording.wav");
+  const replayPath = path.join(dir, "replay.wav");
+  // RIFF/data sizes and the fmt chunk of a 44-byte canonical header
+  const readWav = (file) => {
+    const b = fs.readFileSync(file);
+    return {
+      size: b.length,
+      riff: b.toString("ascii", 0, 4) + b.toString("ascii", 8, 12),
+      riffSize: b.readUInt32LE(4),
+      tag: b.readUInt16LE(20),
+      channels: b.readUInt16LE(22),
+      rate: b.readUInt32LE(24),
+      bits: b.readUInt16LE(34),
+      dataSize: b.readUInt32LE(40),
+    };
+  };
+
+  const session = new addon.CaptureSession();
+  session.onData(() => {});
+  const info = await session.start(process.pid, true, { sampleRate: 24000, sampleFormat: "int16", replaySeconds: 2 });
+  await session.startRecording(wavPath);
+  await sleep(1000);
+  const during = session.getStats();
+  const recorded = await session.stopRecording();
+  await sleep(1500);
+  const replay = await session.saveReplay(replayPath, { seconds: 1 });
+  const stats = session.getStats();
+  session.stop();
+
+  await testAsync("recording writes a WAV of the delivered format", async () => {
+    const wav = readWav(wavPath);
+    console.log(`    recorded ${recorded.frames} frames (${recorded.seconds.toFixed(2)} s, ${recorded.bytes} bytes) dropped=${stats.recordDroppedFrames}`);
+    assert(during.recording === true && stats.recording === false, `recording=${during.recording}/${stats.recording}`);
+    assert(wav.riff === "RIFFWAVE" && wav.tag === 1 && wav.bits === 16, JSON.stringify(wav));
+    assert(wav.channels === 2 && wav.rate === 24000, JSON.stringify(wav));
+    assert(wav.size === recorded.bytes && wav.dataSize === recorded.frames * 4, `size=${wav.size} data=${wav.dataSize}`);
+    assert(wav.riffSize === wav.size - 8, `riffSize=${wav.riffSize}`);
+    assert(recorded.seconds > 0.8 && recorded.seconds < 1.5, `seconds=${recorded.seconds}`);
+    assert(stats.recordDroppedFrames === 0, `${stats.recordDroppedFrames} frames dropped`);
+  });
+
+  await testAsync("saveReplay writes the last seconds held", async () => {
+    const wav = readWav(replayPath);
+    console.log(`    replay ${replay.frames} frames of ${stats.replayFrames} held`);
+    assert(info.replaySeconds === 2, `replaySeconds=${info.replaySeconds}`);
+    assert(replay.frames === 24000, `replay.frames=${replay.frames}`);
+    assert(wav.dataSize === replay.frames * 4 && wav.size === replay.bytes, JSON.stringify(wav));
+    assert(stats.replayFrames <= 48000, `replayFrames=${stats.replayFrames}`);
+  });
+
+  await testAsync("recording calls reject out of order", async () => {
+    let rejected = 0;
+    try {
+      await session.stopRecording();
+    } catch {
+      rejected++;
+    }
+    try {
+      await session.startRecording(wavPath);
+    } catch {
+      rejected++;
+    }
+    assert(rejected === 2, `Only ${rejected} of 2 rejected`);
+  });
+
+  test("invalid recording options throw", () => {
+    let threw = 0;
+    const cases = [() => session.startRecording(), () => session.saveReplay(replayPath, { format: "mp3" }), () => addon.startCapture(process.pid, true, { replaySeconds: 3600 })];
+    // Opus in Ogg needs a with_opus build
+    if (!addon.isOpusAvailable()) cases.push(() => session.startRecording(wavPath, { format: "ogg" }));
+    for (const fn of cases) {
+      try {
+        fn();
+      } catch (e) {
+        if (e instanceof TypeError) threw++;
+      }
+    }
+    assert(threw === cases.length, `Only ${threw} of ${cases.length} threw`);
+  });
+
+  fs.rmSync(dir, { recursive: true, force: true });
+}
+
 // ─── Run all async tests ───────────────────────────────────────────────────────
 
 testExcludeCapture()
   .then(() => testIncludeCapture())
+  .then(() => testZeroCopyCapture())
+  .then(() => testCoalescedCapture())
+  .then(() => testMmcssOptions())
+  .then(() => testConcurrentSessions())
+  .then(() => testAsyncStart())
+  .then(() => testPrewarm())
+  .then(() => testStats())
+  .then(() => testOutputFormat())
+  .then(() => testNativeLayout())
+  .then(() => testSilenceSuppression())
+  .then(() => testOpus())
+  .then(() => testNoiseSuppression())
+  .then(() => testMetering())
+  .then(() => testProbe())
+  .then(() => testMix())
+  .then(() => testLowLatency())
+  .then(() => testRecovery())
+  .then(() => testRetarget())
+  .then(() => testQueuePolicy())
+  .then(() => testRecording())
   .then(() => {
     console.log(`\n--- Results: ${passed} passed, ${failed} failed ---\n`);
     process.exit(failed > 0 ? 1 : 0);
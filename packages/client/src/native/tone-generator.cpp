@@ -0,0 +1,124 @@
+// Known source for bench-capture.cjs: renders a continuous sine to the
+// default output endpoint, so an include-mode capture of this process
+// delivers a signal whose every sample is predictable and any glitch
+// (a dropped, duplicated or zeroed run) shows up as a phase jump.
+//
+//   tone_generator.exe [frequencyHz=1000] [amplitude=0.25] [seconds=0]
+//
+// seconds == 0 runs until killed. Prints "ready" once the stream runs.
+
+#include <windows.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static constexpr double kTwoPi = 6.283185307179586;
+
+static int Die(const char *step, HRESULT hr) {
+  fprintf(stderr, "tone_generator: %s: 0x%08lX\n", step, hr);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  const double frequency = argc > 1 ? atof(argv[1]) : 1000.0;
+  const double amplitude = argc > 2 ? atof(argv[2]) : 0.25;
+  const double seconds = argc > 3 ? atof(argv[3]) : 0.0;
+  if (!(frequency > 0 && frequency < 24000) ||
+      !(amplitude > 0 && amplitude <= 1)) {
+    fprintf(stderr, "usage: tone_generator [frequencyHz] [amplitude] [seconds]\n");
+    return 2;
+  }
+
+  CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+  IMMDeviceEnumerator *enumerator = nullptr;
+  HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr,
+                                CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                                (void **)&enumerator);
+  if (FAILED(hr)) return Die("CoCreateInstance(MMDeviceEnumerator)", hr);
+  IMMDevice *device = nullptr;
+  hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+  enumerator->Release();
+  if (FAILED(hr)) return Die("GetDefaultAudioEndpoint", hr);
+  IAudioClient *client = nullptr;
+  hr = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                        (void **)&client);
+  device->Release();
+  if (FAILED(hr)) return Die("IMMDevice::Activate", hr);
+
+  // The same 48 kHz stereo float32 the capture side runs at, converted to
+  // the device's mix format by the engine
+  WAVEFORMATEX fmt = {};
+  fmt.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+  fmt.nChannels = 2;
+  fmt.nSamplesPerSec = 48000;
+  fmt.wBitsPerSample = 32;
+  fmt.nBlockAlign = fmt.nChannels * fmt.wBitsPerSample / 8;
+  fmt.nAvgBytesPerSec = fmt.nSamplesPerSec * fmt.nBlockAlign;
+  hr = client->Initialize(AUDCLNT_SHAREMODE_SHARED,
+                          AUDCLNT_STREAMFLAGS_EVENTCALLBACK |
+                              AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM |
+                              AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY,
+                          200000, 0, &fmt, nullptr);
+  if (FAILED(hr)) return Die("IAudioClient::Initialize", hr);
+
+  HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  hr = client->SetEventHandle(event);
+  if (FAILED(hr)) return Die("SetEventHandle", hr);
+  UINT32 bufferFrames = 0;
+  hr = client->GetBufferSize(&bufferFrames);
+  if (FAILED(hr)) return Die("GetBufferSize", hr);
+  IAudioRenderClient *render = nullptr;
+  hr = client->GetService(__uuidof(IAudioRenderClient), (void **)&render);
+  if (FAILED(hr)) return Die("GetService", hr);
+
+  const double step = kTwoPi * frequency / fmt.nSamplesPerSec;
+  const UINT64 totalFrames =
+      seconds > 0 ? static_cast<UINT64>(seconds * fmt.nSamplesPerSec) : 0;
+  double phase = 0.0;
+  UINT64 rendered = 0;
+  // Fill whatever the endpoint buffer has room for
+  auto fill = [&]() -> HRESULT {
+    UINT32 padding = 0;
+    HRESULT r = client->GetCurrentPadding(&padding);
+    if (FAILED(r)) return r;
+    const UINT32 frames = bufferFrames - padding;
+    if (frames == 0) return S_OK;
+    BYTE *data = nullptr;
+    r = render->GetBuffer(frames, &data);
+    if (FAILED(r)) return r;
+    float *out = reinterpret_cast<float *>(data);
+    for (UINT32 i = 0; i < frames; i++) {
+      const float v = static_cast<float>(amplitude * sin(phase));
+      out[i * 2] = v;
+      out[i * 2 + 1] = v;
+      phase += step;
+      if (phase >= kTwoPi) phase -= kTwoPi;
+    }
+    rendered += frames;
+    return render->ReleaseBuffer(frames, 0);
+  };
+
+  hr = fill();
+  if (SUCCEEDED(hr)) hr = client->Start();
+  if (FAILED(hr)) return Die("IAudioClient::Start", hr);
+  printf("ready\n");
+  fflush(stdout);
+
+  while (totalFrames == 0 || rendered < totalFrames) {
+    if (WaitForSingleObject(event, 2000) != WAIT_OBJECT_0)
+      return Die("render event", E_FAIL);
+    hr = fill();
+    if (FAILED(hr)) return Die("render", hr);
+  }
+
+  client->Stop();
+  render->Release();
+  client->Release();
+  CloseHandle(event);
+  CoUninitialize();
+  return 0;
+}
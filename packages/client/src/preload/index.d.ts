@@ -50,14 +50,190 @@ declare global {
     getVersion: () => Promise<string>;
   }
 
+  interface AudioCaptureHistogram {
+    edgesUs: number[];
+    counts: number[];
+  }
+
+  interface AudioCaptureStats {
+    packets: number;
+    frames: number;
+    silentPackets: number;
+    discontinuities: number;
+    timestampErrors: number;
+    positionGaps: number;
+    gapFrames: number;
+    devicePosition: number;
+    qpcPosition: number;
+    droppedPackets: number;
+    drains: number;
+    suppressedPackets: number;
+    suppressedFrames: number;
+    silenceMarkers: number;
+    encodedPackets: number;
+    encodedBytes: number;
+    encodeErrors: number;
+    tsfnCalls: number;
+    tsfnCallFailures: number;
+    readyDepth: number;
+    maxReadyDepth: number;
+    lentSlots: number;
+    packetInterval: AudioCaptureHistogram;
+    drainDuration: AudioCaptureHistogram;
+    /** Capture time (QPC) to the JS callback, per delivered packet */
+    deliveryLatency: AudioCaptureHistogram;
+    maxDeliveryLatencyUs: number;
+    /** Packets copied into fresh ArrayBuffers instead of lent */
+    copiedPackets: number;
+    copiedBytes: number;
+    /** Frames through RNNoise, and its voice probability (0..1) for the latest one */
+    denoisedFrames: number;
+    voiceProbability: number;
+    /** Ready packets the queue policy discarded, and merged callbacks */
+    queueDroppedPackets: number;
+    queueDroppedFrames: number;
+    queueMerges: number;
+    queueMergedPackets: number;
+    /** What WASAPI delivers: engine-downmixed stereo, or the device layout
+     * downmixed natively ("downmix") or passed through */
+    captureFormat: {
+      sampleRate: number;
+      channels: number;
+      channelMask: number;
+      speakers: (string | null)[];
+      mode: "stereo" | "downmix" | "passthrough";
+    };
+    /** Local recording progress, frames lost to a stalled disk, and frames
+     * held for saveReplay */
+    recording: boolean;
+    recordedFrames: number;
+    recordDroppedFrames: number;
+    replayFrames: number;
+    /** Kernel + user time of the shared capture thread; -1 when not running */
+    captureThreadCpuMs: number;
+    timeToFirstPacketMs: number;
+    state: AudioCaptureStateEvent["state"];
+    recoveryAttempts: number;
+    recoveries: number;
+    /** Hot swaps of the capture target, and ones that kept the old target */
+    retargets: number;
+    retargetFailures: number;
+    /** Engine period and endpoint buffer of the running stream, in frames */
+    period?: {
+      lowLatency: boolean;
+      periodFrames: number;
+      defaultPeriodFrames: number;
+      fundamentalPeriodFrames: number;
+      minPeriodFrames: number;
+      maxPeriodFrames: number;
+      bufferFrames: number;
+    };
+    /** Mixed shares only, one entry per source */
+    mix?: {
+      packets: number;
+      frames: number;
+      lateFrames: number;
+      gapFrames: number;
+      resyncs: number;
+      error?: string;
+    }[];
+  }
+
+  /** The share's stream failed, is being re-activated, or came back */
+  interface AudioCaptureStateEvent {
+    state: "running" | "recovering" | "failed";
+    reason?: string;
+    error?: string;
+    attempt: number;
+    retryInMs?: number;
+    pid: number;
+  }
+
+  /** One input of a natively mixed share; endpoints default to the system default */
+  type AudioCaptureMixSource =
+    | { sourceId: string; sourceType: "window" | "screen"; gain?: number }
+    | { type: "output" | "microphone"; deviceId?: string; gain?: number };
+
+  interface AudioCaptureLevels {
+    peak: [number, number];
+    rms: [number, number];
+    momentaryLufs: number;
+    shortTermLufs: number;
+    /** Momentary loudness above the BS.1770 -70 LUFS gate */
+    active: boolean;
+    blocks: number;
+  }
+
+  interface AudioCaptureShareOptions {
+    chunkMs?: number;
+    /** int16 halves the bytes per packet; the worklet must widen it on read */
+    sampleFormat?: "float32" | "int16";
+    lowLatency?: boolean;
+    noiseSuppression?: boolean;
+    /** Keep this many seconds (max 300) in memory for saveReplay */
+    replaySeconds?: number;
+    /** "native" captures the device's 5.1/7.1 layout and downmixes it natively */
+    captureLayout?: "stereo" | "native";
+  }
+
+  /** "ogg" is Opus in Ogg and needs an addon built with Opus */
+  interface AudioCaptureRecordOptions {
+    format?: "wav" | "ogg";
+    opusBitrate?: number;
+  }
+
+  /** A file written under userData/recordings */
+  interface AudioCaptureRecording {
+    path: string;
+    frames: number;
+    seconds: number;
+    bytes: number;
+  }
+
   interface AudioCaptureAPI {
     isAvailable: () => Promise<boolean>;
+    /** The addon was built with RNNoise, so start/startMix accept noiseSuppression */
+    isNoiseSuppressionAvailable: () => Promise<boolean>;
+    /** The addon can move a running share to another source (Windows only) */
+    isRetargetAvailable: () => Promise<boolean>;
+    prepare: (
+      sourceId: string,
+      sourceType: "window" | "screen",
+      options?: { lowLatency?: boolean },
+    ) => Promise<boolean>;
+    /** lowLatency: the engine's minimum period where supported, see getStats().period */
     start: (
       sourceId: string,
       sourceType: "window" | "screen",
+      options?: AudioCaptureShareOptions,
+    ) => Promise<boolean>;
+    /** Capture several sources at once, mixed natively into one stream. */
+    startMix: (
+      sources: AudioCaptureMixSource[],
+      options?: AudioCaptureShareOptions,
     ) => Promise<boolean>;
+    /** Move the running share to another source, crossfading natively; the
+     * worklet and published track are kept. False if it stays on the old one. */
+    retarget: (sourceId: string, sourceType: "window" | "screen") => Promise<boolean>;
     stop: () => Promise<void>;
-    onData: (callback: (buffer: Float32Array) => void) => () => void;
+    /** Recovery state changes of the running share; returns an unsubscribe. */
+    onStateChange: (callback: (event: AudioCaptureStateEvent) => void) => () => void;
+    getTimeToFirstPacket: () => Promise<number>;
+    getStats: () => Promise<AudioCaptureStats | null>;
+    getLevels: () => Promise<AudioCaptureLevels | null>;
+    /** Briefly capture all candidate windows at once; true = making sound. */
+    probe: (sourceIds: string[], durationMs?: number) => Promise<Record<string, boolean>>;
+    /** Preview audio activity of candidate windows; replaces any previous set. */
+    startMeters: (sourceIds: string[]) => Promise<boolean>;
+    getMeterLevels: () => Promise<Record<string, AudioCaptureLevels | null>>;
+    stopMeters: () => Promise<void>;
+    /** Tee the running share to a local file until stopRecording */
+    startRecording: (options?: AudioCaptureRecordOptions) => Promise<boolean>;
+    stopRecording: () => Promise<AudioCaptureRecording | null>;
+    /** Write out the last seconds (default all) held by a share started with replaySeconds */
+    saveReplay: (
+      options?: AudioCaptureRecordOptions & { seconds?: number },
+    ) => Promise<AudioCaptureRecording | null>;
   }
 
   interface OverlayBridgeAPI {
@@ -50,23 +50,80 @@ contextBridge.exposeInMainWorld("updaterAPI", updaterAPI);
 const audioCaptureAPI = {
   isAvailable: () =>
     ipcRenderer.invoke("audio-capture:isAvailable") as Promise<boolean>,
-  start: (sourceId: string, sourceType: "window" | "screen") =>
+  isNoiseSuppressionAvailable: () =>
+    ipcRenderer.invoke("audio-capture:isNoiseSuppressionAvailable") as Promise<boolean>,
+  isRetargetAvailable: () =>
+    ipcRenderer.invoke("audio-capture:isRetargetAvailable") as Promise<boolean>,
+  prepare: (
+    sourceId: string,
+    sourceType: "window" | "screen",
+    options?: { lowLatency?: boolean },
+  ) =>
+    ipcRenderer.invoke(
+      "audio-capture:prepare",
+      sourceId,
+      sourceType,
+      options,
+    ) as Promise<boolean>,
+  start: (
+    sourceId: string,
+    sourceType: "window" | "screen",
+    options?: AudioCaptureShareOptions,
+  ) =>
     ipcRenderer.invoke(
       "audio-capture:start",
       sourceId,
       sourceType,
+      options,
     ) as Promise<boolean>,
+  startMix: (
+    sources: AudioCaptureMixSource[],
+    options?: AudioCaptureShareOptions,
+  ) =>
+    ipcRenderer.invoke("audio-capture:startMix", sources, options) as Promise<boolean>,
+  retarget: (sourceId: string, sourceType: "window" | "screen") =>
+    ipcRenderer.invoke("audio-capture:retarget", sourceId, sourceType) as Promise<boolean>,
   stop: () => ipcRenderer.invoke("audio-capture:stop") as Promise<void>,
-  onData: (callback: (buffer: Float32Array) => void) => {
-    const handler = (_event: Electron.IpcRendererEvent, buf: ArrayBuffer) =>
-      callback(new Float32Array(buf));
-    ipcRenderer.on("audio-capture:data", handler);
-    return () => ipcRenderer.removeListener("audio-capture:data", handler);
+  onStateChange: (callback: (event: AudioCaptureStateEvent) => void) => {
+    const handler = (_event: Electron.IpcRendererEvent, data: AudioCaptureStateEvent) =>
+      callback(data);
+    ipcRenderer.on("audio-capture:state", handler);
+    return () => ipcRenderer.removeListener("audio-capture:state", handler);
   },
+  getTimeToFirstPacket: () =>
+    ipcRenderer.invoke("audio-capture:getTimeToFirstPacket") as Promise<number>,
+  getStats: () =>
+    ipcRenderer.invoke("audio-capture:getStats") as Promise<AudioCaptureStats | null>,
+  getLevels: () =>
+    ipcRenderer.invoke("audio-capture:getLevels") as Promise<AudioCaptureLevels | null>,
+  probe: (sourceIds: string[], durationMs?: number) =>
+    ipcRenderer.invoke("audio-capture:probe", sourceIds, durationMs) as Promise<
+      Record<string, boolean>
+    >,
+  startMeters: (sourceIds: string[]) =>
+    ipcRenderer.invoke("audio-capture:startMeters", sourceIds) as Promise<boolean>,
+  getMeterLevels: () =>
+    ipcRenderer.invoke("audio-capture:getMeterLevels") as Promise<
+      Record<string, AudioCaptureLevels | null>
+    >,
+  stopMeters: () => ipcRenderer.invoke("audio-capture:stopMeters") as Promise<void>,
+  startRecording: (options?: AudioCaptureRecordOptions) =>
+    ipcRenderer.invoke("audio-capture:startRecording", options) as Promise<boolean>,
+  stopRecording: () =>
+    ipcRenderer.invoke("audio-capture:stopRecording") as Promise<AudioCaptureRecording | null>,
+  saveReplay: (options?: AudioCaptureRecordOptions & { seconds?: number }) =>
+    ipcRenderer.invoke("audio-capture:saveReplay", options) as Promise<AudioCaptureRecording | null>,
 };
 
 contextBridge.exposeInMainWorld("audioCaptureAPI", audioCaptureAPI);
 
+// MessagePorts can't cross the context bridge, so the capture data port is
+// re-posted to the main world, where the screen share pipeline hands it to
+// its AudioWorklet. PCM then flows host process → worklet directly.
+ipcRenderer.on("audio-capture:port", (event) => {
+  window.postMessage("audio-capture:port", "*", event.ports);
+});
+
 const overlayBridgeAPI = {
   create: (displayIndex: number) =>
     ipcRenderer.invoke("overlay:create", displayIndex) as Promise<boolean>,
@@ -1,11 +1,12 @@
 import { useEffect, useState } from "react";
-import { Monitor, AppWindow } from "lucide-react";
+import { Monitor, AppWindow, Volume2 } from "lucide-react";
 import { Dialog, DialogContent, DialogHeader, DialogTitle, DialogDescription } from "@/components/ui/dialog";
 import { useVoiceStore } from "@/stores/voice";
 import { SCREEN_SHARE_PRESETS, DEFAULT_SCREEN_SHARE_RESOLUTION, type ScreenShareResolution } from "@/lib/livekit";
 
 const RESOLUTION_OPTIONS = Object.keys(SCREEN_SHARE_PRESETS) as ScreenShareResolution[];
 const STORAGE_KEY = "migo-screen-share-resolution";
+const METER_POLL_MS = 250;
 
 function getSavedResolution(): ScreenShareResolution {
   const saved = localStorage.getItem(STORAGE_KEY);
@@ -19,6 +20,7 @@ export function ScreenSharePicker() {
   const [sources, setSources] = useState<ScreenSources | null>(null);
   const [loading, setLoading] = useState(true);
   const [resolution, setResolution] = useState<ScreenShareResolution>(getSavedResolution);
+  const [audibleWindows, setAudibleWindows] = useState<Set<string>>(new Set());
 
   useEffect(() => {
     const api = window.screenAPI;
@@ -29,8 +31,49 @@ export function ScreenSharePicker() {
       .then((s) => setSources(s))
       .catch(() => setSources(null))
       .finally(() => setLoading(false));
+    // Warm native audio capture for a display share while the user picks,
+    // so the share's audio starts without a fresh WASAPI activation.
+    window.audioCaptureAPI?.prepare("", "screen").catch(() => {});
   }, [showPicker]);
 
+  // Mark the candidate windows currently making sound: one parallel probe
+  // for a quick first answer, then native meters (no PCM leaves the capture
+  // host) to keep it live.
+  useEffect(() => {
+    const api = window.audioCaptureAPI;
+    const windowIds = sources?.windows.map((w) => w.id) ?? [];
+    if (!showPicker || !api || windowIds.length === 0) return;
+    let cancelled = false;
+    api
+      .probe(windowIds)
+      .then((audible) => {
+        if (!cancelled) setAudibleWindows(new Set(windowIds.filter((id) => audible[id])));
+      })
+      .catch(() => {})
+      .finally(() => {
+        if (!cancelled) api.startMeters(windowIds).catch(() => {});
+      });
+    const timer = setInterval(() => {
+      api
+        .getMeterLevels()
+        .then((levels) => {
+          // Keep the probe's answer until the meters are up
+          if (cancelled || Object.keys(levels).length === 0) return;
+          const audible = new Set(Object.keys(levels).filter((id) => levels[id]?.active));
+          setAudibleWindows((prev) =>
+            prev.size === audible.size && [...audible].every((id) => prev.has(id)) ? prev : audible,
+          );
+        })
+        .catch(() => {});
+    }, METER_POLL_MS);
+    return () => {
+      cancelled = true;
+      clearInterval(timer);
+      setAudibleWindows(new Set());
+      api.stopMeters().catch(() => {});
+    };
+  }, [showPicker, sources]);
+
   const handleClose = () => {
     useVoiceStore.setState({ showScreenSharePicker: false });
   };
@@ -111,6 +154,7 @@ export function ScreenSharePicker() {
                     <button
                       key={win.id}
                       onClick={() => handleSelectWindow(win.index)}
+                      onMouseEnter={() => window.audioCaptureAPI?.prepare(win.id, "window").catch(() => {})}
                       className="group flex flex-col rounded-lg border border-border bg-card p-3 hover:border-primary hover:bg-accent transition-colors text-left"
                     >
                       <div className="flex items-center gap-3">
@@ -118,6 +162,12 @@ export function ScreenSharePicker() {
                         <div className="min-w-0">
                           <div className="text-sm font-medium truncate">{win.name}</div>
                         </div>
+                        {audibleWindows.has(win.id) && (
+                          <Volume2
+                            className="h-4 w-4 text-primary shrink-0 ml-auto"
+                            aria-label="Playing audio"
+                          />
+                        )}
                       </div>
                     </button>
                   ))}
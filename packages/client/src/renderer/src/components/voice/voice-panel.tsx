@@ -1,6 +1,7 @@
-import { Mic, MicOff, Headphones, HeadphoneOff, PhoneOff, Monitor, MonitorOff, AudioLines } from "lucide-react";
+import { Mic, MicOff, Headphones, HeadphoneOff, PhoneOff, Monitor, MonitorOff, AudioLines, Repeat } from "lucide-react";
 import { useVoiceStore } from "@/stores/voice";
 import { useAuthStore } from "@/stores/auth";
+import { isElectron } from "@/lib/platform";
 import { cn } from "@/lib/utils";
 import { ScreenSharePicker } from "./screen-share-picker";
 
@@ -20,6 +21,7 @@ export function VoicePanel() {
   const toggleMute = useVoiceStore((s) => s.toggleMute);
   const toggleDeafen = useVoiceStore((s) => s.toggleDeafen);
   const toggleScreenShare = useVoiceStore((s) => s.toggleScreenShare);
+  const switchScreenShareSource = useVoiceStore((s) => s.switchScreenShareSource);
 
   if (!currentChannelId) return null;
 
@@ -69,6 +71,15 @@ export function VoicePanel() {
         >
           {isScreenSharing ? <MonitorOff className="h-4 w-4" /> : <Monitor className="h-4 w-4" />}
         </button>
+        {isScreenSharing && isElectron && (
+          <button
+            onClick={switchScreenShareSource}
+            className="p-2 rounded-md hover:bg-muted transition-colors"
+            title="Switch Source"
+          >
+            <Repeat className="h-4 w-4" />
+          </button>
+        )}
         <button
           onClick={toggleNoiseSuppression}
           disabled={isConnecting}
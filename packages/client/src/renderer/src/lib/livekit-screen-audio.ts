@@ -5,50 +5,161 @@ import { Room, Track, LocalAudioTrack, AudioPresets } from "livekit-client";
 // Ring buffer design:
 // - `available` is computed from writePos/readPos (no separate counter that can drift)
 // - `write()` drops excess samples on overrun (reports count for diagnostics)
+// - A number instead of samples is a native silence marker: that many frames
+//   of zeros, synthesized here instead of shipped over IPC
 // - Pre-buffering: delays first read until enough samples are buffered to absorb jitter
+// - Clock drift: reads are resampled at a ratio that holds the buffer level
+//   near PRE_BUFFER_SAMPLES (see DriftController in ring-buffer.ts, which
+//   this mirrors), so the level never creeps into a skip or an underrun.
+//   Skipping is left for a backlog after a stall.
+// - Underruns fade out instead of cutting to silence, then re-buffer; the
+//   first quantum after (re)starting fades in
 // - Diagnostic counters (underruns, overruns) reported periodically to renderer
+// - About once a second a { type: 'timing' } message precedes a buffer with
+//   its capture time and capture→delivery latency; adding what is queued
+//   ahead of that buffer gives the latency up to the worklet's output
+// - processorOptions.sampleFormat "int16" keeps the native int16 delivery in
+//   an Int16Array ring (half the memory) and widens it to float on read
 const WORKLET_SOURCE = `
 const RING_BUFFER_SIZE = 48000 * 2 * 4 + 1; // ~4 seconds stereo + sentinel
-const PRE_BUFFER_SAMPLES = 19200;            // ~200ms pre-buffer (absorbs WASAPI startup delay)
-const DRIFT_THRESHOLD = 48000;               // skip if buffer exceeds 500ms
-const DRIFT_TARGET = 19200;                  // skip down to 200ms
+const PRE_BUFFER_SAMPLES = 3840;             // ~40ms pre-buffer, also the drift target
+const DRIFT_THRESHOLD = 24000;               // skip if buffer exceeds 250ms
+const DRIFT_TARGET = PRE_BUFFER_SAMPLES;     // skip down to the target
+const RATE_PPM_PER_MS = 100;                 // playback speed-up per ms above target
+const MAX_RATE_DEVIATION = 0.005;            // ±0.5%, under 9 cents of pitch
+const LEVEL_SMOOTHING = 0.01;                // per quantum, ~270ms
+
+function hermite(x0, x1, x2, x3, t) {
+  const c1 = 0.5 * (x2 - x0);
+  const c2 = x0 - 2.5 * x1 + 2 * x2 - 0.5 * x3;
+  const c3 = 0.5 * (x3 - x0) + 1.5 * (x1 - x2);
+  return ((c3 * t + c2) * t + c1) * t + x1;
+}
 
 class AudioCaptureProcessor extends AudioWorkletProcessor {
-  constructor() {
+  constructor(options) {
     super();
-    this.buffer = new Float32Array(RING_BUFFER_SIZE);
+    const int16 = options?.processorOptions?.sampleFormat === 'int16';
+    this.buffer = int16 ? new Int16Array(RING_BUFFER_SIZE) : new Float32Array(RING_BUFFER_SIZE);
+    this.scale = int16 ? 1 / 32767 : 1;
     this.writePos = 0;
     this.readPos = 0;
     this.started = false;
+    this.fadeIn = false;
+    // Resampler state: frame before readPos, position past it, rate
+    this.prevLeft = 0;
+    this.prevRight = 0;
+    this.frac = 0;
+    this.level = PRE_BUFFER_SAMPLES;
+    this.ratio = 1;
+    this.lastLeft = 0;
+    this.lastRight = 0;
     this.underrunCount = 0;
     this.overrunSamples = 0;
     this.driftCorrections = 0;
     this.processCount = 0;
+    // Latest timing message: capture time (ms, QPC clock) and the latency
+    // from capture to the end of this ring
+    this.captureTime = null;
+    this.latencyMs = null;
 
+    // PCM arrives on a dedicated MessagePort straight from the capture host
+    // process; the node's own port only carries that handoff.
     this.port.onmessage = (event) => {
-      const incoming = event.data;
-      const len = incoming.length;
-      const avail = this._available();
-      const freeSpace = RING_BUFFER_SIZE - 1 - avail;
-      const toWrite = Math.min(len, freeSpace);
-
-      if (len > freeSpace) {
-        this.overrunSamples += len - freeSpace;
+      const msg = event.data;
+      if (msg && msg.type === 'capturePort') {
+        msg.port.onmessage = (e) => this._write(e.data);
+        return;
       }
+      this._write(msg);
+    };
+  }
 
-      // Fast path: no wraparound
-      const endPos = this.writePos + toWrite;
-      if (endPos <= RING_BUFFER_SIZE) {
-        this.buffer.set(incoming.subarray(0, toWrite), this.writePos);
-        this.writePos = endPos === RING_BUFFER_SIZE ? 0 : endPos;
-      } else {
-        const firstChunk = RING_BUFFER_SIZE - this.writePos;
-        this.buffer.set(incoming.subarray(0, firstChunk), this.writePos);
-        const secondChunk = toWrite - firstChunk;
-        this.buffer.set(incoming.subarray(firstChunk, firstChunk + secondChunk), 0);
-        this.writePos = secondChunk;
+  _write(incoming) {
+    if (typeof incoming === 'number') {
+      this._writeSilence(incoming * 2);
+      return;
+    }
+    if (incoming.type === 'timing') {
+      this.captureTime = incoming.captureTime;
+      this.latencyMs = incoming.latencyMs === null ? null : incoming.latencyMs + this._available() / 96;
+      return;
+    }
+    const len = incoming.length;
+    const avail = this._available();
+    const freeSpace = RING_BUFFER_SIZE - 1 - avail;
+    const toWrite = Math.min(len, freeSpace);
+
+    if (len > freeSpace) {
+      this.overrunSamples += len - freeSpace;
+    }
+
+    // Fast path: no wraparound
+    const endPos = this.writePos + toWrite;
+    if (endPos <= RING_BUFFER_SIZE) {
+      this.buffer.set(incoming.subarray(0, toWrite), this.writePos);
+      this.writePos = endPos === RING_BUFFER_SIZE ? 0 : endPos;
+    } else {
+      const firstChunk = RING_BUFFER_SIZE - this.writePos;
+      this.buffer.set(incoming.subarray(0, firstChunk), this.writePos);
+      const secondChunk = toWrite - firstChunk;
+      this.buffer.set(incoming.subarray(firstChunk, firstChunk + secondChunk), 0);
+      this.writePos = secondChunk;
+    }
+  }
+
+  _writeSilence(len) {
+    const freeSpace = RING_BUFFER_SIZE - 1 - this._available();
+    const toWrite = Math.min(len, freeSpace);
+    if (len > freeSpace) {
+      this.overrunSamples += len - freeSpace;
+    }
+
+    const endPos = this.writePos + toWrite;
+    if (endPos <= RING_BUFFER_SIZE) {
+      this.buffer.fill(0, this.writePos, endPos);
+      this.writePos = endPos === RING_BUFFER_SIZE ? 0 : endPos;
+    } else {
+      this.buffer.fill(0, this.writePos);
+      this.buffer.fill(0, 0, endPos - RING_BUFFER_SIZE);
+      this.writePos = endPos - RING_BUFFER_SIZE;
+    }
+  }
+
+  // Consume ratio input frames per output frame, 4-point cubic Hermite
+  // interpolation. False (nothing consumed) if the look-ahead isn't there.
+  _readResampled(left, right, frames, ratio) {
+    const framesNeeded = Math.ceil(this.frac + frames * ratio) + 2;
+    if (this._available() < framesNeeded * 2) return false;
+
+    const size = RING_BUFFER_SIZE;
+    const buf = this.buffer;
+    const scale = this.scale;
+    let pos = this.readPos;
+    let frac = this.frac;
+    let l0 = this.prevLeft;
+    let r0 = this.prevRight;
+    for (let i = 0; i < frames; i++) {
+      const p1 = (pos + 1) % size;
+      const p2 = (pos + 2) % size;
+      const p3 = (pos + 3) % size;
+      const p4 = (pos + 4) % size;
+      const p5 = (pos + 5) % size;
+      left[i] = hermite(l0, buf[pos], buf[p2], buf[p4], frac) * scale;
+      right[i] = hermite(r0, buf[p1], buf[p3], buf[p5], frac) * scale;
+      frac += ratio;
+      while (frac >= 1) {
+        frac -= 1;
+        l0 = buf[pos];
+        r0 = buf[(pos + 1) % size];
+        pos = (pos + 2) % size;
       }
-    };
+    }
+    this.readPos = pos;
+    this.frac = frac;
+    this.prevLeft = l0;
+    this.prevRight = r0;
+    return true;
   }
 
   _available() {
@@ -62,12 +173,13 @@ class AudioCaptureProcessor extends AudioWorkletProcessor {
     const left = output[0];
     const right = output[1];
     const frames = left.length;
-    const samplesNeeded = frames * 2;
 
     // Pre-buffering: wait until enough data is accumulated to absorb jitter
     if (!this.started) {
       if (this._available() >= PRE_BUFFER_SAMPLES) {
         this.started = true;
+        this.fadeIn = true;
+        this.level = PRE_BUFFER_SAMPLES;
       } else {
         left.fill(0);
         right.fill(0);
@@ -75,26 +187,44 @@ class AudioCaptureProcessor extends AudioWorkletProcessor {
       }
     }
 
+    // Drift correction: skip a stale backlog (e.g. after the capture side
+    // stalled); ordinary drift is absorbed by the playback rate below
     const avail = this._available();
-    if (avail >= samplesNeeded) {
-      for (let i = 0; i < frames; i++) {
-        left[i] = this.buffer[this.readPos];
-        this.readPos = (this.readPos + 1) % RING_BUFFER_SIZE;
-        right[i] = this.buffer[this.readPos];
-        this.readPos = (this.readPos + 1) % RING_BUFFER_SIZE;
-      }
+    if (avail > DRIFT_THRESHOLD) {
+      const skip = avail - DRIFT_TARGET;
+      this.readPos = (this.readPos + skip) % RING_BUFFER_SIZE;
+      this.level = DRIFT_TARGET;
+      this.driftCorrections++;
+    }
+
+    this.level += (this._available() - this.level) * LEVEL_SMOOTHING;
+    const excessMs = (this.level - PRE_BUFFER_SAMPLES) / 96; // 96 samples per ms
+    const deviation = excessMs * RATE_PPM_PER_MS * 1e-6;
+    this.ratio = 1 + Math.max(-MAX_RATE_DEVIATION, Math.min(MAX_RATE_DEVIATION, deviation));
 
-      // Drift correction: skip stale samples to resync after underrun recovery
-      const postReadAvail = this._available();
-      if (postReadAvail > DRIFT_THRESHOLD) {
-        const skip = postReadAvail - DRIFT_TARGET;
-        this.readPos = (this.readPos + skip) % RING_BUFFER_SIZE;
-        this.driftCorrections++;
+    if (this._readResampled(left, right, frames, this.ratio)) {
+      if (this.fadeIn) {
+        for (let i = 0; i < frames; i++) {
+          const g = i / frames;
+          left[i] *= g;
+          right[i] *= g;
+        }
+        this.fadeIn = false;
       }
+      this.lastLeft = left[frames - 1];
+      this.lastRight = right[frames - 1];
     } else {
+      // Ramp from the last sample played instead of cutting to zero, then
+      // build the pre-buffer back up
       this.underrunCount++;
-      left.fill(0);
-      right.fill(0);
+      for (let i = 0; i < frames; i++) {
+        const g = 1 - (i + 1) / frames;
+        left[i] = this.lastLeft * g;
+        right[i] = this.lastRight * g;
+      }
+      this.lastLeft = 0;
+      this.lastRight = 0;
+      this.started = false;
     }
 
     // Report diagnostics every ~5 seconds (1875 process calls at 128 frames / 48kHz)
@@ -106,7 +236,10 @@ class AudioCaptureProcessor extends AudioWorkletProcessor {
         overruns: this.overrunSamples,
         driftCorrections: this.driftCorrections,
         bufferLevel: this._available(),
+        ratio: this.ratio,
         processCount: this.processCount,
+        captureTime: this.captureTime,
+        latencyMs: this.latencyMs,
       });
     }
 
@@ -116,18 +249,64 @@ class AudioCaptureProcessor extends AudioWorkletProcessor {
 registerProcessor("audio-capture-processor", AudioCaptureProcessor);
 `;
 
+// Native side coalesces WASAPI packets (~10ms each) into chunks of this size
+// before crossing into JS. Halves TSFN wakeups, IPC messages and worklet
+// postMessages; the worklet's 40ms pre-buffer hides the added delay.
+const CAPTURE_CHUNK_MS = 20;
+
+// Packed natively (with saturation) and widened back in the worklet: half
+// the bytes of float32 over the TSFN, IPC and the worklet port, and plenty
+// for a screen share's audio.
+const CAPTURE_SAMPLE_FORMAT = "int16";
+
+/**
+ * Resolve with the next capture data port the preload re-posts from the main
+ * process. Must be armed before `audioCaptureAPI.start()` since the port is
+ * sent ahead of the start reply.
+ */
+function waitForCapturePort(): { port: Promise<MessagePort>; cancel: () => void } {
+  let onMessage: (event: MessageEvent) => void = () => {};
+  const port = new Promise<MessagePort>((resolve) => {
+    onMessage = (event: MessageEvent) => {
+      if (event.source !== window || event.data !== "audio-capture:port") return;
+      window.removeEventListener("message", onMessage);
+      resolve(event.ports[0]);
+    };
+    window.addEventListener("message", onMessage);
+  });
+  return { port, cancel: () => window.removeEventListener("message", onMessage) };
+}
+
 export class ScreenShareAudioPipeline {
   private screenAudioContext: AudioContext | null = null;
   private screenAudioWorklet: AudioWorkletNode | null = null;
   private screenAudioCleanup: (() => void) | null = null;
+  private workletLatencyMs: number | null = null;
+
+  /** ms from capture to the worklet's output, the track LiveKit is fed, as
+   * of the worklet's last stats (every ~5 s); null before the first. For
+   * lining audio up against the screen video track. */
+  get latencyMs(): number | null {
+    return this.workletLatencyMs;
+  }
 
   async start(room: Room, sourceId: string, sourceType: "window" | "screen"): Promise<void> {
     try {
       const available = await window.audioCaptureAPI?.isAvailable();
       if (!available) return;
 
-      const started = await window.audioCaptureAPI!.start(sourceId, sourceType);
-      if (!started) return;
+      const capturePort = waitForCapturePort();
+      this.screenAudioCleanup = capturePort.cancel;
+
+      const started = await window.audioCaptureAPI!.start(sourceId, sourceType, {
+        chunkMs: CAPTURE_CHUNK_MS,
+        sampleFormat: CAPTURE_SAMPLE_FORMAT,
+      });
+      if (!started) {
+        capturePort.cancel();
+        this.screenAudioCleanup = null;
+        return;
+      }
 
       // Create AudioContext → AudioWorklet → MediaStreamDestination pipeline
       this.screenAudioContext = new AudioContext({ sampleRate: 48000 });
@@ -140,20 +319,26 @@ export class ScreenShareAudioPipeline {
       this.screenAudioWorklet = new AudioWorkletNode(
         this.screenAudioContext,
         "audio-capture-processor",
-        { outputChannelCount: [2] },
+        {
+          outputChannelCount: [2],
+          processorOptions: { sampleFormat: CAPTURE_SAMPLE_FORMAT },
+        },
       );
 
-      // Discard diagnostic stats from the worklet (audio pipeline is stable)
-      this.screenAudioWorklet.port.onmessage = null;
+      // Diagnostic stats: only the latency estimate is kept
+      this.workletLatencyMs = null;
+      this.screenAudioWorklet.port.onmessage = (event: MessageEvent) => {
+        if (event.data?.type === "stats") this.workletLatencyMs = event.data.latencyMs;
+      };
 
       const destination = this.screenAudioContext.createMediaStreamDestination();
       this.screenAudioWorklet.connect(destination);
 
-      // Forward WASAPI PCM buffers to the worklet
-      const removeListener = window.audioCaptureAPI!.onData((buffer) => {
-        this.screenAudioWorklet?.port.postMessage(buffer, [buffer.buffer]);
-      });
-      this.screenAudioCleanup = removeListener;
+      // Hand the capture data port to the worklet; WASAPI PCM is posted into
+      // it directly by the capture host process.
+      const port = await capturePort.port;
+      this.screenAudioWorklet.port.postMessage({ type: "capturePort", port }, [port]);
+      this.screenAudioCleanup = () => port.close();
 
       // Publish the audio track to LiveKit as screen share audio
       const audioTrack = destination.stream.getAudioTracks()[0];
@@ -172,8 +357,30 @@ export class ScreenShareAudioPipeline {
     }
   }
 
+  /** Move the running capture to another source without touching the
+   * AudioContext, worklet or published track; the capture side crossfades.
+   * False if nothing is running or it stays on the old source. */
+  async retarget(sourceId: string, sourceType: "window" | "screen"): Promise<boolean> {
+    if (!this.screenAudioWorklet) return false;
+    try {
+      if (!(await window.audioCaptureAPI?.isRetargetAvailable())) return false;
+      return (await window.audioCaptureAPI?.retarget(sourceId, sourceType)) ?? false;
+    } catch (err) {
+      console.warn("Failed to retarget screen share audio:", err);
+      return false;
+    }
+  }
+
+  /** Follow a mid-share source switch: retarget in place where the addon
+   * can, else restart the audio pipeline alone. */
+  async switchSource(room: Room, sourceId: string, sourceType: "window" | "screen"): Promise<void> {
+    if (await this.retarget(sourceId, sourceType)) return;
+    await this.stop(room);
+    await this.start(room, sourceId, sourceType);
+  }
+
   async stop(room: Room | null): Promise<void> {
-    // Remove IPC data listener
+    // Close the capture data port (or stop waiting for it)
     if (this.screenAudioCleanup) {
       this.screenAudioCleanup();
       this.screenAudioCleanup = null;
@@ -6,6 +6,7 @@ import {
   type RemoteTrackPublication,
   type RemoteTrack,
   LocalAudioTrack,
+  LocalVideoTrack,
 } from "livekit-client";
 import { MicrophoneProcessor } from "./audio-processor";
 import {
@@ -41,6 +42,7 @@ export class LiveKitManager {
   private vad = new VoiceActivityDetector();
   private screenAudio = new ScreenShareAudioPipeline();
   private screenShareStatsInterval: ReturnType<typeof setInterval> | null = null;
+  private screenShareResolution: ScreenShareResolution = DEFAULT_SCREEN_SHARE_RESOLUTION;
 
   // Audio elements attached to remote audio tracks (mic only)
   private attachedAudioElements = new Map<string, HTMLMediaElement[]>();
@@ -265,7 +267,8 @@ export class LiveKitManager {
   ): Promise<void> {
     if (!this.room) return;
 
-    const preset = SCREEN_SHARE_PRESETS[resolution ?? DEFAULT_SCREEN_SHARE_RESOLUTION];
+    this.screenShareResolution = resolution ?? DEFAULT_SCREEN_SHARE_RESOLUTION;
+    const preset = SCREEN_SHARE_PRESETS[this.screenShareResolution];
 
     // On Electron, audio is captured separately via WASAPI native addon,
     // so we disable getDisplayMedia audio. On web, we request audio from
@@ -301,6 +304,29 @@ export class LiveKitManager {
     this.startScreenShareStats();
   }
 
+  /** Switch a running Electron share to another window or screen without
+   * unpublishing it: the video track's source is replaced in place, and the
+   * native audio retargets (or restarts on its own where it can't). The
+   * source must already be selected in the main process. */
+  async switchScreenShare(sourceId: string, sourceType: "window" | "screen"): Promise<void> {
+    if (!this.room) return;
+    const pub = this.room.localParticipant.getTrackPublication(Track.Source.ScreenShare);
+    if (!(pub?.track instanceof LocalVideoTrack)) throw new Error("Not screen sharing");
+
+    const preset = SCREEN_SHARE_PRESETS[this.screenShareResolution];
+    const stream = await navigator.mediaDevices.getDisplayMedia({
+      audio: false,
+      video: { width: 3840, height: preset.height, frameRate: preset.fps },
+    });
+    const video = stream.getVideoTracks()[0];
+    if (!video) throw new Error("No video track for the new source");
+    video.contentHint = "motion";
+    // Stops the old source's track once the sender carries the new one
+    await pub.track.replaceTrack(video);
+
+    await this.screenAudio.switchSource(this.room, sourceId, sourceType);
+  }
+
   async stopScreenShare(): Promise<void> {
     if (!this.room) return;
 
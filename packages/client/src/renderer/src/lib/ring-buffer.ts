@@ -9,21 +9,33 @@
  * but `available` is derived from positions (not a separate counter) to avoid drift.
  *
  * The buffer holds `size - 1` usable slots to distinguish full from empty.
+ *
+ * With `sampleFormat` "int16" the ring stores the native int16 delivery
+ * as-is, at half the memory, and reads widen it back to [-1, 1].
  */
 export class RingBuffer {
-  private buffer: Float32Array;
+  private buffer: Float32Array | Int16Array;
+  // Multiplies stored samples into float output
+  private scale: number;
   private writePos = 0;
   private readPos = 0;
   private _size: number;
 
+  // Resampled reads: the frame before readPos and the fractional position
+  // between it and the frame at readPos
+  private prevLeft = 0;
+  private prevRight = 0;
+  private frac = 0;
+
   // Diagnostic counters
   private _overrunSamples = 0;
   private _underrunCount = 0;
   private _driftCorrections = 0;
 
-  constructor(size: number) {
+  constructor(size: number, sampleFormat: "float32" | "int16" = "float32") {
     this._size = size;
-    this.buffer = new Float32Array(size);
+    this.buffer = sampleFormat === "int16" ? new Int16Array(size) : new Float32Array(size);
+    this.scale = sampleFormat === "int16" ? 1 / 32767 : 1;
   }
 
   /** Number of samples available to read. */
@@ -58,10 +70,10 @@ export class RingBuffer {
   }
 
   /**
-   * Write interleaved stereo samples into the buffer.
+   * Write interleaved stereo samples, in the ring's sample format, into the buffer.
    * @returns Number of samples dropped (0 if all fit).
    */
-  write(data: Float32Array): number {
+  write(data: Float32Array | Int16Array): number {
     const len = data.length;
     const freeSpace = this.free;
     const toWrite = Math.min(len, freeSpace);
@@ -88,6 +100,31 @@ export class RingBuffer {
     return dropped;
   }
 
+  /**
+   * Write `samples` zeros, as for a native silence marker.
+   * @returns Number of samples dropped (0 if all fit).
+   */
+  writeSilence(samples: number): number {
+    const toWrite = Math.min(samples, this.free);
+    const dropped = samples - toWrite;
+
+    if (dropped > 0) {
+      this._overrunSamples += dropped;
+    }
+
+    const endPos = this.writePos + toWrite;
+    if (endPos <= this._size) {
+      this.buffer.fill(0, this.writePos, endPos);
+      this.writePos = endPos === this._size ? 0 : endPos;
+    } else {
+      this.buffer.fill(0, this.writePos);
+      this.buffer.fill(0, 0, endPos - this._size);
+      this.writePos = endPos - this._size;
+    }
+
+    return dropped;
+  }
+
   /**
    * Read interleaved stereo samples into separate left/right channel buffers.
    * @returns `true` if enough data was available, `false` on underrun (outputs untouched).
@@ -100,15 +137,62 @@ export class RingBuffer {
     }
 
     for (let i = 0; i < frames; i++) {
-      left[i] = this.buffer[this.readPos];
+      left[i] = this.buffer[this.readPos] * this.scale;
       this.readPos = (this.readPos + 1) % this._size;
-      right[i] = this.buffer[this.readPos];
+      right[i] = this.buffer[this.readPos] * this.scale;
       this.readPos = (this.readPos + 1) % this._size;
     }
 
     return true;
   }
 
+  /**
+   * Read `frames` output frames while consuming `ratio` input frames per
+   * output frame (ratio ≈ 1 ± a few thousand ppm). Interpolates with a
+   * 4-point cubic Hermite, which stays flat to well above 10 kHz at any
+   * fractional position, unlike linear interpolation.
+   * @returns `true` if enough data was available, `false` on underrun (outputs untouched).
+   */
+  readStereoResampled(left: Float32Array, right: Float32Array, frames: number, ratio: number): boolean {
+    // The last output frame reads up to two frames past its position
+    const framesNeeded = Math.ceil(this.frac + frames * ratio) + 2;
+    if (this.available < framesNeeded * 2) {
+      this._underrunCount++;
+      return false;
+    }
+
+    const size = this._size;
+    const buf = this.buffer;
+    const scale = this.scale;
+    let pos = this.readPos;
+    let frac = this.frac;
+    let l0 = this.prevLeft;
+    let r0 = this.prevRight;
+    for (let i = 0; i < frames; i++) {
+      // A frame may straddle the end of the (odd-sized) buffer
+      const p1 = (pos + 1) % size;
+      const p2 = (pos + 2) % size;
+      const p3 = (pos + 3) % size;
+      const p4 = (pos + 4) % size;
+      const p5 = (pos + 5) % size;
+      // Interpolate the stored values; scaling after is the same, and cheaper
+      left[i] = hermite(l0, buf[pos], buf[p2], buf[p4], frac) * scale;
+      right[i] = hermite(r0, buf[p1], buf[p3], buf[p5], frac) * scale;
+      frac += ratio;
+      while (frac >= 1) {
+        frac -= 1;
+        l0 = buf[pos];
+        r0 = buf[(pos + 1) % size];
+        pos = (pos + 2) % size;
+      }
+    }
+    this.readPos = pos;
+    this.frac = frac;
+    this.prevLeft = l0;
+    this.prevRight = r0;
+    return true;
+  }
+
   /**
    * If available samples exceed `threshold`, advance readPos to bring
    * the buffer level down to `target`. Returns the number of samples skipped.
@@ -126,8 +210,64 @@ export class RingBuffer {
   reset(): void {
     this.writePos = 0;
     this.readPos = 0;
+    this.prevLeft = 0;
+    this.prevRight = 0;
+    this.frac = 0;
     this._overrunSamples = 0;
     this._underrunCount = 0;
     this._driftCorrections = 0;
   }
 }
+
+/** 4-point cubic Hermite between x1 (t = 0) and x2 (t = 1). */
+function hermite(x0: number, x1: number, x2: number, x3: number, t: number): number {
+  const c1 = 0.5 * (x2 - x0);
+  const c2 = x0 - 2.5 * x1 + 2 * x2 - 0.5 * x3;
+  const c3 = 0.5 * (x3 - x0) + 1.5 * (x1 - x2);
+  return ((c3 * t + c2) * t + c1) * t + x1;
+}
+
+/**
+ * Playback rate that holds a ring buffer near a target level.
+ *
+ * The capture clock and the AudioContext clock drift apart by up to a few
+ * hundred ppm. Instead of letting the level creep until samples have to be
+ * skipped (or the buffer runs dry), the consumer reads at `update()`'s
+ * ratio: each ms of smoothed excess over the target speeds playback up by
+ * `ppmPerMs`, clamped to ±`maxDeviation`. At the defaults a 200 ppm drift
+ * settles 2 ms off target, and the pitch never shifts more than 0.5%.
+ */
+export class DriftController {
+  private level: number;
+  private _ratio = 1;
+
+  constructor(
+    private targetSamples: number,
+    private sampleRate = 48000,
+    private ppmPerMs = 100,
+    private maxDeviation = 0.005,
+    private smoothing = 0.01, // per update, ~270 ms at one update per quantum
+  ) {
+    this.level = targetSamples;
+  }
+
+  /** Current ratio, input frames consumed per output frame. */
+  get ratio(): number {
+    return this._ratio;
+  }
+
+  /** Feed the buffer level (interleaved stereo samples) ahead of a read. */
+  update(availableSamples: number): number {
+    this.level += (availableSamples - this.level) * this.smoothing;
+    const excessMs = ((this.level - this.targetSamples) / 2 / this.sampleRate) * 1000;
+    const deviation = excessMs * this.ppmPerMs * 1e-6;
+    this._ratio = 1 + Math.max(-this.maxDeviation, Math.min(this.maxDeviation, deviation));
+    return this._ratio;
+  }
+
+  /** Forget the smoothed level, e.g. after re-buffering. */
+  reset(): void {
+    this.level = this.targetSamples;
+    this._ratio = 1;
+  }
+}
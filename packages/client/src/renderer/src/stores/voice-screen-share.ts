@@ -70,9 +70,29 @@ export function createScreenShareActions(set: Set, get: Get) {
       }
     },
 
+    // Electron: pick another source for the running share
+    switchScreenShareSource: () => {
+      if (get().isScreenSharing && isElectron) set({ showScreenSharePicker: true });
+    },
+
     startScreenShare: async (target: { type: string; id: number }, resolution?: ScreenShareResolution) => {
       set({ showScreenSharePicker: false });
 
+      // Picked while already sharing: switch in place, keeping the published
+      // tracks (and the audio pipeline where the addon can retarget)
+      if (get().isScreenSharing && isElectron && window.screenAPI) {
+        const sourceType: "window" | "screen" = target.type === "window" ? "window" : "screen";
+        try {
+          const sourceId = await window.screenAPI.selectSource(target.type, target.id);
+          if (!sourceId) throw new Error("No source selected");
+          await livekitManager.switchScreenShare(sourceId, sourceType);
+          set({ screenShareSourceId: sourceId, screenShareSourceType: sourceType });
+        } catch (err) {
+          console.error("Failed to switch screen share source:", err);
+        }
+        return;
+      }
+
       try {
         let sourceId: string | null = null;
         let sourceType: "window" | "screen" =
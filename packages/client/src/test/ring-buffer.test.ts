@@ -1,5 +1,5 @@
 import { describe, it, expect } from "vitest";
-import { RingBuffer } from "../renderer/src/lib/ring-buffer";
+import { DriftController, RingBuffer } from "../renderer/src/lib/ring-buffer";
 
 describe("RingBuffer", () => {
   describe("basic operations", () => {
@@ -123,6 +123,45 @@ describe("RingBuffer", () => {
     });
   });
 
+  describe("silence markers", () => {
+    it("writeSilence fills zeros in order with surrounding audio", () => {
+      const rb = new RingBuffer(16); // 15 usable
+      rb.write(new Float32Array([1, 2]));
+      expect(rb.writeSilence(4)).toBe(0);
+      rb.write(new Float32Array([3, 4]));
+      expect(rb.available).toBe(8);
+
+      const left = new Float32Array(4);
+      const right = new Float32Array(4);
+      rb.readStereoInterleaved(left, right, 4);
+      expect(Array.from(left)).toEqual([1, 0, 0, 3]);
+      expect(Array.from(right)).toEqual([2, 0, 0, 4]);
+    });
+
+    it("overwrites stale samples across wraparound", () => {
+      const rb = new RingBuffer(10); // 9 usable
+      rb.write(new Float32Array([9, 9, 9, 9, 9, 9, 9, 9]));
+      const left = new Float32Array(3);
+      const right = new Float32Array(3);
+      rb.readStereoInterleaved(left, right, 3); // readPos=6, writePos=8
+
+      expect(rb.writeSilence(6)).toBe(0); // wraps: 8..9, then 0..3
+      expect(rb.available).toBe(8);
+      rb.readStereoInterleaved(left, right, 1); // the last two 9s
+      expect(left[0]).toBe(9);
+      rb.readStereoInterleaved(left, right, 3);
+      expect(Array.from(left)).toEqual([0, 0, 0]);
+      expect(Array.from(right)).toEqual([0, 0, 0]);
+    });
+
+    it("reports dropped samples when the run doesn't fit", () => {
+      const rb = new RingBuffer(16); // 15 usable
+      expect(rb.writeSilence(20)).toBe(5);
+      expect(rb.overrunSamples).toBe(5);
+      expect(rb.available).toBe(15);
+    });
+  });
+
   describe("underrun behavior", () => {
     it("returns false when insufficient data", () => {
       const rb = new RingBuffer(1024);
@@ -267,6 +306,194 @@ describe("RingBuffer", () => {
     });
   });
 
+  describe("resampled reads", () => {
+    it("ratio 1 is an exact pass-through, across wraparound", () => {
+      const rb = new RingBuffer(17); // odd, like the worklet's buffer
+      const left = new Float32Array(2);
+      const right = new Float32Array(2);
+      let next = 0;
+      const out: number[] = [];
+      for (let round = 0; round < 10; round++) {
+        const chunk = new Float32Array(4).map(() => ++next);
+        rb.write(chunk);
+        // Resampled reads keep two frames of look-ahead
+        if (rb.readStereoResampled(left, right, 2, 1)) {
+          out.push(left[0], right[0], left[1], right[1]);
+        }
+      }
+      expect(out.length).toBeGreaterThan(20);
+      out.forEach((v, i) => expect(v).toBe(i + 1));
+    });
+
+    it("consumes ratio input frames per output frame", () => {
+      const rb = new RingBuffer(48000 * 2 + 1);
+      rb.write(new Float32Array(48000 * 2 - 2));
+      const left = new Float32Array(128);
+      const right = new Float32Array(128);
+      const before = rb.available;
+      for (let i = 0; i < 100; i++) rb.readStereoResampled(left, right, 128, 1.005);
+      const consumedFrames = (before - rb.available) / 2;
+      expect(consumedFrames).toBeGreaterThanOrEqual(Math.floor(12800 * 1.005) - 1);
+      expect(consumedFrames).toBeLessThanOrEqual(Math.ceil(12800 * 1.005));
+    });
+
+    it("keeps a sine continuous while changing rate", () => {
+      const frames = 48000;
+      const rb = new RingBuffer(frames * 2 + 1);
+      const input = new Float32Array(frames * 2);
+      for (let i = 0; i < frames; i++) {
+        input[i * 2] = input[i * 2 + 1] = Math.sin((2 * Math.PI * 1000 * i) / 48000);
+      }
+      rb.write(input);
+
+      const left = new Float32Array(128);
+      const right = new Float32Array(128);
+      let phase = 0; // input frames consumed so far, exactly
+      let maxError = 0;
+      for (let q = 0; q < 300; q++) {
+        const ratio = 1 + 0.004 * Math.sin(q / 20); // sweep ±0.4%
+        expect(rb.readStereoResampled(left, right, 128, ratio)).toBe(true);
+        for (let i = 0; i < 128; i++) {
+          const expected = Math.sin((2 * Math.PI * 1000 * phase) / 48000);
+          maxError = Math.max(maxError, Math.abs(left[i] - expected), Math.abs(right[i] - expected));
+          phase += ratio;
+        }
+      }
+      // Cubic interpolation of a 1 kHz tone at 48 kHz
+      expect(maxError).toBeLessThan(1e-3);
+    });
+
+    it("reports underrun without consuming when look-ahead is missing", () => {
+      const rb = new RingBuffer(1024);
+      rb.write(new Float32Array(256)); // exactly 128 frames
+      const left = new Float32Array(128);
+      const right = new Float32Array(128);
+      expect(rb.readStereoResampled(left, right, 128, 1)).toBe(false);
+      expect(rb.available).toBe(256);
+      expect(rb.underrunCount).toBe(1);
+    });
+  });
+
+  describe("int16 storage", () => {
+    it("widens samples to [-1, 1] on read", () => {
+      const rb = new RingBuffer(17, "int16");
+      rb.write(Int16Array.from([32767, -32767, 16384, 0]));
+      const left = new Float32Array(2);
+      const right = new Float32Array(2);
+      expect(rb.readStereoInterleaved(left, right, 2)).toBe(true);
+      expect(left[0]).toBe(1);
+      expect(right[0]).toBe(-1);
+      expect(left[1]).toBeCloseTo(0.5, 4);
+      expect(right[1]).toBe(0);
+    });
+
+    it("resamples a sine as closely as float32 storage", () => {
+      const frames = 48000;
+      const rb = new RingBuffer(frames * 2 + 1, "int16");
+      const input = new Int16Array(frames * 2);
+      for (let i = 0; i < frames; i++) {
+        input[i * 2] = input[i * 2 + 1] = Math.round(32767 * 0.5 * Math.sin((2 * Math.PI * 1000 * i) / 48000));
+      }
+      rb.write(input);
+
+      const left = new Float32Array(128);
+      const right = new Float32Array(128);
+      let phase = 0;
+      let maxError = 0;
+      for (let q = 0; q < 100; q++) {
+        expect(rb.readStereoResampled(left, right, 128, 1.003)).toBe(true);
+        for (let i = 0; i < 128; i++) {
+          const expected = 0.5 * Math.sin((2 * Math.PI * 1000 * phase) / 48000);
+          maxError = Math.max(maxError, Math.abs(left[i] - expected), Math.abs(right[i] - expected));
+          phase += 1.003;
+        }
+      }
+      // Interpolation error plus half an int16 step
+      expect(maxError).toBeLessThan(1e-3);
+    });
+
+    it("writeSilence stores zeros", () => {
+      const rb = new RingBuffer(9, "int16");
+      rb.write(Int16Array.from([1000, 1000]));
+      rb.writeSilence(2);
+      const left = new Float32Array(2);
+      const right = new Float32Array(2);
+      expect(rb.readStereoInterleaved(left, right, 2)).toBe(true);
+      expect(left[1]).toBe(0);
+      expect(right[1]).toBe(0);
+    });
+  });
+
+  describe("drift compensation", () => {
+    // 60 s of 20 ms chunks from a capture clock `ppm` off the AudioContext's,
+    // with ±5 ms delivery jitter, played back at the controller's ratio.
+    function simulateDrift(ppm: number) {
+      const target = 3840; // 40 ms
+      const rb = new RingBuffer(48000 * 2 * 4 + 1);
+      const ctrl = new DriftController(target);
+      const quantumMs = (128 / 48000) * 1000;
+      const left = new Float32Array(128);
+      const right = new Float32Array(128);
+
+      let seed = 7;
+      const random = () => {
+        seed = (seed * 1664525 + 1013904223) & 0x7fffffff;
+        return seed / 0x7fffffff;
+      };
+
+      let producedFrames = 0;
+      let chunkIndex = 0;
+      let nextChunkMs = 0;
+      let started = false;
+      let minLevel = Infinity;
+      let maxLevel = 0;
+      for (let t = 0; t < 60000; t += quantumMs) {
+        while (nextChunkMs <= t) {
+          // Frames the capture clock produced by the end of this chunk
+          const due = Math.round((chunkIndex + 1) * 960 * (1 + ppm * 1e-6));
+          rb.write(new Float32Array((due - producedFrames) * 2));
+          producedFrames = due;
+          chunkIndex++;
+          nextChunkMs = chunkIndex * 20 + (random() * 2 - 1) * 5;
+        }
+        if (!started) {
+          started = rb.available >= target;
+          continue;
+        }
+        if (t > 10000) {
+          minLevel = Math.min(minLevel, rb.available);
+          maxLevel = Math.max(maxLevel, rb.available);
+        }
+        rb.readStereoResampled(left, right, 128, ctrl.update(rb.available));
+      }
+      return { rb, ctrl, minLevel, maxLevel };
+    }
+
+    it("absorbs a fast capture clock without skipping", () => {
+      const { rb, ctrl, maxLevel } = simulateDrift(300);
+      expect(rb.underrunCount).toBe(0);
+      expect(rb.driftCorrections).toBe(0);
+      expect(ctrl.ratio).toBeGreaterThan(1);
+      // Uncorrected, 300 ppm would have added 18 ms over the run
+      expect(maxLevel).toBeLessThan(3840 + 2 * 960 * 2);
+    });
+
+    it("absorbs a slow capture clock without underruns", () => {
+      const { rb, ctrl, minLevel } = simulateDrift(-300);
+      expect(rb.underrunCount).toBe(0);
+      expect(ctrl.ratio).toBeLessThan(1);
+      expect(minLevel).toBeGreaterThan(0);
+    });
+
+    it("clamps the ratio", () => {
+      const ctrl = new DriftController(3840, 48000, 100, 0.005, 1);
+      expect(ctrl.update(3840 * 100)).toBeCloseTo(1.005);
+      expect(ctrl.update(0)).toBeCloseTo(0.996); // -40 ms * 100 ppm
+      ctrl.reset();
+      expect(ctrl.ratio).toBe(1);
+    });
+  });
+
   describe("reset", () => {
     it("clears all state", () => {
       const rb = new RingBuffer(1024);